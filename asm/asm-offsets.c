@@ -38,6 +38,8 @@ int main(void)
 	OFFSET(CPUTHREAD_SAVE_R1, cpu_thread, save_r1);
 	OFFSET(CPUTHREAD_STATE, cpu_thread, state);
 	OFFSET(CPUTHREAD_CUR_TOKEN, cpu_thread, current_token);
+	OFFSET(CPUTHREAD_OPAL_CALL_STATS, cpu_thread, opal_call_stats);
+	OFFSET(CPUTHREAD_OPAL_CALL_TB, cpu_thread, opal_call_entry_tb);
 	DEFINE(CPUTHREAD_GAP, sizeof(struct cpu_thread) + STACK_SAFETY_GAP);
 #ifdef STACK_CHECK_ENABLED
 	OFFSET(CPUTHREAD_STACK_BOT_MARK, cpu_thread, stack_bot_mark);
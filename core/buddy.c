@@ -62,6 +62,108 @@ static inline unsigned int buddy_node_to_index(struct buddy *b,
 	return (node - start) << order;
 }
 
+/* Work out the size of each level of the free index, and how many */
+static unsigned int buddy_index_sizes(unsigned int max_order,
+				      unsigned int *bits)
+{
+	unsigned int l = 0, n = BITMAP_ELEMS(1u << (max_order + 1));
+
+	for (;;) {
+		assert(l < BUDDY_INDEX_LEVELS);
+		bits[l++] = n;
+		if (n <= BITMAP_ELSZ)
+			return l;
+		n = BITMAP_ELEMS(n);
+	}
+}
+
+static void buddy_set_busy(struct buddy *b, unsigned int node)
+{
+	unsigned int l, el = BITMAP_ELEM(node);
+
+	bitmap_set_bit(b->map, node);
+	if (~b->map[el])
+		return;
+
+	/* That element is now full, take it out of the index, and
+	 * its parent too if it was the last one with anything free.
+	 */
+	for (l = 0; l < b->index_levels; l++) {
+		bitmap_clr_bit(b->index[l], el);
+		el = BITMAP_ELEM(el);
+		if (b->index[l][el])
+			break;
+	}
+}
+
+static void buddy_set_free(struct buddy *b, unsigned int node)
+{
+	unsigned int l, el = BITMAP_ELEM(node);
+
+	bitmap_clr_bit(b->map, node);
+	for (l = 0; l < b->index_levels; l++) {
+		if (bitmap_tst_bit(b->index[l], el))
+			break;
+		bitmap_set_bit(b->index[l], el);
+		el = BITMAP_ELEM(el);
+	}
+}
+
+/* Bits of e from first, count of them at most */
+static inline bitmap_elem_t buddy_elem_bits(bitmap_elem_t e,
+					    unsigned int first,
+					    unsigned int count)
+{
+	e >>= first;
+	if (count < BITMAP_ELSZ)
+		e &= (1ul << count) - 1;
+	return e;
+}
+
+/*
+ * Find a set bit among count bits from start in level l of the index.
+ * start is a multiple of count, which is a power of 2, as the levels
+ * of the tree are, so a range never straddles an element unless it
+ * covers whole ones.
+ */
+static int buddy_index_find(struct buddy *b, unsigned int l,
+			    unsigned int start, unsigned int count)
+{
+	bitmap_elem_t e;
+	int el;
+
+	if (count <= BITMAP_ELSZ) {
+		e = buddy_elem_bits(b->index[l][BITMAP_ELEM(start)],
+				    BITMAP_BIT(start), count);
+		return e ? (int)start + __builtin_ctzl(e) : -1;
+	}
+
+	el = buddy_index_find(b, l + 1, BITMAP_ELEM(start),
+			      BITMAP_ELEM(count));
+	if (el < 0)
+		return -1;
+	return el * BITMAP_ELSZ + __builtin_ctzl(b->index[l][el]);
+}
+
+/* Same for a free node in the map, through the index */
+static int buddy_find_free(struct buddy *b, unsigned int start,
+			   unsigned int count)
+{
+	bitmap_elem_t e;
+	int el;
+
+	if (count <= BITMAP_ELSZ) {
+		e = buddy_elem_bits(~b->map[BITMAP_ELEM(start)],
+				    BITMAP_BIT(start), count);
+		return e ? (int)start + __builtin_ctzl(e) : -1;
+	}
+
+	el = buddy_index_find(b, 0, BITMAP_ELEM(start), BITMAP_ELEM(count));
+	if (el < 0)
+		return -1;
+	return el * BITMAP_ELSZ + __builtin_ctzl(~b->map[el]);
+}
+
 #ifdef BUDDY_DEBUG
 static void buddy_check_alloc(struct buddy *b, unsigned int node)
 {
@@ -113,14 +215,14 @@ int buddy_alloc(struct buddy *b, unsigned int order)
 		    1u << (b->max_order - o));
 
 	/* Now find a free node */
-	node = bitmap_find_zero_bit(b->map, buddy_order_start(b, o),
-				    1u << (b->max_order - o));
+	node = buddy_find_free(b, buddy_order_start(b, o),
+			       1u << (b->max_order - o));
 
 	/* There should always be one */
 	assert(node >= 0);
 
 	/* Mark it allocated and decrease free count */
-	bitmap_set_bit(b->map, node);
+	buddy_set_busy(b, node);
 	b->freecounts[o]--;
 
 	/* We know that node was free which means all its children must have
@@ -140,7 +242,7 @@ int buddy_alloc(struct buddy *b, unsigned int order)
 
 		BUDDY_NOISE("  order %d, using %d marking %d free\n",
 			    o, node, node ^ 1);
-		bitmap_clr_bit(b->map, node ^ 1);
+		buddy_set_free(b, node ^ 1);
 		b->freecounts[o]++;
 		assert(bitmap_tst_bit(b->map, node));
 	}
@@ -178,7 +280,7 @@ bool buddy_reserve(struct buddy *b, unsigned int index, unsigned int order)
 		return false;
 
 	/* We sit on a free node, mark it busy */
-	bitmap_set_bit(b->map, freenode);
+	buddy_set_busy(b, freenode);
 	assert(b->freecounts[o]);
 	b->freecounts[o]--;
 
@@ -199,7 +301,7 @@ bool buddy_reserve(struct buddy *b, unsigned int index, unsigned int order)
 
 		BUDDY_NOISE("  order %d, using %d marking %d free\n",
 			    o, freenode, freenode ^ 1);
-		bitmap_clr_bit(b->map, freenode ^ 1);
+		buddy_set_free(b, freenode ^ 1);
 		b->freecounts[o]++;
 		assert(bitmap_tst_bit(b->map, node));
 	}
@@ -235,7 +337,7 @@ void buddy_free(struct buddy *b, unsigned int index, unsigned int order)
 			    order, node, node ^ 1);
 
 		/* Mark buddy busy (we are already marked busy) */
-		bitmap_set_bit(b->map, node ^ 1);
+		buddy_set_busy(b, node ^ 1);
 
 		/* Reduce free count */
 		assert(b->freecounts[order] > 0);
@@ -252,7 +354,7 @@ void buddy_free(struct buddy *b, unsigned int index, unsigned int order)
 	}
 
 	/* No more coalescing, mark it free */
-	bitmap_clr_bit(b->map, node);
+	buddy_set_free(b, node);
 
 	/* Increase the freelist count for that level */
 	b->freecounts[order]++;
@@ -264,12 +366,18 @@ void buddy_free(struct buddy *b, unsigned int index, unsigned int order)
 void buddy_reset(struct buddy *b)
 {
 	unsigned int bsize = BITMAP_BYTES(1u << (b->max_order + 1));
+	unsigned int bits[BUDDY_INDEX_LEVELS], l;
 
 	BUDDY_NOISE("buddy_reset()\n");
 	/* We fill the bitmap with 1's to make it completely "busy" */
 	memset(b->map, 0xff, bsize);
 	memset(b->freecounts, 0, sizeof(b->freecounts));
 
+	/* Nothing free, so nothing in the index either */
+	buddy_index_sizes(b->max_order, bits);
+	for (l = 0; l < b->index_levels; l++)
+		memset(b->index[l], 0, BITMAP_BYTES(bits[l]));
+
 	/* We mark the root of the tree free, this is entry 1 as entry 0
 	 * is unused.
 	 */
@@ -279,16 +387,27 @@ void buddy_reset(struct buddy *b)
 struct buddy *buddy_create(unsigned int max_order)
 {
 	struct buddy *b;
-	unsigned int bsize;
+	unsigned int bsize, isize, bits[BUDDY_INDEX_LEVELS], levels, l;
+	bitmap_elem_t *index;
 
 	assert(max_order <= BUDDY_MAX_ORDER);
 
 	bsize = BITMAP_BYTES(1u << (max_order + 1));
+	levels = buddy_index_sizes(max_order, bits);
+	for (isize = l = 0; l < levels; l++)
+		isize += BITMAP_BYTES(bits[l]);
 
-	b = zalloc(sizeof(struct buddy) + bsize);
+	/* The index goes right after the map */
+	b = zalloc(sizeof(struct buddy) + bsize + isize);
 	if (!b)
 		return NULL;
 	b->max_order = max_order;
+	b->index_levels = levels;
+	index = b->map + BITMAP_ELEMS(1u << (max_order + 1));
+	for (l = 0; l < levels; l++) {
+		b->index[l] = index;
+		index += BITMAP_ELEMS(bits[l]);
+	}
 
 	BUDDY_NOISE("Map @%p, size: %d bytes\n", b->map, bsize);
 
@@ -38,7 +38,7 @@ static struct con_ops *con_driver;
 /* External (OPAL) console driver ops */
 static struct opal_con_ops *opal_con_driver = &dummy_opal_con;
 
-static struct lock con_lock = LOCK_UNLOCKED;
+static struct lock con_lock = LOCK_UNLOCKED_NAMED("con_lock");
 
 /* This is mapped via TCEs so we keep it alone in a page */
 struct memcons memcons __section(".data.memcons") = {
@@ -29,6 +29,25 @@ u32 last_phandle = 0;
 struct dt_node *dt_root;
 struct dt_node *dt_chosen;
 
+/* Sequence numbers for the flattened size cache, see core/fdt.c */
+u32 dt_flat_seq;
+u32 dt_flat_flush_seq;
+
+void dt_flat_invalidate(struct dt_node *node)
+{
+	/*
+	 * A node can only have a valid cached size if all of its
+	 * children do, so we can stop at the first invalid parent.
+	 */
+	for (; node && dt_flat_valid(node); node = node->parent)
+		node->flat_seq = 0;
+}
+
+void dt_flat_flush(void)
+{
+	dt_flat_flush_seq = dt_flat_seq;
+}
+
 static const char *take_name(const char *name)
 {
 	if (!is_rodata(name) && !(name = strdup(name))) {
@@ -44,6 +63,76 @@ static void free_name(const char *name)
 		free((char *)name);
 }
 
+#define DT_NAME_HASH_BITS	10
+#define DT_NAME_HASH_SIZE	(1 << DT_NAME_HASH_BITS)
+
+/* Interned property names, see struct dt_name */
+static struct dt_name *dt_names[DT_NAME_HASH_SIZE];
+
+static u32 dt_name_hash(const char *name, u32 *len)
+{
+	const char *c;
+	u32 hash = 2166136261u;
+
+	/* FNV-1a */
+	for (c = name; *c; c++)
+		hash = (hash ^ (u8)*c) * 16777619u;
+	*len = c - name;
+
+	return hash;
+}
+
+static struct dt_name *dt_find_name(const char *name, u32 *hash, u32 *len)
+{
+	struct dt_name *n;
+
+	*hash = dt_name_hash(name, len);
+	for (n = dt_names[*hash % DT_NAME_HASH_SIZE]; n; n = n->next)
+		if (n->hash == *hash && n->len == *len &&
+		    memcmp(n->name, name, *len) == 0)
+			return n;
+
+	return NULL;
+}
+
+const char *dt_lookup_name(const char *name)
+{
+	struct dt_name *n;
+	u32 hash, len;
+
+	n = dt_find_name(name, &hash, &len);
+	return n ? n->name : NULL;
+}
+
+const char *dt_intern_name(const char *name)
+{
+	struct dt_name *n;
+	u32 hash, len, bucket;
+
+	n = dt_find_name(name, &hash, &len);
+	if (n)
+		return n->name;
+
+	n = malloc(sizeof(*n) + len + 1);
+	if (!n) {
+		prerror("Failed to allocate property name\n");
+		abort();
+	}
+	n->hash = hash;
+	n->len = len;
+	n->private = strstarts(name, DT_PRIVATE);
+	n->flat_gen = 0;
+	n->flat_off = 0;
+	memcpy(n->name, name, len + 1);
+
+	/* Names are never freed, only ever added at the head */
+	bucket = hash % DT_NAME_HASH_SIZE;
+	n->next = dt_names[bucket];
+	dt_names[bucket] = n;
+
+	return n->name;
+}
+
 static struct dt_node *new_node(const char *name)
 {
 	struct dt_node *node = malloc(sizeof *node);
@@ -58,6 +147,7 @@ static struct dt_node *new_node(const char *name)
 	list_head_init(&node->children);
 	/* FIXME: locking? */
 	node->phandle = ++last_phandle;
+	node->flat_seq = 0;
 	return node;
 }
 
@@ -108,6 +198,7 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 	if (list_empty(&parent->children)) {
 		list_add(&parent->children, &root->list);
 		root->parent = parent;
+		dt_flat_invalidate(parent);
 
 		return true;
 	}
@@ -130,6 +221,7 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 
 	list_add_before(&parent->children, &root->list, &node->list);
 	root->parent = parent;
+	dt_flat_invalidate(parent);
 
 	return true;
 }
@@ -448,9 +540,10 @@ static struct dt_property *new_property(struct dt_node *node,
 
 	}
 
-	p->name = take_name(name);
+	p->name = dt_intern_name(name);
 	p->len = size;
 	list_add_tail(&node->properties, &p->list);
+	dt_flat_invalidate(node);
 	return p;
 }
 
@@ -470,6 +563,7 @@ struct dt_property *dt_add_property(struct dt_node *node,
 		node->phandle = *(const u32 *)val;
 		if (node->phandle >= last_phandle)
 			last_phandle = node->phandle;
+		dt_flat_invalidate(node);
 		return NULL;
 	}
 
@@ -488,6 +582,9 @@ void dt_resize_property(struct dt_property **prop, size_t len)
 	/* Fix up linked lists in case we moved. (note: not an empty list). */
 	(*prop)->list.next->prev = &(*prop)->list;
 	(*prop)->list.prev->next = &(*prop)->list;
+
+	/* We don't know which node owns the property, drop all sizes */
+	dt_flat_flush();
 }
 
 struct dt_property *dt_add_property_string(struct dt_node *node,
@@ -587,8 +684,8 @@ struct dt_property *__dt_add_property_strings(struct dt_node *node,
 void dt_del_property(struct dt_node *node, struct dt_property *prop)
 {
 	list_del_from(&node->properties, &prop->list);
-	free_name(prop->name);
 	free(prop);
+	dt_flat_invalidate(node);
 }
 
 u32 dt_property_get_cell(const struct dt_property *prop, u32 index)
@@ -626,12 +723,7 @@ struct dt_node *dt_next(const struct dt_node *root,
 
 struct dt_property *__dt_find_property(struct dt_node *node, const char *name)
 {
-	struct dt_property *i;
-
-	list_for_each(&node->properties, i, list)
-		if (strcmp(i->name, name) == 0)
-			return i;
-	return NULL;
+	return (struct dt_property *)dt_find_property(node, name);
 }
 
 const struct dt_property *dt_find_property(const struct dt_node *node,
@@ -639,8 +731,13 @@ const struct dt_property *dt_find_property(const struct dt_node *node,
 {
 	const struct dt_property *i;
 
+	/* A name nobody interned can't be on any property */
+	name = dt_lookup_name(name);
+	if (!name)
+		return NULL;
+
 	list_for_each(&node->properties, i, list)
-		if (strcmp(i->name, name) == 0)
+		if (i->name == name)
 			return i;
 	return NULL;
 }
@@ -816,13 +913,13 @@ void dt_free(struct dt_node *node)
 	while ((child = list_top(&node->children, struct dt_node, list)))
 		dt_free(child);
 
-	while ((p = list_pop(&node->properties, struct dt_property, list))) {
-		free_name(p->name);
+	while ((p = list_pop(&node->properties, struct dt_property, list)))
 		free(p);
-	}
 
-	if (node->parent)
+	if (node->parent) {
 		list_del_from(&node->parent->children, &node->list);
+		dt_flat_invalidate(node->parent);
+	}
 	dt_destroy(node);
 }
 
@@ -17,6 +17,7 @@
 #include <skiboot.h>
 #include <stdarg.h>
 #include <libfdt.h>
+#include <libfdt/libfdt_internal.h>
 #include <device.h>
 #include <cpu.h>
 #include <opal.h>
@@ -24,10 +25,26 @@
 #include <fsp.h>
 #include <cec.h>
 #include <vpd.h>
+#include <lock.h>
 #include <ccan/str/str.h>
 
 static int fdt_error;
 
+/* Bumped for each blob so dt_name::flat_off is only valid within one */
+static u32 fdt_strings_gen;
+
+/*
+ * Last subtree handed out by OPAL_GET_DEVICE_TREE. The OS asks for the
+ * size first and then for the content, so keep the blob around until
+ * something under that node changes.
+ */
+static struct lock fdt_cache_lock = LOCK_UNLOCKED;
+static struct {
+	const struct dt_node *root;
+	u32 flat_seq;
+	void *fdt;
+} fdt_cache;
+
 #undef DEBUG_FDT
 #ifdef DEBUG_FDT
 #define FDT_DBG(fmt, a...)	prlog(PR_DEBUG, "FDT: " fmt, ##a)
@@ -46,21 +63,90 @@ static void __save_err(int err, const char *str)
 
 #define save_err(...) __save_err(__VA_ARGS__, #__VA_ARGS__)
 
+/*
+ * Property names are interned so each one is added to the strings block
+ * the first time it's used and its offset remembered, rather than having
+ * libfdt search the whole strings block for every property. libfdt has
+ * no API taking a string offset, so the two helpers below do what
+ * fdt_property() does in the sequential-write state set up by
+ * fdt_create(), minus the search.
+ */
+static int dt_fdt_add_string(void *fdt, const struct dt_name *n)
+{
+	char *strtab = (char *)fdt + fdt_totalsize(fdt);
+	int strtabsize = fdt_size_dt_strings(fdt);
+	int len = n->len + 1;
+	int offset, struct_top;
+
+	offset = -strtabsize - len;
+	struct_top = fdt_off_dt_struct(fdt) + fdt_size_dt_struct(fdt);
+	if (fdt_totalsize(fdt) + offset < struct_top)
+		return 0;
+
+	memcpy(strtab + offset, n->name, len);
+	fdt_set_size_dt_strings(fdt, strtabsize + len);
+	return offset;
+}
+
+static int dt_fdt_property(void *fdt, int nameoff, const void *val, int len)
+{
+	struct fdt_property *prop;
+	int offset = fdt_size_dt_struct(fdt);
+	int size = FDT_TAGALIGN(sizeof(*prop) + len);
+
+	if (!nameoff)
+		return -FDT_ERR_NOSPACE;
+	if (fdt_off_dt_struct(fdt) + offset + size >
+	    fdt_totalsize(fdt) - fdt_size_dt_strings(fdt))
+		return -FDT_ERR_NOSPACE;
+
+	fdt_set_size_dt_struct(fdt, offset + size);
+	prop = _fdt_offset_ptr_w(fdt, offset);
+	prop->tag = cpu_to_fdt32(FDT_PROP);
+	prop->len = cpu_to_fdt32(len);
+	prop->nameoff = cpu_to_fdt32(nameoff);
+	memcpy(prop->data, val, len);
+
+	return 0;
+}
+
+static int dt_name_offset(void *fdt, const char *name)
+{
+	struct dt_name *n = dt_name_of(name);
+
+	if (n->flat_gen != fdt_strings_gen) {
+		n->flat_off = dt_fdt_add_string(fdt, n);
+		if (!n->flat_off)
+			return 0;
+		n->flat_gen = fdt_strings_gen;
+	}
+
+	return n->flat_off;
+}
+
 static void dt_property_cell(void *fdt, const char *name, u32 cell)
 {
-	save_err(fdt_property_cell(fdt, name, cell));
+	cell = cpu_to_fdt32(cell);
+	save_err(dt_fdt_property(fdt, dt_name_offset(fdt, name),
+				 &cell, sizeof(cell)));
 }
 
 static void dt_begin_node(void *fdt, const struct dt_node *dn)
 {
+	static const char *phandle_name;
+
+	if (!phandle_name)
+		phandle_name = dt_intern_name("phandle");
+
 	save_err(fdt_begin_node(fdt, dn->name));
 
-	dt_property_cell(fdt, "phandle", dn->phandle);
+	dt_property_cell(fdt, phandle_name, dn->phandle);
 }
 
 static void dt_property(void *fdt, const struct dt_property *p)
 {
-	save_err(fdt_property(fdt, p->name, p->prop, p->len));
+	save_err(dt_fdt_property(fdt, dt_name_offset(fdt, p->name),
+				 p->prop, p->len));
 }
 
 static void dt_end_node(void *fdt)
@@ -117,7 +203,7 @@ static void flatten_dt_properties(void *fdt, const struct dt_node *dn)
 	const struct dt_property *p;
 
 	list_for_each(&dn->properties, p, list) {
-		if (strstarts(p->name, DT_PRIVATE))
+		if (dt_name_of(p->name)->private)
 			continue;
 
 		FDT_DBG("  prop: %s size: %ld\n", p->name, p->len);
@@ -143,6 +229,87 @@ static void flatten_dt_node(void *fdt, const struct dt_node *root,
 		dt_end_node(fdt);
 }
 
+#define FDT_PROP_SIZE(len)	(sizeof(struct fdt_property) + FDT_TAGALIGN(len))
+
+/*
+ * Size of the structure block and an upper bound of the strings block
+ * generated by flatten_dt_node() for a subtree. The result is cached in
+ * the node until something below it changes, so recomputing the size
+ * of a mostly unchanged tree only walks the modified branches.
+ */
+static u32 dt_flat_size(const struct dt_node *dn, u32 *strings)
+{
+	/* The cache lives in the node but isn't part of its state */
+	struct dt_node *n = (struct dt_node *)dn;
+	const struct dt_property *p;
+	const struct dt_node *i;
+	u32 size, strs, child_strs;
+
+	if (dt_flat_valid(n)) {
+		*strings = n->flat_strings;
+		return n->flat_size;
+	}
+
+	/* Begin/end tags and the phandle added by dt_begin_node() */
+	size = sizeof(struct fdt_node_header) + FDT_TAGALIGN(strlen(n->name) + 1);
+	size += FDT_TAGSIZE + FDT_PROP_SIZE(sizeof(u32));
+	strs = sizeof("phandle");
+
+	list_for_each(&n->properties, p, list) {
+		const struct dt_name *name = dt_name_of(p->name);
+
+		if (name->private)
+			continue;
+		size += FDT_PROP_SIZE(p->len);
+		strs += name->len + 1;
+	}
+
+	list_for_each(&n->children, i, list) {
+		size += dt_flat_size(i, &child_strs);
+		strs += child_strs;
+	}
+
+	n->flat_size = size;
+	n->flat_strings = strs;
+	n->flat_seq = ++dt_flat_seq;
+
+	*strings = strs;
+	return size;
+}
+
+static size_t dtb_size(const struct dt_node *root, bool exclusive)
+{
+	const struct dt_property *prop;
+	const struct dt_node *i;
+	size_t size, rsv_entries = 1;
+	u32 strings, child_strs;
+
+	if (exclusive) {
+		/*
+		 * Size the root anyway so that its flat_seq covers the
+		 * subtree, which is what get_subtree_dtb() checks.
+		 */
+		dt_flat_size(root, &strings);
+		size = strings = 0;
+		list_for_each(&root->children, i, list) {
+			size += dt_flat_size(i, &child_strs);
+			strings += child_strs;
+		}
+	} else
+		size = dt_flat_size(root, &strings);
+
+	if (root == dt_root && !exclusive) {
+		prop = dt_find_property(root, "reserved-ranges");
+		if (prop)
+			rsv_entries += prop->len / (sizeof(uint64_t) * 2);
+	}
+
+	return FDT_ALIGN(sizeof(struct fdt_header),
+			 sizeof(struct fdt_reserve_entry)) +
+		rsv_entries * sizeof(struct fdt_reserve_entry) +
+		size + FDT_TAGSIZE + strings;
+}
+
 static void create_dtb_reservemap(void *fdt, const struct dt_node *root)
 {
 	uint64_t base, size;
@@ -170,6 +337,7 @@ static int __create_dtb(void *fdt, size_t len,
 			bool exclusive)
 {
 	fdt_create(fdt, len);
+	fdt_strings_gen++;
 	if (root == dt_root && !exclusive)
 		create_dtb_reservemap(fdt, root);
 	else
@@ -189,28 +357,56 @@ static int __create_dtb(void *fdt, size_t len,
 
 void *create_dtb(const struct dt_node *root, bool exclusive)
 {
-	void *fdt = NULL;
-	size_t len = DEVICE_TREE_MAX_SIZE;
-	uint32_t old_last_phandle = last_phandle;
+	void *fdt;
+	size_t len;
+	bool flushed = false;
 	int ret;
 
-	do {
-		last_phandle = old_last_phandle;
-		fdt_error = 0;
-		fdt = malloc(len);
-		if (!fdt) {
-			prerror("dtb: could not malloc %lu\n", (long)len);
-			return NULL;
-		}
+again:
+	len = dtb_size(root, exclusive);
+	fdt_error = 0;
+	fdt = malloc(len);
+	if (!fdt) {
+		prerror("dtb: could not malloc %lu\n", (long)len);
+		return NULL;
+	}
 
-		ret = __create_dtb(fdt, len, root, exclusive);
-		if (ret) {
-			free(fdt);
-			fdt = NULL;
-		}
+	ret = __create_dtb(fdt, len, root, exclusive);
+	if (ret) {
+		free(fdt);
+		fdt = NULL;
+	}
 
-		len *= 2;
-	} while (ret == -FDT_ERR_NOSPACE);
+	/*
+	 * The size can only be wrong if someone changed a property
+	 * length without going through the dt_* helpers.
+	 */
+	if (ret == -FDT_ERR_NOSPACE && !flushed) {
+		prlog(PR_WARNING, "dtb: stale size cache, recomputing\n");
+		dt_flat_flush();
+		flushed = true;
+		goto again;
+	}
+
+	return fdt;
+}
+
+static void *get_subtree_dtb(const struct dt_node *root)
+{
+	void *fdt;
+
+	if (fdt_cache.fdt && fdt_cache.root == root &&
+	    dt_flat_valid(root) && root->flat_seq == fdt_cache.flat_seq)
+		return fdt_cache.fdt;
+
+	fdt = create_dtb(root, true);
+	if (!fdt)
+		return NULL;
+
+	free(fdt_cache.fdt);
+	fdt_cache.root = root;
+	fdt_cache.flat_seq = root->flat_seq;
+	fdt_cache.fdt = fdt;
 
 	return fdt;
 }
@@ -219,41 +415,41 @@ static int64_t opal_get_device_tree(uint32_t phandle,
 				    uint64_t buf, uint64_t len)
 {
 	struct dt_node *root;
-	void *fdt = (void *)buf;
-	uint32_t old_last_phandle;
-	int64_t totalsize;
-	int ret;
+	void *fdt, *dst = (void *)buf;
+	int64_t ret, totalsize;
 
-	if (!opal_addr_valid(fdt))
+	if (!opal_addr_valid(dst))
 		return OPAL_PARAMETER;
 
 	root = dt_find_by_phandle(dt_root, phandle);
 	if (!root)
 		return OPAL_PARAMETER;
 
+	if (dst && !len)
+		return OPAL_PARAMETER;
+
+	lock(&fdt_cache_lock);
+	fdt = get_subtree_dtb(root);
 	if (!fdt) {
-		fdt = create_dtb(root, true);
-		if (!fdt)
-			return OPAL_INTERNAL_ERROR;
-		totalsize = fdt_totalsize(fdt);
-		free(fdt);
-		return totalsize;
+		ret = dst ? OPAL_EMPTY : OPAL_INTERNAL_ERROR;
+		goto out;
 	}
 
-	if (!len)
-		return OPAL_PARAMETER;
-
-	fdt_error = 0;
-	old_last_phandle = last_phandle;
-	ret = __create_dtb(fdt, len, root, true);
-	if (ret) {
-		last_phandle = old_last_phandle;
-		if (ret == -FDT_ERR_NOSPACE)
-			return OPAL_NO_MEM;
+	totalsize = fdt_totalsize(fdt);
+	if (!dst) {
+		ret = totalsize;
+		goto out;
+	}
 
-		return OPAL_EMPTY;
+	if (totalsize > len) {
+		ret = OPAL_NO_MEM;
+		goto out;
 	}
 
-	return OPAL_SUCCESS;
+	memcpy(dst, fdt, totalsize);
+	ret = OPAL_SUCCESS;
+out:
+	unlock(&fdt_cache_lock);
+	return ret;
 }
 opal_call(OPAL_GET_DEVICE_TREE, opal_get_device_tree, 3);
@@ -41,7 +41,7 @@ static LIST_HEAD(flashes);
 static struct flash *system_flash;
 
 /* Using a single lock as we only have one flash at present. */
-static struct lock flash_lock;
+static struct lock flash_lock = LOCK_UNLOCKED_NAMED("flash_lock");
 
 /* nvram-on-flash support */
 static struct flash *nvram_flash;
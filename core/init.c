@@ -43,6 +43,7 @@
 #include <timer.h>
 #include <ipmi.h>
 #include <sensor.h>
+#include <dts.h>
 #include <xive.h>
 #include <nvram.h>
 #include <libstb/stb.h>
@@ -548,6 +549,9 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	printf("INIT: Starting kernel at 0x%llx, fdt at %p %u bytes)\n",
 	       kernel_entry, fdt, fdt_totalsize(fdt));
 
+	/* Boot time lock contention, if built with LOCK_STATS */
+	lock_stats_dump();
+
 	debug_descriptor.state_flags |= OPAL_BOOT_COMPLETE;
 
 	fdt_set_boot_cpuid_phys(fdt, this_cpu()->pir);
@@ -762,6 +766,7 @@ static void per_thread_sanity_checks(void)
 static void pci_nvram_init(void)
 {
 	const char *nvram_speed;
+	long threshold;
 
 	pcie_max_link_speed = 0;
 
@@ -771,6 +776,27 @@ static void pci_nvram_init(void)
 		prlog(PR_NOTICE, "PHB: NVRAM set max link speed to GEN%i\n",
 		      pcie_max_link_speed);
 	}
+
+	threshold = nvram_query_int("pcie-tce-kill-threshold",
+				    PCI_TCE_KILL_PE_THRESHOLD);
+	if (threshold < 0 || threshold > UINT_MAX)
+		threshold = PCI_TCE_KILL_PE_THRESHOLD;
+	if (threshold != PCI_TCE_KILL_PE_THRESHOLD)
+		prlog(PR_NOTICE, "PHB: NVRAM set TCE kill threshold to %ld\n",
+		      threshold);
+	pci_tce_kill_threshold = threshold;
+}
+
+static void dts_nvram_init(void)
+{
+	long ms = nvram_query_int("dts-refresh-ms", DTS_REFRESH_MS);
+
+	if (ms < 0)
+		ms = DTS_REFRESH_MS;
+	if (ms != DTS_REFRESH_MS)
+		prlog(PR_NOTICE, "DTS: NVRAM set snapshot refresh to %ld ms\n",
+		      ms);
+	dts_refresh_ms = ms;
 }
 
 /* Called from head.S, thus no prototype. */
@@ -916,6 +942,9 @@ void __noreturn __nomcount main_cpu_entry(const void *fdt)
 	/* Allocate our split trace buffers now. Depends add_opal_node() */
 	init_trace_buffers();
 
+	/* Export the lock statistics, if built in. Depends add_opal_node() */
+	lock_stats_init();
+
 	/* On P7/P8, get the ICPs and make sure they are in a sane state */
 	init_interrupts();
 
@@ -991,6 +1020,10 @@ void __noreturn __nomcount main_cpu_entry(const void *fdt)
 	op_display(OP_LOG, OP_MOD_INIT, 0x0002);
 
 	pci_nvram_init();
+	dts_nvram_init();
+
+	/* Optional OPAL call latency statistics */
+	opal_call_stats_init();
 
 	phb3_preload_vpd();
 	preload_capp_ucode();
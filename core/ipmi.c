@@ -57,6 +57,7 @@ void ipmi_init_msg(struct ipmi_msg *msg, int interface,
 	msg->resp_size = resp_size;
 	msg->complete = complete;
 	msg->user_data = user_data;
+	msg->prio = IPMI_PRIO_NORMAL;
 }
 
 struct ipmi_msg *ipmi_mkmsg_simple(uint32_t code, void *req_data, size_t req_size)
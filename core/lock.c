@@ -20,6 +20,10 @@
 #include <processor.h>
 #include <cpu.h>
 #include <console.h>
+#include <timebase.h>
+#include <opal-internal.h>
+#include <device.h>
+#include <libfdt.h>
 
 /* Set to bust locks. Note, this is initialized to true because our
  * lock debugging code is not going to work until we have the per
@@ -66,6 +70,243 @@ static inline void lock_check(struct lock *l) { };
 static inline void unlock_check(struct lock *l) { };
 #endif /* DEBUG_LOCKS */
 
+#ifdef LOCK_STATS
+
+/*
+ * Lock statistics are kept in a fixed open addressed table keyed by
+ * the lock address rather than in struct lock itself, so that
+ * init_lock() on a live lock or freeing a structure embedding one
+ * cannot corrupt them. An entry is only updated with its lock held.
+ */
+#define LOCK_STATS_ENTRIES	1024
+#define LOCK_STATS_CALLERS	4
+
+/*
+ * The blob has room for every entry at its largest: begin and end
+ * tags with a "lock@<addr>" unit name, the name cut to
+ * LOCK_STATS_NAME_MAX, four counters and the callers. 1K covers the
+ * header, the root node and the strings.
+ */
+#define LOCK_STATS_NAME_MAX	32
+#define LOCK_STATS_PROP(len)	(12 + (len))
+#define LOCK_STATS_ENTRY_SIZE	(8 + 24 + \
+				 LOCK_STATS_PROP(LOCK_STATS_NAME_MAX) + \
+				 4 * LOCK_STATS_PROP(8) + \
+				 LOCK_STATS_PROP(LOCK_STATS_CALLERS * 16))
+#define LOCK_STATS_BLOB_SIZE	(0x400 + \
+				 LOCK_STATS_ENTRIES * LOCK_STATS_ENTRY_SIZE)
+
+struct lock_stats {
+	struct lock *lock;
+	const char *name;
+	uint64_t acquisitions;
+	uint64_t contended;
+	uint64_t spin_tb;
+	uint64_t max_spin_tb;
+	struct {
+		unsigned long addr;
+		uint64_t count;
+	} callers[LOCK_STATS_CALLERS];
+};
+
+static struct lock_stats lock_stats[LOCK_STATS_ENTRIES];
+/* Acquisitions of locks that got no entry, bumped from any CPU */
+static unsigned long lock_stats_untracked;
+static void *lock_stats_blob;
+
+static struct lock_stats *lock_stats_get(struct lock *l)
+{
+	unsigned int i, h = ((unsigned long)l >> 3) * 0x9e3779b1u;
+	struct lock_stats *e;
+
+	h %= LOCK_STATS_ENTRIES;
+	for (i = 0; i < LOCK_STATS_ENTRIES; i++) {
+		e = &lock_stats[(h + i) % LOCK_STATS_ENTRIES];
+		if (e->lock == l)
+			return e;
+		if (!e->lock &&
+		    __sync_bool_compare_and_swap(&e->lock, NULL, l))
+			return e;
+		/* Lost a race for the slot, it may have been for us */
+		if (e->lock == l)
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Called with @l held, @start is the timebase at which we started
+ * spinning or 0 if the lock was acquired at the first attempt.
+ *
+ * The top callers are tracked with the "space saving" scheme: an
+ * unknown caller evicts the least frequent one and inherits its count,
+ * which keeps frequent callers in the table.
+ */
+static void lock_stats_record(struct lock *l, void *caller, uint64_t start)
+{
+	uint64_t spin;
+	struct lock_stats *e = lock_stats_get(l);
+	unsigned int i, min = 0;
+
+	if (!e) {
+		__atomic_fetch_add(&lock_stats_untracked, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	e->name = l->name;
+	e->acquisitions++;
+	if (start) {
+		spin = mftb() - start;
+		e->contended++;
+		e->spin_tb += spin;
+		if (spin > e->max_spin_tb)
+			e->max_spin_tb = spin;
+	}
+
+	for (i = 0; i < LOCK_STATS_CALLERS; i++) {
+		if (e->callers[i].addr == (unsigned long)caller) {
+			e->callers[i].count++;
+			return;
+		}
+		if (e->callers[i].count < e->callers[min].count)
+			min = i;
+	}
+	e->callers[min].addr = (unsigned long)caller;
+	e->callers[min].count++;
+}
+
+static int lock_stats_prop_u64s(void *fdt, const char *name,
+				const uint64_t *vals, unsigned int count)
+{
+	__be64 buf[LOCK_STATS_CALLERS * 2];
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		buf[i] = cpu_to_be64(vals[i]);
+	return fdt_property(fdt, name, buf, count * sizeof(__be64));
+}
+
+/* Flatten the statistics into lock_stats_blob */
+static int lock_stats_flatten(void)
+{
+	void *fdt = lock_stats_blob;
+	struct lock_stats *e;
+	uint64_t vals[LOCK_STATS_CALLERS * 2];
+	char name[32], lname[LOCK_STATS_NAME_MAX];
+	unsigned int i, j;
+	int rc;
+
+	rc = fdt_create(fdt, LOCK_STATS_BLOB_SIZE);
+	rc |= fdt_finish_reservemap(fdt);
+	rc |= fdt_begin_node(fdt, "");
+	rc |= fdt_property_cell(fdt, "timebase-frequency", tb_hz);
+	vals[0] = __atomic_load_n(&lock_stats_untracked, __ATOMIC_RELAXED);
+	rc |= lock_stats_prop_u64s(fdt, "untracked", vals, 1);
+
+	for (i = 0; i < LOCK_STATS_ENTRIES && !rc; i++) {
+		e = &lock_stats[i];
+		if (!e->lock)
+			continue;
+		snprintf(name, sizeof(name), "lock@%lx", (unsigned long)e->lock);
+		rc |= fdt_begin_node(fdt, name);
+		if (e->name) {
+			snprintf(lname, sizeof(lname), "%s", e->name);
+			rc |= fdt_property_string(fdt, "name", lname);
+		}
+		vals[0] = e->acquisitions;
+		vals[1] = e->contended;
+		vals[2] = e->spin_tb;
+		vals[3] = e->max_spin_tb;
+		rc |= lock_stats_prop_u64s(fdt, "acquisitions", vals, 1);
+		rc |= lock_stats_prop_u64s(fdt, "contended", vals + 1, 1);
+		rc |= lock_stats_prop_u64s(fdt, "spin-tb", vals + 2, 1);
+		rc |= lock_stats_prop_u64s(fdt, "max-spin-tb", vals + 3, 1);
+		for (j = 0; j < LOCK_STATS_CALLERS; j++) {
+			vals[j * 2] = e->callers[j].addr;
+			vals[j * 2 + 1] = e->callers[j].count;
+		}
+		rc |= lock_stats_prop_u64s(fdt, "callers", vals,
+					   LOCK_STATS_CALLERS * 2);
+		rc |= fdt_end_node(fdt);
+	}
+
+	rc |= fdt_end_node(fdt);
+	rc |= fdt_finish(fdt);
+	return rc;
+}
+
+void lock_stats_init(void)
+{
+	struct dt_node *exports;
+
+	lock_stats_blob = zalloc(LOCK_STATS_BLOB_SIZE);
+	if (!lock_stats_blob) {
+		prerror("LOCK: Failed to allocate statistics blob\n");
+		return;
+	}
+	lock_stats_flatten();
+
+	exports = dt_find_by_path(opal_node, "firmware/exports");
+	if (exports)
+		dt_add_property_u64s(exports, "lock_stats",
+				     (u64)lock_stats_blob,
+				     LOCK_STATS_BLOB_SIZE);
+}
+
+bool lock_stats_dump(void)
+{
+	static struct lock dump_lock = LOCK_UNLOCKED_NAMED("lock_stats");
+	struct lock_stats *e;
+	char *sym, *sym_end;
+	unsigned long saddr, untracked;
+	unsigned int i, j;
+
+	lock(&dump_lock);
+	prlog(PR_NOTICE, "LOCK: %-24s %16s %8s %12s %8s %10s\n", "name",
+	      "addr", "acq", "contended", "spin(us)", "max(us)");
+	for (i = 0; i < LOCK_STATS_ENTRIES; i++) {
+		e = &lock_stats[i];
+		if (!e->lock || !e->contended)
+			continue;
+		prlog(PR_NOTICE, "LOCK: %-24s %16p %8llu %12llu %8lu %10lu\n",
+		      e->name ? e->name : "", e->lock, e->acquisitions,
+		      e->contended, tb_to_usecs(e->spin_tb),
+		      tb_to_usecs(e->max_spin_tb));
+		for (j = 0; j < LOCK_STATS_CALLERS; j++) {
+			if (!e->callers[j].count)
+				continue;
+			saddr = get_symbol(e->callers[j].addr, &sym, &sym_end);
+			prlog(PR_NOTICE, "LOCK:    %10llu %.*s+0x%lx\n",
+			      e->callers[j].count,
+			      saddr ? (int)(sym_end - sym) : 0, sym,
+			      e->callers[j].addr - saddr);
+		}
+	}
+	untracked = __atomic_load_n(&lock_stats_untracked, __ATOMIC_RELAXED);
+	if (untracked)
+		prlog(PR_NOTICE, "LOCK: %lu acquisitions untracked\n",
+		      untracked);
+
+	if (lock_stats_blob && lock_stats_flatten())
+		prerror("LOCK: Statistics blob truncated\n");
+	unlock(&dump_lock);
+
+	return true;
+}
+
+#else
+static inline void lock_stats_record(struct lock *l __unused,
+				     void *caller __unused,
+				     uint64_t start __unused) { };
+
+void lock_stats_init(void) { }
+
+bool lock_stats_dump(void)
+{
+	return false;
+}
+#endif /* LOCK_STATS */
+
 bool lock_held_by_me(struct lock *l)
 {
 	uint64_t pir64 = this_cpu()->pir;
@@ -73,7 +314,7 @@ bool lock_held_by_me(struct lock *l)
 	return l->lock_val == ((pir64 << 32) | 1);
 }
 
-bool try_lock(struct lock *l)
+static bool __try_lock_nostats(struct lock *l)
 {
 	if (__try_lock(l)) {
 		if (l->in_con_path)
@@ -84,20 +325,40 @@ bool try_lock(struct lock *l)
 	return false;
 }
 
-void lock(struct lock *l)
+bool try_lock(struct lock *l)
 {
+	if (!__try_lock_nostats(l))
+		return false;
+	lock_stats_record(l, __builtin_return_address(0), 0);
+	return true;
+}
+
+static void lock_caller(struct lock *l, void *caller)
+{
+	uint64_t start = 0;
+
 	if (bust_locks)
 		return;
 
 	lock_check(l);
 	for (;;) {
-		if (try_lock(l))
+		if (__try_lock_nostats(l))
 			break;
+#ifdef LOCK_STATS
+		if (!start)
+			start = mftb();
+#endif
 		smt_lowest();
 		while (l->lock_val)
 			barrier();
 		smt_medium();
 	}
+	lock_stats_record(l, caller, start);
+}
+
+void lock(struct lock *l)
+{
+	lock_caller(l, __builtin_return_address(0));
 }
 
 void unlock(struct lock *l)
@@ -131,7 +392,7 @@ bool lock_recursive(struct lock *l)
 	if (lock_held_by_me(l))
 		return false;
 
-	lock(l);
+	lock_caller(l, __builtin_return_address(0));
 	return true;
 }
 
@@ -73,6 +73,7 @@ struct mem_region skiboot_heap = {
 	.start		= HEAP_BASE,
 	.len		= HEAP_SIZE,
 	.type		= REGION_SKIBOOT_HEAP,
+	.free_list_lock	= LOCK_UNLOCKED_NAMED("skiboot_heap"),
 };
 
 static struct mem_region skiboot_code_and_text = {
@@ -639,7 +640,7 @@ static struct mem_region *new_region(const char *name,
 	region->node = node;
 	region->type = type;
 	region->free_list.n.next = NULL;
-	init_lock(&region->free_list_lock);
+	init_lock_named(&region->free_list_lock, name);
 
 	return region;
 }
@@ -44,6 +44,36 @@ static struct chrp_nvram_hdr *skiboot_part_hdr;
 /* 4k should be enough, famous last words... */
 #define NVRAM_SIZE_FW_PRIV	0x1000
 
+/*
+ * Parsed view of the skiboot partition so nvram_query() doesn't have to
+ * walk every key=value string. It points into the NVRAM image and is
+ * thrown away whenever the image is (re)checked or (re)formatted, which
+ * is what happens after the OS writes to it.
+ */
+#define NVRAM_INDEX_BUCKETS	64
+#define NVRAM_INDEX_MAX		256
+
+struct nvram_key {
+	const char	*key;
+	const char	*value;
+	uint32_t	hash;
+	uint16_t	key_len;
+	int16_t		next;
+};
+
+static struct {
+	bool		valid;
+	bool		overflow;
+	unsigned int	count;
+	int16_t		buckets[NVRAM_INDEX_BUCKETS];
+	struct nvram_key keys[NVRAM_INDEX_MAX];
+} nvram_index;
+
+static void nvram_index_invalidate(void)
+{
+	nvram_index.valid = false;
+}
+
 static uint8_t chrp_nv_cksum(struct chrp_nvram_hdr *hdr)
 {
 	struct chrp_nvram_hdr h_copy = *hdr;
@@ -69,6 +99,7 @@ int nvram_format(void *nvram_image, uint32_t nvram_size)
 
 	prerror("NVRAM: Re-initializing (size: 0x%08x)\n", nvram_size);
 	memset(nvram_image, 0, nvram_size);
+	nvram_index_invalidate();
 
 	/* Create private partition */
 	if (nvram_size - offset < NVRAM_SIZE_FW_PRIV)
@@ -124,6 +155,7 @@ int nvram_check(void *nvram_image, const uint32_t nvram_size)
 	bool found_common = false;
 
 	skiboot_part_hdr = NULL;
+	nvram_index_invalidate();
 
 	while (offset + sizeof(struct chrp_nvram_hdr) < nvram_size) {
 		struct chrp_nvram_hdr *h = nvram_image + offset;
@@ -205,6 +237,120 @@ static const char *find_next_key(const char *start, const char *end)
 	return NULL;
 }
 
+static const char *nvram_part_start(void)
+{
+	return (const char *) skiboot_part_hdr + sizeof(*skiboot_part_hdr);
+}
+
+static const char *nvram_part_end(void)
+{
+	return (const char *) skiboot_part_hdr
+		+ be16_to_cpu(skiboot_part_hdr->len) * 16 - 1;
+}
+
+static unsigned int nvram_entry_len(const char *start, const char *end)
+{
+	const char *c = start;
+
+	while (c < end && *c)
+		c++;
+
+	return c - start;
+}
+
+static uint32_t nvram_key_hash(const char *key, unsigned int len)
+{
+	uint32_t hash = 2166136261u;
+
+	while (len--)
+		hash = (hash ^ (uint8_t)*(key++)) * 16777619u;
+
+	return hash;
+}
+
+static struct nvram_key *nvram_index_find(const char *key, unsigned int len)
+{
+	uint32_t hash = nvram_key_hash(key, len);
+	struct nvram_key *k;
+	int i;
+
+	for (i = nvram_index.buckets[hash % NVRAM_INDEX_BUCKETS]; i >= 0;
+	     i = k->next) {
+		k = &nvram_index.keys[i];
+		if (k->hash == hash && k->key_len == len &&
+		    !memcmp(k->key, key, len))
+			return k;
+	}
+
+	return NULL;
+}
+
+static void nvram_index_build(void)
+{
+	const char *start = nvram_part_start();
+	const char *end = nvram_part_end();
+	const char *eq;
+	struct nvram_key *k;
+	unsigned int b, len;
+
+	nvram_index.count = 0;
+	nvram_index.overflow = false;
+	for (b = 0; b < NVRAM_INDEX_BUCKETS; b++)
+		nvram_index.buckets[b] = -1;
+
+	for (; start; start = find_next_key(start, end)) {
+		len = nvram_entry_len(start, end);
+		eq = memchr(start, '=', len);
+
+		/* Skip malformed entries and keep the first of duplicates */
+		if (!eq || eq == start)
+			continue;
+		if (nvram_index_find(start, eq - start))
+			continue;
+
+		if (nvram_index.count == NVRAM_INDEX_MAX) {
+			prlog(PR_DEBUG, "NVRAM: Too many keys to index\n");
+			nvram_index.overflow = true;
+			break;
+		}
+
+		k = &nvram_index.keys[nvram_index.count];
+		k->key = start;
+		k->key_len = eq - start;
+		k->value = eq + 1;
+		k->hash = nvram_key_hash(start, k->key_len);
+		b = k->hash % NVRAM_INDEX_BUCKETS;
+		k->next = nvram_index.buckets[b];
+		nvram_index.buckets[b] = nvram_index.count++;
+	}
+
+	nvram_index.valid = true;
+}
+
+/* Walk the whole partition, used when the index can't answer */
+static const char *nvram_scan(const char *key, int key_len)
+{
+	const char *part_end = nvram_part_end();
+	const char *start = nvram_part_start();
+
+	while (start) {
+		int remaining = part_end - start;
+
+		prlog(PR_TRACE, "NVRAM: '%s' (%lu)\n",
+			start, strlen(start));
+
+		if (key_len + 1 > remaining)
+			return NULL;
+
+		if (!strncmp(key, start, key_len) && start[key_len] == '=')
+			return &start[key_len + 1];
+
+		start = find_next_key(start, part_end);
+	}
+
+	return NULL;
+}
+
 /*
  * nvram_query() - Searches skiboot NVRAM partition for a key=value pair.
  *
@@ -213,7 +359,8 @@ static const char *find_next_key(const char *start, const char *end)
  */
 const char *nvram_query(const char *key)
 {
-	const char *part_end, *start;
+	const struct nvram_key *k;
+	const char *value;
 	int key_len = strlen(key);
 
 	/*
@@ -228,12 +375,6 @@ const char *nvram_query(const char *key)
 		return NULL;
 	}
 
-	part_end = (const char *) skiboot_part_hdr
-		+ be16_to_cpu(skiboot_part_hdr->len) * 16 - 1;
-
-	start = (const char *) skiboot_part_hdr
-		+ sizeof(*skiboot_part_hdr);
-
 	if (!key_len) {
 		prlog(PR_WARNING, "NVRAM: search key is empty!\n");
 		return NULL;
@@ -242,30 +383,24 @@ const char *nvram_query(const char *key)
 	if (key_len > 32)
 		prlog(PR_WARNING, "NVRAM: search key '%s' is longer than 32 chars\n", key);
 
-	while (start) {
-		int remaining = part_end - start;
-
-		prlog(PR_TRACE, "NVRAM: '%s' (%lu)\n",
-			start, strlen(start));
-
-		if (key_len + 1 > remaining)
-			return NULL;
+	if (!nvram_index.valid)
+		nvram_index_build();
 
-		if (!strncmp(key, start, key_len) && start[key_len] == '=') {
-			const char *value = &start[key_len + 1];
-
-			prlog(PR_DEBUG, "NVRAM: Searched for '%s' found '%s'\n",
-				key, value);
-
-			return value;
-		}
-
-		start = find_next_key(start, part_end);
+	/* A key containing '=' can only be matched by a raw scan */
+	if (nvram_index.overflow || strchr(key, '=')) {
+		value = nvram_scan(key, key_len);
+	} else {
+		k = nvram_index_find(key, key_len);
+		value = k ? k->value : NULL;
 	}
 
-	prlog(PR_DEBUG, "NVRAM: '%s' not found\n", key);
+	if (value)
+		prlog(PR_DEBUG, "NVRAM: Searched for '%s' found '%s'\n",
+		      key, value);
+	else
+		prlog(PR_DEBUG, "NVRAM: '%s' not found\n", key);
 
-	return NULL;
+	return value;
 }
 
 
@@ -278,3 +413,127 @@ bool nvram_query_eq(const char *key, const char *value)
 
 	return !strcmp(s, value);
 }
+
+bool nvram_query_bool(const char *key, bool def)
+{
+	const char *s = nvram_query(key);
+
+	if (!s)
+		return def;
+
+	if (!strcmp(s, "true") || !strcmp(s, "yes") ||
+	    !strcmp(s, "on") || !strcmp(s, "1"))
+		return true;
+
+	if (!strcmp(s, "false") || !strcmp(s, "no") ||
+	    !strcmp(s, "off") || !strcmp(s, "0"))
+		return false;
+
+	prlog(PR_WARNING, "NVRAM: '%s=%s' is not a boolean\n", key, s);
+	return def;
+}
+
+long nvram_query_int(const char *key, long def)
+{
+	const char *s = nvram_query(key);
+	char *end;
+	long val;
+
+	if (!s)
+		return def;
+
+	val = strtol(s, &end, 0);
+	if (!*s || *end) {
+		prlog(PR_WARNING, "NVRAM: '%s=%s' is not a number\n", key, s);
+		return def;
+	}
+
+	return val;
+}
+
+/*
+ * nvram_update() - Apply a batch of key changes to the skiboot partition.
+ *
+ * Each update sets @key to @value, or removes it if @value is NULL. If
+ * a key is updated more than once, the last update wins. The partition
+ * is rewritten in one go, keeping unmodified keys in their original
+ * order, and written back to the platform once.
+ *
+ * Returns 0 on success, or -1 if the partition is invalid or the result
+ * doesn't fit, in which case the NVRAM is left untouched.
+ */
+int nvram_update(const struct nvram_update *updates, unsigned int count)
+{
+	const char *start, *end, *eq;
+	unsigned int i, j, len, part_len;
+	char *buf, *p;
+	bool replaced;
+
+	if (!nvram_validate()) {
+		prerror("NVRAM: Update failed due to bad format!\n");
+		return -1;
+	}
+
+	start = nvram_part_start();
+	end = nvram_part_end();
+
+	/* Keep the last byte free, the partition must end with a NUL */
+	part_len = end - start;
+	buf = zalloc(part_len + 1);
+	if (!buf)
+		return -1;
+	p = buf;
+
+	for (; start; start = find_next_key(start, end)) {
+		len = nvram_entry_len(start, end);
+		if (!len)
+			continue;
+		eq = memchr(start, '=', len);
+
+		replaced = false;
+		for (i = 0; eq && i < count; i++) {
+			if (strlen(updates[i].key) == eq - start &&
+			    !memcmp(updates[i].key, start, eq - start))
+				replaced = true;
+		}
+		if (replaced)
+			continue;
+
+		if (p + len + 1 > buf + part_len)
+			goto too_big;
+		memcpy(p, start, len);
+		p += len + 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!updates[i].value)
+			continue;
+
+		/* The last update of a key wins */
+		for (j = i + 1; j < count; j++)
+			if (!strcmp(updates[i].key, updates[j].key))
+				break;
+		if (j < count)
+			continue;
+
+		len = strlen(updates[i].key) + 1 + strlen(updates[i].value);
+		if (p + len + 1 > buf + part_len)
+			goto too_big;
+		p += snprintf(p, len + 1, "%s=%s", updates[i].key,
+			      updates[i].value) + 1;
+	}
+
+	memcpy((char *) nvram_part_start(), buf, part_len);
+	free(buf);
+
+	skiboot_part_hdr->cksum = chrp_nv_cksum(skiboot_part_hdr);
+	nvram_index_invalidate();
+
+	return nvram_write_back(skiboot_part_hdr,
+				be16_to_cpu(skiboot_part_hdr->len) * 16);
+
+ too_big:
+	prerror("NVRAM: Update doesn't fit in the skiboot partition\n");
+	free(buf);
+	return -1;
+}
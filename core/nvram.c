@@ -67,6 +67,21 @@ static int64_t opal_write_nvram(uint64_t buffer, uint64_t size, uint64_t offset)
 }
 opal_call(OPAL_WRITE_NVRAM, opal_write_nvram, 3);
 
+int nvram_write_back(const void *start, uint32_t len)
+{
+	uint32_t offset = start - nvram_image;
+
+	if (!nvram_ready)
+		return -1;
+
+	assert(start >= nvram_image && offset + len <= nvram_size);
+
+	if (platform.nvram_write)
+		return platform.nvram_write(offset, nvram_image + offset, len);
+
+	return 0;
+}
+
 bool nvram_validate(void)
 {
 	if (!nvram_valid)
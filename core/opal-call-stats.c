@@ -0,0 +1,253 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define pr_fmt(fmt) "CALLSTATS: " fmt
+#include <skiboot.h>
+#include <opal.h>
+#include <cpu.h>
+#include <lock.h>
+#include <device.h>
+#include <timebase.h>
+#include <nvram.h>
+#include <mem_region-malloc.h>
+
+/*
+ * Per CPU OPAL call latency histograms.
+ *
+ * opal_entry timestamps every call when its CPU has a statistics
+ * block and calls opal_call_stats_exit() once the handler returns.
+ * Each CPU only ever updates its own block, so no locking is needed
+ * on that path. The blocks live in one region laid out as described
+ * by struct opal_call_stats so it can be exported to the OS as is.
+ *
+ * The region is only allocated when statistics are first enabled,
+ * either with the "opal-call-stats" NVRAM key at boot (in which case
+ * it is also exported in the device-tree) or with OPAL_CALL_STATS.
+ */
+
+#define NR_TOKENS	(OPAL_LAST + 1)
+#define CPU_STATS_SIZE	(sizeof(struct opal_call_stats_cpu) + \
+			 NR_TOKENS * sizeof(struct opal_call_stat))
+
+static struct opal_call_stats *call_stats;
+static size_t call_stats_size;
+static struct lock call_stats_lock = LOCK_UNLOCKED;
+
+static struct opal_call_stats_cpu *cpu_stats(unsigned int idx)
+{
+	return (void *)(call_stats + 1) + idx * CPU_STATS_SIZE;
+}
+
+/* Called from head.S, thus no prototype */
+void opal_call_stats_exit(void);
+
+void __nomcount opal_call_stats_exit(void)
+{
+	struct cpu_thread *c = this_cpu();
+	struct opal_call_stat *s = c->opal_call_stats;
+	uint64_t ticks = mftb() - c->opal_call_entry_tb;
+	unsigned int b = 0;
+
+	c->opal_call_entry_tb = 0;
+
+	/* Statistics may have been disabled during the call */
+	if (!s)
+		return;
+	s += c->current_token;
+
+	if (ticks >> OPAL_CALL_STATS_SHIFT) {
+		b = ilog2(ticks) - OPAL_CALL_STATS_SHIFT + 1;
+		if (b >= OPAL_CALL_STATS_BUCKETS)
+			b = OPAL_CALL_STATS_BUCKETS - 1;
+	}
+
+	s->count = cpu_to_be64(be64_to_cpu(s->count) + 1);
+	s->total_tb = cpu_to_be64(be64_to_cpu(s->total_tb) + ticks);
+	if (ticks > be64_to_cpu(s->max_tb))
+		s->max_tb = cpu_to_be64(ticks);
+	s->buckets[b] = cpu_to_be32(be32_to_cpu(s->buckets[b]) + 1);
+}
+
+static bool call_stats_alloc(void)
+{
+	struct cpu_thread *c;
+	unsigned int i = 0;
+
+	for_each_present_cpu(c)
+		i++;
+
+	call_stats_size = sizeof(*call_stats) + i * CPU_STATS_SIZE;
+	call_stats = local_alloc(this_cpu()->chip_id, call_stats_size, 0x10000);
+	if (!call_stats) {
+		prerror("Failed to allocate %zu bytes\n", call_stats_size);
+		return false;
+	}
+	memset(call_stats, 0, call_stats_size);
+
+	call_stats->magic = cpu_to_be32(OPAL_CALL_STATS_MAGIC);
+	call_stats->version = cpu_to_be32(OPAL_CALL_STATS_VERSION);
+	call_stats->nr_cpus = cpu_to_be32(i);
+	call_stats->nr_tokens = cpu_to_be32(NR_TOKENS);
+	call_stats->nr_buckets = cpu_to_be32(OPAL_CALL_STATS_BUCKETS);
+	call_stats->bucket_shift = cpu_to_be32(OPAL_CALL_STATS_SHIFT);
+	call_stats->tb_hz = cpu_to_be64(tb_hz);
+
+	i = 0;
+	for_each_present_cpu(c)
+		cpu_stats(i++)->pir = cpu_to_be32(c->pir);
+
+	prlog(PR_DEBUG, "%zu bytes for %d CPUs\n", call_stats_size,
+	      be32_to_cpu(call_stats->nr_cpus));
+	return true;
+}
+
+static void call_stats_set(bool enable)
+{
+	struct cpu_thread *c;
+	unsigned int i = 0;
+
+	for_each_present_cpu(c) {
+		c->opal_call_stats = enable ? cpu_stats(i)->tokens : NULL;
+		i++;
+	}
+	lwsync();
+}
+
+static void call_stats_reset(void)
+{
+	unsigned int i, nr_cpus = be32_to_cpu(call_stats->nr_cpus);
+
+	for (i = 0; i < nr_cpus; i++)
+		memset(cpu_stats(i)->tokens, 0,
+		       NR_TOKENS * sizeof(struct opal_call_stat));
+}
+
+void opal_call_stats_init(void)
+{
+	struct dt_node *exports;
+
+	if (!nvram_query_bool("opal-call-stats", false))
+		return;
+
+	lock(&call_stats_lock);
+	if (call_stats_alloc()) {
+		call_stats_set(true);
+		exports = dt_find_by_path(opal_node, "firmware/exports");
+		if (exports)
+			dt_add_property_u64s(exports, "opal_call_stats",
+					     (u64)call_stats, call_stats_size);
+		prlog(PR_NOTICE, "OPAL call statistics enabled\n");
+	}
+	unlock(&call_stats_lock);
+}
+
+/* Accumulate one CPU's statistics into @out */
+static void call_stats_add(struct opal_call_stat *out,
+			   const struct opal_call_stat *in)
+{
+	unsigned int t, b;
+
+	for (t = 0; t < NR_TOKENS; t++, out++, in++) {
+		if (!in->count)
+			continue;
+		out->count = cpu_to_be64(be64_to_cpu(out->count) +
+					 be64_to_cpu(in->count));
+		out->total_tb = cpu_to_be64(be64_to_cpu(out->total_tb) +
+					    be64_to_cpu(in->total_tb));
+		if (be64_to_cpu(in->max_tb) > be64_to_cpu(out->max_tb))
+			out->max_tb = in->max_tb;
+		for (b = 0; b < OPAL_CALL_STATS_BUCKETS; b++)
+			out->buckets[b] = cpu_to_be32(
+				be32_to_cpu(out->buckets[b]) +
+				be32_to_cpu(in->buckets[b]));
+	}
+}
+
+static int64_t call_stats_read(int64_t pir, struct opal_call_stats *buf,
+			       uint64_t size)
+{
+	size_t needed = sizeof(*call_stats) + CPU_STATS_SIZE;
+	struct opal_call_stats_cpu *out;
+	unsigned int i, nr_cpus;
+	bool found = false;
+
+	if (!buf)
+		return needed;
+	if (size < needed)
+		return OPAL_PARAMETER;
+	if (!opal_addr_valid(buf))
+		return OPAL_PARAMETER;
+
+	memcpy(buf, call_stats, sizeof(*call_stats));
+	buf->nr_cpus = cpu_to_be32(1);
+	out = (void *)(buf + 1);
+	memset(out, 0, CPU_STATS_SIZE);
+	out->pir = cpu_to_be32(pir);
+
+	nr_cpus = be32_to_cpu(call_stats->nr_cpus);
+	for (i = 0; i < nr_cpus; i++) {
+		struct opal_call_stats_cpu *in = cpu_stats(i);
+
+		if (pir != -1 && be32_to_cpu(in->pir) != pir)
+			continue;
+		call_stats_add(out->tokens, in->tokens);
+		found = true;
+	}
+
+	return found ? OPAL_SUCCESS : OPAL_PARAMETER;
+}
+
+static int64_t opal_call_stats(uint64_t op, int64_t pir, uint64_t buf,
+			       uint64_t size)
+{
+	int64_t rc = OPAL_SUCCESS;
+
+	lock(&call_stats_lock);
+	switch (op) {
+	case OPAL_CALL_STATS_DISABLE:
+		if (call_stats)
+			call_stats_set(false);
+		break;
+	case OPAL_CALL_STATS_ENABLE:
+		if (!call_stats && !call_stats_alloc()) {
+			rc = OPAL_NO_MEM;
+			break;
+		}
+		call_stats_set(true);
+		break;
+	case OPAL_CALL_STATS_RESET:
+		if (call_stats)
+			call_stats_reset();
+		break;
+	case OPAL_CALL_STATS_READ:
+		if (!call_stats) {
+			rc = OPAL_WRONG_STATE;
+			break;
+		}
+		rc = call_stats_read(pir, (void *)buf, size);
+		break;
+	case OPAL_CALL_STATS_DUMP_LOCKS:
+		if (!lock_stats_dump())
+			rc = OPAL_UNSUPPORTED;
+		break;
+	default:
+		rc = OPAL_PARAMETER;
+	}
+	unlock(&call_stats_lock);
+
+	return rc;
+}
+opal_call(OPAL_CALL_STATS, opal_call_stats, 4);
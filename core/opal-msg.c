@@ -32,7 +32,7 @@ struct opal_msg_entry {
 static LIST_HEAD(msg_free_list);
 static LIST_HEAD(msg_pending_list);
 
-static struct lock opal_msg_lock = LOCK_UNLOCKED;
+static struct lock opal_msg_lock = LOCK_UNLOCKED_NAMED("opal_msg_lock");
 
 int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 		    void (*consumed)(void *data), size_t num_params,
@@ -0,0 +1,121 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <skiboot.h>
+#include <pci.h>
+
+/*
+ * Config filter lookup
+ *
+ * Every config access to a device with filters, be it a real device
+ * with a few registers emulated or a pci_virt one, looks up the filter
+ * covering the access. Rather than walking the list of filters of the
+ * device, we keep a table of which filter overlaps each word of config
+ * space. Accesses are at most 4 bytes and naturally aligned, so they
+ * fall in a single word and the common case, a word with at most one
+ * filter, is a table lookup. Words that several filters overlap fall
+ * back to walking the list, in order, which also gives the filter the
+ * list walk would.
+ */
+
+static bool pci_cfg_filter_match(struct pci_cfg_reg_filter *pcrf,
+				 uint32_t start, uint32_t len, bool contain)
+{
+	if (contain)
+		return start >= pcrf->start &&
+			start + len <= pcrf->start + pcrf->len;
+
+	return start < pcrf->start + pcrf->len && start + len > pcrf->start;
+}
+
+bool pci_cfg_filter_map_add(struct pci_cfg_filter_map *map,
+			    struct pci_cfg_reg_filter *pcrf)
+{
+	struct pci_cfg_reg_filter **filters;
+	uint32_t w, last;
+	uint8_t idx = PCI_CFG_FILTER_SEVERAL;
+
+	if (!pcrf->len || pcrf->start >= 0x1000)
+		return false;
+
+	if (!map->words) {
+		map->words = zalloc(PCI_CFG_FILTER_WORDS);
+		if (!map->words)
+			return false;
+	}
+
+	/* Past 254 filters, their words are walked */
+	if (map->nr < PCI_CFG_FILTER_SEVERAL - 1) {
+		filters = realloc(map->filters,
+				  (map->nr + 1) * sizeof(*filters));
+		if (!filters)
+			return false;
+		map->filters = filters;
+		map->filters[map->nr++] = pcrf;
+		idx = map->nr;
+	}
+
+	last = MIN(pcrf->start + pcrf->len - 1, 0xfffu) / 4;
+	for (w = pcrf->start / 4; w <= last; w++)
+		map->words[w] = map->words[w] ? PCI_CFG_FILTER_SEVERAL : idx;
+
+	return true;
+}
+
+void pci_cfg_filter_map_free(struct pci_cfg_filter_map *map)
+{
+	free(map->words);
+	free(map->filters);
+	memset(map, 0, sizeof(*map));
+}
+
+/*
+ * Find the first filter of @filters matching an access of @len bytes
+ * at @start. With @contain, the filter must cover the whole access,
+ * otherwise any overlap will do.
+ */
+struct pci_cfg_reg_filter *pci_cfg_filter_find(struct pci_cfg_filter_map *map,
+					       struct list_head *filters,
+					       uint32_t start, uint32_t len,
+					       bool contain)
+{
+	struct pci_cfg_reg_filter *pcrf;
+	uint8_t idx;
+
+	if (!map->words || !len || start >= 0x1000)
+		return NULL;
+
+	/* Ranges across words, when adding filters, take the slow path */
+	if ((start & 3) + len > 4)
+		goto walk;
+
+	idx = map->words[start / 4];
+	if (!idx)
+		return NULL;
+	if (idx != PCI_CFG_FILTER_SEVERAL) {
+		pcrf = map->filters[idx - 1];
+		return pci_cfg_filter_match(pcrf, start, len, contain) ?
+			pcrf : NULL;
+	}
+
+walk:
+	list_for_each(filters, pcrf, link) {
+		if (pci_cfg_filter_match(pcrf, start, len, contain))
+			return pcrf;
+	}
+
+	return NULL;
+}
@@ -133,16 +133,20 @@ static int64_t pci_iov_change(void *dev __unused,
 
 	/* Remove all VFs that have been attached to the parent */
 	if (!iov->enabled) {
-		list_for_each_safe(&pd->children, vf, tmp, link)
+		list_for_each_safe(&pd->children, vf, tmp, link) {
 			list_del(&vf->link);
+			pci_dev_map_del(pd->phb, vf);
+		}
 		return OPAL_PARTIAL;
 	}
 
 	/* Initialize the VFs and attach them to parent */
 	for (changed = false, i = 0; i < iov->num_VFs; i++) {
 		vf = &iov->VFs[i];
+		pci_dev_map_del(phb, vf);
 		vf->bdfn = pd->bdfn + iov->offset + iov->stride * i;
 		list_add_tail(&pd->children, &vf->link);
+		pci_dev_map_add(phb, vf);
 
 		/*
 		 * We don't populate the capabilities again if they have
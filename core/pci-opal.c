@@ -74,6 +74,71 @@ opal_call(OPAL_PCI_CONFIG_WRITE_BYTE, opal_pci_config_write_byte, 4);
 opal_call(OPAL_PCI_CONFIG_WRITE_HALF_WORD, opal_pci_config_write_half_word, 4);
 opal_call(OPAL_PCI_CONFIG_WRITE_WORD, opal_pci_config_write_word, 4);
 
+/*
+ * Block accesses. The buffer holds the config space bytes as they are
+ * on the device, that is little endian words, whatever the endianness
+ * of the OS.
+ */
+#define OPAL_PCICFG_BLOCK_WORDS	64
+
+static int64_t opal_pci_config_read_block(uint64_t phb_id,
+					  uint64_t bus_dev_func,
+					  uint64_t offset, uint32_t *buf,
+					  uint64_t size)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	uint32_t i, count = size / 4;
+	int64_t rc;
+
+	if (!phb || !opal_addr_valid(buf) || ((uint64_t)buf & 3))
+		return OPAL_PARAMETER;
+	if (!size || (size & 3) || offset > 0xfff || size > 0x1000 - offset)
+		return OPAL_PARAMETER;
+
+	phb_lock(phb);
+	rc = pci_cfg_read_block(phb, bus_dev_func, offset, buf, count);
+	phb_unlock(phb);
+
+	for (i = 0; i < count; i++)
+		buf[i] = cpu_to_le32(buf[i]);
+
+	return rc;
+}
+
+static int64_t opal_pci_config_write_block(uint64_t phb_id,
+					   uint64_t bus_dev_func,
+					   uint64_t offset, const uint32_t *buf,
+					   uint64_t size)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	uint32_t data[OPAL_PCICFG_BLOCK_WORDS];
+	uint32_t i, n, count = size / 4;
+	int64_t rc = OPAL_SUCCESS;
+
+	if (!phb || !opal_addr_valid(buf) || ((uint64_t)buf & 3))
+		return OPAL_PARAMETER;
+	if (!size || (size & 3) || offset > 0xfff || size > 0x1000 - offset)
+		return OPAL_PARAMETER;
+
+	/* Convert and write a chunk at a time, under the same lock */
+	phb_lock(phb);
+	while (count && rc == OPAL_SUCCESS) {
+		n = MIN(count, OPAL_PCICFG_BLOCK_WORDS);
+		for (i = 0; i < n; i++)
+			data[i] = le32_to_cpu(buf[i]);
+		rc = pci_cfg_write_block(phb, bus_dev_func, offset, data, n);
+		offset += n * 4;
+		buf += n;
+		count -= n;
+	}
+	phb_unlock(phb);
+
+	return rc;
+}
+
+opal_call(OPAL_PCI_CONFIG_READ_BLOCK, opal_pci_config_read_block, 5);
+opal_call(OPAL_PCI_CONFIG_WRITE_BLOCK, opal_pci_config_write_block, 5);
+
 static struct lock opal_eeh_evt_lock = LOCK_UNLOCKED;
 static uint64_t opal_eeh_evt = 0;
 
@@ -379,14 +444,72 @@ static int64_t opal_pci_tce_kill(uint64_t phb_id,
 	if (!phb->ops->tce_kill)
 		return OPAL_UNSUPPORTED;
 	phb_lock(phb);
-	rc = phb->ops->tce_kill(phb, kill_type, pe_number, tce_size,
-				dma_addr, npages);
+	phb->tce_kill_stats.requests++;
+	if (kill_type == OPAL_PCI_TCE_KILL_PAGES)
+		phb->tce_kill_stats.pages += npages;
+	rc = pci_tce_kill(phb, kill_type, pe_number, tce_size,
+			  dma_addr, npages);
 	phb_unlock(phb);
 
 	return rc;
 }
 opal_call(OPAL_PCI_TCE_KILL, opal_pci_tce_kill, 6);
 
+static int64_t opal_pci_tce_kill_ranges(uint64_t phb_id,
+					uint64_t pe_number,
+					uint32_t tce_size,
+					struct opal_tce_kill_range *ranges,
+					uint32_t nr_ranges)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	int64_t rc;
+
+	if (!phb || !nr_ranges || nr_ranges > PCI_TCE_KILL_MAX_RANGES)
+		return OPAL_PARAMETER;
+	if (!opal_addr_valid(ranges) ||
+	    !opal_addr_valid((void *)&ranges[nr_ranges] - 1))
+		return OPAL_PARAMETER;
+	if (!phb->ops->tce_kill)
+		return OPAL_UNSUPPORTED;
+	phb_lock(phb);
+	rc = pci_tce_kill_ranges(phb, pe_number, tce_size, ranges, nr_ranges);
+	phb_unlock(phb);
+
+	return rc;
+}
+opal_call(OPAL_PCI_TCE_KILL_RANGES, opal_pci_tce_kill_ranges, 5);
+
+static int64_t opal_pci_tce_kill_stats(uint64_t phb_id,
+				       struct opal_tce_kill_stats *stats,
+				       uint64_t flags)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	struct pci_tce_kill_stats *s;
+
+	if (!phb || (flags & ~OPAL_PCI_TCE_KILL_STATS_RESET))
+		return OPAL_PARAMETER;
+	if (stats && !opal_addr_valid(stats))
+		return OPAL_PARAMETER;
+	if (!phb->ops->tce_kill)
+		return OPAL_UNSUPPORTED;
+
+	phb_lock(phb);
+	s = &phb->tce_kill_stats;
+	if (stats) {
+		stats->kills = cpu_to_be64(s->kills);
+		stats->pe_kills = cpu_to_be64(s->pe_kills);
+		stats->all_kills = cpu_to_be64(s->all_kills);
+		stats->pages = cpu_to_be64(s->pages);
+		stats->requests = cpu_to_be64(s->requests);
+	}
+	if (flags & OPAL_PCI_TCE_KILL_STATS_RESET)
+		memset(s, 0, sizeof(*s));
+	phb_unlock(phb);
+
+	return OPAL_SUCCESS;
+}
+opal_call(OPAL_PCI_TCE_KILL_STATS, opal_pci_tce_kill_stats, 3);
+
 static int64_t opal_pci_set_xive_pe(uint64_t phb_id, uint64_t pe_number,
 				    uint32_t xive_num)
 {
@@ -935,6 +1058,39 @@ static int64_t opal_pci_next_error(uint64_t phb_id, uint64_t *first_frozen_pe,
 }
 opal_call(OPAL_PCI_NEXT_ERROR, opal_pci_next_error, 4);
 
+static int64_t opal_pci_get_frozen_pes(uint64_t phb_id, uint8_t *pes,
+				       uint64_t size)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	uint32_t num_pes;
+	int64_t rc;
+	int pe;
+
+	if (!phb || !opal_addr_valid(pes))
+		return OPAL_PARAMETER;
+	if (!phb->ops->eeh_frozen_pes)
+		return OPAL_UNSUPPORTED;
+	phb_lock(phb);
+
+	rc = phb->ops->eeh_frozen_pes(phb, &num_pes);
+	if (rc != OPAL_SUCCESS)
+		goto out;
+	if (size < num_pes / 8) {
+		rc = OPAL_PARAMETER;
+		goto out;
+	}
+
+	/* Same layout as a PELTV entry, PE 0 is the MSB of byte 0 */
+	memset(pes, 0, num_pes / 8);
+	bitmap_for_each_one(phb->frozen_pes, num_pes, pe)
+		pes[pe / 8] |= 0x80 >> (pe % 8);
+out:
+	phb_unlock(phb);
+
+	return rc;
+}
+opal_call(OPAL_PCI_GET_FROZEN_PES, opal_pci_get_frozen_pes, 3);
+
 static int64_t opal_pci_eeh_freeze_status2(uint64_t phb_id, uint64_t pe_number,
 					   uint8_t *freeze_state,
 					   uint16_t *pci_error_type,
@@ -0,0 +1,112 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <skiboot.h>
+#include <pci.h>
+
+/*
+ * RID to PE translation table (RTT) updates, shared by the IODA2 and
+ * IODA3 PHBs.
+ *
+ * OPAL_PCI_SET_PE selects RIDs by comparing the top bits of the bus
+ * number, the device number and the function number, each of them
+ * being optional. Whatever the combination, the RIDs it selects are
+ * runs of the same length, evenly spaced:
+ *
+ *   bus   dev   fn    runs
+ *   any   any   any   one run of all the RIDs
+ *   n     any   any   one run of 2^(8-n) buses
+ *   any   d     any   the 8 functions of d, every 256 RIDs
+ *   any   any   f     one RID every 8
+ *   any   d     f     one RID every 256
+ *
+ * so we work out the runs from the request rather than testing all
+ * 64K RIDs against it.
+ */
+void pci_rid_set_init(struct pci_rid_set *rs, uint16_t bdfn,
+		      uint8_t bcompare, uint8_t dcompare, uint8_t fcompare)
+{
+	uint32_t nbuses = 0x100, first = 0, run, stride;
+	bool any_dev = dcompare == OPAL_IGNORE_RID_DEVICE_NUMBER;
+	bool any_fn = fcompare == OPAL_IGNORE_RID_FUNCTION_NUMBER;
+
+	/* Buses matching the top bcompare + 1 bits */
+	if (bcompare != OpalPciBusAny) {
+		nbuses = 0x100 >> (bcompare + 1);
+		first = (bdfn >> 8) & ~(nbuses - 1);
+	}
+	first <<= 8;
+	if (!any_dev)
+		first |= bdfn & 0xf8;
+	if (!any_fn)
+		first |= bdfn & 0x7;
+
+	if (any_dev && any_fn) {
+		run = stride = nbuses << 8;
+		nbuses = 1;
+	} else if (any_dev) {
+		run = 1;
+		stride = 8;
+		nbuses *= 32;
+	} else {
+		run = any_fn ? 8 : 1;
+		stride = 0x100;
+	}
+
+	rs->first = first;
+	rs->run = run;
+	rs->stride = stride;
+	rs->count = nbuses;
+}
+
+/* Fill @n entries from @rte with @pe, 4 entries per store */
+static void pci_rtt_fill(uint16_t *rte, uint32_t n, uint16_t pe)
+{
+	uint64_t pat = pe * 0x0001000100010001ull;
+
+	for (; n && ((unsigned long)rte & 7); n--)
+		*(rte++) = pe;
+	for (; n >= 4; n -= 4, rte += 4)
+		*(uint64_t *)rte = pat;
+	while (n--)
+		*(rte++) = pe;
+}
+
+/*
+ * Point the RIDs of @rs to @pe in the shadow RTT @cache, then copy the
+ * runs to the RTT in memory @rtt, if any. Returns the number of
+ * entries updated.
+ */
+uint32_t pci_rtt_update(uint16_t *cache, uint16_t *rtt,
+			const struct pci_rid_set *rs, uint16_t pe)
+{
+	uint32_t i, start;
+
+	for (i = 0; i < rs->count; i++) {
+		start = rs->first + i * rs->stride;
+		if (rs->run == 1) {
+			cache[start] = pe;
+			if (rtt)
+				rtt[start] = pe;
+			continue;
+		}
+		pci_rtt_fill(cache + start, rs->run, pe);
+		if (rtt)
+			memcpy(rtt + start, cache + start, rs->run * 2);
+	}
+
+	return rs->run * rs->count;
+}
@@ -50,8 +50,6 @@ static struct pci_cfg_reg_filter *pci_virt_find_filter(
 					struct pci_virt_device *pvd,
 					uint32_t start, uint32_t len)
 {
-	struct pci_cfg_reg_filter *pcrf;
-
 	if (!pvd || !len || start >= pvd->cfg_size)
 		return NULL;
 
@@ -60,13 +58,8 @@ static struct pci_cfg_reg_filter *pci_virt_find_filter(
 	 * means the associated handler should validate the register
 	 * offset and length.
 	 */
-	list_for_each(&pvd->pcrf, pcrf, link) {
-		if (start < (pcrf->start + pcrf->len) &&
-		    (start + len) > pcrf->start)
-			return pcrf;
-	}
-
-	return NULL;
+	return pci_cfg_filter_find(&pvd->pcrf_map, &pvd->pcrf, start, len,
+				   false);
 }
 
 struct pci_cfg_reg_filter *pci_virt_add_filter(struct pci_virt_device *pvd,
@@ -101,6 +94,11 @@ struct pci_cfg_reg_filter *pci_virt_add_filter(struct pci_virt_device *pvd,
 	pcrf->flags = flags;
 	pcrf->func  = func;
 	pcrf->data  = data;
+	if (!pci_cfg_filter_map_add(&pvd->pcrf_map, pcrf)) {
+		prlog(PR_ERR, "%s: Out of memory!\n", __func__);
+		free(pcrf);
+		return NULL;
+	}
 	list_add_tail(&pvd->pcrf, &pcrf->link);
 
 	return pcrf;
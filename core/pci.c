@@ -182,6 +182,14 @@ static void pci_init_pcie_cap(struct phb *phb, struct pci_device *pd)
 	    pd->dev_type == PCIE_TYPE_ROOT_PORT)
 		pd->scan_map = 0x1;
 
+	/* Config reads below a root port with CRS visibility enabled
+	 * return a vendor ID of 0x0001 until the device is ready.
+	 */
+	if (pd->dev_type == PCIE_TYPE_ROOT_PORT) {
+		pci_cfg_read16(phb, pd->bdfn, ecap + PCICAP_EXP_RC, &reg);
+		pd->crs_visible = !!(reg & PCICAP_EXP_RC_CRS_VISIBLE);
+	}
+
 	/* Read MPS capability, whose maximal size is 4096 */
 	pci_cfg_read32(phb, pd->bdfn, ecap + PCICAP_EXP_DEVCAP, &val);
 	pd->mps = (128 << GETFIELD(PCICAP_EXP_DEVCAP_MPSS, val));
@@ -218,6 +226,9 @@ void pci_init_capabilities(struct phb *phb, struct pci_device *pd)
 	pci_init_pm_cap(phb, pd);
 }
 
+#define PCI_CRS_POLL_MS		10
+#define PCI_CRS_TIMEOUT_MS	4000
+
 static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *parent,
 				       uint16_t bdfn)
 {
@@ -227,7 +238,12 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 	uint8_t htype;
 	bool had_crs = false;
 
-	for (retries = 0; retries < 40; retries++) {
+	/* Poll config retry status (CRS) at a fine grain so that devices
+	 * behind a root port with CRS visibility are probed as soon as
+	 * they are ready. We give up after the same 4s as ever.
+	 */
+	for (retries = 0; retries < PCI_CRS_TIMEOUT_MS / PCI_CRS_POLL_MS;
+	     retries++) {
 		rc = pci_cfg_read32(phb, bdfn, PCI_CFG_VENDOR_ID, &vdid);
 		if (rc)
 			return NULL;
@@ -236,7 +252,7 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 		if (vdid != 0xffff0001)
 			break;
 		had_crs = true;
-		time_wait_ms(100);
+		time_wait_ms(PCI_CRS_POLL_MS);
 	}
 	if (vdid == 0xffff0001) {
 		PCIERR(phb, bdfn, "CRS timeout !\n");
@@ -264,6 +280,7 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 	pd->class >>= 8;
 
 	pd->parent = parent;
+	pd->crs_visible = parent && parent->crs_visible;
 	list_head_init(&pd->pcrf);
 	list_head_init(&pd->children);
 	rc = pci_cfg_read8(phb, bdfn, PCI_CFG_HDR_TYPE, &htype);
@@ -307,6 +324,7 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 		list_add_tail(&phb->devices, &pd->link);
 	else
 		list_add_tail(&parent->children, &pd->link);
+	pci_dev_map_add(phb, pd);
 
 	/*
 	 * Call PHB hook
@@ -437,10 +455,16 @@ error:
 	pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
 }
 
-static bool pci_bridge_power_on(struct phb *phb, struct pci_device *pd)
+/*
+ * Power on the slot or link below a bridge. Returns false if the slot
+ * is known to be empty. The caller must wait @wait_ms before calling
+ * pci_bridge_enable_link() if @enable_link is set.
+ */
+static bool pci_bridge_power_on(struct phb *phb, struct pci_device *pd,
+				uint32_t *wait_ms, bool *enable_link)
 {
 	int32_t ecap;
-	uint16_t pcie_cap, slot_sts, slot_ctl, link_ctl;
+	uint16_t pcie_cap, slot_sts, slot_ctl;
 	uint32_t slot_cap;
 	int64_t rc;
 
@@ -504,146 +528,236 @@ static bool pci_bridge_power_on(struct phb *phb, struct pci_device *pd)
 				ecap + PCICAP_EXP_SLOTCTL, slot_ctl);
 
 		/* Wait a couple of seconds */
-		time_wait_ms(2000);
+		*wait_ms = 2000;
 	}
 
-	/* Enable link */
+	*enable_link = true;
+	return true;
+}
+
+static void pci_bridge_enable_link(struct phb *phb, struct pci_device *pd,
+				   int32_t ecap)
+{
+	uint16_t link_ctl;
+
 	pci_cfg_read16(phb, pd->bdfn, ecap + PCICAP_EXP_LCTL, &link_ctl);
 	PCITRACE(phb, pd->bdfn, " LINK_CTL=%04x\n", link_ctl);
 	link_ctl &= ~PCICAP_EXP_LCTL_LINK_DIS;
 	pci_cfg_write16(phb, pd->bdfn, ecap + PCICAP_EXP_LCTL, link_ctl);
-
-	return true;
 }
 
-static bool pci_bridge_wait_link(struct phb *phb,
-				 struct pci_device *pd,
-				 bool was_reset)
+/*
+ * Bridges are brought up by pci_enable_bridges() as a set, so that the
+ * power-on, reset and link training delays of sibling bridges (the
+ * downstream ports of a switch typically) overlap rather than add up.
+ * The config space of a PHB is only accessed from the job scanning it,
+ * so instead of running a job per bridge, each bridge is stepped
+ * through the states below and we sleep until the earliest is due.
+ */
+enum pci_bridge_state {
+	PCI_BRIDGE_START,
+	PCI_BRIDGE_LINK_ENABLE,
+	PCI_BRIDGE_RESET,
+	PCI_BRIDGE_LINK_WAIT,
+	PCI_BRIDGE_FINISH,
+	PCI_BRIDGE_DONE,
+};
+
+struct pci_bridge_enable {
+	struct pci_device	*pd;
+	enum pci_bridge_state	state;
+	uint64_t		due;		/* Timebase of the next step */
+	uint64_t		timeout;	/* Link training deadline */
+	bool			was_reset;
+	bool			link_polled;
+	bool			do_scan;
+};
+
+#define PCI_LINK_POLL_MS	10
+#define PCI_LINK_TIMEOUT_MS	10000
+
+static void pci_enable_bridge_step(struct phb *phb,
+				   struct pci_bridge_enable *be)
 {
+	struct pci_device *pd = be->pd;
+	uint64_t now = mftb();
+	uint32_t link_cap = 0, wait_ms = 0;
+	uint16_t bctl, link_sts = 0;
+	bool enable_link = false;
 	int32_t ecap = 0;
-	uint32_t link_cap = 0, retries = 100;
-	uint16_t link_sts;
 
-	if (pci_has_cap(pd, PCI_CFG_CAP_ID_EXP, false)) {
+	if (pci_has_cap(pd, PCI_CFG_CAP_ID_EXP, false))
 		ecap = pci_cap(pd, PCI_CFG_CAP_ID_EXP, false);
-		pci_cfg_read32(phb, pd->bdfn, ecap + PCICAP_EXP_LCAP, &link_cap);
-	}
 
-	/*
-	 * If link state reporting isn't supported, wait 10 seconds
-	 * if the downstream link was ever resetted.
-	 */
-	if (!(link_cap & PCICAP_EXP_LCAP_DL_ACT_REP)) {
-		if (was_reset)
-			time_wait_ms(1000);
+	switch (be->state) {
+	case PCI_BRIDGE_START:
+		/* Disable master aborts, clear errors */
+		pci_cfg_read16(phb, pd->bdfn, PCI_CFG_BRCTL, &bctl);
+		bctl &= ~PCI_CFG_BRCTL_MABORT_REPORT;
+		pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, bctl);
 
-		return true;
-	}
+		/* PCI-E bridge, check the slot state. We don't do that on the
+		 * root complex as this is handled separately and not all our
+		 * RCs implement the standard register set.
+		 */
+		if ((pd->dev_type == PCIE_TYPE_ROOT_PORT && pd->primary_bus > 0) ||
+		    pd->dev_type == PCIE_TYPE_SWITCH_DNPORT) {
+			if (ecap) {
+				/*
+				 * No need to touch the power supply if the PCIe link has
+				 * been up. Further more, the slot presence bit is lost while
+				 * the PCIe link is up on the specific PCI topology. In that
+				 * case, we need ignore the slot presence bit and go ahead for
+				 * probing. Otherwise, the NVMe adapter won't be probed.
+				 *
+				 * PHB3 root port, PLX switch 8748 (10b5:8748), PLX swich 9733
+				 * (10b5:9733), PMC 8546 swtich (11f8:8546), NVMe adapter
+				 * (1c58:0023).
+				 */
+				pci_cfg_read32(phb, pd->bdfn,
+					       ecap + PCICAP_EXP_LCAP, &link_cap);
+				pci_cfg_read16(phb, pd->bdfn,
+					       ecap + PCICAP_EXP_LSTAT, &link_sts);
+				if ((link_cap & PCICAP_EXP_LCAP_DL_ACT_REP) &&
+				    (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT)) {
+					be->do_scan = true;
+					be->state = PCI_BRIDGE_DONE;
+					return;
+				}
+			}
 
-	/*
-	 * Link state reporting is supported, wait for the link to
-	 * come up until timeout.
-	 */
-	PCIDBG(phb, pd->bdfn, "waiting for link... \n");
-	while (retries--) {
+			/* Power on the downstream slot or link */
+			if (!pci_bridge_power_on(phb, pd, &wait_ms,
+						 &enable_link)) {
+				be->state = PCI_BRIDGE_DONE;
+				return;
+			}
+		}
+		be->state = enable_link ? PCI_BRIDGE_LINK_ENABLE :
+					  PCI_BRIDGE_RESET;
+		be->due = now + msecs_to_tb(wait_ms);
+		return;
+
+	case PCI_BRIDGE_LINK_ENABLE:
+		pci_bridge_enable_link(phb, pd, ecap);
+		be->state = PCI_BRIDGE_RESET;
+		return;
+
+	case PCI_BRIDGE_RESET:
+		/* Clear secondary reset. With CRS visibility, the devices
+		 * below tell us when they are ready so we only need to give
+		 * them the 100ms the spec requires before a config request.
+		 */
+		pci_cfg_read16(phb, pd->bdfn, PCI_CFG_BRCTL, &bctl);
+		if (bctl & PCI_CFG_BRCTL_SECONDARY_RESET) {
+			PCIDBG(phb, pd->bdfn,
+			       "Bridge secondary reset is on, clearing it ...\n");
+			bctl &= ~PCI_CFG_BRCTL_SECONDARY_RESET;
+			pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, bctl);
+			wait_ms = pd->crs_visible ? 100 : 1000;
+			be->was_reset = true;
+		}
+		be->state = PCI_BRIDGE_LINK_WAIT;
+		be->due = now + msecs_to_tb(wait_ms);
+		be->timeout = be->due + msecs_to_tb(PCI_LINK_TIMEOUT_MS);
+		return;
+
+	case PCI_BRIDGE_LINK_WAIT:
+		be->state = PCI_BRIDGE_FINISH;
+		if (pd->dev_type != PCIE_TYPE_ROOT_PORT &&
+		    pd->dev_type != PCIE_TYPE_SWITCH_DNPORT)
+			return;
+
+		if (ecap)
+			pci_cfg_read32(phb, pd->bdfn,
+				       ecap + PCICAP_EXP_LCAP, &link_cap);
+
+		/*
+		 * If link state reporting isn't supported, wait a second
+		 * if the downstream link was ever reset, unless CRS will
+		 * tell us when the devices are ready.
+		 */
+		if (!(link_cap & PCICAP_EXP_LCAP_DL_ACT_REP)) {
+			if (be->was_reset && !pd->crs_visible)
+				be->due = now + msecs_to_tb(1000);
+			return;
+		}
+
+		/*
+		 * Link state reporting is supported, wait for the link to
+		 * come up until timeout.
+		 */
+		if (!be->link_polled) {
+			PCIDBG(phb, pd->bdfn, "waiting for link... \n");
+			be->link_polled = true;
+		}
 		pci_cfg_read16(phb, pd->bdfn,
 			       ecap + PCICAP_EXP_LSTAT, &link_sts);
-		if (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT)
-			break;
+		if (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT) {
+			PCIDBG(phb, pd->bdfn, "link is up\n");
 
-		time_wait_ms(100);
-	}
+			/* Need another 100ms before touching the config space */
+			be->due = now + msecs_to_tb(100);
+			return;
+		}
 
-	if (!(link_sts & PCICAP_EXP_LSTAT_DLLL_ACT)) {
-		PCIERR(phb, pd->bdfn, "Timeout waitingfor downstream link\n");
-		return false;
-	}
+		if (tb_compare(now, be->timeout) != TB_ABEFOREB) {
+			PCIERR(phb, pd->bdfn,
+			       "Timeout waitingfor downstream link\n");
+			be->state = PCI_BRIDGE_DONE;
+			return;
+		}
+		be->state = PCI_BRIDGE_LINK_WAIT;
+		be->due = now + msecs_to_tb(PCI_LINK_POLL_MS);
+		return;
 
-	/* Need another 100ms before touching the config space */
-	time_wait_ms(100);
-	PCIDBG(phb, pd->bdfn, "link is up\n");
+	case PCI_BRIDGE_FINISH:
+		/* Clear error status */
+		pci_cfg_write16(phb, pd->bdfn, PCI_CFG_STAT, 0xffff);
+		be->do_scan = true;
+		be->state = PCI_BRIDGE_DONE;
+		return;
 
-	return true;
+	case PCI_BRIDGE_DONE:
+		return;
+	}
 }
 
-/* pci_enable_bridge - Called before scanning a bridge
+/* pci_enable_bridges - Called before scanning a set of bridges
  *
  * Ensures error flags are clean, disable master abort, and
  * check if the subordinate bus isn't reset, the slot is enabled
- * on PCIe, etc...
+ * on PCIe, etc... do_scan is set for each bridge that may have
+ * something behind it.
  */
-static bool pci_enable_bridge(struct phb *phb, struct pci_device *pd)
+static void pci_enable_bridges(struct phb *phb, struct pci_bridge_enable *be,
+			       unsigned int count)
 {
-	uint16_t bctl;
-	bool was_reset = false;
-
-	/* Disable master aborts, clear errors */
-	pci_cfg_read16(phb, pd->bdfn, PCI_CFG_BRCTL, &bctl);
-	bctl &= ~PCI_CFG_BRCTL_MABORT_REPORT;
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, bctl);
-
-
-	/* PCI-E bridge, check the slot state. We don't do that on the
-	 * root complex as this is handled separately and not all our
-	 * RCs implement the standard register set.
-	 */
-	if ((pd->dev_type == PCIE_TYPE_ROOT_PORT && pd->primary_bus > 0) ||
-	    pd->dev_type == PCIE_TYPE_SWITCH_DNPORT) {
-		if (pci_has_cap(pd, PCI_CFG_CAP_ID_EXP, false)) {
-			int32_t ecap;
-			uint32_t link_cap = 0;
-			uint16_t link_sts = 0;
-
-			ecap = pci_cap(pd, PCI_CFG_CAP_ID_EXP, false);
-			pci_cfg_read32(phb, pd->bdfn,
-				       ecap + PCICAP_EXP_LCAP, &link_cap);
-
-			/*
-			 * No need to touch the power supply if the PCIe link has
-			 * been up. Further more, the slot presence bit is lost while
-			 * the PCIe link is up on the specific PCI topology. In that
-			 * case, we need ignore the slot presence bit and go ahead for
-			 * probing. Otherwise, the NVMe adapter won't be probed.
-			 *
-			 * PHB3 root port, PLX switch 8748 (10b5:8748), PLX swich 9733
-			 * (10b5:9733), PMC 8546 swtich (11f8:8546), NVMe adapter
-			 * (1c58:0023).
-			 */
-			ecap = pci_cap(pd, PCI_CFG_CAP_ID_EXP, false);
-			pci_cfg_read32(phb, pd->bdfn,
-				       ecap + PCICAP_EXP_LCAP, &link_cap);
-			pci_cfg_read16(phb, pd->bdfn,
-				       ecap + PCICAP_EXP_LSTAT, &link_sts);
-			if ((link_cap & PCICAP_EXP_LCAP_DL_ACT_REP) &&
-			    (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT))
-				return true;
+	uint64_t now, next = 0;
+	unsigned int i;
+	bool pending;
+
+	for (;;) {
+		pending = false;
+		for (i = 0; i < count; i++) {
+			/* Run each bridge as far as it goes without waiting */
+			while (be[i].state != PCI_BRIDGE_DONE &&
+			       tb_compare(mftb(), be[i].due) != TB_ABEFOREB)
+				pci_enable_bridge_step(phb, &be[i]);
+
+			if (be[i].state == PCI_BRIDGE_DONE)
+				continue;
+			if (!pending || tb_compare(be[i].due, next) == TB_ABEFOREB)
+				next = be[i].due;
+			pending = true;
 		}
+		if (!pending)
+			break;
 
-		/* Power on the downstream slot or link */
-		if (!pci_bridge_power_on(phb, pd))
-			return false;
-	}
-
-	/* Clear secondary reset */
-	if (bctl & PCI_CFG_BRCTL_SECONDARY_RESET) {
-		PCIDBG(phb, pd->bdfn,
-		       "Bridge secondary reset is on, clearing it ...\n");
-		bctl &= ~PCI_CFG_BRCTL_SECONDARY_RESET;
-		pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, bctl);
-		time_wait_ms(1000);
-		was_reset = true;
-	}
-
-	/* PCI-E bridge, wait for link */
-	if (pd->dev_type == PCIE_TYPE_ROOT_PORT ||
-	    pd->dev_type == PCIE_TYPE_SWITCH_DNPORT) {
-		if (!pci_bridge_wait_link(phb, pd, was_reset))
-			return false;
+		now = mftb();
+		if (tb_compare(now, next) == TB_ABEFOREB)
+			time_wait(next - now);
 	}
-
-	/* Clear error status */
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_STAT, 0xffff);
-	return true;
 }
 
 /* Clear up bridge resources */
@@ -687,14 +801,16 @@ void pci_remove_bus(struct phb *phb, struct list_head *list)
 		if (phb->ops->device_remove)
 			phb->ops->device_remove(phb, pd);
 
-		/* Release device node and PCI slot */
+		/* Release device node, PCI slot and filter lookup table */
 		if (pd->dn)
 			dt_free(pd->dn);
 		if (pd->slot)
 			free(pd->slot);
+		pci_cfg_filter_map_free(&pd->pcrf_map);
 
 		/* Remove from parent list and release itself */
 		list_del(&pd->link);
+		pci_dev_map_del(phb, pd);
 		free(pd);
 	}
 }
@@ -717,21 +833,28 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 		     bool scan_downstream)
 {
 	struct pci_device *pd = NULL, *rc = NULL;
+	struct pci_bridge_enable *be = NULL;
 	uint8_t dev, fn, next_bus, max_sub, save_max;
+	unsigned int i, nr_bridges = 0;
 	uint32_t scan_map;
-	bool use_max;
+	bool use_max, frozen = false;
 
 	/* Decide what to scan  */
 	scan_map = parent ? parent->scan_map : phb->scan_map;
 
-	/* Do scan */
+	/* Do scan. Only probing an empty slot can freeze the reserved
+	 * PE, so the freeze is only checked before the probe following
+	 * a miss, and once at the end of the bus.
+	 */
 	for (dev = 0; dev < 32; dev++) {
 		if (!(scan_map & (1ul << dev)))
 			continue;
 
 		/* Scan the device */
+		if (frozen)
+			pci_check_clear_freeze(phb);
 		pd = pci_scan_one(phb, parent, (bus << 8) | (dev << 3));
-		pci_check_clear_freeze(phb);
+		frozen = !pd;
 		if (!pd)
 			continue;
 
@@ -743,11 +866,15 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 		if (!pd->is_multifunction)
 			continue;
 		for (fn = 1; fn < 8; fn++) {
+			if (frozen)
+				pci_check_clear_freeze(phb);
 			pd = pci_scan_one(phb, parent,
 					  ((uint16_t)bus << 8) | (dev << 3) | fn);
-			pci_check_clear_freeze(phb);
+			frozen = !pd;
 		}
 	}
+	if (frozen)
+		pci_check_clear_freeze(phb);
 
 	/* Reserve all possible buses if RC's downstream link is down
 	 * if PCI hotplug is supported.
@@ -780,13 +907,40 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 	max_sub = bus;
 	save_max = max_bus;
 
+	/* Configure all the bridges at once so that their power on and
+	 * link training delays overlap. This will enable power to the
+	 * slots if currently disabled, lift reset, etc...
+	 */
+	list_for_each(list, pd, link)
+		if (pd->is_bridge)
+			nr_bridges++;
+	if (nr_bridges) {
+		be = zalloc(nr_bridges * sizeof(*be));
+		assert(be);
+	}
+	i = 0;
+	list_for_each(list, pd, link) {
+		if (!pd->is_bridge)
+			continue;
+
+		/* Clear up bridge resources */
+		pci_cleanup_bridge(phb, pd);
+		be[i++].pd = pd;
+	}
+	if (nr_bridges)
+		pci_enable_bridges(phb, be, nr_bridges);
+
 	/* Scan down bridges */
+	i = 0;
 	list_for_each(list, pd, link) {
 		bool do_scan;
 
 		if (!pd->is_bridge)
 			continue;
 
+		/* false if we know there's nothing behind the bridge */
+		do_scan = be[i++].do_scan;
+
 		/* We need to figure out a new bus number to start from.
 		 *
 		 * This can be tricky due to our HW constraints which differ
@@ -830,16 +984,6 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 		PCIDBG(phb, pd->bdfn, "Bus %02x..%02x %s scanning...\n",
 		       next_bus, max_bus, use_max ? "[use max]" : "");
 
-		/* Clear up bridge resources */
-		pci_cleanup_bridge(phb, pd);
-
-		/* Configure the bridge. This will enable power to the slot
-		 * if it's currently disabled, lift reset, etc...
-		 *
-		 * Return false if we know there's nothing behind the bridge
-		 */
-		do_scan = pci_enable_bridge(phb, pd);
-
 		/* Perform recursive scan */
 		if (do_scan) {
 			max_sub = pci_scan_bus(phb, next_bus, max_bus,
@@ -866,6 +1010,7 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 
 		pci_slot_set_power_state(phb, pd, PCI_SLOT_POWER_OFF);
 	}
+	free(be);
 
 	return max_sub;
 }
@@ -1042,7 +1187,7 @@ int64_t pci_register_phb(struct phb *phb, int opal_id)
 	dt_add_property_cells(phb->dt_node, "ibm,opal-phbid", 0, phb->opal_id);
 	PCIDBG(phb, 0, "PCI: Registered PHB\n");
 
-	init_lock(&phb->lock);
+	init_lock_named(&phb->lock, phb->dt_node->name);
 	list_head_init(&phb->devices);
 
 	phb->filter_map = zalloc(BITMAP_BYTES(0x10000));
@@ -1639,6 +1784,7 @@ static void __pci_reset(struct list_head *list)
 
 	while ((pd = list_pop(list, struct pci_device, link)) != NULL) {
 		__pci_reset(&pd->children);
+		pci_dev_map_del(pd->phb, pd);
 		dt_free(pd->dn);
 		free(pd);
 	}
@@ -1809,23 +1955,29 @@ struct pci_device *pci_walk_dev(struct phb *phb,
 	return __pci_walk_dev(phb, &phb->devices, cb, userdata);
 }
 
-static int __pci_find_dev(struct phb *phb,
-			  struct pci_device *pd, void *userdata)
+/*
+ * Every device linked into the PHB hierarchy must also be entered in
+ * the bdfn map so that pci_find_dev() can find it. The first device
+ * added for a bdfn wins, like the hierarchy walk it replaces.
+ */
+void pci_dev_map_add(struct phb *phb, struct pci_device *pd)
 {
-	uint16_t bdfn = *((uint16_t *)userdata);
-
-	if (!phb || !pd)
-		return 0;
+	struct pci_device ***bus = &phb->dev_map[pd->bdfn >> 8];
 
-	if (pd->bdfn == bdfn)
-		return 1;
-
-	return 0;
+	if (!*bus) {
+		*bus = zalloc(256 * sizeof(struct pci_device *));
+		assert(*bus);
+	}
+	if (!(*bus)[pd->bdfn & 0xff])
+		(*bus)[pd->bdfn & 0xff] = pd;
 }
 
-struct pci_device *pci_find_dev(struct phb *phb, uint16_t bdfn)
+void pci_dev_map_del(struct phb *phb, struct pci_device *pd)
 {
-	return pci_walk_dev(phb, NULL, __pci_find_dev, &bdfn);
+	struct pci_device **bus = phb->dev_map[pd->bdfn >> 8];
+
+	if (bus && bus[pd->bdfn & 0xff] == pd)
+		bus[pd->bdfn & 0xff] = NULL;
 }
 
 static int __pci_restore_bridge_buses(struct phb *phb,
@@ -1858,20 +2010,7 @@ void pci_restore_bridge_buses(struct phb *phb, struct pci_device *pd)
 struct pci_cfg_reg_filter *pci_find_cfg_reg_filter(struct pci_device *pd,
 						   uint32_t start, uint32_t len)
 {
-	struct pci_cfg_reg_filter *pcrf;
-
-	/* Check on the cached range, which contains holes */
-	if ((start + len) <= pd->pcrf_start ||
-	    pd->pcrf_end <= start)
-		return NULL;
-
-	list_for_each(&pd->pcrf, pcrf, link) {
-		if (start >= pcrf->start &&
-		    (start + len) <= (pcrf->start + pcrf->len))
-			return pcrf;
-	}
-
-	return NULL;
+	return pci_cfg_filter_find(&pd->pcrf_map, &pd->pcrf, start, len, true);
 }
 
 static bool pci_device_has_cfg_reg_filters(struct phb *phb, uint16_t bdfn)
@@ -1901,6 +2040,62 @@ int64_t pci_handle_cfg_filters(struct phb *phb, uint32_t bdfn,
 	return pcrf->func(pd, pcrf, offset, len, data, write);
 }
 
+/*
+ * Config space block accesses, @count 32-bit words from @offset. PHBs
+ * that implement the block ops do the whole range after checking their
+ * state once, the others go a word at a time through the regular
+ * accessors. Reads fill @data with all ones first, so what's left of
+ * the range after an error reads as nothing there.
+ */
+static int64_t pci_cfg_check_block(uint32_t offset, uint32_t count)
+{
+	if (!count || (offset & 3) || offset > 0xfff ||
+	    count > (0x1000 - offset) / 4)
+		return OPAL_PARAMETER;
+
+	return OPAL_SUCCESS;
+}
+
+int64_t pci_cfg_read_block(struct phb *phb, uint32_t bdfn, uint32_t offset,
+			   uint32_t *data, uint32_t count)
+{
+	int64_t rc;
+	uint32_t i;
+
+	rc = pci_cfg_check_block(offset, count);
+	if (rc)
+		return rc;
+
+	memset(data, 0xff, count * 4);
+	if (phb->ops->cfg_read_block)
+		return phb->ops->cfg_read_block(phb, bdfn, offset, data, count);
+
+	for (i = 0; i < count && !rc; i++)
+		rc = pci_cfg_read32(phb, bdfn, offset + i * 4, &data[i]);
+
+	return rc;
+}
+
+int64_t pci_cfg_write_block(struct phb *phb, uint32_t bdfn, uint32_t offset,
+			    const uint32_t *data, uint32_t count)
+{
+	int64_t rc;
+	uint32_t i;
+
+	rc = pci_cfg_check_block(offset, count);
+	if (rc)
+		return rc;
+
+	if (phb->ops->cfg_write_block)
+		return phb->ops->cfg_write_block(phb, bdfn, offset, data,
+						 count);
+
+	for (i = 0; i < count && !rc; i++)
+		rc = pci_cfg_write32(phb, bdfn, offset + i * 4, data[i]);
+
+	return rc;
+}
+
 struct pci_cfg_reg_filter *pci_add_cfg_reg_filter(struct pci_device *pd,
 						  uint32_t start, uint32_t len,
 						  uint32_t flags,
@@ -1925,12 +2120,187 @@ struct pci_cfg_reg_filter *pci_add_cfg_reg_filter(struct pci_device *pd,
 	pcrf->func = func;
 	pcrf->data = (uint8_t *)(pcrf + 1);
 
-	if (start < pd->pcrf_start)
-		pd->pcrf_start = start;
-	if (pd->pcrf_end < (start + len))
-		pd->pcrf_end = start + len;
+	if (!pci_cfg_filter_map_add(&pd->pcrf_map, pcrf)) {
+		free(pcrf);
+		return NULL;
+	}
 	list_add_tail(&pd->pcrf, &pcrf->link);
 	bitmap_set_bit(*pd->phb->filter_map, pd->bdfn);
 
 	return pcrf;
 }
+
+/*
+ * TCE invalidation. Everything goes through pci_tce_kill() so that it
+ * is accounted in phb->tce_kill_stats.
+ *
+ * pci_tce_kill_ranges() invalidates a list of DMA ranges of a PE in
+ * one call. Ranges that follow each other in the list and touch or
+ * overlap are merged so that no TCE is killed twice, and each run is
+ * killed TCE by TCE. The PHBs can't invalidate more than one TCE per
+ * kill: the page size given to a PHB4 kill selects how the entry index
+ * is worked out, it doesn't widen the kill. If the runs take more than
+ * pci_tce_kill_threshold kills, the whole PE is invalidated instead.
+ */
+unsigned int pci_tce_kill_threshold = PCI_TCE_KILL_PE_THRESHOLD;
+
+int64_t pci_tce_kill(struct phb *phb, uint32_t kill_type,
+		     uint64_t pe_number, uint32_t tce_size,
+		     uint64_t dma_addr, uint32_t npages)
+{
+	struct pci_tce_kill_stats *stats = &phb->tce_kill_stats;
+	int64_t rc;
+
+	if (!phb->ops->tce_kill)
+		return OPAL_UNSUPPORTED;
+
+	rc = phb->ops->tce_kill(phb, kill_type, pe_number, tce_size,
+				dma_addr, npages);
+	if (rc != OPAL_SUCCESS)
+		return rc;
+
+	switch (kill_type) {
+	case OPAL_PCI_TCE_KILL_PAGES:
+		stats->kills += npages;
+		break;
+	case OPAL_PCI_TCE_KILL_PE:
+		stats->kills++;
+		stats->pe_kills++;
+		break;
+	case OPAL_PCI_TCE_KILL_ALL:
+		stats->kills++;
+		stats->all_kills++;
+		break;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+/*
+ * Count the kills the ranges take, issuing them if @kill is set.
+ * The ranges have been validated by pci_tce_kill_ranges().
+ */
+static uint64_t pci_tce_kill_walk(struct phb *phb, uint64_t pe_number,
+				  uint32_t tce_size,
+				  const struct opal_tce_kill_range *ranges,
+				  uint32_t nr_ranges, bool kill, int64_t *rc)
+{
+	uint64_t start, end, addr, kills = 0;
+	uint32_t i = 0;
+
+	while (i < nr_ranges) {
+		start = be64_to_cpu(ranges[i].dma_addr);
+		end = start + be64_to_cpu(ranges[i].npages) * tce_size;
+
+		/* Merge the ranges that continue this one */
+		for (i++; i < nr_ranges; i++) {
+			addr = be64_to_cpu(ranges[i].dma_addr);
+			if (addr < start || addr > end)
+				break;
+			addr += be64_to_cpu(ranges[i].npages) * tce_size;
+			if (addr > end)
+				end = addr;
+		}
+
+		kills += (end - start) / tce_size;
+		if (!kill)
+			continue;
+		*rc = pci_tce_kill(phb, OPAL_PCI_TCE_KILL_PAGES, pe_number,
+				   tce_size, start, (end - start) / tce_size);
+		if (*rc != OPAL_SUCCESS)
+			return kills;
+	}
+
+	return kills;
+}
+
+int64_t pci_tce_kill_ranges(struct phb *phb, uint64_t pe_number,
+			    uint32_t tce_size,
+			    const struct opal_tce_kill_range *ranges,
+			    uint32_t nr_ranges)
+{
+	struct pci_tce_kill_stats *stats = &phb->tce_kill_stats;
+	uint64_t addr, npages, pages = 0;
+	int64_t rc = OPAL_SUCCESS;
+	uint32_t i;
+
+	if (!phb->ops->tce_kill)
+		return OPAL_UNSUPPORTED;
+	if (!nr_ranges || tce_size < 0x1000 || (tce_size & (tce_size - 1)))
+		return OPAL_PARAMETER;
+
+	for (i = 0; i < nr_ranges; i++) {
+		addr = be64_to_cpu(ranges[i].dma_addr);
+		npages = be64_to_cpu(ranges[i].npages);
+		if (!npages || (addr & (tce_size - 1)) ||
+		    npages > (~0ull - addr) / tce_size)
+			return OPAL_PARAMETER;
+		pages += npages;
+	}
+
+	stats->requests++;
+	stats->pages += pages;
+
+	if (pci_tce_kill_walk(phb, pe_number, tce_size, ranges, nr_ranges,
+			      false, &rc) > pci_tce_kill_threshold)
+		return pci_tce_kill(phb, OPAL_PCI_TCE_KILL_PE, pe_number,
+				    0, 0, 0);
+
+	pci_tce_kill_walk(phb, pe_number, tce_size, ranges, nr_ranges,
+			  true, &rc);
+
+	return rc;
+}
+
+/*
+ * Frozen PE tracking
+ *
+ * phb->frozen_pes mirrors the PE error vector (PEEV) of the PHB. The
+ * hardware sets PEEV bits as it freezes PEs and only clearing the
+ * freeze or resetting the IODA tables clears them again, both of which
+ * go through OPAL, so a set bit can be trusted without going back to
+ * the hardware. A clear bit can't: a PE may freeze at any time.
+ */
+void pci_frozen_pes_update(struct phb *phb, uint32_t word, uint64_t peev)
+{
+	uint32_t i, pe = word * 64;
+
+	if (pe >= PCI_MAX_PES)
+		return;
+
+	for (i = 0; i < 64; i++) {
+		if (peev & PPC_BIT(i))
+			bitmap_set_bit(phb->frozen_pes, pe + i);
+		else
+			bitmap_clr_bit(phb->frozen_pes, pe + i);
+	}
+}
+
+void pci_frozen_pes_clear(struct phb *phb)
+{
+	memset(phb->frozen_pes, 0, sizeof(phb->frozen_pes));
+}
+
+bool pci_pe_frozen(struct phb *phb, uint64_t pe_number)
+{
+	return pe_number < PCI_MAX_PES &&
+		bitmap_tst_bit(phb->frozen_pes, pe_number);
+}
+
+/*
+ * The frozen PE next_error reports, -1 if there is none. That's the
+ * lowest PE of the highest PEEV word with any, the order in which the
+ * PHB backends have always handed them to the OS.
+ */
+int pci_first_frozen_pe(struct phb *phb)
+{
+	int word, pe;
+
+	for (word = PCI_MAX_PES / 64 - 1; word >= 0; word--) {
+		pe = bitmap_find_one_bit(phb->frozen_pes, word * 64, 64);
+		if (pe >= 0)
+			return pe;
+	}
+
+	return -1;
+}
@@ -187,37 +187,6 @@ static void create_private_header_section(struct errorlog *elog_data,
 	*pel_offset += PRIVATE_HEADER_SECTION_SIZE;
 }
 
-static void create_user_defined_section(struct errorlog *elog_data,
-					char *pel_buffer, int *pel_offset)
-{
-	char *dump = (char *)pel_buffer + *pel_offset;
-	char *opal_buf = (char *)elog_data->user_data_dump;
-	struct opal_user_section *usrhdr;
-	struct elog_user_data_section *opal_usr_data;
-	struct opal_private_header_section *privhdr =
-			 (struct opal_private_header_section *)pel_buffer;
-	int i;
-
-	for (i = 0; i < elog_data->user_section_count; i++) {
-
-		usrhdr = (struct opal_user_section *)dump;
-		opal_usr_data = (struct elog_user_data_section *)opal_buf;
-
-		usrhdr->v6header.id = ELOG_SID_USER_DEFINED;
-		usrhdr->v6header.version = OPAL_ELOG_VERSION;
-		usrhdr->v6header.length = sizeof(struct opal_v6_header) +
-							opal_usr_data->size;
-		usrhdr->v6header.subtype = OPAL_ELOG_SST;
-		usrhdr->v6header.component_id = elog_data->component_id;
-
-		memcpy(usrhdr->dump, opal_buf, opal_usr_data->size);
-		*pel_offset += usrhdr->v6header.length;
-		dump += usrhdr->v6header.length;
-		opal_buf += opal_usr_data->size;
-		privhdr->section_count++;
-	}
-}
-
 static size_t pel_user_section_size(struct errorlog *elog_data)
 {
 	int i;
@@ -240,11 +209,89 @@ size_t pel_size(struct errorlog *elog_data)
 	return PEL_MIN_SIZE + pel_user_section_size(elog_data);
 }
 
+void pel_stream_init(struct pel_stream *s, struct errorlog *elog_data)
+{
+	struct opal_private_header_section *privhdr =
+			(struct opal_private_header_section *)s->hdr;
+	int pel_offset = 0;
+
+	memset(s->hdr, 0, sizeof(s->hdr));
+
+	create_private_header_section(elog_data, s->hdr, &pel_offset);
+	create_user_header_section(elog_data, s->hdr, &pel_offset);
+	create_src_section(elog_data, s->hdr, &pel_offset);
+	create_extended_header_section(elog_data, s->hdr, &pel_offset);
+	create_mtms_section(elog_data, s->hdr, &pel_offset);
+	privhdr->section_count += elog_data->user_section_count;
+
+	s->elog_data = elog_data;
+	s->size = pel_size(elog_data);
+	s->offset = 0;
+	s->usr_offset = PEL_MIN_SIZE;
+	s->usr_data = elog_data->user_data_dump;
+}
+
+/*
+ * Read from the user data section at the current offset, up to the end
+ * of the section. Each one is a v6 header followed by the user data as
+ * it is in the errorlog.
+ */
+static size_t pel_stream_read_user(struct pel_stream *s, char *buf,
+				   size_t len)
+{
+	const struct elog_user_data_section *opal_usr_data =
+		(const struct elog_user_data_section *)s->usr_data;
+	struct opal_v6_header v6header;
+	size_t off = s->offset - s->usr_offset;
+	size_t sec_len = sizeof(v6header) + opal_usr_data->size;
+
+	len = MIN(len, sec_len - off);
+
+	if (off < sizeof(v6header)) {
+		v6header.id = ELOG_SID_USER_DEFINED;
+		v6header.version = OPAL_ELOG_VERSION;
+		v6header.length = sec_len;
+		v6header.subtype = OPAL_ELOG_SST;
+		v6header.component_id = s->elog_data->component_id;
+
+		len = MIN(len, sizeof(v6header) - off);
+		memcpy(buf, (char *)&v6header + off, len);
+	} else {
+		memcpy(buf, s->usr_data + off - sizeof(v6header), len);
+	}
+
+	if (off + len == sec_len) {
+		s->usr_offset += sec_len;
+		s->usr_data += opal_usr_data->size;
+	}
+
+	return len;
+}
+
+/* Read the next len bytes of the PEL, returns how many there were */
+size_t pel_stream_read(struct pel_stream *s, void *buf, size_t len)
+{
+	size_t n, done = 0;
+
+	while (done < len && s->offset < s->size) {
+		if (s->offset < PEL_MIN_SIZE) {
+			n = MIN(len - done, PEL_MIN_SIZE - s->offset);
+			memcpy(buf + done, s->hdr + s->offset, n);
+		} else {
+			n = pel_stream_read_user(s, buf + done, len - done);
+		}
+		s->offset += n;
+		done += n;
+	}
+
+	return done;
+}
+
 /* Converts an OPAL errorlog into a PEL formatted log */
 int create_pel_log(struct errorlog *elog_data, char *pel_buffer,
 		   size_t pel_buffer_size)
 {
-	int pel_offset = 0;
+	struct pel_stream s;
 
 	if (pel_buffer_size < pel_size(elog_data)) {
 		prerror("PEL buffer too small to create record\n");
@@ -253,13 +300,7 @@ int create_pel_log(struct errorlog *elog_data, char *pel_buffer,
 
 	memset(pel_buffer, 0, pel_buffer_size);
 
-	create_private_header_section(elog_data, pel_buffer, &pel_offset);
-	create_user_header_section(elog_data, pel_buffer, &pel_offset);
-	create_src_section(elog_data, pel_buffer, &pel_offset);
-	create_extended_header_section(elog_data, pel_buffer, &pel_offset);
-	create_mtms_section(elog_data, pel_buffer, &pel_offset);
-	if (elog_data->user_section_count)
-		create_user_defined_section(elog_data, pel_buffer, &pel_offset);
+	pel_stream_init(&s, elog_data);
 
-	return pel_offset;
+	return pel_stream_read(&s, pel_buffer, s.size);
 }
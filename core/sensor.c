@@ -20,9 +20,24 @@
 #include <device.h>
 #include <opal.h>
 #include <dts.h>
+#include <lock.h>
+#include <timebase.h>
+#include <ccan/list/list.h>
 
 struct dt_node *sensor_node;
 
+struct sensor_group {
+	struct list_node	link;
+	uint32_t		id;
+	unsigned long		last_read;	/* timebase, 0 if never read */
+	unsigned int		nr;
+	uint32_t		handles[];
+};
+
+static LIST_HEAD(sensor_groups);
+static struct dt_node *sensor_groups_node;
+static uint32_t sensor_nr_groups;
+
 static int64_t opal_sensor_read(uint32_t sensor_hndl, int token,
 		uint32_t *sensor_data)
 {
@@ -37,6 +52,133 @@ static int64_t opal_sensor_read(uint32_t sensor_hndl, int token,
 	return OPAL_UNSUPPORTED;
 }
 
+int sensor_group_add(const char *name, int chip_id,
+		     const uint32_t *handles, unsigned int nr)
+{
+	struct sensor_group *grp;
+	struct dt_node *node;
+	char node_name[64];
+	__be32 *cells;
+	unsigned int i;
+
+	if (!nr)
+		return OPAL_PARAMETER;
+
+	if (!sensor_groups_node) {
+		sensor_groups_node = dt_new(opal_node, "sensor-groups");
+		if (!sensor_groups_node)
+			return OPAL_NO_MEM;
+		dt_add_property_string(sensor_groups_node, "compatible",
+				       "ibm,opal-sensor-group");
+	}
+
+	grp = zalloc(sizeof(*grp) + nr * sizeof(uint32_t));
+	cells = malloc(nr * sizeof(u32));
+	if (!grp || !cells)
+		goto fail;
+
+	snprintf(node_name, sizeof(node_name), "%s@%x", name,
+		 sensor_nr_groups);
+	node = dt_new(sensor_groups_node, node_name);
+	if (!node)
+		goto fail;
+
+	grp->id = sensor_nr_groups++;
+	grp->nr = nr;
+	memcpy(grp->handles, handles, nr * sizeof(uint32_t));
+	list_add_tail(&sensor_groups, &grp->link);
+
+	for (i = 0; i < nr; i++)
+		cells[i] = cpu_to_be32(handles[i]);
+
+	dt_add_property_string(node, "compatible", "ibm,opal-sensor-group");
+	dt_add_property_cells(node, "sensor-group-id", grp->id);
+	dt_add_property(node, "sensors", cells, nr * sizeof(u32));
+	free(cells);
+	dt_add_property_string(node, "label", name);
+	if (chip_id >= 0)
+		dt_add_property_cells(node, "ibm,chip-id", chip_id);
+
+	prlog(PR_DEBUG, "SENSOR: group %s (%d) with %u sensors\n", name,
+	      grp->id, nr);
+
+	return grp->id;
+fail:
+	free(cells);
+	free(grp);
+	return OPAL_NO_MEM;
+}
+
+static struct sensor_group *sensor_group_get(uint32_t group_id)
+{
+	struct sensor_group *grp;
+
+	list_for_each(&sensor_groups, grp, link) {
+		if (grp->id == group_id)
+			return grp;
+	}
+
+	return NULL;
+}
+
+/*
+ * Read all the sensors of a group. DTS sensors are read right away,
+ * the others are left to the platform which may complete them
+ * asynchronously, in which case *nr and *last_read are valid on return
+ * and the values once the completion for token has arrived.
+ */
+static int64_t opal_sensor_group_read(uint32_t group_id, int token,
+				      struct opal_sensor_group_entry *buf,
+				      __be32 *nr, __be64 *last_read)
+{
+	struct sensor_group *grp = sensor_group_get(group_id);
+	bool platform_read = false;
+	unsigned int i;
+	int64_t rc;
+
+	if (!grp || !opal_addr_valid(nr))
+		return OPAL_PARAMETER;
+
+	if (last_read && !opal_addr_valid(last_read))
+		return OPAL_PARAMETER;
+
+	if (be32_to_cpu(*nr) < grp->nr) {
+		*nr = cpu_to_be32(grp->nr);
+		return OPAL_PARTIAL;
+	}
+
+	if (!opal_addr_valid(buf))
+		return OPAL_PARAMETER;
+
+	for (i = 0; i < grp->nr; i++) {
+		uint32_t hndl = grp->handles[i];
+		uint32_t val = 0;
+
+		buf[i].handle = cpu_to_be32(hndl);
+		if (sensor_get_family(hndl) == SENSOR_DTS) {
+			rc = dts_sensor_read(hndl, &val);
+			buf[i].value = cpu_to_be32(val);
+			buf[i].rc = cpu_to_be32(rc);
+		} else {
+			buf[i].value = 0;
+			buf[i].rc = cpu_to_be32(OPAL_UNSUPPORTED);
+			platform_read = true;
+		}
+	}
+	*nr = cpu_to_be32(grp->nr);
+
+	rc = OPAL_SUCCESS;
+	if (platform_read && platform.sensor_read_group)
+		rc = platform.sensor_read_group(buf, grp->nr, token);
+
+	if (last_read)
+		*last_read = cpu_to_be64(grp->last_read);
+	if (rc == OPAL_SUCCESS || rc == OPAL_ASYNC_COMPLETION)
+		grp->last_read = mftb();
+
+	return rc;
+}
+
 void sensor_init(void)
 {
 	sensor_node = dt_new(opal_node, "sensors");
@@ -46,4 +188,5 @@ void sensor_init(void)
 
 	/* Register OPAL interface */
 	opal_register(OPAL_SENSOR_READ, opal_sensor_read, 3);
+	opal_register(OPAL_SENSOR_GROUP_READ, opal_sensor_group_read, 5);
 }
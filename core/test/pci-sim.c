@@ -0,0 +1,1074 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A software PHB for running the core PCI code on the build host.
+ *
+ * The topology is described by a device-tree subtree. Each child of
+ * the description node is a function on the root bus, each child of
+ * a bridge is a function on its secondary bus:
+ *
+ *   compatible		"sim,root-port", "sim,upstream-port",
+ *			"sim,downstream-port", "sim,pcie-to-pci-bridge",
+ *			"sim,endpoint" or "sim,pci-device"
+ *   reg		devfn
+ *   vendor-id, device-id, class-code	optional IDs
+ *   link-delay-ms	ports: link training time (default 100)
+ *   link-dead		ports: the link never trains
+ *   in-reset		bridges: secondary reset asserted at power on
+ *   hotplug		ports: slot with power control and presence
+ *   empty		hotplug ports: nothing in the slot at power on
+ *   crs-visible	root ports: CRS software visibility enabled
+ *   crs-delay-ms	answer with CRS for that long after link up
+ *   freeze-after	freeze the PE on the Nth config access
+ *
+ * and on the description node itself:
+ *
+ *   num-pes		number of PEs (default 256, the last is reserved)
+ *   cfg-access-ns	simulated cost of a config access (default 500)
+ *
+ * Config accesses go through the config filters first, like on PHB3
+ * and PHB4, then are routed through the bus numbers programmed in the
+ * bridges, like the hardware does. Probing an empty address freezes
+ * the PE it maps to, and a frozen PE blocks config space until it is
+ * cleared. Time is the simulated timebase of pci-sim.h, which
+ * pci-sim.c moves forward on waits and config accesses.
+ */
+
+#include <pci-slot.h>
+
+#include "../../test/bench.h"
+
+#define PCI_SIM_CFG_SIZE	0x1000
+#define PCI_SIM_EXP_CAP		0x40
+#define PCI_SIM_MAX_PES		256
+#define PCI_SIM_LINK_WIDTH	8
+
+enum {
+	PCI_SIM_CFG_NORMAL,
+	PCI_SIM_CFG_RDONLY,
+	PCI_SIM_CFG_W1CLR,
+	PCI_SIM_CFG_MAX
+};
+
+struct pci_sim_dev {
+	struct dt_node		*np;
+	struct pci_sim_dev	*parent;
+	struct list_head	children;
+	struct list_node	link;
+	uint8_t			devfn;
+	int			dev_type;	/* PCIE_TYPE_* */
+	bool			has_exp;	/* PCIe capability */
+	bool			bridge;
+	bool			port;		/* Link below */
+	bool			hotplug;
+	bool			present;
+	bool			link_dead;
+	bool			perst;		/* Root ports: PHB reset */
+	uint32_t		link_ms;
+	uint32_t		crs_ms;
+	uint64_t		link_tb;	/* Link up time, 0 if down */
+	uint32_t		freeze_after;
+	uint32_t		accesses;
+	uint8_t			cfg[PCI_SIM_CFG_MAX][PCI_SIM_CFG_SIZE];
+};
+
+struct pci_sim_phb {
+	struct phb		phb;
+	struct dt_node		*desc;
+	struct list_head	devices;	/* Root bus */
+	uint32_t		num_pes;
+	uint32_t		cfg_ns;
+	uint16_t		rte[0x10000];	/* bdfn to PE */
+	bool			frozen[PCI_SIM_MAX_PES];
+	uint8_t			peltv[PCI_SIM_MAX_PES][PCI_SIM_MAX_PES / 8];
+	uint64_t		ops[PCI_SIM_OP_MAX];
+	uint64_t		start_tb;
+	uint64_t		start_ns;
+};
+
+static const char *pci_sim_op_names[PCI_SIM_OP_MAX] = {
+	[PCI_SIM_CFG_READ]	= "cfg-read",
+	[PCI_SIM_CFG_WRITE]	= "cfg-write",
+	[PCI_SIM_CFG_UR]	= "cfg-ur",
+	[PCI_SIM_CFG_CRS]	= "cfg-crs",
+	[PCI_SIM_CFG_FROZEN]	= "cfg-frozen",
+	[PCI_SIM_FREEZE]	= "freeze",
+	[PCI_SIM_FREEZE_STATUS]	= "freeze-status",
+	[PCI_SIM_FREEZE_CLEAR]	= "freeze-clear",
+	[PCI_SIM_FREEZE_SET]	= "freeze-set",
+	[PCI_SIM_ERR_INJECT]	= "err-inject",
+	[PCI_SIM_NEXT_ERROR]	= "next-error",
+	[PCI_SIM_PEEV_READ]	= "peev-read",
+	[PCI_SIM_SET_PE]	= "set-pe",
+	[PCI_SIM_RTE_WRITE]	= "rte-write",
+	[PCI_SIM_SET_PELTV]	= "set-peltv",
+	[PCI_SIM_IODA_RESET]	= "ioda-reset",
+	[PCI_SIM_DEVICE_INIT]	= "device-init",
+	[PCI_SIM_CRESET]	= "creset",
+	[PCI_SIM_TCE_KILL]	= "tce-kill",
+	[PCI_SIM_TCE_KILL_PE]	= "tce-kill-pe",
+};
+
+static inline struct pci_sim_phb *phb_to_sim(struct phb *phb)
+{
+	return container_of(phb, struct pci_sim_phb, phb);
+}
+
+void time_wait(unsigned long duration)
+{
+	sim_tb += duration;
+}
+
+void time_wait_ms(unsigned long ms)
+{
+	sim_tb += msecs_to_tb(ms);
+}
+
+/*
+ * Config space storage. Like pci-virt, each register has a value, a
+ * read-only mask and a write-one-to-clear mask.
+ */
+static uint32_t pci_sim_cfg_get(struct pci_sim_dev *d, int space,
+				uint32_t offset, uint32_t size)
+{
+	uint32_t i, val = 0;
+
+	for (i = 0; i < size; i++)
+		val |= (uint32_t)d->cfg[space][offset + i] << (i * 8);
+
+	return val;
+}
+
+static void pci_sim_cfg_set(struct pci_sim_dev *d, int space,
+			    uint32_t offset, uint32_t size, uint32_t val)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++, val >>= 8)
+		d->cfg[space][offset + i] = val;
+}
+
+static void pci_sim_cfg_init(struct pci_sim_dev *d, uint32_t offset,
+			     uint32_t size, uint32_t val, uint32_t ro)
+{
+	pci_sim_cfg_set(d, PCI_SIM_CFG_NORMAL, offset, size, val);
+	pci_sim_cfg_set(d, PCI_SIM_CFG_RDONLY, offset, size, ro);
+}
+
+static uint16_t pci_sim_exp_reg(struct pci_sim_dev *d, uint32_t reg)
+{
+	return pci_sim_cfg_get(d, PCI_SIM_CFG_NORMAL,
+			       PCI_SIM_EXP_CAP + reg, 2);
+}
+
+/*
+ * The link below a port trains link-delay-ms after the last of its
+ * preconditions is met, and goes down as soon as one of them isn't.
+ */
+static void pci_sim_update_link(struct pci_sim_dev *d)
+{
+	uint16_t bctl;
+	bool ok;
+
+	if (!d->port)
+		return;
+
+	bctl = pci_sim_cfg_get(d, PCI_SIM_CFG_NORMAL, PCI_CFG_BRCTL, 2);
+	ok = d->present && !d->link_dead && !d->perst &&
+	     !(bctl & PCI_CFG_BRCTL_SECONDARY_RESET) &&
+	     !(pci_sim_exp_reg(d, PCICAP_EXP_LCTL) & PCICAP_EXP_LCTL_LINK_DIS);
+	if (d->hotplug &&
+	    (pci_sim_exp_reg(d, PCICAP_EXP_SLOTCTL) & PCICAP_EXP_SLOTCTL_PWRCTLR))
+		ok = false;
+
+	if (!ok)
+		d->link_tb = 0;
+	else if (!d->link_tb)
+		d->link_tb = mftb() + msecs_to_tb(d->link_ms);
+}
+
+static bool pci_sim_link_up(struct pci_sim_dev *d)
+{
+	return d->link_tb && tb_compare(mftb(), d->link_tb) != TB_ABEFOREB;
+}
+
+/* Refresh the registers that reflect the link and slot state */
+static void pci_sim_refresh(struct pci_sim_dev *d)
+{
+	uint16_t lsts = 0, ssts;
+
+	if (!d->port)
+		return;
+
+	if (pci_sim_link_up(d))
+		lsts = PCICAP_EXP_LSTAT_DLLL_ACT | (PCI_SIM_LINK_WIDTH << 4);
+	pci_sim_cfg_set(d, PCI_SIM_CFG_NORMAL,
+			PCI_SIM_EXP_CAP + PCICAP_EXP_LSTAT, 2, lsts);
+
+	if (!d->hotplug)
+		return;
+	ssts = pci_sim_exp_reg(d, PCICAP_EXP_SLOTSTAT);
+	ssts &= ~PCICAP_EXP_SLOTSTAT_PDETECTST;
+	if (d->present)
+		ssts |= PCICAP_EXP_SLOTSTAT_PDETECTST;
+	pci_sim_cfg_set(d, PCI_SIM_CFG_NORMAL,
+			PCI_SIM_EXP_CAP + PCICAP_EXP_SLOTSTAT, 2, ssts);
+}
+
+static struct pci_sim_dev *pci_sim_find_devfn(struct list_head *list,
+					      uint8_t devfn)
+{
+	struct pci_sim_dev *d;
+
+	list_for_each(list, d, link)
+		if (d->devfn == devfn)
+			return d;
+
+	return NULL;
+}
+
+/* Follow the bus numbers programmed in the bridges down to @bdfn */
+static struct pci_sim_dev *pci_sim_route(struct pci_sim_phb *s, uint16_t bdfn)
+{
+	struct list_head *list = &s->devices;
+	struct pci_sim_dev *d, *bridge;
+	uint8_t bus = bdfn >> 8, cur = 0, sec, sub;
+	uint16_t bctl;
+
+	while (bus != cur) {
+		bridge = NULL;
+		list_for_each(list, d, link) {
+			if (!d->bridge)
+				continue;
+			sec = d->cfg[PCI_SIM_CFG_NORMAL][PCI_CFG_SECONDARY_BUS];
+			sub = d->cfg[PCI_SIM_CFG_NORMAL][PCI_CFG_SUBORDINATE_BUS];
+			if (sec > cur && bus >= sec && bus <= sub) {
+				bridge = d;
+				break;
+			}
+		}
+		if (!bridge)
+			return NULL;
+
+		bctl = pci_sim_cfg_get(bridge, PCI_SIM_CFG_NORMAL,
+				       PCI_CFG_BRCTL, 2);
+		if (bctl & PCI_CFG_BRCTL_SECONDARY_RESET)
+			return NULL;
+		if (bridge->port && !pci_sim_link_up(bridge))
+			return NULL;
+
+		list = &bridge->children;
+		cur = sec;
+	}
+
+	return pci_sim_find_devfn(list, bdfn & 0xff);
+}
+
+/* Devices answer with CRS for a while after the link above comes up */
+static bool pci_sim_ready(struct pci_sim_dev *d)
+{
+	struct pci_sim_dev *port;
+
+	if (!d->crs_ms)
+		return true;
+	for (port = d->parent; port && !port->port; port = port->parent)
+		;
+	if (!port)
+		return true;
+
+	return tb_compare(mftb(), port->link_tb + msecs_to_tb(d->crs_ms)) !=
+		TB_ABEFOREB;
+}
+
+static void pci_sim_freeze(struct pci_sim_phb *s, uint32_t pe)
+{
+	uint32_t i;
+
+	if (!s->frozen[pe])
+		s->ops[PCI_SIM_FREEZE]++;
+	s->frozen[pe] = true;
+
+	/* The PEs in the domain of the frozen one go down with it */
+	for (i = 0; i < s->num_pes; i++)
+		if (s->peltv[pe][i / 8] & (0x80 >> (i % 8)))
+			s->frozen[i] = true;
+}
+
+/*
+ * Common front end of the config accessors. Returns the device if the
+ * access should go ahead, NULL with *data filled if it shouldn't.
+ */
+static struct pci_sim_dev *pci_sim_cfg_access(struct pci_sim_phb *s,
+					      uint32_t bdfn, uint32_t offset,
+					      uint32_t *data, bool write)
+{
+	struct pci_sim_dev *d;
+	uint32_t pe = s->rte[bdfn];
+
+	s->ops[write ? PCI_SIM_CFG_WRITE : PCI_SIM_CFG_READ]++;
+	sim_tb += (uint64_t)s->cfg_ns * tb_hz / 1000000000ul;
+	*data = 0xffffffff;
+
+	if (s->frozen[pe]) {
+		s->ops[PCI_SIM_CFG_FROZEN]++;
+		return NULL;
+	}
+
+	d = pci_sim_route(s, bdfn);
+	if (!d) {
+		s->ops[PCI_SIM_CFG_UR]++;
+		pci_sim_freeze(s, pe);
+		return NULL;
+	}
+
+	if (!pci_sim_ready(d)) {
+		s->ops[PCI_SIM_CFG_CRS]++;
+		if (offset == PCI_CFG_VENDOR_ID)
+			*data = 0xffff0001;
+		return NULL;
+	}
+
+	if (d->freeze_after && ++d->accesses == d->freeze_after) {
+		pci_sim_freeze(s, pe);
+		return NULL;
+	}
+
+	return d;
+}
+
+static int64_t pci_sim_cfg_read(struct phb *phb, uint32_t bdfn,
+				uint32_t offset, uint32_t size,
+				uint32_t *data)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	struct pci_sim_dev *d;
+
+	int64_t rc;
+
+	if (bdfn > 0xffff || offset + size > PCI_SIM_CFG_SIZE ||
+	    (offset & (size - 1)))
+		return OPAL_PARAMETER;
+
+	rc = pci_handle_cfg_filters(phb, bdfn, offset, size, data, false);
+	if (rc != OPAL_PARTIAL)
+		return rc;
+
+	d = pci_sim_cfg_access(s, bdfn, offset, data, false);
+	if (d) {
+		pci_sim_refresh(d);
+		*data = pci_sim_cfg_get(d, PCI_SIM_CFG_NORMAL, offset, size);
+	}
+	if (size < 4)
+		*data &= (1u << (size * 8)) - 1;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_cfg_write(struct phb *phb, uint32_t bdfn,
+				 uint32_t offset, uint32_t size,
+				 uint32_t data)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	struct pci_sim_dev *d;
+	uint32_t old, ro, w1c, dummy;
+	int64_t rc;
+
+	if (bdfn > 0xffff || offset + size > PCI_SIM_CFG_SIZE ||
+	    (offset & (size - 1)))
+		return OPAL_PARAMETER;
+
+	rc = pci_handle_cfg_filters(phb, bdfn, offset, size, &data, true);
+	if (rc != OPAL_PARTIAL)
+		return rc;
+
+	d = pci_sim_cfg_access(s, bdfn, offset, &dummy, true);
+	if (!d)
+		return OPAL_SUCCESS;
+
+	old = pci_sim_cfg_get(d, PCI_SIM_CFG_NORMAL, offset, size);
+	ro = pci_sim_cfg_get(d, PCI_SIM_CFG_RDONLY, offset, size);
+	w1c = pci_sim_cfg_get(d, PCI_SIM_CFG_W1CLR, offset, size);
+	data = (data & ~ro) | (old & ro);
+	data &= ~(data & w1c);
+	pci_sim_cfg_set(d, PCI_SIM_CFG_NORMAL, offset, size, data);
+	pci_sim_update_link(d);
+
+	return OPAL_SUCCESS;
+}
+
+#define PCI_SIM_CFG_READ_OP(sz, type)					\
+static int64_t pci_sim_cfg_read##sz(struct phb *phb, uint32_t bdfn,	\
+				    uint32_t offset, type *data)	\
+{									\
+	uint32_t val;							\
+	int64_t rc;							\
+									\
+	rc = pci_sim_cfg_read(phb, bdfn, offset, sizeof(type), &val);	\
+	*data = val;							\
+	return rc;							\
+}
+
+#define PCI_SIM_CFG_WRITE_OP(sz, type)					\
+static int64_t pci_sim_cfg_write##sz(struct phb *phb, uint32_t bdfn,	\
+				     uint32_t offset, type data)	\
+{									\
+	return pci_sim_cfg_write(phb, bdfn, offset, sizeof(type), data);\
+}
+
+PCI_SIM_CFG_READ_OP(8, uint8_t)
+PCI_SIM_CFG_READ_OP(16, uint16_t)
+PCI_SIM_CFG_READ_OP(32, uint32_t)
+PCI_SIM_CFG_WRITE_OP(8, uint8_t)
+PCI_SIM_CFG_WRITE_OP(16, uint16_t)
+PCI_SIM_CFG_WRITE_OP(32, uint32_t)
+
+static uint8_t pci_sim_choose_bus(struct phb *phb __unused,
+				  struct pci_device *bridge __unused,
+				  uint8_t candidate, uint8_t *max_bus __unused,
+				  bool *use_max)
+{
+	*use_max = false;
+	return candidate;
+}
+
+static int64_t pci_sim_get_reserved_pe_number(struct phb *phb)
+{
+	return phb_to_sim(phb)->num_pes - 1;
+}
+
+static int pci_sim_device_init(struct phb *phb, struct pci_device *pd __unused,
+			       void *data __unused)
+{
+	phb_to_sim(phb)->ops[PCI_SIM_DEVICE_INIT]++;
+	return 0;
+}
+
+/* A word of the PE error vector, PE 0 in the MSB like the hardware */
+static uint64_t pci_sim_peev(struct pci_sim_phb *s, uint32_t word)
+{
+	uint64_t peev = 0;
+	uint32_t i;
+
+	s->ops[PCI_SIM_PEEV_READ]++;
+	for (i = 0; i < 64 && word * 64 + i < s->num_pes; i++)
+		if (s->frozen[word * 64 + i])
+			peev |= PPC_BIT(i);
+
+	return peev;
+}
+
+static bool pci_sim_read_frozen_pes(struct pci_sim_phb *s)
+{
+	uint64_t peev, frozen = 0;
+	uint32_t i;
+
+	for (i = 0; i * 64 < s->num_pes; i++) {
+		peev = pci_sim_peev(s, i);
+		pci_frozen_pes_update(&s->phb, i, peev);
+		frozen |= peev;
+	}
+
+	return frozen != 0;
+}
+
+static int64_t pci_sim_eeh_freeze_status(struct phb *phb, uint64_t pe_number,
+					 uint8_t *freeze_state,
+					 uint16_t *pci_error_type,
+					 uint16_t *severity,
+					 uint64_t *phb_status __unused)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	uint64_t peev;
+
+	s->ops[PCI_SIM_FREEZE_STATUS]++;
+	if (pe_number >= s->num_pes)
+		return OPAL_PARAMETER;
+
+	*freeze_state = OPAL_EEH_STOPPED_NOT_FROZEN;
+	*pci_error_type = OPAL_EEH_NO_ERROR;
+	if (severity)
+		*severity = OPAL_EEH_SEV_NO_ERROR;
+	if (!pci_pe_frozen(phb, pe_number)) {
+		peev = pci_sim_peev(s, pe_number / 64);
+		if (!(peev & PPC_BIT(pe_number & 0x3f)))
+			return OPAL_SUCCESS;
+		pci_frozen_pes_update(phb, pe_number / 64, peev);
+	}
+
+	*freeze_state = OPAL_EEH_STOPPED_MMIO_DMA_FREEZE;
+	if (severity)
+		*severity = OPAL_EEH_SEV_PE_ER;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_eeh_freeze_clear(struct phb *phb, uint64_t pe_number,
+					uint64_t eeh_action_token)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+
+	s->ops[PCI_SIM_FREEZE_CLEAR]++;
+	if (pe_number >= s->num_pes)
+		return OPAL_PARAMETER;
+
+	/* MMIO and DMA aren't tracked separately, either clears both */
+	if (eeh_action_token & OPAL_EEH_ACTION_CLEAR_FREEZE_ALL)
+		s->frozen[pe_number] = false;
+	pci_sim_read_frozen_pes(s);
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_eeh_freeze_set(struct phb *phb, uint64_t pe_number,
+				      uint64_t eeh_action_token)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+
+	s->ops[PCI_SIM_FREEZE_SET]++;
+	if (pe_number >= s->num_pes)
+		return OPAL_PARAMETER;
+
+	if (eeh_action_token & OPAL_EEH_ACTION_SET_FREEZE_ALL)
+		s->frozen[pe_number] = true;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_err_inject(struct phb *phb, uint64_t pe_number,
+				  uint32_t type __unused, uint32_t func __unused,
+				  uint64_t addr __unused, uint64_t mask __unused)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+
+	s->ops[PCI_SIM_ERR_INJECT]++;
+	if (pe_number >= s->num_pes)
+		return OPAL_PARAMETER;
+
+	pci_sim_freeze(s, pe_number);
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_next_error(struct phb *phb, uint64_t *first_frozen_pe,
+				  uint16_t *pci_error_type,
+				  uint16_t *severity)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	int pe;
+
+	s->ops[PCI_SIM_NEXT_ERROR]++;
+	*first_frozen_pe = (uint64_t)-1;
+	*pci_error_type = OPAL_EEH_NO_ERROR;
+	*severity = OPAL_EEH_SEV_NO_ERROR;
+	if (!pci_sim_read_frozen_pes(s))
+		return OPAL_SUCCESS;
+
+	pe = pci_first_frozen_pe(phb);
+	*first_frozen_pe = pe;
+	*pci_error_type = OPAL_EEH_PE_ERROR;
+	*severity = OPAL_EEH_SEV_PE_ER;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_eeh_frozen_pes(struct phb *phb, uint32_t *num_pes)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+
+	pci_sim_read_frozen_pes(s);
+	*num_pes = s->num_pes;
+
+	return OPAL_SUCCESS;
+}
+
+/* Same RID matching as the PHB3 RTT */
+static int64_t pci_sim_set_pe(struct phb *phb, uint64_t pe_number,
+			      uint64_t bdfn, uint8_t bcompare,
+			      uint8_t dcompare, uint8_t fcompare,
+			      uint8_t action)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	struct pci_rid_set rids;
+
+	s->ops[PCI_SIM_SET_PE]++;
+	if (action != OPAL_MAP_PE && action != OPAL_UNMAP_PE)
+		return OPAL_PARAMETER;
+	if (pe_number >= s->num_pes || bdfn > 0xffff ||
+	    bcompare > OpalPciBusAll ||
+	    dcompare > OPAL_COMPARE_RID_DEVICE_NUMBER ||
+	    fcompare > OPAL_COMPARE_RID_FUNCTION_NUMBER)
+		return OPAL_PARAMETER;
+
+	if (action == OPAL_UNMAP_PE)
+		pe_number = s->num_pes - 1;
+	pci_rid_set_init(&rids, bdfn, bcompare, dcompare, fcompare);
+	s->ops[PCI_SIM_RTE_WRITE] += pci_rtt_update(s->rte, NULL, &rids,
+						    pe_number);
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_set_peltv(struct phb *phb, uint32_t parent_pe,
+				 uint32_t child_pe, uint8_t state)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	uint8_t bit = 0x80 >> (child_pe % 8);
+
+	s->ops[PCI_SIM_SET_PELTV]++;
+	if (parent_pe >= s->num_pes || child_pe >= s->num_pes)
+		return OPAL_PARAMETER;
+
+	if (state)
+		s->peltv[parent_pe][child_pe / 8] |= bit;
+	else
+		s->peltv[parent_pe][child_pe / 8] &= ~bit;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_ioda_reset(struct phb *phb, bool purge __unused)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	uint32_t i;
+
+	s->ops[PCI_SIM_IODA_RESET]++;
+	for (i = 0; i < ARRAY_SIZE(s->rte); i++)
+		s->rte[i] = s->num_pes - 1;
+	memset(s->frozen, 0, sizeof(s->frozen));
+	memset(s->peltv, 0, sizeof(s->peltv));
+	pci_frozen_pes_clear(phb);
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_tce_kill(struct phb *phb, uint32_t kill_type,
+				uint64_t pe_number, uint32_t tce_size,
+				uint64_t dma_addr, uint32_t npages)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+
+	if (pe_number >= s->num_pes)
+		return OPAL_PARAMETER;
+
+	switch (kill_type) {
+	case OPAL_PCI_TCE_KILL_PAGES:
+		/* The TCE tables are 4K, a kill covers one TCE */
+		if (tce_size != 0x1000)
+			return OPAL_PARAMETER;
+		if (dma_addr & (tce_size - 1))
+			return OPAL_PARAMETER;
+		s->ops[PCI_SIM_TCE_KILL] += npages;
+		break;
+	case OPAL_PCI_TCE_KILL_PE:
+		s->ops[PCI_SIM_TCE_KILL]++;
+		s->ops[PCI_SIM_TCE_KILL_PE]++;
+		break;
+	case OPAL_PCI_TCE_KILL_ALL:
+		s->ops[PCI_SIM_TCE_KILL]++;
+		break;
+	default:
+		return OPAL_UNSUPPORTED;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+static const struct phb_ops pci_sim_ops = {
+	.cfg_read8		= pci_sim_cfg_read8,
+	.cfg_read16		= pci_sim_cfg_read16,
+	.cfg_read32		= pci_sim_cfg_read32,
+	.cfg_write8		= pci_sim_cfg_write8,
+	.cfg_write16		= pci_sim_cfg_write16,
+	.cfg_write32		= pci_sim_cfg_write32,
+	.choose_bus		= pci_sim_choose_bus,
+	.get_reserved_pe_number	= pci_sim_get_reserved_pe_number,
+	.device_init		= pci_sim_device_init,
+	.eeh_freeze_status	= pci_sim_eeh_freeze_status,
+	.eeh_freeze_clear	= pci_sim_eeh_freeze_clear,
+	.eeh_freeze_set		= pci_sim_eeh_freeze_set,
+	.err_inject		= pci_sim_err_inject,
+	.next_error		= pci_sim_next_error,
+	.eeh_frozen_pes		= pci_sim_eeh_frozen_pes,
+	.set_pe			= pci_sim_set_pe,
+	.set_peltv		= pci_sim_set_peltv,
+	.ioda_reset		= pci_sim_ioda_reset,
+	.tce_kill		= pci_sim_tce_kill,
+};
+
+/*
+ * PHB slot. The link state is the one of the first root port. Both
+ * fundamental and complete resets hold PERST on the root ports for
+ * 100ms, then wait for the links to train. A complete reset also
+ * resets the IODA state.
+ */
+static struct pci_sim_dev *pci_sim_root_port(struct pci_sim_phb *s)
+{
+	struct pci_sim_dev *d;
+
+	list_for_each(&s->devices, d, link)
+		if (d->port)
+			return d;
+
+	return NULL;
+}
+
+static void pci_sim_perst(struct pci_sim_phb *s, bool assert)
+{
+	struct pci_sim_dev *d;
+
+	list_for_each(&s->devices, d, link) {
+		d->perst = assert;
+		pci_sim_update_link(d);
+	}
+}
+
+static int64_t pci_sim_slot_get_presence_state(struct pci_slot *slot __unused,
+					       uint8_t *val)
+{
+	*val = OPAL_PCI_SLOT_PRESENT;
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_slot_get_link_state(struct pci_slot *slot,
+					   uint8_t *val)
+{
+	struct pci_sim_dev *rp = pci_sim_root_port(phb_to_sim(slot->phb));
+
+	*val = (rp && pci_sim_link_up(rp)) ? PCI_SIM_LINK_WIDTH : 0;
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_sim_slot_poll_link(struct pci_slot *slot)
+{
+	struct pci_sim_dev *rp = pci_sim_root_port(phb_to_sim(slot->phb));
+
+	switch (slot->state) {
+	case PCI_SLOT_STATE_LINK_START_POLL:
+		slot->retries = 1000;
+		pci_slot_set_state(slot, PCI_SLOT_STATE_LINK_POLLING);
+		/* fall through */
+	case PCI_SLOT_STATE_LINK_POLLING:
+		if (!rp || pci_sim_link_up(rp)) {
+			pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
+			return OPAL_SUCCESS;
+		}
+		if (slot->retries-- == 0) {
+			pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
+			return OPAL_HARDWARE;
+		}
+		return pci_slot_set_sm_timeout(slot, msecs_to_tb(10));
+	}
+
+	pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
+	return OPAL_HARDWARE;
+}
+
+static int64_t pci_sim_slot_freset(struct pci_slot *slot)
+{
+	struct pci_sim_phb *s = phb_to_sim(slot->phb);
+
+	switch (slot->state) {
+	case PCI_SLOT_STATE_NORMAL:
+		pci_sim_perst(s, true);
+		pci_slot_set_state(slot, PCI_SLOT_STATE_FRESET_POWER_OFF);
+		return pci_slot_set_sm_timeout(slot, msecs_to_tb(100));
+	case PCI_SLOT_STATE_FRESET_POWER_OFF:
+		pci_sim_perst(s, false);
+		pci_slot_set_state(slot, PCI_SLOT_STATE_LINK_START_POLL);
+		return pci_slot_set_sm_timeout(slot, msecs_to_tb(10));
+	}
+
+	pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
+	return OPAL_HARDWARE;
+}
+
+static int64_t pci_sim_slot_creset(struct pci_slot *slot)
+{
+	struct pci_sim_phb *s = phb_to_sim(slot->phb);
+
+	switch (slot->state) {
+	case PCI_SLOT_STATE_NORMAL:
+		s->ops[PCI_SIM_CRESET]++;
+		pci_sim_ioda_reset(slot->phb, true);
+		pci_sim_perst(s, true);
+		pci_slot_set_state(slot, PCI_SLOT_STATE_CRESET_START);
+		return pci_slot_set_sm_timeout(slot, msecs_to_tb(100));
+	case PCI_SLOT_STATE_CRESET_START:
+		pci_sim_perst(s, false);
+		pci_slot_set_state(slot, PCI_SLOT_STATE_LINK_START_POLL);
+		return pci_slot_set_sm_timeout(slot, msecs_to_tb(10));
+	}
+
+	pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
+	return OPAL_HARDWARE;
+}
+
+/* Hotplug ports get a standard PCIe slot */
+static void pci_sim_get_slot_info(struct phb *phb, struct pci_device *pd)
+{
+	struct pci_sim_dev *d;
+
+	if (phb->ops != &pci_sim_ops)
+		return;
+	d = pci_sim_route(phb_to_sim(phb), pd->bdfn);
+	if (d && d->hotplug)
+		pcie_slot_create(phb, pd);
+}
+
+static const struct {
+	const char	*compat;
+	int		dev_type;
+	bool		has_exp;
+	bool		bridge;
+	uint32_t	class;
+} pci_sim_types[] = {
+	{ "sim,root-port",	   PCIE_TYPE_ROOT_PORT,	    true,  true,  0x060400 },
+	{ "sim,upstream-port",	   PCIE_TYPE_SWITCH_UPPORT, true,  true,  0x060400 },
+	{ "sim,downstream-port",   PCIE_TYPE_SWITCH_DNPORT, true,  true,  0x060400 },
+	{ "sim,pcie-to-pci-bridge", PCIE_TYPE_PCIE_TO_PCIX, true,  true,  0x060400 },
+	{ "sim,endpoint",	   PCIE_TYPE_ENDPOINT,	    true,  false, 0x020000 },
+	{ "sim,pci-device",	   PCIE_TYPE_LEGACY,	    false, false, 0x020000 },
+};
+
+static struct pci_sim_dev *pci_sim_new_dev(struct pci_sim_dev *parent,
+					   struct dt_node *np)
+{
+	struct pci_sim_dev *d = zalloc(sizeof(*d));
+	uint32_t i, cap, slot_cap;
+
+	assert(d);
+	for (i = 0; i < ARRAY_SIZE(pci_sim_types); i++)
+		if (dt_node_is_compatible(np, pci_sim_types[i].compat))
+			break;
+	assert(i < ARRAY_SIZE(pci_sim_types));
+
+	d->np = np;
+	d->parent = parent;
+	d->devfn = dt_prop_get_u32(np, "reg");
+	d->dev_type = pci_sim_types[i].dev_type;
+	d->has_exp = pci_sim_types[i].has_exp;
+	d->bridge = pci_sim_types[i].bridge;
+	d->port = d->dev_type == PCIE_TYPE_ROOT_PORT ||
+		  d->dev_type == PCIE_TYPE_SWITCH_DNPORT;
+	d->hotplug = d->port && dt_has_node_property(np, "hotplug", NULL);
+	d->present = !d->hotplug || !dt_has_node_property(np, "empty", NULL);
+	d->link_dead = dt_has_node_property(np, "link-dead", NULL);
+	d->link_ms = dt_prop_get_u32_def(np, "link-delay-ms", 100);
+	d->crs_ms = dt_prop_get_u32_def(np, "crs-delay-ms", 0);
+	d->freeze_after = dt_prop_get_u32_def(np, "freeze-after", 0);
+	list_head_init(&d->children);
+
+	/* Standard header */
+	pci_sim_cfg_init(d, PCI_CFG_VENDOR_ID, 2,
+			 dt_prop_get_u32_def(np, "vendor-id", 0x1014), 0xffff);
+	pci_sim_cfg_init(d, PCI_CFG_DEVICE_ID, 2,
+			 dt_prop_get_u32_def(np, "device-id", 0x5a00 + i),
+			 0xffff);
+	pci_sim_cfg_init(d, PCI_CFG_REV_ID, 4,
+			 dt_prop_get_u32_def(np, "class-code",
+					     pci_sim_types[i].class) << 8,
+			 0xffffffff);
+	pci_sim_cfg_init(d, PCI_CFG_HDR_TYPE, 1, d->bridge ? 1 : 0, 0xff);
+	pci_sim_cfg_set(d, PCI_SIM_CFG_W1CLR, PCI_CFG_STAT, 2, 0xf900);
+	if (d->bridge && dt_has_node_property(np, "in-reset", NULL))
+		pci_sim_cfg_init(d, PCI_CFG_BRCTL, 2,
+				 PCI_CFG_BRCTL_SECONDARY_RESET, 0);
+	if (!d->has_exp)
+		return d;
+
+	/* PCIe capability */
+	pci_sim_cfg_init(d, PCI_CFG_STAT, 2, PCI_CFG_STAT_CAP,
+			 PCI_CFG_STAT_CAP);
+	pci_sim_cfg_init(d, PCI_CFG_CAP, 1, PCI_SIM_EXP_CAP, 0xff);
+	pci_sim_cfg_init(d, PCI_SIM_EXP_CAP, 2, PCI_CFG_CAP_ID_EXP, 0xffff);
+	cap = 2 | SETFIELD(PCICAP_EXP_CAP_TYPE, 0ul, d->dev_type);
+	if (d->hotplug)
+		cap |= PCICAP_EXP_CAP_SLOT;
+	pci_sim_cfg_init(d, PCI_SIM_EXP_CAP + PCICAP_EXP_CAPABILITY_REG, 2,
+			 cap, 0xffff);
+	pci_sim_cfg_init(d, PCI_SIM_EXP_CAP + PCICAP_EXP_DEVCAP, 4,
+			 SETFIELD(PCICAP_EXP_DEVCAP_MPSS, 0ul, 1), 0xffffffff);
+	if (!d->port)
+		return d;
+
+	pci_sim_cfg_init(d, PCI_SIM_EXP_CAP + PCICAP_EXP_LCAP, 4,
+			 PCICAP_EXP_LCAP_DL_ACT_REP | (PCI_SIM_LINK_WIDTH << 4),
+			 0xffffffff);
+	pci_sim_cfg_set(d, PCI_SIM_CFG_RDONLY,
+			PCI_SIM_EXP_CAP + PCICAP_EXP_LSTAT, 2, 0xffff);
+	if (d->dev_type == PCIE_TYPE_ROOT_PORT &&
+	    dt_has_node_property(np, "crs-visible", NULL))
+		pci_sim_cfg_init(d, PCI_SIM_EXP_CAP + PCICAP_EXP_RC, 2,
+				 PCICAP_EXP_RC_CRS_VISIBLE, 0);
+	if (d->hotplug) {
+		slot_cap = PCICAP_EXP_SLOTCAP_PWCTRL |
+			   PCICAP_EXP_SLOTCAP_ATTNI |
+			   PCICAP_EXP_SLOTCAP_PWRI |
+			   PCICAP_EXP_SLOTCAP_HPLUG_CAP;
+		pci_sim_cfg_init(d, PCI_SIM_EXP_CAP + PCICAP_EXP_SLOTCAP, 4,
+				 slot_cap, 0xffffffff);
+		pci_sim_cfg_init(d, PCI_SIM_EXP_CAP + PCICAP_EXP_SLOTCTL, 2,
+				 PCIE_INDIC_ON << 8, 0);
+		pci_sim_cfg_set(d, PCI_SIM_CFG_RDONLY,
+				PCI_SIM_EXP_CAP + PCICAP_EXP_SLOTSTAT, 2,
+				PCICAP_EXP_SLOTSTAT_PDETECTST);
+	}
+	pci_sim_update_link(d);
+
+	return d;
+}
+
+static void pci_sim_populate(struct list_head *list, struct pci_sim_dev *parent,
+			     struct dt_node *np)
+{
+	struct pci_sim_dev *d, *fn0;
+	struct dt_node *child;
+
+	dt_for_each_child(np, child) {
+		d = pci_sim_new_dev(parent, child);
+		list_add_tail(list, &d->link);
+		if (d->bridge)
+			pci_sim_populate(&d->children, d, child);
+	}
+
+	/* Flag the multi-function devices */
+	list_for_each(list, d, link) {
+		if (!(d->devfn & 0x7))
+			continue;
+		fn0 = pci_sim_find_devfn(list, d->devfn & 0xf8);
+		if (fn0)
+			fn0->cfg[PCI_SIM_CFG_NORMAL][PCI_CFG_HDR_TYPE] |= 0x80;
+	}
+}
+
+struct phb *pci_sim_create(struct dt_node *np)
+{
+	static unsigned int index;
+	struct pci_sim_phb *s = zalloc(sizeof(*s));
+	struct pci_slot *slot;
+	char name[32];
+
+	assert(s);
+	s->desc = np;
+	s->num_pes = dt_prop_get_u32_def(np, "num-pes", PCI_SIM_MAX_PES);
+	assert(s->num_pes && s->num_pes <= PCI_SIM_MAX_PES);
+	s->cfg_ns = dt_prop_get_u32_def(np, "cfg-access-ns", 500);
+	list_head_init(&s->devices);
+	pci_sim_populate(&s->devices, NULL, np);
+
+	snprintf(name, sizeof(name), "pciex@%u", index++);
+	s->phb.dt_node = dt_new(dt_root, name);
+	s->phb.ops = &pci_sim_ops;
+	s->phb.phb_type = phb_type_pcie_v3;
+	s->phb.scan_map = 0x1;
+	list_head_init(&s->phb.virt_devices);
+	assert(pci_register_phb(&s->phb, OPAL_DYNAMIC_PHB_ID) == OPAL_SUCCESS);
+	pci_sim_ioda_reset(&s->phb, true);
+
+	slot = pci_slot_alloc(&s->phb, NULL);
+	assert(slot);
+	slot->ops.get_presence_state = pci_sim_slot_get_presence_state;
+	slot->ops.get_link_state = pci_sim_slot_get_link_state;
+	slot->ops.poll_link = pci_sim_slot_poll_link;
+	slot->ops.freset = pci_sim_slot_freset;
+	slot->ops.creset = pci_sim_slot_creset;
+
+	if (!platform.pci_get_slot_info)
+		platform.pci_get_slot_info = pci_sim_get_slot_info;
+
+	pci_sim_reset_counts(&s->phb);
+	return &s->phb;
+}
+
+struct dt_node *pci_sim_add(struct dt_node *parent, const char *name,
+			    const char *type, uint8_t devfn)
+{
+	struct dt_node *np = dt_new_addr(parent, name, devfn);
+	char compat[64];
+
+	assert(np);
+	snprintf(compat, sizeof(compat), "sim,%s", type);
+	dt_add_property_string(np, "compatible", compat);
+	dt_add_property_cells(np, "reg", devfn);
+
+	return np;
+}
+
+static struct pci_sim_dev *pci_sim_find_node(struct list_head *list,
+					     struct dt_node *np)
+{
+	struct pci_sim_dev *d, *found;
+
+	list_for_each(list, d, link) {
+		if (d->np == np)
+			return d;
+		found = pci_sim_find_node(&d->children, np);
+		if (found)
+			return found;
+	}
+
+	return NULL;
+}
+
+void pci_sim_set_presence(struct phb *phb, struct dt_node *np, bool present)
+{
+	struct pci_sim_dev *d = pci_sim_find_node(&phb_to_sim(phb)->devices, np);
+
+	assert(d && d->hotplug);
+	d->present = present;
+	pci_sim_update_link(d);
+}
+
+uint16_t pci_sim_pe_of(struct phb *phb, uint16_t bdfn)
+{
+	return phb_to_sim(phb)->rte[bdfn];
+}
+
+bool pci_sim_pe_frozen(struct phb *phb, uint16_t pe)
+{
+	return phb_to_sim(phb)->frozen[pe];
+}
+
+uint64_t pci_sim_count(struct phb *phb, enum pci_sim_op op)
+{
+	return phb_to_sim(phb)->ops[op];
+}
+
+void pci_sim_reset_counts(struct phb *phb)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+
+	memset(s->ops, 0, sizeof(s->ops));
+	s->start_tb = mftb();
+	s->start_ns = bench_now_ns();
+}
+
+void pci_sim_report(struct phb *phb, const char *what)
+{
+	struct pci_sim_phb *s = phb_to_sim(phb);
+	uint64_t host_ns = bench_now_ns() - s->start_ns;
+	unsigned int i;
+
+	printf("%s: %lums simulated\n", what,
+	       tb_to_msecs(mftb() - s->start_tb));
+	if (bench_enabled())
+		printf("  host time      %lluus\n",
+		       (unsigned long long)host_ns / 1000);
+	for (i = 0; i < PCI_SIM_OP_MAX; i++)
+		if (s->ops[i])
+			printf("  %-14s %llu\n", pci_sim_op_names[i],
+			       (unsigned long long)s->ops[i]);
+}
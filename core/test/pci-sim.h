@@ -0,0 +1,76 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated PHB for the host tests. Include this before the core PCI
+ * code, so that it runs on the simulated timebase, and pci-sim.c after
+ * it. See pci-sim.c for the topology description.
+ */
+
+#ifndef __PCI_SIM_H
+#define __PCI_SIM_H
+
+#define __TEST__
+#include <skiboot.h>
+
+/* Simulated time, moved forward by waits and config accesses */
+#define mftb()	(sim_tb)
+static unsigned long sim_tb = 1;
+unsigned long tb_hz = 512000000;
+
+struct phb;
+struct dt_node;
+
+/* Operations counted by the simulated PHB */
+enum pci_sim_op {
+	PCI_SIM_CFG_READ,
+	PCI_SIM_CFG_WRITE,
+	PCI_SIM_CFG_UR,			/* Nothing at that address */
+	PCI_SIM_CFG_CRS,		/* Device not ready yet */
+	PCI_SIM_CFG_FROZEN,		/* Blocked by a frozen PE */
+	PCI_SIM_FREEZE,
+	PCI_SIM_FREEZE_STATUS,
+	PCI_SIM_FREEZE_CLEAR,
+	PCI_SIM_FREEZE_SET,
+	PCI_SIM_ERR_INJECT,
+	PCI_SIM_NEXT_ERROR,
+	PCI_SIM_PEEV_READ,		/* PE error vector words read */
+	PCI_SIM_SET_PE,
+	PCI_SIM_RTE_WRITE,		/* RTT entries updated */
+	PCI_SIM_SET_PELTV,
+	PCI_SIM_IODA_RESET,
+	PCI_SIM_DEVICE_INIT,
+	PCI_SIM_CRESET,
+	PCI_SIM_TCE_KILL,		/* TCE kills, of any type */
+	PCI_SIM_TCE_KILL_PE,
+	PCI_SIM_OP_MAX
+};
+
+extern struct phb *pci_sim_create(struct dt_node *np);
+extern struct dt_node *pci_sim_add(struct dt_node *parent, const char *name,
+				   const char *type, uint8_t devfn);
+extern void pci_sim_set_presence(struct phb *phb, struct dt_node *np,
+				 bool present);
+extern uint16_t pci_sim_pe_of(struct phb *phb, uint16_t bdfn);
+extern bool pci_sim_pe_frozen(struct phb *phb, uint16_t pe);
+extern uint64_t pci_sim_count(struct phb *phb, enum pci_sim_op op);
+extern void pci_sim_reset_counts(struct phb *phb);
+extern void pci_sim_report(struct phb *phb, const char *what);
+
+extern void time_wait(unsigned long duration);
+extern void time_wait_ms(unsigned long ms);
+
+#endif /* __PCI_SIM_H */
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 
 static void *zalloc(size_t size)
 {
@@ -25,9 +26,209 @@ static void *zalloc(size_t size)
 
 #include "../buddy.c"
 #include "../bitmap.c"
+#include "../../test/bench.h"
 
 #define BUDDY_ORDER	8
 
+/* The index has exactly the elements with something free in them */
+static void check_index(struct buddy *b)
+{
+	unsigned int bits[BUDDY_INDEX_LEVELS], l, i;
+	bitmap_elem_t *below = b->map, e;
+
+	assert(buddy_index_sizes(b->max_order, bits) == b->index_levels);
+	for (l = 0; l < b->index_levels; l++) {
+		for (i = 0; i < bits[l]; i++) {
+			e = l ? below[i] : ~below[i];
+			assert(bitmap_tst_bit(b->index[l], i) == !!e);
+		}
+		below = b->index[l];
+	}
+}
+
+/* And finds the same free node as a scan of the order would */
+static void check_find(struct buddy *b)
+{
+	unsigned int o, start, count;
+
+	for (o = 0; o <= b->max_order; o++) {
+		start = buddy_order_start(b, o);
+		count = 1u << (b->max_order - o);
+		assert(buddy_find_free(b, start, count) ==
+		       bitmap_find_zero_bit(b->map, start, count));
+	}
+}
+
+static void check_all_free(struct buddy *b)
+{
+	unsigned int i;
+
+	for (i = 2; i < buddy_map_size(b); i++)
+		assert(bitmap_tst_bit(b->map, i));
+	assert(!bitmap_tst_bit(b->map, 1));
+	check_index(b);
+}
+
+/* Random allocations and frees, checking everything as we go */
+#define RANDOM_ORDER	12
+#define RANDOM_ROUNDS	20000
+
+static void random_test(void)
+{
+	static int idx[RANDOM_ROUNDS];
+	static unsigned char ord[RANDOM_ROUNDS];
+	struct buddy *b = buddy_create(RANDOM_ORDER);
+	unsigned int i, n = 0;
+
+	assert(b);
+	for (i = 0; i < RANDOM_ROUNDS; i++) {
+		if (n && (rand() & 1)) {
+			unsigned int j = rand() % n;
+
+			buddy_free(b, idx[j], ord[j]);
+			idx[j] = idx[--n];
+			ord[j] = ord[n];
+		} else {
+			ord[n] = rand() % 6;
+			idx[n] = buddy_alloc(b, ord[n]);
+			if (idx[n] >= 0)
+				n++;
+		}
+		if (!(i % 64)) {
+			check_index(b);
+			check_find(b);
+		}
+	}
+	while (n--)
+		buddy_free(b, idx[n], ord[n]);
+	check_all_free(b);
+	buddy_destroy(b);
+}
+
+/*
+ * Threads allocating and freeing under one lock, the way xive uses
+ * its VP buddy, each owning what it got until it frees it.
+ */
+#define STRESS_ORDER	14
+#define STRESS_THREADS	8
+#define STRESS_ROUNDS	20000
+#define STRESS_HELD	32
+
+static struct buddy *stress_buddy;
+static pthread_mutex_t stress_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char stress_owner[1u << STRESS_ORDER];
+
+static void stress_claim(int index, unsigned int order, unsigned char who)
+{
+	unsigned int i;
+
+	for (i = 0; i < (1u << order); i++) {
+		unsigned char old;
+
+		old = __atomic_exchange_n(&stress_owner[index + i], who,
+					  __ATOMIC_RELAXED);
+		assert(who ? !old : old);
+	}
+}
+
+static void *stress_thread(void *arg)
+{
+	unsigned char who = (unsigned long)arg;
+	unsigned int seed = who, i, n = 0;
+	int idx[STRESS_HELD];
+	unsigned char ord[STRESS_HELD];
+
+	for (i = 0; i < STRESS_ROUNDS; i++) {
+		if (n == STRESS_HELD || (n && (rand_r(&seed) & 1))) {
+			n--;
+			stress_claim(idx[n], ord[n], 0);
+			pthread_mutex_lock(&stress_lock);
+			buddy_free(stress_buddy, idx[n], ord[n]);
+			pthread_mutex_unlock(&stress_lock);
+			continue;
+		}
+		ord[n] = rand_r(&seed) % 5;
+		pthread_mutex_lock(&stress_lock);
+		idx[n] = buddy_alloc(stress_buddy, ord[n]);
+		pthread_mutex_unlock(&stress_lock);
+		if (idx[n] < 0)
+			continue;
+		stress_claim(idx[n], ord[n], who);
+		n++;
+	}
+	while (n--) {
+		stress_claim(idx[n], ord[n], 0);
+		pthread_mutex_lock(&stress_lock);
+		buddy_free(stress_buddy, idx[n], ord[n]);
+		pthread_mutex_unlock(&stress_lock);
+	}
+
+	return NULL;
+}
+
+static void stress_test(void)
+{
+	pthread_t threads[STRESS_THREADS];
+	unsigned long i;
+
+	stress_buddy = buddy_create(STRESS_ORDER);
+	assert(stress_buddy);
+	for (i = 0; i < STRESS_THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, stress_thread,
+				       (void *)(i + 1)));
+	for (i = 0; i < STRESS_THREADS; i++)
+		assert(!pthread_join(threads[i], NULL));
+	check_all_free(stress_buddy);
+	buddy_destroy(stress_buddy);
+}
+
+/*
+ * Alloc/free pairs on a mostly full buddy of the size xive uses for
+ * VPs. With SKIBOOT_BENCH set they are repeated and timed against what
+ * just finding the free node with a scan costs.
+ */
+#define BENCH_ORDER	19
+#define BENCH_LOOPS	20000
+
+static void check_nearly_full(void)
+{
+	struct buddy *b = buddy_create(BENCH_ORDER);
+	unsigned int i, loops, start, count;
+	uint64_t t0, alloc, scan;
+	int idx = -1;
+
+	assert(b);
+
+	/* Take it all in small pieces and give back the last one */
+	for (i = 0; i < (1u << BENCH_ORDER); i += 2)
+		idx = buddy_alloc(b, 1);
+	assert(idx >= 0 && buddy_alloc(b, 1) < 0);
+	buddy_free(b, idx, 1);
+
+	loops = bench_enabled() ? BENCH_LOOPS : 1;
+	t0 = bench_now_ns();
+	for (i = 0; i < loops; i++) {
+		idx = buddy_alloc(b, 1);
+		assert(idx >= 0);
+		buddy_free(b, idx, 1);
+	}
+	alloc = bench_now_ns() - t0;
+
+	start = buddy_order_start(b, 1);
+	count = 1u << (BENCH_ORDER - 1);
+	t0 = bench_now_ns();
+	for (i = 0; i < loops; i++)
+		assert(bitmap_find_zero_bit(b->map, start, count) >= 0);
+	scan = bench_now_ns() - t0;
+
+	if (bench_enabled())
+		printf("buddy: order %d, %llu ns per alloc+free, "
+		       "%llu ns per scan of an order\n", BENCH_ORDER,
+		       (unsigned long long)alloc / loops,
+		       (unsigned long long)scan / loops);
+	buddy_destroy(b);
+}
+
 int main(void)
 {
 	struct buddy *b;
@@ -77,7 +278,21 @@ int main(void)
 	for (i = 2; i < buddy_map_size(b); i++)
 		assert(bitmap_tst_bit(b->map, i));
 	assert(!bitmap_tst_bit(b->map, 1));
+	check_index(b);
 
 	buddy_destroy(b);
+
+	/* Smallest and largest */
+	b = buddy_create(0);
+	assert(b && buddy_alloc(b, 0) == 0 && buddy_alloc(b, 0) < 0);
+	buddy_free(b, 0, 0);
+	check_all_free(b);
+	buddy_destroy(b);
+
+	srand(0xb0dd1);
+	random_test();
+	stress_test();
+	check_nearly_full();
+
 	return 0;
 }
@@ -15,14 +15,99 @@
  */
 
 #include <stdlib.h>
+#include <stdarg.h>
+
+/* Keep the lookup loops from drowning in debug output */
+#define _prlog(...) test_prlog(__VA_ARGS__)
+void test_prlog(int log_level, const char *fmt, ...);
+
+#define zalloc(bytes) calloc((bytes), 1)
 
 #include "../nvram-format.c"
+#include "../../test/bench.h"
+
+static bool quiet;
+
+void test_prlog(int log_level __unused, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (quiet)
+		return;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
 
 bool nvram_validate(void)
 {
 	return true;
 }
 
+static int write_backs;
+
+int nvram_write_back(const void *start, uint32_t len)
+{
+	assert(start == skiboot_part_hdr);
+	assert(len == NVRAM_SIZE_FW_PRIV);
+	write_backs++;
+	return 0;
+}
+
+#define BENCH_KEYS	128
+#define BENCH_LOOKUPS	100000
+
+/*
+ * Look keys up through the index and by scanning the partition. With
+ * SKIBOOT_BENCH set, repeat and time both and the index rebuild.
+ */
+static void check_query(char *data)
+{
+	char key[32];
+	uint64_t start, indexed, scanned, rebuild;
+	unsigned int i, lookups;
+	char *p = data;
+
+	for (i = 0; i < BENCH_KEYS; i++)
+		p += sprintf(p, "bench-key-%u=%u", i, i) + 1;
+	assert(p < data + NVRAM_SIZE_FW_PRIV - sizeof(struct chrp_nvram_hdr));
+	nvram_index_invalidate();
+
+	lookups = bench_enabled() ? BENCH_LOOKUPS : BENCH_KEYS;
+	quiet = true;
+
+	start = bench_now_ns();
+	for (i = 0; i < lookups; i++) {
+		snprintf(key, sizeof(key), "bench-key-%u", i % BENCH_KEYS);
+		assert(nvram_query_int(key, -1) == i % BENCH_KEYS);
+	}
+	indexed = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (i = 0; i < lookups; i++) {
+		snprintf(key, sizeof(key), "bench-key-%u", i % BENCH_KEYS);
+		assert(nvram_scan(key, strlen(key)));
+	}
+	scanned = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (i = 0; i < lookups / BENCH_KEYS; i++)
+		nvram_index_build();
+	rebuild = bench_now_ns() - start;
+
+	quiet = false;
+
+	if (!bench_enabled())
+		return;
+
+	printf("nvram: %u keys, indexed lookup %llu ns, scan %llu ns, "
+	       "index rebuild %llu ns\n", BENCH_KEYS,
+	       (unsigned long long)indexed / lookups,
+	       (unsigned long long)scanned / lookups,
+	       (unsigned long long)rebuild / (lookups / BENCH_KEYS));
+}
+
 static char *nvram_reset(void *nvram_image, int size)
 {
 	struct chrp_nvram_hdr *h = nvram_image;
@@ -162,6 +247,93 @@ int main(void)
 	assert(result);
 	assert(strcmp(result, "test") == 0);
 
+	/* duplicates resolve to the first one, malformed keys are skipped */
+	data = nvram_reset(nvram_image, 128*1024);
+#define TEST_2 "dup=first\0noeq\0=empty\0dup=second\0a=b=c\0"
+	memcpy(data, TEST_2, sizeof(TEST_2));
+	assert(strcmp(nvram_query("dup"), "first") == 0);
+	assert(nvram_query("noeq") == NULL);
+	assert(strcmp(nvram_query("a"), "b=c") == 0);
+	assert(strcmp(nvram_query("a=b"), "c") == 0);
+
+	/* re-checking the image drops the index */
+	memcpy(data, "dup=third", sizeof("dup=third"));
+	assert(nvram_check(nvram_image, 128*1024) == 0);
+	assert(strcmp(nvram_query("dup"), "third") == 0);
+
+	/* typed getters */
+	data = nvram_reset(nvram_image, 128*1024);
+#define TEST_3 "t=true\0f=off\0n=0x10\0m=-3\0bad=12a\0junk=maybe\0"
+	memcpy(data, TEST_3, sizeof(TEST_3));
+	assert(nvram_query_bool("t", false) == true);
+	assert(nvram_query_bool("f", true) == false);
+	assert(nvram_query_bool("junk", true) == true);
+	assert(nvram_query_bool("missing", false) == false);
+	assert(nvram_query_int("n", 0) == 16);
+	assert(nvram_query_int("m", 0) == -3);
+	assert(nvram_query_int("bad", 42) == 42);
+	assert(nvram_query_int("missing", 7) == 7);
+
+	/* batched updates */
+	data = nvram_reset(nvram_image, 128*1024);
+#define TEST_4 "keep=1\0change=old\0drop=me\0"
+	memcpy(data, TEST_4, sizeof(TEST_4));
+	{
+		struct nvram_update updates[] = {
+			{ "change", "new" },
+			{ "drop", NULL },
+			{ "add", "yes" },
+		};
+
+		assert(nvram_update(updates, ARRAY_SIZE(updates)) == 0);
+	}
+	assert(write_backs == 1);
+#define TEST_4_RESULT "keep=1\0change=new\0add=yes\0"
+	assert(memcmp(data, TEST_4_RESULT, sizeof(TEST_4_RESULT)) == 0);
+	assert(nvram_check(nvram_image, 128*1024) == 0);
+	assert(strcmp(nvram_query("change"), "new") == 0);
+	assert(nvram_query("drop") == NULL);
+	assert(nvram_query_bool("add", false));
+
+	/* an update that doesn't fit leaves the partition alone */
+	{
+		char *big = malloc(NVRAM_SIZE_FW_PRIV);
+		struct nvram_update update = { "big", big };
+
+		memset(big, 'x', NVRAM_SIZE_FW_PRIV - 1);
+		big[NVRAM_SIZE_FW_PRIV - 1] = 0;
+		assert(nvram_update(&update, 1) != 0);
+		assert(write_backs == 1);
+		assert(memcmp(data, TEST_4_RESULT,
+			      sizeof(TEST_4_RESULT)) == 0);
+		free(big);
+	}
+
+	/* the same key more than once, the last update wins */
+	data = nvram_reset(nvram_image, 128*1024);
+#define TEST_5 "keep=1\0twice=old\0"
+	memcpy(data, TEST_5, sizeof(TEST_5));
+	{
+		struct nvram_update updates[] = {
+			{ "twice", "first" },
+			{ "gone", "first" },
+			{ "twice", "second" },
+			{ "gone", NULL },
+			{ "back", NULL },
+			{ "back", "again" },
+		};
+
+		assert(nvram_update(updates, ARRAY_SIZE(updates)) == 0);
+	}
+	assert(write_backs == 2);
+#define TEST_5_RESULT "keep=1\0twice=second\0back=again\0"
+	assert(memcmp(data, TEST_5_RESULT, sizeof(TEST_5_RESULT)) == 0);
+	assert(strcmp(nvram_query("twice"), "second") == 0);
+	assert(nvram_query("gone") == NULL);
+
+	data = nvram_reset(nvram_image, 128*1024);
+	check_query(data);
+
 	free(nvram_image);
 
 	return 0;
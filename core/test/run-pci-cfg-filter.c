@@ -0,0 +1,179 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+#include "../pci-virt.c"
+#include "../pci-cfg-filter.c"
+#include "../../test/bench.h"
+
+#define NR_DEVS		6	/* Like the links of an NPU2 */
+#define NR_FILTERS	48	/* Filters per device */
+#define NR_ACCESSES	(1 << 20)
+
+static struct phb phb;
+static struct pci_device pd;
+static uint64_t filter_calls;
+
+static int64_t test_filter(void *dev __unused,
+			   struct pci_cfg_reg_filter *pcrf __unused,
+			   uint32_t offset __unused, uint32_t len __unused,
+			   uint32_t *data __unused, bool write __unused)
+{
+	filter_calls++;
+	return OPAL_PARTIAL;
+}
+
+/* The list walks lookups used to do */
+static struct pci_cfg_reg_filter *ref_find(struct list_head *filters,
+					   uint32_t start, uint32_t len,
+					   bool contain)
+{
+	struct pci_cfg_reg_filter *pcrf;
+
+	list_for_each(filters, pcrf, link) {
+		if (contain && start >= pcrf->start &&
+		    start + len <= pcrf->start + pcrf->len)
+			return pcrf;
+		if (!contain && start < pcrf->start + pcrf->len &&
+		    start + len > pcrf->start)
+			return pcrf;
+	}
+
+	return NULL;
+}
+
+static void check_all(struct pci_cfg_filter_map *map,
+		      struct list_head *filters, bool contain)
+{
+	uint32_t offset, len;
+
+	for (len = 1; len <= 4; len <<= 1)
+		for (offset = 0; offset < 0x1000; offset += len)
+			assert(pci_cfg_filter_find(map, filters, offset, len,
+						   contain) ==
+			       ref_find(filters, offset, len, contain));
+}
+
+/* Filters of a pci_device may overlap, the first one added wins */
+static void test_overlaps(void)
+{
+	static struct pci_cfg_reg_filter f[5] = {
+		{ .start = 0x40, .len = 2 },
+		{ .start = 0x40, .len = 4 },
+		{ .start = 0x100, .len = 0x20 },
+		{ .start = 0x104, .len = 4 },
+		{ .start = 0x1f2, .len = 1 },
+	};
+	uint32_t i;
+
+	list_head_init(&pd.pcrf);
+	for (i = 0; i < ARRAY_SIZE(f); i++) {
+		assert(pci_cfg_filter_map_add(&pd.pcrf_map, &f[i]));
+		list_add_tail(&pd.pcrf, &f[i].link);
+	}
+	check_all(&pd.pcrf_map, &pd.pcrf, true);
+	check_all(&pd.pcrf_map, &pd.pcrf, false);
+
+	/* Ranges across words */
+	assert(pci_cfg_filter_find(&pd.pcrf_map, &pd.pcrf, 0x100, 8,
+				   true) == &f[2]);
+	assert(!pci_cfg_filter_find(&pd.pcrf_map, &pd.pcrf, 0x11c, 8, true));
+	pci_cfg_filter_map_free(&pd.pcrf_map);
+}
+
+int main(void)
+{
+	static const uint32_t sizes[] = { 1, 2, 4, 8 };
+	struct pci_virt_device *pvd[NR_DEVS];
+	struct pci_cfg_reg_filter *pcrf;
+	uint64_t start, ref_ns, map_ns, read_ns;
+	uint32_t i, j, offset, data, accesses;
+	uintptr_t sum = 0;
+
+	test_overlaps();
+
+	/* Devices with the filters spread over the config space */
+	list_head_init(&phb.virt_devices);
+	for (i = 0; i < NR_DEVS; i++) {
+		pvd[i] = pci_virt_add_device(&phb, i << 3, 0x1000, NULL);
+		assert(pvd[i]);
+		for (j = 0; j < NR_FILTERS; j++) {
+			offset = 0x10 + j * 0x50;
+			pcrf = pci_virt_add_filter(pvd[i], offset,
+						   sizes[j % 4],
+						   PCI_REG_FLAG_READ |
+						   PCI_REG_FLAG_WRITE,
+						   test_filter, NULL);
+			assert(pcrf);
+		}
+		check_all(&pvd[i]->pcrf_map, &pvd[i]->pcrf, false);
+	}
+
+	/* Overlapping filters are refused */
+	assert(!pci_virt_add_filter(pvd[0], 0x0e, 4, PCI_REG_FLAG_READ,
+				    test_filter, NULL));
+
+	/*
+	 * Lookups, the way they were done and the way they are now. A
+	 * plain run goes over the config space once per device, with
+	 * SKIBOOT_BENCH set it's repeated and timed.
+	 */
+	accesses = bench_enabled() ? NR_ACCESSES : 0x1000 / 4 * NR_DEVS;
+	start = bench_now_ns();
+	for (i = 0; i < accesses; i++) {
+		offset = (i * 4) & 0xffc;
+		sum += (uintptr_t)ref_find(&pvd[i % NR_DEVS]->pcrf, offset, 4,
+					   false);
+	}
+	ref_ns = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (i = 0; i < accesses; i++) {
+		offset = (i * 4) & 0xffc;
+		sum -= (uintptr_t)pci_virt_find_filter(pvd[i % NR_DEVS],
+						       offset, 4);
+	}
+	map_ns = bench_now_ns() - start;
+	assert(sum == 0);
+
+	/* And whole config reads through the pci_virt accessor */
+	start = bench_now_ns();
+	for (i = 0; i < accesses; i++) {
+		offset = (i * 4) & 0xffc;
+		assert(pci_virt_cfg_read(&phb, (i % NR_DEVS) << 3, offset, 4,
+					 &data) == OPAL_SUCCESS);
+	}
+	read_ns = bench_now_ns() - start;
+	assert(filter_calls);
+
+	if (!bench_enabled())
+		return 0;
+
+	printf("%d filters per device, lookup: list %llu ns, table %llu ns, "
+	       "config read %llu ns\n", NR_FILTERS,
+	       (unsigned long long)ref_ns / accesses,
+	       (unsigned long long)map_ns / accesses,
+	       (unsigned long long)read_ns / accesses);
+
+	return 0;
+}
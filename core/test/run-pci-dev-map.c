@@ -0,0 +1,342 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+/* Keep the scan from drowning the output in debug messages */
+#define _prlog(...) test_prlog(__VA_ARGS__)
+void test_prlog(int log_level, const char *fmt, ...);
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* skiboot.h's ilog2() is POWER assembly */
+#define ilog2(val) (63 - __builtin_clzl(val))
+
+/* The bridge delays don't matter here, they just pass */
+#define mftb()	(fake_tb)
+static unsigned long fake_tb;
+unsigned long tb_hz = 512000000;
+
+/* Override this for device.c */
+#define is_rodata(p) false
+
+#include "../device.c"
+#include "../pci.c"
+#include "../pci-virt.c"
+#include "../pci-cfg-filter.c"
+#include "../bitmap.c"
+#include "../../test/bench.h"
+
+void test_prlog(int log_level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (log_level > PR_NOTICE)
+		return;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+struct platform platform;
+
+bool fsp_present(void)
+{
+	return false;
+}
+
+void time_wait(unsigned long duration)
+{
+	fake_tb += duration;
+}
+
+void time_wait_ms(unsigned long ms)
+{
+	fake_tb += msecs_to_tb(ms);
+}
+
+void pci_handle_quirk(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+void pci_init_iov_cap(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+/* Only used by pci_init_slots() and device-tree generation */
+struct cpu_job * __noreturn __cpu_queue_job(struct cpu_thread *cpu __unused,
+					    const char *name __unused,
+					    void (*func)(void *data) __unused,
+					    void *data __unused,
+					    bool no_return __unused)
+{
+	abort();
+}
+
+void __noreturn cpu_wait_job(struct cpu_job *job __unused,
+			     bool free_it __unused)
+{
+	abort();
+}
+
+void __noreturn cpu_process_local_jobs(void)
+{
+	abort();
+}
+
+void __noreturn check_timers(bool from_interrupt __unused)
+{
+	abort();
+}
+
+void __noreturn pci_slot_add_dt_properties(struct pci_slot *slot __unused,
+					   struct dt_node *np __unused)
+{
+	abort();
+}
+
+static int64_t virt_cfg_read8(struct phb *phb, uint32_t bdfn,
+			      uint32_t offset, uint8_t *data)
+{
+	uint32_t v;
+	int64_t rc = pci_virt_cfg_read(phb, bdfn, offset, 1, &v);
+
+	*data = v;
+	return rc;
+}
+
+static int64_t virt_cfg_read16(struct phb *phb, uint32_t bdfn,
+			       uint32_t offset, uint16_t *data)
+{
+	uint32_t v;
+	int64_t rc = pci_virt_cfg_read(phb, bdfn, offset, 2, &v);
+
+	*data = v;
+	return rc;
+}
+
+static int64_t virt_cfg_read32(struct phb *phb, uint32_t bdfn,
+			       uint32_t offset, uint32_t *data)
+{
+	return pci_virt_cfg_read(phb, bdfn, offset, 4, data);
+}
+
+static int64_t virt_cfg_write8(struct phb *phb, uint32_t bdfn,
+			       uint32_t offset, uint8_t data)
+{
+	return pci_virt_cfg_write(phb, bdfn, offset, 1, data);
+}
+
+static int64_t virt_cfg_write16(struct phb *phb, uint32_t bdfn,
+				uint32_t offset, uint16_t data)
+{
+	return pci_virt_cfg_write(phb, bdfn, offset, 2, data);
+}
+
+static int64_t virt_cfg_write32(struct phb *phb, uint32_t bdfn,
+				uint32_t offset, uint32_t data)
+{
+	return pci_virt_cfg_write(phb, bdfn, offset, 4, data);
+}
+
+static uint8_t virt_choose_bus(struct phb *phb __unused,
+			       struct pci_device *bridge __unused,
+			       uint8_t candidate, uint8_t *max_bus __unused,
+			       bool *use_max)
+{
+	*use_max = false;
+	return candidate;
+}
+
+static const struct phb_ops virt_phb_ops = {
+	.cfg_read8	= virt_cfg_read8,
+	.cfg_read16	= virt_cfg_read16,
+	.cfg_read32	= virt_cfg_read32,
+	.cfg_write8	= virt_cfg_write8,
+	.cfg_write16	= virt_cfg_write16,
+	.cfg_write32	= virt_cfg_write32,
+	.choose_bus	= virt_choose_bus,
+};
+
+static unsigned int nr_devices;
+
+static void add_virt_device(struct phb *phb, uint16_t bdfn, bool bridge)
+{
+	struct pci_virt_device *pvd;
+
+	pvd = pci_virt_add_device(phb, bdfn, 0x100, NULL);
+	assert(pvd);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_VENDOR_ID, 4,
+			     bridge ? 0x12341014 : 0x56781014);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_HDR_TYPE, 1, bridge ? 1 : 0);
+	nr_devices++;
+}
+
+/*
+ * Populate bus @bus with @fanout bridges followed by @endpoints
+ * endpoints, then recurse below the bridges. Bus numbers are handed
+ * out depth first, the way pci_scan_bus() assigns them with our
+ * choose_bus(), so the virtual devices sit where the scan looks.
+ */
+static uint8_t build_tree(struct phb *phb, uint8_t bus, unsigned int depth,
+			  unsigned int fanout, unsigned int endpoints)
+{
+	uint8_t next = bus + 1;
+	unsigned int dev;
+
+	if (!depth)
+		fanout = 0;
+	for (dev = 0; dev < fanout + endpoints; dev++)
+		add_virt_device(phb, (bus << 8) | (dev << 3), dev < fanout);
+	for (dev = 0; dev < fanout; dev++)
+		next = build_tree(phb, next, depth - 1, fanout, endpoints);
+
+	return next;
+}
+
+static struct phb *new_virt_phb(const char *name)
+{
+	struct phb *phb = zalloc(sizeof(*phb));
+
+	assert(phb);
+	phb->dt_node = dt_new(dt_root, name);
+	phb->ops = &virt_phb_ops;
+	phb->scan_map = 0xffffffff;
+	list_head_init(&phb->virt_devices);
+	assert(pci_register_phb(phb, OPAL_DYNAMIC_PHB_ID) == OPAL_SUCCESS);
+
+	return phb;
+}
+
+/* The hierarchy walk pci_find_dev() used to do */
+static int match_bdfn(struct phb *phb __unused, struct pci_device *pd,
+		      void *data)
+{
+	return pd->bdfn == *(uint16_t *)data;
+}
+
+static struct pci_device *walk_find_dev(struct phb *phb, uint16_t bdfn)
+{
+	return pci_walk_dev(phb, NULL, match_bdfn, &bdfn);
+}
+
+static unsigned int check_map(struct phb *phb)
+{
+	struct pci_device *pd;
+	unsigned int bdfn, found = 0;
+
+	for (bdfn = 0; bdfn < 0x10000; bdfn++) {
+		pd = pci_find_dev(phb, bdfn);
+		assert(pd == walk_find_dev(phb, bdfn));
+		if (pd) {
+			assert(pd->bdfn == bdfn);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+#define BENCH_LOOPS	20
+
+static void bench_lookup(struct phb *phb, const char *what)
+{
+	struct pci_device *pd;
+	static uint16_t bdfns[512];
+	unsigned int i, j, n = 0;
+	uint64_t start, walk, map;
+
+	for (i = 0; i < 0x10000 && n < ARRAY_SIZE(bdfns); i++)
+		if (pci_find_dev(phb, i))
+			bdfns[n++] = i;
+
+	start = bench_now_ns();
+	for (j = 0; j < BENCH_LOOPS; j++)
+		for (i = 0; i < n; i++) {
+			pd = walk_find_dev(phb, bdfns[i]);
+			assert(pd);
+		}
+	walk = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (j = 0; j < BENCH_LOOPS; j++)
+		for (i = 0; i < n; i++) {
+			pd = pci_find_dev(phb, bdfns[i]);
+			assert(pd);
+		}
+	map = bench_now_ns() - start;
+
+	printf("%s: %u devices, walk %llu ns/lookup, map %llu ns/lookup\n",
+	       what, n, (unsigned long long)walk / (BENCH_LOOPS * n),
+	       (unsigned long long)map / (BENCH_LOOPS * n));
+}
+
+int main(void)
+{
+	struct phb *tree, *chain;
+	struct pci_device *pd;
+	unsigned int before, total;
+	uint8_t sec, sub;
+
+	dt_root = dt_new_root("");
+
+	/* A wide tree: 3 bridges and 2 endpoints per bus, 4 levels deep */
+	tree = new_virt_phb("pciex@0");
+	nr_devices = 0;
+	build_tree(tree, 0, 4, 3, 2);
+	pci_scan_bus(tree, 0, 0xff, &tree->devices, NULL, true);
+	total = check_map(tree);
+	assert(total == nr_devices);
+
+	/* Unplug everything below the second root bridge ... */
+	pd = pci_find_dev(tree, 1 << 3);
+	assert(pd && pd->is_bridge);
+	sec = pd->secondary_bus;
+	sub = pd->subordinate_bus;
+	pci_remove_bus(tree, &pd->children);
+	assert(list_empty(&pd->children));
+	before = check_map(tree);
+	assert(before < total);
+	assert(!pci_find_dev(tree, sec << 8));
+
+	/* ... and plug it back */
+	pci_scan_bus(tree, sec, sub, &pd->children, pd, true);
+	assert(check_map(tree) == total);
+
+	/* A chain of bridges, one endpoint on each bus */
+	chain = new_virt_phb("pciex@1");
+	nr_devices = 0;
+	build_tree(chain, 0, 200, 1, 1);
+	pci_scan_bus(chain, 0, 0xff, &chain->devices, NULL, true);
+	assert(check_map(chain) == nr_devices);
+	assert(pci_find_dev(chain, 200 << 8)->parent->bdfn == 199 << 8);
+
+	if (bench_enabled()) {
+		bench_lookup(tree, "tree");
+		bench_lookup(chain, "chain");
+	}
+
+	/* Tear down a whole PHB */
+	pci_remove_bus(chain, &chain->devices);
+	assert(check_map(chain) == 0);
+
+	return 0;
+}
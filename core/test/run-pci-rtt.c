@@ -0,0 +1,201 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#include "../pci-rtt.c"
+#include "../../test/bench.h"
+
+#define NR_RIDS		0x10000
+#define RESERVED_PE	255
+
+static uint16_t cache[NR_RIDS], rtt[NR_RIDS], ref[NR_RIDS];
+static bool selected[NR_RIDS];
+
+/* What phb3_set_pe() and phb4_set_pe() used to do */
+static uint32_t ref_set_pe(uint16_t *table, uint16_t pe, uint16_t bdfn,
+			   uint8_t bcompare, uint8_t dcompare,
+			   uint8_t fcompare)
+{
+	uint64_t mask = 0, val = 0, idx;
+	uint32_t n = 0;
+
+	if (bcompare != OpalPciBusAny) {
+		mask = ((0x1 << (bcompare + 1)) - 1) << (15 - bcompare);
+		val = bdfn & mask;
+	}
+	if (dcompare != OPAL_IGNORE_RID_DEVICE_NUMBER) {
+		mask |= 0xf8;
+		val |= bdfn & 0xf8;
+	}
+	if (fcompare != OPAL_IGNORE_RID_FUNCTION_NUMBER) {
+		mask |= 0x7;
+		val |= bdfn & 0x7;
+	}
+
+	for (idx = 0; idx < NR_RIDS; idx++) {
+		if ((idx & mask) != val)
+			continue;
+		table[idx] = pe;
+		n++;
+	}
+
+	return n;
+}
+
+static void reset_tables(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_RIDS; i++)
+		cache[i] = rtt[i] = ref[i] = RESERVED_PE;
+}
+
+/* Check every combination of compares against the old code */
+static void check_set_pe(uint16_t bdfn, uint16_t pe)
+{
+	static const uint8_t bcompares[] = {
+		OpalPciBusAny, 1, OpalPciBus3Bits, OpalPciBus4Bits,
+		OpalPciBus5Bits, OpalPciBus6Bits, OpalPciBus7Bits,
+		OpalPciBusAll,
+	};
+	struct pci_rid_set rs;
+	uint32_t b, d, f, i, rid, n, count;
+
+	for (b = 0; b < ARRAY_SIZE(bcompares); b++)
+	for (d = 0; d <= OPAL_COMPARE_RID_DEVICE_NUMBER; d++)
+	for (f = 0; f <= OPAL_COMPARE_RID_FUNCTION_NUMBER; f++) {
+		reset_tables();
+		pci_rid_set_init(&rs, bdfn, bcompares[b], d, f);
+		n = pci_rtt_update(cache, rtt, &rs, pe);
+		assert(n == ref_set_pe(ref, pe, bdfn, bcompares[b], d, f));
+		assert(!memcmp(cache, ref, sizeof(ref)));
+		assert(!memcmp(rtt, ref, sizeof(ref)));
+
+		/* The RIDs to invalidate are exactly those */
+		memset(selected, 0, sizeof(selected));
+		count = 0;
+		for_each_rid_in_set(&rs, i, rid) {
+			assert(rid < NR_RIDS && !selected[rid]);
+			assert(ref[rid] == pe);
+			selected[rid] = true;
+			count++;
+		}
+		assert(count == n);
+	}
+}
+
+/*
+ * An SR-IOV enable as Linux does it: a PE per VF, each mapped by its
+ * exact RID, then everything unmapped again. The VFs follow the PF
+ * on bus 1 and spill onto the next buses. Both ways of updating the
+ * RTT are timed, the times are reported with SKIBOOT_BENCH set.
+ */
+#define NR_VFS	512
+
+static void check_sriov(void)
+{
+	struct pci_rid_set rs;
+	uint64_t start, old, new;
+	uint32_t vf;
+	uint16_t rid;
+
+	reset_tables();
+	start = bench_now_ns();
+	for (vf = 0; vf < NR_VFS; vf++) {
+		rid = 0x100 + 1 + vf;
+		ref_set_pe(ref, vf % RESERVED_PE, rid, OpalPciBusAll,
+			   OPAL_COMPARE_RID_DEVICE_NUMBER,
+			   OPAL_COMPARE_RID_FUNCTION_NUMBER);
+	}
+	for (vf = 0; vf < NR_VFS; vf++) {
+		rid = 0x100 + 1 + vf;
+		ref_set_pe(ref, RESERVED_PE, rid, OpalPciBusAll,
+			   OPAL_COMPARE_RID_DEVICE_NUMBER,
+			   OPAL_COMPARE_RID_FUNCTION_NUMBER);
+	}
+	old = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (vf = 0; vf < NR_VFS; vf++) {
+		rid = 0x100 + 1 + vf;
+		pci_rid_set_init(&rs, rid, OpalPciBusAll,
+				 OPAL_COMPARE_RID_DEVICE_NUMBER,
+				 OPAL_COMPARE_RID_FUNCTION_NUMBER);
+		pci_rtt_update(cache, rtt, &rs, vf % RESERVED_PE);
+	}
+	for (vf = 0; vf < NR_VFS; vf++) {
+		rid = 0x100 + 1 + vf;
+		pci_rid_set_init(&rs, rid, OpalPciBusAll,
+				 OPAL_COMPARE_RID_DEVICE_NUMBER,
+				 OPAL_COMPARE_RID_FUNCTION_NUMBER);
+		pci_rtt_update(cache, rtt, &rs, RESERVED_PE);
+	}
+	new = bench_now_ns() - start;
+
+	assert(!memcmp(cache, ref, sizeof(ref)));
+	if (bench_enabled())
+		printf("%d VFs mapped and unmapped: scan %llu us, "
+		       "ranges %llu us\n", NR_VFS, (unsigned long long)old / 1000,
+		       (unsigned long long)new / 1000);
+}
+
+/* A PE per bus, the way PEs are usually set up for bridges */
+static void check_buses(void)
+{
+	struct pci_rid_set rs;
+	uint64_t start, old, new;
+	uint32_t bus;
+
+	reset_tables();
+	start = bench_now_ns();
+	for (bus = 0; bus < 256; bus++)
+		ref_set_pe(ref, bus % RESERVED_PE, bus << 8, OpalPciBusAll,
+			   OPAL_IGNORE_RID_DEVICE_NUMBER,
+			   OPAL_IGNORE_RID_FUNCTION_NUMBER);
+	old = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (bus = 0; bus < 256; bus++) {
+		pci_rid_set_init(&rs, bus << 8, OpalPciBusAll,
+				 OPAL_IGNORE_RID_DEVICE_NUMBER,
+				 OPAL_IGNORE_RID_FUNCTION_NUMBER);
+		pci_rtt_update(cache, rtt, &rs, bus % RESERVED_PE);
+	}
+	new = bench_now_ns() - start;
+
+	assert(!memcmp(cache, ref, sizeof(ref)));
+	if (bench_enabled())
+		printf("256 buses mapped: scan %llu us, ranges %llu us\n",
+		       (unsigned long long)old / 1000,
+		       (unsigned long long)new / 1000);
+}
+
+int main(void)
+{
+	check_set_pe(0x0000, 1);
+	check_set_pe(0x0108, 2);
+	check_set_pe(0x5a3d, 3);
+	check_set_pe(0xffff, 254);
+
+	check_sriov();
+	check_buses();
+
+	return 0;
+}
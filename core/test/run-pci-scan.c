@@ -0,0 +1,381 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+/* Keep the scan from drowning the output in debug messages */
+#define _prlog(...) test_prlog(__VA_ARGS__)
+void test_prlog(int log_level, const char *fmt, ...);
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* skiboot.h's ilog2() is POWER assembly */
+#define ilog2(val) (63 - __builtin_clzl(val))
+
+/* Simulated time, only moved forward by the waits in the scan */
+#define mftb()	(fake_tb)
+static unsigned long fake_tb;
+unsigned long tb_hz = 512000000;
+
+/* Override this for device.c */
+#define is_rodata(p) false
+
+#include "../device.c"
+#include "../pci.c"
+#include "../pci-virt.c"
+#include "../pci-cfg-filter.c"
+#include "../bitmap.c"
+
+void test_prlog(int log_level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (log_level > PR_NOTICE)
+		return;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+struct platform platform;
+
+bool fsp_present(void)
+{
+	return false;
+}
+
+void time_wait(unsigned long duration)
+{
+	fake_tb += duration;
+}
+
+void time_wait_ms(unsigned long ms)
+{
+	fake_tb += msecs_to_tb(ms);
+}
+
+void pci_handle_quirk(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+void pci_init_iov_cap(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+/* Only used by pci_init_slots() and device-tree generation */
+struct cpu_job * __noreturn __cpu_queue_job(struct cpu_thread *cpu __unused,
+					    const char *name __unused,
+					    void (*func)(void *data) __unused,
+					    void *data __unused,
+					    bool no_return __unused)
+{
+	abort();
+}
+
+void __noreturn cpu_wait_job(struct cpu_job *job __unused,
+			     bool free_it __unused)
+{
+	abort();
+}
+
+void __noreturn cpu_process_local_jobs(void)
+{
+	abort();
+}
+
+void __noreturn check_timers(bool from_interrupt __unused)
+{
+	abort();
+}
+
+void __noreturn pci_slot_add_dt_properties(struct pci_slot *slot __unused,
+					   struct dt_node *np __unused)
+{
+	abort();
+}
+
+static int64_t virt_cfg_read8(struct phb *phb, uint32_t bdfn,
+			      uint32_t offset, uint8_t *data)
+{
+	uint32_t v;
+	int64_t rc = pci_virt_cfg_read(phb, bdfn, offset, 1, &v);
+
+	*data = v;
+	return rc;
+}
+
+static int64_t virt_cfg_read16(struct phb *phb, uint32_t bdfn,
+			       uint32_t offset, uint16_t *data)
+{
+	uint32_t v;
+	int64_t rc = pci_virt_cfg_read(phb, bdfn, offset, 2, &v);
+
+	*data = v;
+	return rc;
+}
+
+static int64_t virt_cfg_read32(struct phb *phb, uint32_t bdfn,
+			       uint32_t offset, uint32_t *data)
+{
+	return pci_virt_cfg_read(phb, bdfn, offset, 4, data);
+}
+
+static int64_t virt_cfg_write8(struct phb *phb, uint32_t bdfn,
+			       uint32_t offset, uint8_t data)
+{
+	return pci_virt_cfg_write(phb, bdfn, offset, 1, data);
+}
+
+static int64_t virt_cfg_write16(struct phb *phb, uint32_t bdfn,
+				uint32_t offset, uint16_t data)
+{
+	return pci_virt_cfg_write(phb, bdfn, offset, 2, data);
+}
+
+static int64_t virt_cfg_write32(struct phb *phb, uint32_t bdfn,
+				uint32_t offset, uint32_t data)
+{
+	return pci_virt_cfg_write(phb, bdfn, offset, 4, data);
+}
+
+static uint8_t virt_choose_bus(struct phb *phb __unused,
+			       struct pci_device *bridge __unused,
+			       uint8_t candidate, uint8_t *max_bus __unused,
+			       bool *use_max)
+{
+	*use_max = false;
+	return candidate;
+}
+
+static const struct phb_ops virt_phb_ops = {
+	.cfg_read8	= virt_cfg_read8,
+	.cfg_read16	= virt_cfg_read16,
+	.cfg_read32	= virt_cfg_read32,
+	.cfg_write8	= virt_cfg_write8,
+	.cfg_write16	= virt_cfg_write16,
+	.cfg_write32	= virt_cfg_write32,
+	.choose_bus	= virt_choose_bus,
+};
+
+/*
+ * A root port, a switch upstream port and NR_PORTS downstream ports
+ * with an endpoint behind each. The downstream ports come out of
+ * reset with their link down; it trains LINK_MS after the secondary
+ * reset is lifted and the endpoint then answers config reads with CRS
+ * for another CRS_MS.
+ */
+#define NR_PORTS	8
+#define LINK_MS		300
+#define CRS_MS		200
+
+#define EXP_CAP		0x40
+
+struct sim_port {
+	unsigned long	link_up;	/* Timebase, 0 until reset is lifted */
+	bool		dead;		/* Link never trains */
+};
+
+static struct sim_port ports[NR_PORTS];
+
+static bool sim_link_up(struct sim_port *port)
+{
+	return port->link_up && !port->dead && fake_tb >= port->link_up;
+}
+
+static int64_t sim_brctl(void *dev, struct pci_cfg_reg_filter *pcrf,
+			 uint32_t offset __unused, uint32_t len __unused,
+			 uint32_t *data, bool write)
+{
+	struct pci_virt_device *pvd = dev;
+	struct sim_port *port = (struct sim_port *)pcrf->data;
+	uint32_t bctl;
+
+	assert(write);
+	PCI_VIRT_CFG_NORMAL_RD(pvd, PCI_CFG_BRCTL, 2, &bctl);
+	if ((bctl & PCI_CFG_BRCTL_SECONDARY_RESET) &&
+	    !(*data & PCI_CFG_BRCTL_SECONDARY_RESET))
+		port->link_up = fake_tb + msecs_to_tb(LINK_MS);
+
+	return OPAL_PARTIAL;
+}
+
+static int64_t sim_lstat(void *dev __unused, struct pci_cfg_reg_filter *pcrf,
+			 uint32_t offset __unused, uint32_t len __unused,
+			 uint32_t *data, bool write)
+{
+	struct sim_port *port = (struct sim_port *)pcrf->data;
+
+	assert(!write);
+	*data = sim_link_up(port) ? PCICAP_EXP_LSTAT_DLLL_ACT : 0;
+
+	return OPAL_SUCCESS;
+}
+
+static unsigned int nr_crs;
+
+static int64_t sim_vdid(void *dev __unused, struct pci_cfg_reg_filter *pcrf,
+			uint32_t offset __unused, uint32_t len __unused,
+			uint32_t *data, bool write)
+{
+	struct sim_port *port = (struct sim_port *)pcrf->data;
+
+	assert(!write);
+	assert(sim_link_up(port));
+	if (fake_tb < port->link_up + msecs_to_tb(CRS_MS)) {
+		nr_crs++;
+		*data = 0xffff0001;
+		return OPAL_SUCCESS;
+	}
+
+	return OPAL_PARTIAL;
+}
+
+static struct pci_virt_device *add_virt_device(struct phb *phb, uint16_t bdfn,
+					       int type)
+{
+	struct pci_virt_device *pvd;
+	bool bridge = type != PCIE_TYPE_ENDPOINT;
+
+	pvd = pci_virt_add_device(phb, bdfn, 0x100, NULL);
+	assert(pvd);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_VENDOR_ID, 4,
+			     bridge ? 0x12341014 : 0x56781014);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_HDR_TYPE, 1, bridge ? 1 : 0);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_STAT, 2, PCI_CFG_STAT_CAP);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_CAP, 1, EXP_CAP);
+	PCI_VIRT_CFG_INIT_RO(pvd, EXP_CAP, 1, PCI_CFG_CAP_ID_EXP);
+	PCI_VIRT_CFG_INIT_RO(pvd, EXP_CAP + PCICAP_EXP_CAPABILITY_REG, 2,
+			     SETFIELD(PCICAP_EXP_CAP_TYPE, 0ul, type));
+	PCI_VIRT_CFG_INIT_RO(pvd, EXP_CAP + PCICAP_EXP_LCAP, 4,
+			     PCICAP_EXP_LCAP_DL_ACT_REP);
+
+	return pvd;
+}
+
+static struct phb *build_phb(const char *name, unsigned int nr_dead)
+{
+	struct phb *phb = zalloc(sizeof(*phb));
+	struct pci_virt_device *pvd;
+	unsigned int i;
+
+	assert(phb);
+	phb->dt_node = dt_new(dt_root, name);
+	phb->ops = &virt_phb_ops;
+	phb->scan_map = 0x1;
+	list_head_init(&phb->virt_devices);
+	assert(pci_register_phb(phb, OPAL_DYNAMIC_PHB_ID) == OPAL_SUCCESS);
+
+	/* Root port, its link is up and CRS visibility is on */
+	pvd = add_virt_device(phb, 0, PCIE_TYPE_ROOT_PORT);
+	PCI_VIRT_CFG_INIT_RO(pvd, EXP_CAP + PCICAP_EXP_LSTAT, 2,
+			     PCICAP_EXP_LSTAT_DLLL_ACT);
+	PCI_VIRT_CFG_INIT(pvd, EXP_CAP + PCICAP_EXP_RC, 2,
+			  PCICAP_EXP_RC_CRS_VISIBLE, 0, 0);
+
+	/* Switch on bus 1, downstream ports on bus 2 */
+	add_virt_device(phb, 1 << 8, PCIE_TYPE_SWITCH_UPPORT);
+	for (i = 0; i < NR_PORTS; i++) {
+		ports[i].link_up = 0;
+		ports[i].dead = i >= NR_PORTS - nr_dead;
+
+		pvd = add_virt_device(phb, (2 << 8) | (i << 3),
+				      PCIE_TYPE_SWITCH_DNPORT);
+		PCI_VIRT_CFG_INIT(pvd, PCI_CFG_BRCTL, 2,
+				  PCI_CFG_BRCTL_SECONDARY_RESET, 0, 0);
+		assert(pci_virt_add_filter(pvd, PCI_CFG_BRCTL, 2,
+					   PCI_REG_FLAG_WRITE,
+					   sim_brctl, &ports[i]));
+		assert(pci_virt_add_filter(pvd, EXP_CAP + PCICAP_EXP_LSTAT, 2,
+					   PCI_REG_FLAG_READ,
+					   sim_lstat, &ports[i]));
+
+		/* The endpoint, on the bus the scan will give the port */
+		pvd = add_virt_device(phb, (3 + i) << 8, PCIE_TYPE_ENDPOINT);
+		assert(pci_virt_add_filter(pvd, PCI_CFG_VENDOR_ID, 4,
+					   PCI_REG_FLAG_READ,
+					   sim_vdid, &ports[i]));
+	}
+
+	return phb;
+}
+
+static unsigned long scan_phb(struct phb *phb)
+{
+	unsigned long start = fake_tb;
+
+	nr_crs = 0;
+	pci_scan_bus(phb, 0, 0xff, &phb->devices, NULL, true);
+
+	return tb_to_msecs(fake_tb - start);
+}
+
+int main(void)
+{
+	struct phb *phb;
+	struct pci_device *pd;
+	unsigned long elapsed, serial;
+	unsigned int i;
+
+	dt_root = dt_new_root("");
+	fake_tb = 1;
+
+	/*
+	 * All links train. Bringing the ports up one after the other
+	 * would cost each of them the post-reset wait, the link training
+	 * and the 100ms after link up.
+	 */
+	phb = build_phb("pciex@0", 0);
+	elapsed = scan_phb(phb);
+	serial = 100 + NR_PORTS * (100 + LINK_MS + 100);
+	printf("%d ports, %dms link training: scan took %lums, "
+	       "one port at a time would take at least %lums\n",
+	       NR_PORTS, LINK_MS, elapsed, serial);
+	assert(elapsed < 100 + 100 + LINK_MS + 100 + CRS_MS +
+			 NR_PORTS * (PCI_LINK_POLL_MS + PCI_CRS_POLL_MS));
+
+	/* Everything was found, with the bus numbers the serial scan gave */
+	for (i = 0; i < NR_PORTS; i++) {
+		pd = pci_find_dev(phb, (2 << 8) | (i << 3));
+		assert(pd && pd->is_bridge && pd->crs_visible);
+		assert(pd->secondary_bus == 3 + i);
+		assert(pci_find_dev(phb, (3 + i) << 8));
+	}
+	assert(pci_find_dev(phb, 1 << 8)->subordinate_bus == 2 + NR_PORTS);
+
+	/* The first endpoint was probed while it still answered with CRS */
+	assert(nr_crs > 0);
+
+	/*
+	 * Two dead links only cost a single link training timeout. They
+	 * are the last ports, the bus numbers reserved for hotplug below
+	 * them don't move the others.
+	 */
+	phb = build_phb("pciex@1", 2);
+	elapsed = scan_phb(phb);
+	printf("2 dead links: scan took %lums\n", elapsed);
+	assert(elapsed < PCI_LINK_TIMEOUT_MS + 1000);
+	for (i = 0; i < NR_PORTS; i++) {
+		pd = pci_find_dev(phb, (2 << 8) | (i << 3));
+		assert(pd && list_empty(&pd->children) == (i >= NR_PORTS - 2));
+	}
+
+	return 0;
+}
@@ -0,0 +1,629 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "pci-sim.h"
+
+/* Keep the scan from drowning the output in debug messages */
+#define _prlog(...) test_prlog(__VA_ARGS__)
+void test_prlog(int log_level, const char *fmt, ...);
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* skiboot.h's ilog2() is POWER assembly */
+#define ilog2(val) (63 - __builtin_clzl(val))
+
+/* Override this for device.c */
+#define is_rodata(p) false
+
+#include "../device.c"
+#include "../pci.c"
+#include "../pci-virt.c"
+#include "../pci-cfg-filter.c"
+#include "../pci-slot.c"
+#include "../pcie-slot.c"
+#include "../pci-opal.c"
+#include "../pci-rtt.c"
+#include "../bitmap.c"
+#include "pci-sim.c"
+
+void test_prlog(int log_level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (log_level > PR_NOTICE)
+		return;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+struct platform platform;
+unsigned long top_of_ram = ~0ul;
+
+bool fsp_present(void)
+{
+	return false;
+}
+
+void lock(struct lock *l __unused)
+{
+}
+
+void unlock(struct lock *l __unused)
+{
+}
+
+void pci_handle_quirk(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+void pci_init_iov_cap(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+void opal_update_pending_evt(uint64_t evt_mask __unused,
+			     uint64_t evt_values __unused)
+{
+}
+
+/* The last async completion */
+static uint64_t async_token, async_rc;
+
+int _opal_queue_msg(enum opal_msg_type msg_type, void *data __unused,
+		    void (*consumed)(void *data) __unused, size_t num_params,
+		    const u64 *params)
+{
+	assert(msg_type == OPAL_MSG_ASYNC_COMP && num_params == 4);
+	async_token = params[0];
+	async_rc = params[3];
+
+	return 0;
+}
+
+/* A single timer is all the slot code needs */
+static struct timer *pending_timer;
+
+void init_timer(struct timer *t, timer_func_t expiry, void *data)
+{
+	t->expiry = expiry;
+	t->user_data = data;
+	t->target = 0;
+}
+
+uint64_t schedule_timer(struct timer *t, uint64_t how_long)
+{
+	t->target = mftb() + how_long;
+	pending_timer = t;
+
+	return mftb();
+}
+
+static void run_timers(void)
+{
+	struct timer *t;
+
+	while (pending_timer) {
+		t = pending_timer;
+		pending_timer = NULL;
+		if (tb_compare(mftb(), t->target) == TB_ABEFOREB)
+			sim_tb = t->target;
+		t->expiry(t, t->user_data, mftb());
+	}
+}
+
+void check_timers(bool from_interrupt __unused)
+{
+	run_timers();
+}
+
+/* No secondary CPUs: pci_init_slots() runs the PHB jobs in line */
+struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu __unused,
+				const char *name __unused,
+				void (*func)(void *data), void *data,
+				bool no_return __unused)
+{
+	func(data);
+	return (struct cpu_job *)data;
+}
+
+void cpu_wait_job(struct cpu_job *job __unused, bool free_it __unused)
+{
+}
+
+void cpu_process_local_jobs(void)
+{
+}
+
+static int count_dev(struct phb *phb __unused, struct pci_device *pd __unused,
+		     void *data)
+{
+	(*(unsigned int *)data)++;
+	return 0;
+}
+
+static unsigned int nr_devices(struct phb *phb)
+{
+	unsigned int count = 0;
+
+	pci_walk_dev(phb, NULL, count_dev, &count);
+	return count;
+}
+
+static struct pci_device *find_child(struct pci_device *bridge, uint8_t devfn)
+{
+	struct pci_device *pd;
+
+	list_for_each(&bridge->children, pd, link)
+		if ((pd->bdfn & 0xff) == devfn)
+			return pd;
+
+	return NULL;
+}
+
+/* Run a slot state machine to completion, as the OS would */
+static int64_t poll_slot(uint64_t id, int64_t rc)
+{
+	while (rc > 0) {
+		time_wait_ms(rc);
+		rc = opal_pci_poll(id);
+	}
+
+	return rc;
+}
+
+static struct dt_node *dn4;
+
+/*
+ * A root port with CRS visibility and a six port switch below:
+ *
+ *   dn0  an endpoint that takes 300ms to become ready
+ *   dn1  a two function endpoint
+ *   dn2  a PCIe to PCI bridge with two conventional devices
+ *   dn3  an endpoint whose first config access freezes its PE
+ *   dn4  an empty hotplug slot, the card described is plugged later.
+ *        Boot leaves the secondary reset of empty slots alone, so it
+ *        isn't asserted on that one.
+ *   dn5  nothing connected
+ */
+static struct phb *build_switch_phb(void)
+{
+	struct dt_node *desc, *rp, *up, *dn[6], *br, *np;
+	unsigned int i;
+
+	desc = dt_new(dt_root, "sim-switch");
+	rp = pci_sim_add(desc, "rp", "root-port", 0);
+	dt_add_property(rp, "crs-visible", NULL, 0);
+	up = pci_sim_add(rp, "up", "upstream-port", 0);
+	for (i = 0; i < ARRAY_SIZE(dn); i++) {
+		dn[i] = pci_sim_add(up, "dn", "downstream-port", i << 3);
+		if (i != 4)
+			dt_add_property(dn[i], "in-reset", NULL, 0);
+		dt_add_property_cells(dn[i], "link-delay-ms", 200);
+	}
+
+	np = pci_sim_add(dn[0], "nvme", "endpoint", 0);
+	dt_add_property_cells(np, "class-code", 0x010802);
+	dt_add_property_cells(np, "crs-delay-ms", 300);
+
+	pci_sim_add(dn[1], "eth", "endpoint", 0);
+	pci_sim_add(dn[1], "eth", "endpoint", 1);
+
+	br = pci_sim_add(dn[2], "br", "pcie-to-pci-bridge", 0);
+	pci_sim_add(br, "dev", "pci-device", 1 << 3);
+	pci_sim_add(br, "dev", "pci-device", 2 << 3);
+
+	np = pci_sim_add(dn[3], "bad", "endpoint", 0);
+	dt_add_property_cells(np, "freeze-after", 1);
+
+	dt_add_property(dn[4], "hotplug", NULL, 0);
+	dt_add_property(dn[4], "empty", NULL, 0);
+	pci_sim_add(dn[4], "card", "endpoint", 0);
+	dn4 = dn[4];
+
+	return pci_sim_create(desc);
+}
+
+/* A switch port whose link never trains, next to a working one */
+static struct phb *build_dead_link_phb(void)
+{
+	struct dt_node *desc, *rp, *up, *dn;
+
+	desc = dt_new(dt_root, "sim-dead-link");
+	rp = pci_sim_add(desc, "rp", "root-port", 0);
+	dt_add_property(rp, "crs-visible", NULL, 0);
+	up = pci_sim_add(rp, "up", "upstream-port", 0);
+	dn = pci_sim_add(up, "dn", "downstream-port", 0);
+	pci_sim_add(dn, "ep", "endpoint", 0);
+	dn = pci_sim_add(up, "dn", "downstream-port", 1 << 3);
+	dt_add_property(dn, "link-dead", NULL, 0);
+	pci_sim_add(dn, "lost", "endpoint", 0);
+
+	return pci_sim_create(desc);
+}
+
+/* Three levels of 8 port switches, 64 endpoints */
+static struct phb *build_fanout_phb(void)
+{
+	struct dt_node *desc, *rp, *up, *dn, *up2, *dn2;
+	unsigned int i, j;
+
+	desc = dt_new(dt_root, "sim-fanout");
+	rp = pci_sim_add(desc, "rp", "root-port", 0);
+	up = pci_sim_add(rp, "up", "upstream-port", 0);
+	for (i = 0; i < 8; i++) {
+		dn = pci_sim_add(up, "dn", "downstream-port", i << 3);
+		up2 = pci_sim_add(dn, "up", "upstream-port", 0);
+		for (j = 0; j < 8; j++) {
+			dn2 = pci_sim_add(up2, "dn", "downstream-port", j << 3);
+			dt_add_property(dn2, "in-reset", NULL, 0);
+			pci_sim_add(dn2, "ep", "endpoint", 0);
+		}
+	}
+
+	return pci_sim_create(desc);
+}
+
+static void test_eeh(struct phb *phb, struct pci_device *nvme,
+		     struct pci_device *eth)
+{
+	static uint8_t pes[PCI_SIM_MAX_PES / 8];
+	uint64_t id = phb->opal_id, first_pe, phb_status, peev_reads;
+	uint16_t nvme_pe = 1, eth_pe = 66, type, sev;
+	uint32_t vdid, i;
+	uint8_t state;
+
+	pci_sim_reset_counts(phb);
+
+	/* A PE per bus, eth in the domain of nvme */
+	assert(opal_pci_set_pe(id, nvme_pe, nvme->bdfn, OpalPciBusAll,
+			       OPAL_IGNORE_RID_DEVICE_NUMBER,
+			       OPAL_IGNORE_RID_FUNCTION_NUMBER,
+			       OPAL_MAP_PE) == OPAL_SUCCESS);
+	assert(opal_pci_set_pe(id, eth_pe, eth->bdfn, OpalPciBusAll,
+			       OPAL_IGNORE_RID_DEVICE_NUMBER,
+			       OPAL_IGNORE_RID_FUNCTION_NUMBER,
+			       OPAL_MAP_PE) == OPAL_SUCCESS);
+	assert(pci_sim_pe_of(phb, nvme->bdfn) == nvme_pe);
+	assert(pci_sim_pe_of(phb, eth->bdfn | 1) == eth_pe);
+	assert(opal_pci_set_peltv(id, nvme_pe, nvme_pe,
+				  OPAL_ADD_PE_TO_DOMAIN) == OPAL_SUCCESS);
+	assert(opal_pci_set_peltv(id, nvme_pe, eth_pe,
+				  OPAL_ADD_PE_TO_DOMAIN) == OPAL_SUCCESS);
+
+	/* Break nvme, which takes eth down */
+	assert(opal_pci_err_inject(id, nvme_pe,
+				   OPAL_ERR_INJECT_TYPE_IOA_BUS_ERR,
+				   0, 0, 0) == OPAL_SUCCESS);
+	assert(opal_pci_config_read_word(id, nvme->bdfn, 0,
+					 &vdid) == OPAL_SUCCESS);
+	assert(vdid == 0xffffffff);
+	assert(pci_sim_pe_frozen(phb, eth_pe));
+
+	/*
+	 * What the OS does on the EEH event. The PE reported is the
+	 * lowest of the highest PEEV word with a frozen PE, so eth.
+	 */
+	assert(opal_pci_next_error(id, &first_pe, &type,
+				   &sev) == OPAL_SUCCESS);
+	assert(first_pe == eth_pe && type == OPAL_EEH_PE_ERROR);
+
+	/* next_error has seen both PEs, no need to read the PEEV again */
+	peev_reads = pci_sim_count(phb, PCI_SIM_PEEV_READ);
+	assert(opal_pci_eeh_freeze_status(id, nvme_pe, &state, &type,
+					  &phb_status) == OPAL_SUCCESS);
+	assert(state == OPAL_EEH_STOPPED_MMIO_DMA_FREEZE);
+	assert(opal_pci_eeh_freeze_status(id, eth_pe, &state, &type,
+					  &phb_status) == OPAL_SUCCESS);
+	assert(state == OPAL_EEH_STOPPED_MMIO_DMA_FREEZE);
+	assert(pci_sim_count(phb, PCI_SIM_PEEV_READ) == peev_reads);
+
+	/* All the frozen PEs at once */
+	assert(opal_pci_get_frozen_pes(id, pes, sizeof(pes) - 1) ==
+	       OPAL_PARAMETER);
+	assert(opal_pci_get_frozen_pes(id, pes, sizeof(pes)) == OPAL_SUCCESS);
+	for (i = 0; i < PCI_SIM_MAX_PES; i++)
+		assert(!!(pes[i / 8] & (0x80 >> (i % 8))) ==
+		       (i == nvme_pe || i == eth_pe));
+	assert(opal_pci_eeh_freeze_clear(id, nvme_pe,
+				OPAL_EEH_ACTION_CLEAR_FREEZE_ALL) == OPAL_SUCCESS);
+	assert(opal_pci_eeh_freeze_clear(id, eth_pe,
+				OPAL_EEH_ACTION_CLEAR_FREEZE_ALL) == OPAL_SUCCESS);
+	assert(opal_pci_next_error(id, &first_pe, &type,
+				   &sev) == OPAL_SUCCESS);
+	assert(first_pe == (uint64_t)-1 && type == OPAL_EEH_NO_ERROR);
+	assert(opal_pci_get_frozen_pes(id, pes, sizeof(pes)) == OPAL_SUCCESS);
+	for (i = 0; i < sizeof(pes); i++)
+		assert(!pes[i]);
+	assert(opal_pci_config_read_word(id, nvme->bdfn, 0,
+					 &vdid) == OPAL_SUCCESS);
+	assert(vdid == nvme->vdid);
+
+	pci_sim_report(phb, "EEH");
+}
+
+static void test_hotplug(struct phb *phb, struct pci_device *port)
+{
+	uint64_t id = PCI_SLOT_ID(phb, port->bdfn);
+	uint8_t state;
+	int64_t rc;
+
+	assert(port->slot && port->slot->pluggable);
+	assert(list_empty(&port->children));
+	pci_sim_reset_counts(phb);
+
+	/* Plug the card and power the slot on */
+	pci_sim_set_presence(phb, dn4, true);
+	state = OPAL_PCI_SLOT_POWER_ON;
+	rc = opal_pci_set_power_state(0x1234, id, (uint64_t)&state);
+	assert(rc == OPAL_ASYNC_COMPLETION);
+	run_timers();
+	assert(async_token == 0x1234 && async_rc == OPAL_SUCCESS);
+	assert(find_child(port, 0));
+	pci_sim_report(phb, "hot add");
+
+	/* Hot reset, the card comes back */
+	pci_sim_reset_counts(phb);
+	rc = opal_pci_reset(id, OPAL_RESET_PCI_HOT, OPAL_ASSERT_RESET);
+	assert(poll_slot(id, rc) == OPAL_SUCCESS);
+	assert(opal_pci_get_power_state(id, (uint64_t)&state) == OPAL_SUCCESS);
+	assert(state == OPAL_PCI_SLOT_POWER_ON);
+	pci_sim_report(phb, "hot reset");
+
+	/* Power off and pull the card */
+	state = OPAL_PCI_SLOT_POWER_OFF;
+	rc = opal_pci_set_power_state(0x5678, id, (uint64_t)&state);
+	assert(rc == OPAL_SUCCESS);
+	assert(list_empty(&port->children));
+	pci_sim_set_presence(phb, dn4, false);
+	assert(opal_pci_get_presence_state(id, (uint64_t)&state) ==
+	       OPAL_SUCCESS);
+	assert(state == OPAL_PCI_SLOT_EMPTY);
+}
+
+static void test_creset(struct phb *phb, struct pci_device *nvme)
+{
+	uint64_t id = PCI_PHB_SLOT_ID(phb);
+	int64_t rc;
+
+	pci_sim_reset_counts(phb);
+	rc = opal_pci_reset(id, OPAL_RESET_PHB_COMPLETE, OPAL_ASSERT_RESET);
+	assert(poll_slot(id, rc) == OPAL_SUCCESS);
+	assert(pci_sim_count(phb, PCI_SIM_CRESET) == 1);
+	assert(pci_sim_pe_of(phb, nvme->bdfn) == 255);
+	pci_sim_report(phb, "complete reset");
+}
+
+static struct opal_tce_kill_range ranges[128];
+
+static void set_range(unsigned int i, uint64_t dma_addr, uint64_t npages)
+{
+	ranges[i].dma_addr = cpu_to_be64(dma_addr);
+	ranges[i].npages = cpu_to_be64(npages);
+}
+
+/* Kills issued for @nr ranges of 4K TCEs */
+static uint64_t kill_ranges(struct phb *phb, unsigned int nr)
+{
+	uint64_t before = pci_sim_count(phb, PCI_SIM_TCE_KILL);
+
+	assert(opal_pci_tce_kill_ranges(phb->opal_id, 1, 0x1000, ranges,
+					nr) == OPAL_SUCCESS);
+	return pci_sim_count(phb, PCI_SIM_TCE_KILL) - before;
+}
+
+static void test_tce_kill(struct phb *phb)
+{
+	struct opal_tce_kill_stats stats;
+	uint64_t id = phb->opal_id;
+	unsigned int i;
+
+	pci_sim_reset_counts(phb);
+	assert(opal_pci_tce_kill_stats(id, NULL,
+			OPAL_PCI_TCE_KILL_STATS_RESET) == OPAL_SUCCESS);
+
+	/* A kill covers a single TCE, however the TCEs are given */
+	assert(opal_pci_tce_kill(id, OPAL_PCI_TCE_KILL_PAGES, 1, 0x1000,
+				 0x200000, 32) == OPAL_SUCCESS);
+	assert(pci_sim_count(phb, PCI_SIM_TCE_KILL) == 32);
+	set_range(0, 0x200000, 32);
+	assert(kill_ranges(phb, 1) == 32);
+
+	/* Contiguous and overlapping ranges are merged, each TCE once */
+	set_range(0, 0x10000, 4);
+	set_range(1, 0x14000, 12);
+	set_range(2, 0x18000, 2);
+	assert(kill_ranges(phb, 3) == 16);
+
+	/* Ranges that don't follow each other aren't */
+	set_range(0, 0x40000, 4);
+	set_range(1, 0x20000, 4);
+	assert(kill_ranges(phb, 2) == 8);
+
+	/* Too many TCEs, the whole PE goes */
+	set_range(0, 0x200000, 512);
+	assert(kill_ranges(phb, 1) == 1);
+	for (i = 0; i < ARRAY_SIZE(ranges); i++)
+		set_range(i, i * 0x2000, 1);
+	assert(kill_ranges(phb, ARRAY_SIZE(ranges)) == 1);
+	assert(pci_sim_count(phb, PCI_SIM_TCE_KILL_PE) == 2);
+
+	/* Bad ranges */
+	set_range(0, 0x800, 1);
+	assert(opal_pci_tce_kill_ranges(id, 1, 0x1000, ranges, 1) ==
+	       OPAL_PARAMETER);
+	set_range(0, ~0xfffull, 2);
+	assert(opal_pci_tce_kill_ranges(id, 1, 0x1000, ranges, 1) ==
+	       OPAL_PARAMETER);
+	assert(opal_pci_tce_kill_ranges(id, 1, 0x1800, ranges, 1) ==
+	       OPAL_PARAMETER);
+	assert(opal_pci_tce_kill_ranges(id, 1, 0x1000, ranges, 0) ==
+	       OPAL_PARAMETER);
+	assert(opal_pci_tce_kill_ranges(id, 1, 0x1000, ranges,
+			PCI_TCE_KILL_MAX_RANGES + 1) == OPAL_PARAMETER);
+
+	assert(opal_pci_tce_kill_stats(id, &stats, 0) == OPAL_SUCCESS);
+	assert(be64_to_cpu(stats.requests) == 6);
+	assert(be64_to_cpu(stats.kills) ==
+	       pci_sim_count(phb, PCI_SIM_TCE_KILL));
+	assert(be64_to_cpu(stats.pe_kills) == 2);
+	assert(be64_to_cpu(stats.pages) ==
+	       32 * 2 + 18 + 8 + 512 + ARRAY_SIZE(ranges));
+	printf("TCE kill: %llu pages invalidated with %llu kills\n",
+	       (unsigned long long)be64_to_cpu(stats.pages),
+	       (unsigned long long)be64_to_cpu(stats.kills));
+
+	/* Nor can a PHB kill more than one TCE at once */
+	assert(opal_pci_tce_kill(id, OPAL_PCI_TCE_KILL_PAGES, 1, 0x10000,
+				 0x200000, 1) == OPAL_PARAMETER);
+}
+
+static uint32_t filtered_val = 0x12345678;
+
+static int64_t test_cfg_filter(void *dev __unused,
+			       struct pci_cfg_reg_filter *pcrf __unused,
+			       uint32_t offset __unused, uint32_t len __unused,
+			       uint32_t *data, bool write)
+{
+	if (write)
+		filtered_val = *data;
+	else
+		*data = filtered_val;
+
+	return OPAL_SUCCESS;
+}
+
+/* Block accesses must look like the same 32-bit accesses one by one */
+static void test_cfg_block(struct phb *phb, struct pci_device *pd)
+{
+	static uint32_t block[PCI_SIM_CFG_SIZE / 4 + 1];
+	uint64_t id = phb->opal_id, reads;
+	uint32_t i, val, out[4] = {
+		cpu_to_le32(0x11111111), cpu_to_le32(0x22222222),
+		cpu_to_le32(0x33333333), cpu_to_le32(0x44444444),
+	};
+
+	/* A word emulated by a filter, and a half word one that a 32-bit
+	 * access doesn't hit
+	 */
+	assert(pci_add_cfg_reg_filter(pd, 0x400, 4, PCI_REG_FLAG_READ |
+				      PCI_REG_FLAG_WRITE, test_cfg_filter));
+	assert(pci_add_cfg_reg_filter(pd, 0x404, 2, PCI_REG_FLAG_READ,
+				      test_cfg_filter));
+
+	pci_sim_reset_counts(phb);
+	assert(opal_pci_config_read_block(id, pd->bdfn, 0, block,
+					  PCI_SIM_CFG_SIZE) == OPAL_SUCCESS);
+	reads = pci_sim_count(phb, PCI_SIM_CFG_READ);
+	assert(reads == PCI_SIM_CFG_SIZE / 4 - 1);
+	for (i = 0; i < PCI_SIM_CFG_SIZE / 4; i++) {
+		assert(opal_pci_config_read_word(id, pd->bdfn, i * 4,
+						 &val) == OPAL_SUCCESS);
+		assert(le32_to_cpu(block[i]) == val);
+	}
+	assert(le32_to_cpu(block[0x400 / 4]) == 0x12345678);
+	assert(le32_to_cpu(block[0]) == pd->vdid);
+
+	/* Writes across the filtered word */
+	assert(opal_pci_config_write_block(id, pd->bdfn, 0x3fc, out,
+					   sizeof(out)) == OPAL_SUCCESS);
+	assert(filtered_val == 0x22222222);
+	assert(opal_pci_config_read_block(id, pd->bdfn, 0x3fc, block,
+					  sizeof(out)) == OPAL_SUCCESS);
+	assert(!memcmp(block, out, sizeof(out)));
+
+	/* Misaligned, empty, past the end or misaligned buffer */
+	assert(opal_pci_config_read_block(id, pd->bdfn, 2, block,
+					  4) == OPAL_PARAMETER);
+	assert(opal_pci_config_read_block(id, pd->bdfn, 0, block,
+					  0) == OPAL_PARAMETER);
+	assert(opal_pci_config_read_block(id, pd->bdfn, 4, block,
+					  PCI_SIM_CFG_SIZE) == OPAL_PARAMETER);
+	assert(opal_pci_config_write_block(id, pd->bdfn, 0xffc, out,
+					   8) == OPAL_PARAMETER);
+	assert(opal_pci_config_read_block(id, pd->bdfn, 0,
+					  (void *)block + 2,
+					  4) == OPAL_PARAMETER);
+
+	printf("config block read: %llu config cycles for %d words\n",
+	       (unsigned long long)reads, PCI_SIM_CFG_SIZE / 4);
+}
+
+int main(void)
+{
+	struct pci_device *rp, *up, *nvme, *eth, *port;
+	struct phb *phb;
+	uint64_t freezes, start;
+
+	dt_root = dt_new_root("");
+
+	/* Boot time reset and scan */
+	phb = build_switch_phb();
+	pci_init_slots();
+	pci_sim_report(phb, "switch boot");
+
+	/* rp, up, 6 ports, nvme, 2 eth, bridge and 2 devices */
+	assert(nr_devices(phb) == 14);
+	rp = list_top(&phb->devices, struct pci_device, link);
+	assert(rp && rp->crs_visible);
+	up = find_child(rp, 0);
+	nvme = find_child(find_child(up, 0 << 3), 0);
+	eth = find_child(find_child(up, 1 << 3), 0);
+	assert(nvme && nvme->class == 0x010802);
+	assert(eth && eth->is_multifunction);
+	assert(find_child(find_child(find_child(up, 2 << 3), 0), 2 << 3));
+	assert(pci_sim_count(phb, PCI_SIM_CFG_CRS) > 0);
+
+	/* The failed probe of dn3's endpoint froze the reserved PE and the
+	 * scan cleared it. Nothing below dn3 or dn5.
+	 */
+	freezes = pci_sim_count(phb, PCI_SIM_FREEZE);
+	assert(freezes > 0);
+	assert(pci_sim_count(phb, PCI_SIM_FREEZE_CLEAR) <= freezes);
+	assert(!pci_sim_pe_frozen(phb, 255));
+	assert(list_empty(&find_child(up, 3 << 3)->children));
+	assert(list_empty(&find_child(up, 5 << 3)->children));
+
+	test_eeh(phb, nvme, eth);
+	port = find_child(up, 4 << 3);
+	test_hotplug(phb, port);
+	test_creset(phb, nvme);
+	test_tce_kill(phb);
+	test_cfg_block(phb, nvme);
+
+	/* A bigger tree, for timing the scan */
+	phb = build_fanout_phb();
+	pci_reset_phb(phb);
+	pci_scan_phb(phb);
+	pci_sim_report(phb, "fan-out scan");
+	assert(nr_devices(phb) == 2 + 8 * (2 + 8 * 2));
+
+	/* The dead link costs its timeout and nothing shows below it */
+	phb = build_dead_link_phb();
+	start = mftb();
+	pci_reset_phb(phb);
+	pci_scan_phb(phb);
+	pci_sim_report(phb, "dead link scan");
+	assert(nr_devices(phb) == 5);
+	up = find_child(list_top(&phb->devices, struct pci_device, link), 0);
+	assert(list_empty(&find_child(up, 1 << 3)->children));
+	assert(tb_to_msecs(mftb() - start) >= 1000);
+
+	return 0;
+}
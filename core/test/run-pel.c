@@ -68,8 +68,13 @@ int main(void)
 	size_t size;
 	struct errorlog *elog;
 	struct opal_err_info *opal_err_info = &err_TEST_ERROR;
-	char *buffer;
+	char *buffer, *stream_buf;
 	struct elog_user_data_section *tmp;
+	struct opal_private_header_section *privhdr;
+	struct opal_user_section *usrhdr;
+	struct pel_stream s;
+	size_t chunk, off;
+	int i;
 
 	dt_root = dt_new_root("");
 	dt_add_property_string(dt_root, "model", "run-pel-unittest");
@@ -125,6 +130,43 @@ int main(void)
 
 	assert(size == create_pel_log(elog, pel_buf, size));
 
+	/* Add a second section, and read the PEL in odd sized chunks */
+	buffer = elog->user_data_dump + elog->user_section_size;
+	tmp = (struct elog_user_data_section *)buffer;
+	tmp->tag = 0x44415441;  /* ASCII of DATA */
+	tmp->size = sizeof(struct elog_user_data_section) + 100;
+	for (i = 0; i < 100; i++)
+		tmp->data_dump[i] = i;
+	elog->user_section_size += tmp->size;
+	elog->user_section_count++;
+
+	size = pel_size(elog);
+	pel_buf = realloc(pel_buf, size);
+	stream_buf = malloc(size);
+	assert(pel_buf && stream_buf);
+	assert(size == create_pel_log(elog, pel_buf, size));
+
+	privhdr = (struct opal_private_header_section *)pel_buf;
+	assert(privhdr->section_count == 7);
+	usrhdr = (struct opal_user_section *)(pel_buf + size -
+			sizeof(struct opal_v6_header) - tmp->size);
+	assert(usrhdr->v6header.id == ELOG_SID_USER_DEFINED);
+	assert(usrhdr->v6header.length ==
+	       sizeof(struct opal_v6_header) + tmp->size);
+	assert(!memcmp(usrhdr->dump, tmp, tmp->size));
+
+	for (chunk = 1; chunk < 64; chunk += 7) {
+		memset(stream_buf, 0xaa, size);
+		pel_stream_init(&s, elog);
+		assert(s.size == size);
+		for (off = 0; off < size; off += chunk)
+			assert(pel_stream_read(&s, stream_buf + off, chunk) ==
+			       MIN(chunk, size - off));
+		assert(pel_stream_read(&s, stream_buf, chunk) == 0);
+		assert(!memcmp(stream_buf, pel_buf, size));
+	}
+
+	free(stream_buf);
 	free(pel_buf);
 	free(elog);
 
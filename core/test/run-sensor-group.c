@@ -0,0 +1,187 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+static unsigned long sim_tb = 1;
+
+static inline unsigned long mftb(void)
+{
+	return sim_tb;
+}
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* Override this for device.c */
+#define is_rodata(p) false
+
+#include "../device.c"
+#include "../sensor.c"
+
+struct platform platform;
+struct dt_node *opal_node;
+unsigned long top_of_ram = ~0ul;
+
+static void *opal_group_read;
+
+void __opal_register(uint64_t token, void *func, unsigned num_args)
+{
+	if (token == OPAL_SENSOR_GROUP_READ) {
+		assert(num_args == 5);
+		opal_group_read = func;
+	}
+}
+
+bool dts_sensor_create_nodes(struct dt_node *sensors __unused)
+{
+	return true;
+}
+
+/* DTS sensors read as their resource id, or fail if it is odd */
+static unsigned int nr_dts_reads;
+
+int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data)
+{
+	nr_dts_reads++;
+	if (sensor_get_rid(sensor_hndl) & 1)
+		return OPAL_HARDWARE;
+	*sensor_data = sensor_get_rid(sensor_hndl);
+	return OPAL_SUCCESS;
+}
+
+/*
+ * The platform reads its sensors as their resource id plus one, in a
+ * single call per group read, asynchronously.
+ */
+static unsigned int nr_platform_reads;
+static int last_token;
+
+static int64_t test_read_group(struct opal_sensor_group_entry *entries,
+			       unsigned int nr, int token)
+{
+	unsigned int i;
+
+	nr_platform_reads++;
+	last_token = token;
+	for (i = 0; i < nr; i++) {
+		uint32_t hndl = be32_to_cpu(entries[i].handle);
+
+		if (sensor_get_family(hndl) != SENSOR_FSP)
+			continue;
+		entries[i].value = cpu_to_be32(sensor_get_rid(hndl) + 1);
+		entries[i].rc = cpu_to_be32(OPAL_SUCCESS);
+	}
+
+	return OPAL_ASYNC_COMPLETION;
+}
+
+#define dts(rid)	sensor_make_handler(SENSOR_DTS, 0, rid, 0)
+#define fsp(rid)	sensor_make_handler(SENSOR_FSP, 3, rid, 0)
+
+static int64_t group_read(uint32_t id, struct opal_sensor_group_entry *buf,
+			  __be32 *nr, __be64 *last_read)
+{
+	int64_t (*fn)(uint32_t, int, struct opal_sensor_group_entry *,
+		      __be32 *, __be64 *) = opal_group_read;
+
+	return fn(id, 0x42, buf, nr, last_read);
+}
+
+int main(void)
+{
+	static const uint32_t dts_only[] = { dts(2), dts(3), dts(4) };
+	static const uint32_t mixed[] = { fsp(10), dts(6), fsp(20) };
+	struct opal_sensor_group_entry buf[4];
+	struct dt_node *node;
+	const struct dt_property *prop;
+	__be64 last_read;
+	__be32 nr;
+	int id0, id1;
+
+	dt_root = dt_new_root("");
+	opal_node = dt_new(dt_root, "ibm,opal");
+	sensor_init();
+	assert(opal_group_read);
+
+	assert(sensor_group_add("dts", 0, dts_only, 0) == OPAL_PARAMETER);
+	id0 = sensor_group_add("dts", 0, dts_only, ARRAY_SIZE(dts_only));
+	id1 = sensor_group_add("power", -1, mixed, ARRAY_SIZE(mixed));
+	assert(id0 == 0 && id1 == 1);
+
+	/* The groups show up in the device tree with their handles */
+	node = dt_find_by_path(dt_root, "/ibm,opal/sensor-groups/dts@0");
+	assert(node);
+	assert(dt_prop_get_u32(node, "sensor-group-id") == 0);
+	assert(dt_prop_get_u32(node, "ibm,chip-id") == 0);
+	prop = dt_find_property(node, "sensors");
+	assert(prop && prop->len == sizeof(dts_only));
+	assert(dt_property_get_cell(prop, 1) == dts(3));
+	node = dt_find_by_path(dt_root, "/ibm,opal/sensor-groups/power@1");
+	assert(node && !dt_find_property(node, "ibm,chip-id"));
+
+	/* Bad group and short buffer */
+	nr = cpu_to_be32(ARRAY_SIZE(buf));
+	assert(group_read(2, buf, &nr, NULL) == OPAL_PARAMETER);
+	nr = cpu_to_be32(2);
+	assert(group_read(id0, buf, &nr, NULL) == OPAL_PARTIAL);
+	assert(be32_to_cpu(nr) == ARRAY_SIZE(dts_only));
+
+	/* DTS sensors are read right away, each with its own rc */
+	sim_tb = 100;
+	nr = cpu_to_be32(ARRAY_SIZE(buf));
+	assert(group_read(id0, buf, &nr, &last_read) == OPAL_SUCCESS);
+	assert(be32_to_cpu(nr) == ARRAY_SIZE(dts_only));
+	assert(be64_to_cpu(last_read) == 0);
+	assert(nr_dts_reads == 3 && nr_platform_reads == 0);
+	assert(be32_to_cpu(buf[0].handle) == dts(2));
+	assert(be32_to_cpu(buf[0].value) == 2);
+	assert(be32_to_cpu(buf[0].rc) == OPAL_SUCCESS);
+	assert((int32_t)be32_to_cpu(buf[1].rc) == OPAL_HARDWARE);
+	assert(be32_to_cpu(buf[2].value) == 4);
+
+	sim_tb = 200;
+	assert(group_read(id0, buf, &nr, &last_read) == OPAL_SUCCESS);
+	assert(be64_to_cpu(last_read) == 100);
+
+	/* Without platform support, its sensors are unsupported */
+	assert(group_read(id1, buf, &nr, NULL) == OPAL_SUCCESS);
+	assert((int32_t)be32_to_cpu(buf[0].rc) == OPAL_UNSUPPORTED);
+	assert(be32_to_cpu(buf[1].value) == 6);
+
+	/* Otherwise one platform call covers all of them */
+	platform.sensor_read_group = test_read_group;
+	nr_dts_reads = 0;
+	sim_tb = 300;
+	assert(group_read(id1, buf, &nr, &last_read) == OPAL_ASYNC_COMPLETION);
+	assert(be64_to_cpu(last_read) == 200);
+	assert(nr_platform_reads == 1 && nr_dts_reads == 1);
+	assert(last_token == 0x42);
+	assert(be32_to_cpu(buf[0].value) == 11);
+	assert(be32_to_cpu(buf[1].value) == 6);
+	assert(be32_to_cpu(buf[2].value) == 21);
+	assert(be32_to_cpu(buf[2].rc) == OPAL_SUCCESS);
+
+	/* A group of DTS sensors doesn't bother the platform */
+	assert(group_read(id0, buf, &nr, NULL) == OPAL_SUCCESS);
+	assert(nr_platform_reads == 1);
+
+	dt_free(dt_root);
+	return 0;
+}
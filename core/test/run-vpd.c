@@ -0,0 +1,314 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+#include "../vpd.c"
+#include "../../test/bench.h"
+
+/* The malformed VPD below would be rather noisy */
+void _prlog(int __unused log_level, const __unused char* fmt, ...)
+{
+}
+
+const void *dt_prop_get_def(const struct dt_node *node __unused,
+			    const char *prop __unused, void *def)
+{
+	return def;
+}
+
+struct dt_property *dt_add_property(struct dt_node *node __unused,
+				    const char *name __unused,
+				    const void *val __unused, size_t size __unused)
+{
+	return NULL;
+}
+
+uint32_t fsp_adjust_lid_side(uint32_t lid_no)
+{
+	return lid_no;
+}
+
+int fsp_preload_lid(uint32_t lid_no __unused, char *buf __unused,
+		    size_t *size __unused)
+{
+	return -1;
+}
+
+int fsp_wait_lid_loaded(uint32_t lid_no __unused)
+{
+	return -1;
+}
+
+/*
+ * The lookups as they were before the index, one scan of the blob
+ * per lookup, to check the index and the wrappers against.
+ */
+static const void *ref_find_keyword(const void *rec, size_t rec_sz,
+				    const char *kw, uint8_t *kw_size)
+{
+	const uint8_t *p = rec, *end = rec + rec_sz;
+
+	while (CHECK_SPACE(p, 3, end)) {
+		uint8_t k1 = *(p++);
+		uint8_t k2 = *(p++);
+		uint8_t sz = *(p++);
+
+		if (k1 == kw[0] && k2 == kw[1]) {
+			if (kw_size)
+				*kw_size = sz;
+			return p;
+		}
+		p += sz;
+	}
+	return NULL;
+}
+
+static const void *ref_find_record(const void *vpd, size_t vpd_size,
+				   const char *record, size_t *sz)
+{
+	const uint8_t *p = vpd, *end = vpd + vpd_size;
+	bool first_start = true;
+	size_t rec_sz;
+	uint8_t namesz = 0;
+	const char *rec_name;
+
+	while (CHECK_SPACE(p, 4, end)) {
+		if (*(p++) != 0x84) {
+			if (first_start)
+				continue;
+			break;
+		}
+		first_start = false;
+		rec_sz = *(p++);
+		rec_sz |= *(p++) << 8;
+		if (!CHECK_SPACE(p, rec_sz, end))
+			return NULL;
+
+		rec_name = ref_find_keyword(p, rec_sz, "RT", &namesz);
+		if (rec_name && strncmp(record, rec_name, namesz) == 0) {
+			if (sz)
+				*sz = rec_sz;
+			return p;
+		}
+
+		p += rec_sz;
+		if (p >= end || *(p++) != 0x78)
+			return NULL;
+	}
+	return NULL;
+}
+
+static const void *ref_find(const void *vpd, size_t vpd_size,
+			    const char *record, const char *keyword,
+			    uint8_t *sz)
+{
+	size_t rec_sz;
+	const uint8_t *p;
+
+	p = ref_find_record(vpd, vpd_size, record, &rec_sz);
+	if (p)
+		p = ref_find_keyword(p, rec_sz, keyword, sz);
+	return p;
+}
+
+/*
+ * A VPD LID: some leading padding, then records of keywords, each
+ * record named by its RT keyword and closed by 0x78.
+ */
+#define LID_SIZE	0x4000
+
+static const char *const kws[] = {
+	"RT", "FN", "SN", "PN", "CC", "CE", "HW", "CT", "B3", "DR",
+	"LX", "MF", "SM", "VZ", "PF",
+};
+
+static size_t make_lid(uint8_t *lid, unsigned int nr_recs,
+		       unsigned int nr_kws)
+{
+	size_t pos = 16, rec;
+	unsigned int i, j, sz;
+
+	memset(lid, 0, LID_SIZE);
+	for (i = 0; i < nr_recs; i++) {
+		lid[pos++] = 0x84;
+		rec = pos;
+		pos += 2;
+
+		/* LX00, PR01, LX02, ... with a VINI in the middle */
+		lid[pos++] = 'R';
+		lid[pos++] = 'T';
+		lid[pos++] = 4;
+		if (i == nr_recs / 2)
+			memcpy(&lid[pos], "VINI", 4);
+		else
+			sprintf((char *)&lid[pos], "%s%02u",
+				i & 1 ? "PR" : "LX", i % 100);
+		pos += 4;
+
+		for (j = 1; j < nr_kws; j++) {
+			sz = rand() % 24;
+			memcpy(&lid[pos], kws[j % ARRAY_SIZE(kws)], 2);
+			lid[pos + 2] = sz;
+			memset(&lid[pos + 3], 'a' + j, sz);
+			pos += 3 + sz;
+		}
+
+		lid[rec] = (pos - rec - 2) & 0xff;
+		lid[rec + 1] = (pos - rec - 2) >> 8;
+		lid[pos++] = 0x78;
+		assert(pos < LID_SIZE - 64);
+	}
+
+	return pos;
+}
+
+static const char *const recs[] = {
+	"VINI", "PR01", "PR03", "LX00", "LX10", "PR99", "LXR0", "",
+};
+
+/* Every way of looking something up agrees with the old scans */
+static void check_lookups(const uint8_t *lid, size_t size)
+{
+	struct vpd_index *idx = vpd_index_build(lid, size);
+	const void *ref, *p, *q;
+	size_t ref_sz, sz1, sz2;
+	uint8_t kref, k1, k2;
+	unsigned int i, j;
+
+	assert(idx);
+	for (i = 0; i < ARRAY_SIZE(recs); i++) {
+		ref_sz = sz1 = sz2 = 0;
+		ref = ref_find_record(lid, size, recs[i], &ref_sz);
+		p = vpd_find_record(lid, size, recs[i], &sz1);
+		q = vpd_index_find_record(idx, recs[i], &sz2);
+		assert(p == ref && q == ref);
+		assert(sz1 == ref_sz && sz2 == ref_sz);
+
+		for (j = 0; j < ARRAY_SIZE(kws); j++) {
+			kref = k1 = k2 = 0;
+			ref = ref_find(lid, size, recs[i], kws[j], &kref);
+			p = vpd_find(lid, size, recs[i], kws[j], &k1);
+			q = vpd_index_find(idx, recs[i], kws[j], &k2);
+			assert(p == ref && q == ref);
+			assert(k1 == kref && k2 == kref);
+		}
+	}
+	vpd_index_free(idx);
+}
+
+#define BENCH_LOOPS	200
+
+static void bench(const uint8_t *lid, size_t size, unsigned int nr_recs)
+{
+	uint64_t start, scan, indexed;
+	struct vpd_index *idx;
+	unsigned int i, j, l, n = 0;
+	const void *p;
+	char rec[8];
+
+	start = bench_now_ns();
+	for (l = 0; l < BENCH_LOOPS; l++) {
+		for (i = 0; i < nr_recs; i++) {
+			sprintf(rec, "%s%02u", i & 1 ? "PR" : "LX", i % 100);
+			for (j = 0; j < ARRAY_SIZE(kws); j++) {
+				p = vpd_find(lid, size, rec, kws[j], NULL);
+				n += !!p;
+			}
+		}
+	}
+	scan = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (l = 0; l < BENCH_LOOPS; l++) {
+		idx = vpd_index_build(lid, size);
+		for (i = 0; i < nr_recs; i++) {
+			sprintf(rec, "%s%02u", i & 1 ? "PR" : "LX", i % 100);
+			for (j = 0; j < ARRAY_SIZE(kws); j++) {
+				p = vpd_index_find(idx, rec, kws[j], NULL);
+				n -= !!p;
+			}
+		}
+		vpd_index_free(idx);
+	}
+	indexed = bench_now_ns() - start;
+	assert(n == 0);
+
+	printf("vpd: %u records, %zu bytes: %llu ns per scan, "
+	       "%llu ns per indexed lookup\n", nr_recs, size,
+	       (unsigned long long)scan / (BENCH_LOOPS * nr_recs *
+					   ARRAY_SIZE(kws)),
+	       (unsigned long long)indexed / (BENCH_LOOPS * nr_recs *
+					      ARRAY_SIZE(kws)));
+}
+
+#define FUZZ_ROUNDS	2000
+
+int main(void)
+{
+	static uint8_t lid[LID_SIZE];
+	struct vpd_index *idx;
+	size_t size, sz;
+	unsigned int i, j;
+	const uint8_t *p;
+
+	srand(0x4c58);
+
+	/* Well formed */
+	size = make_lid(lid, 20, 12);
+	idx = vpd_index_build(lid, size);
+	assert(idx && idx->nr_recs == 20 && idx->nr_kws == 20 * 12);
+	p = vpd_index_find_record(idx, "VINI", &sz);
+	assert(p && !memcmp(p + 3, "VINI", 4) && p[sz] == 0x78);
+	vpd_index_free(idx);
+	check_lookups(lid, size);
+
+	/* Truncated anywhere */
+	for (i = 0; i < size; i += 7)
+		check_lookups(lid, i);
+
+	/* And with random bytes flipped */
+	for (i = 0; i < FUZZ_ROUNDS; i++) {
+		size = make_lid(lid, 1 + rand() % 30, 1 + rand() % 16);
+		for (j = rand() % 4; j; j--)
+			lid[rand() % size] = rand();
+		check_lookups(lid, size);
+	}
+
+	/* Nothing to index */
+	assert(!vpd_index_build(NULL, 0));
+	idx = vpd_index_build(lid, 0);
+	assert(idx && !idx->nr_recs);
+	assert(!vpd_index_find(idx, "VINI", "RT", NULL));
+	vpd_index_free(idx);
+
+	if (bench_enabled()) {
+		size = make_lid(lid, 8, 15);
+		bench(lid, size, 8);
+		size = make_lid(lid, 60, 15);
+		bench(lid, size, 60);
+	}
+
+	return 0;
+}
@@ -15,7 +15,7 @@
 /* Heartbeat requested from Linux */
 #define HEARTBEAT_DEFAULT_MS	200
 
-static struct lock timer_lock = LOCK_UNLOCKED;
+static struct lock timer_lock = LOCK_UNLOCKED_NAMED("timer_lock");
 static LIST_HEAD(timer_list);
 static LIST_HEAD(timer_poll_list);
 static bool timer_in_poll;
@@ -22,6 +22,25 @@
 
 #define CHECK_SPACE(_p, _n, _e) (((_e) - (_p)) >= (_n))
 
+/* Step over the next keyword of a record, returning its data. *p is
+ * left at the keyword following it.
+ */
+static const uint8_t *vpd_next_keyword(const uint8_t **p, const uint8_t *end,
+				       const uint8_t **kw, uint8_t *kw_size)
+{
+	const uint8_t *data;
+
+	if (!CHECK_SPACE(*p, 3, end))
+		return NULL;
+
+	*kw = *p;
+	*kw_size = (*p)[2];
+	data = *p + 3;
+	*p = data + *kw_size;
+
+	return data;
+}
+
 /* Low level keyword search in a record. Can be used when we
  * need to find the next keyword of a given type, for example
  * when having multiple MF/SM keyword pairs
@@ -30,18 +49,15 @@ const void *vpd_find_keyword(const void *rec, size_t rec_sz,
 			     const char *kw, uint8_t *kw_size)
 {
 	const uint8_t *p = rec, *end = rec + rec_sz;
+	const uint8_t *data, *k;
+	uint8_t sz;
 
-	while (CHECK_SPACE(p, 3, end)) {
-		uint8_t k1 = *(p++);
-		uint8_t k2 = *(p++);
-		uint8_t sz = *(p++);
-
-		if (k1 == kw[0] && k2 == kw[1]) {
+	while ((data = vpd_next_keyword(&p, end, &k, &sz))) {
+		if (k[0] == kw[0] && k[1] == kw[1]) {
 			if (kw_size)
 				*kw_size = sz;
-			return p;
+			return data;
 		}
-		p += sz;
 	}
 	return NULL;
 }
@@ -75,55 +91,80 @@ bool vpd_valid(const void *vvpd, size_t vpd_size)
 	return true;
 }
 
-/* Locate  a record in a VPD blob
+/* Walk the records of a VPD blob in order. */
+struct vpd_walk {
+	const uint8_t *p, *end;
+	const char *name;
+	uint8_t namesz;
+	bool started;
+};
+
+/* Step to the next record, returning its data and size. Its name is
+ * left in w->name. Stops with NULL at the end of the blob or where it
+ * is malformed.
  *
  * Note: This works with VPD LIDs. It will scan until it finds
  * the first 0x84, so it will skip all those 0's that the VPD
  * LIDs seem to contain
  */
-const void *vpd_find_record(const void *vpd, size_t vpd_size,
-			    const char *record, size_t *sz)
+static const uint8_t *vpd_next_record(struct vpd_walk *w, size_t *sz)
 {
-	const uint8_t *p = vpd, *end = vpd + vpd_size;
-	bool first_start = true;
+	const uint8_t *rec;
 	size_t rec_sz;
-	uint8_t namesz = 0;
-	const char *rec_name;
 
-	if (!vpd)
+	/* The previous record must have been closed */
+	if (w->started && (w->p >= w->end || *(w->p++) != 0x78)) {
+		prerror("VPD: Malformed or truncated VPD,"
+			" missing final 0x78 in record %.4s\n",
+			w->name ? w->name : "????");
 		return NULL;
+	}
 
-	while (CHECK_SPACE(p, 4, end)) {
+	while (CHECK_SPACE(w->p, 4, w->end)) {
 		/* Get header byte */
-		if (*(p++) != 0x84) {
+		if (*(w->p++) != 0x84) {
 			/* Skip initial crap in VPD LIDs */
-			if (first_start)
+			if (!w->started)
 				continue;
-			break;
+			return NULL;
 		}
-		first_start = false;
-		rec_sz = *(p++);
-		rec_sz |= *(p++) << 8;
-		if (!CHECK_SPACE(p, rec_sz, end)) {
+		w->started = true;
+		rec_sz = *(w->p++);
+		rec_sz |= *(w->p++) << 8;
+		if (!CHECK_SPACE(w->p, rec_sz, w->end)) {
 			prerror("VPD: Malformed or truncated VPD,"
 				" record size doesn't fit\n");
 			return NULL;
 		}
 
 		/* Find record name */
-		rec_name = vpd_find_keyword(p, rec_sz, "RT", &namesz);
-		if (rec_name && strncmp(record, rec_name, namesz) == 0) {
+		rec = w->p;
+		w->namesz = 0;
+		w->name = vpd_find_keyword(rec, rec_sz, "RT", &w->namesz);
+		w->p += rec_sz;
+		*sz = rec_sz;
+
+		return rec;
+	}
+	return NULL;
+}
+
+/* Locate  a record in a VPD blob */
+const void *vpd_find_record(const void *vpd, size_t vpd_size,
+			    const char *record, size_t *sz)
+{
+	struct vpd_walk w = { .p = vpd, .end = vpd + vpd_size };
+	const uint8_t *rec;
+	size_t rec_sz;
+
+	if (!vpd)
+		return NULL;
+
+	while ((rec = vpd_next_record(&w, &rec_sz))) {
+		if (w.name && strncmp(record, w.name, w.namesz) == 0) {
 			if (sz)
 				*sz = rec_sz;
-			return p;
-		}
-
-		p += rec_sz;
-		if (*(p++) != 0x78) {
-			prerror("VPD: Malformed or truncated VPD,"
-				" missing final 0x78 in record %.4s\n",
-				rec_name ? rec_name : "????");
-			return NULL;
+			return rec;
 		}
 	}
 	return NULL;
@@ -148,6 +189,137 @@ const void *vpd_find(const void *vpd, size_t vpd_size,
 	return p;
 }
 
+/* Index a VPD blob in one pass, so that looking up many keywords
+ * doesn't rescan it from the start each time. The index points into
+ * the blob, which must outlive it. It covers the same records
+ * vpd_find_record() would find, stopping where the blob is malformed.
+ */
+struct vpd_index *vpd_index_build(const void *vpd, size_t vpd_size)
+{
+	struct vpd_walk w = { .p = vpd, .end = vpd + vpd_size };
+	unsigned int max_recs = 8, max_kws = 64;
+	const uint8_t *rec, *p, *end, *k, *data;
+	struct vpd_index_rec *r;
+	struct vpd_index *idx;
+	size_t rec_sz;
+	uint8_t sz;
+	void *new;
+
+	if (!vpd)
+		return NULL;
+
+	idx = zalloc(sizeof(*idx));
+	if (!idx)
+		return NULL;
+	idx->vpd = vpd;
+	idx->vpd_size = vpd_size;
+	idx->recs = malloc(max_recs * sizeof(*idx->recs));
+	idx->kws = malloc(max_kws * sizeof(*idx->kws));
+	if (!idx->recs || !idx->kws)
+		goto fail;
+
+	while ((rec = vpd_next_record(&w, &rec_sz))) {
+		if (idx->nr_recs == max_recs) {
+			max_recs *= 2;
+			new = realloc(idx->recs, max_recs * sizeof(*idx->recs));
+			if (!new)
+				goto fail;
+			idx->recs = new;
+		}
+
+		r = &idx->recs[idx->nr_recs++];
+		r->name = w.name;
+		r->namesz = w.namesz;
+		r->offset = rec - (const uint8_t *)vpd;
+		r->size = rec_sz;
+		r->first_kw = idx->nr_kws;
+
+		p = rec;
+		end = rec + rec_sz;
+		while ((data = vpd_next_keyword(&p, end, &k, &sz))) {
+			if (idx->nr_kws == max_kws) {
+				max_kws *= 2;
+				new = realloc(idx->kws,
+					      max_kws * sizeof(*idx->kws));
+				if (!new)
+					goto fail;
+				idx->kws = new;
+			}
+			idx->kws[idx->nr_kws].kw[0] = k[0];
+			idx->kws[idx->nr_kws].kw[1] = k[1];
+			idx->kws[idx->nr_kws].size = sz;
+			idx->kws[idx->nr_kws].offset =
+				data - (const uint8_t *)vpd;
+			idx->nr_kws++;
+		}
+		r->nr_kws = idx->nr_kws - r->first_kw;
+	}
+
+	return idx;
+ fail:
+	prerror("VPD: Failed to allocate index\n");
+	vpd_index_free(idx);
+	return NULL;
+}
+
+void vpd_index_free(struct vpd_index *idx)
+{
+	if (!idx)
+		return;
+
+	free(idx->recs);
+	free(idx->kws);
+	free(idx);
+}
+
+static const struct vpd_index_rec *vpd_index_rec(const struct vpd_index *idx,
+						 const char *record)
+{
+	const struct vpd_index_rec *r;
+	unsigned int i;
+
+	for (i = 0; i < idx->nr_recs; i++) {
+		r = &idx->recs[i];
+		if (r->name && strncmp(record, r->name, r->namesz) == 0)
+			return r;
+	}
+	return NULL;
+}
+
+const void *vpd_index_find_record(const struct vpd_index *idx,
+				  const char *record, size_t *sz)
+{
+	const struct vpd_index_rec *r = vpd_index_rec(idx, record);
+
+	if (!r)
+		return NULL;
+	if (sz)
+		*sz = r->size;
+
+	return idx->vpd + r->offset;
+}
+
+const void *vpd_index_find(const struct vpd_index *idx, const char *record,
+			   const char *keyword, uint8_t *sz)
+{
+	const struct vpd_index_rec *r = vpd_index_rec(idx, record);
+	const struct vpd_index_kw *k;
+	unsigned int i;
+
+	if (!r)
+		return NULL;
+
+	for (i = 0; i < r->nr_kws; i++) {
+		k = &idx->kws[r->first_kw + i];
+		if (k->kw[0] == keyword[0] && k->kw[1] == keyword[1]) {
+			if (sz)
+				*sz = k->size;
+			return idx->vpd + k->offset;
+		}
+	}
+	return NULL;
+}
+
 static void *vpd_lid;
 static size_t vpd_lid_size;
 static uint32_t vpd_lid_no;
@@ -0,0 +1,199 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Decode the OPAL call latency statistics, either from the exported
+ * region (/sys/firmware/opal/exports/opal_call_stats) or from
+ * /dev/mem at the address given in the device-tree.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <opal-api.h>
+
+static uint32_t nr_tokens, nr_buckets, bucket_shift;
+static uint64_t tb_hz;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c <pir> | -p] [-o <offset>] <file>\n"
+		"  -c <pir>    Only show CPU <pir>\n"
+		"  -p          Show each CPU separately\n"
+		"  -o <offset> Read at <offset> in <file>, eg. for /dev/mem\n",
+		prog);
+	exit(1);
+}
+
+static void read_at(int fd, void *buf, size_t len, off_t off)
+{
+	ssize_t rc;
+
+	while (len) {
+		rc = pread(fd, buf, len, off);
+		if (rc < 0)
+			err(1, "Reading statistics");
+		if (rc == 0)
+			errx(1, "Truncated statistics");
+		buf += rc;
+		len -= rc;
+		off += rc;
+	}
+}
+
+static double tb_to_us(uint64_t tb)
+{
+	return (double)tb * 1000000 / tb_hz;
+}
+
+static void add_stats(struct opal_call_stat *out,
+		      const struct opal_call_stat *in)
+{
+	uint32_t t, b;
+
+	for (t = 0; t < nr_tokens; t++, out++, in++) {
+		out->count = cpu_to_be64(be64_to_cpu(out->count) +
+					 be64_to_cpu(in->count));
+		out->total_tb = cpu_to_be64(be64_to_cpu(out->total_tb) +
+					    be64_to_cpu(in->total_tb));
+		if (be64_to_cpu(in->max_tb) > be64_to_cpu(out->max_tb))
+			out->max_tb = in->max_tb;
+		for (b = 0; b < nr_buckets; b++)
+			out->buckets[b] = cpu_to_be32(
+				be32_to_cpu(out->buckets[b]) +
+				be32_to_cpu(in->buckets[b]));
+	}
+}
+
+static void print_stats(const char *title, const struct opal_call_stat *s)
+{
+	uint32_t t, b;
+
+	printf("%s\n", title);
+	printf("%5s %12s %10s %10s  histogram (upper bound in us: count)\n",
+	       "token", "calls", "avg(us)", "max(us)");
+
+	for (t = 0; t < nr_tokens; t++, s++) {
+		uint64_t count = be64_to_cpu(s->count);
+
+		if (!count)
+			continue;
+		printf("%5u %12" PRIu64 " %10.2f %10.2f ", t, count,
+		       tb_to_us(be64_to_cpu(s->total_tb)) / count,
+		       tb_to_us(be64_to_cpu(s->max_tb)));
+		for (b = 0; b < nr_buckets; b++) {
+			uint32_t n = be32_to_cpu(s->buckets[b]);
+
+			if (!n)
+				continue;
+			if (b == nr_buckets - 1)
+				printf(" inf:%u", n);
+			else
+				printf(" %.1f:%u", tb_to_us(1ull <<
+					(bucket_shift + b)), n);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct opal_call_stats hdr;
+	struct opal_call_stats_cpu *cpus, *cpu;
+	struct opal_call_stat *total;
+	size_t cpu_size;
+	uint32_t i, nr_cpus;
+	long pir = -1;
+	bool per_cpu = false;
+	off_t off = 0;
+	char title[32];
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "c:po:")) != -1) {
+		switch (opt) {
+		case 'c':
+			pir = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			per_cpu = true;
+			break;
+		case 'o':
+			off = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0)
+		err(1, "Opening %s", argv[optind]);
+
+	read_at(fd, &hdr, sizeof(hdr), off);
+	if (be32_to_cpu(hdr.magic) != OPAL_CALL_STATS_MAGIC)
+		errx(1, "Bad magic 0x%08x", be32_to_cpu(hdr.magic));
+	if (be32_to_cpu(hdr.version) != OPAL_CALL_STATS_VERSION)
+		errx(1, "Unknown version %u", be32_to_cpu(hdr.version));
+
+	nr_cpus = be32_to_cpu(hdr.nr_cpus);
+	nr_tokens = be32_to_cpu(hdr.nr_tokens);
+	nr_buckets = be32_to_cpu(hdr.nr_buckets);
+	bucket_shift = be32_to_cpu(hdr.bucket_shift);
+	tb_hz = be64_to_cpu(hdr.tb_hz);
+	if (nr_buckets != OPAL_CALL_STATS_BUCKETS || !tb_hz)
+		errx(1, "Unsupported statistics layout");
+
+	cpu_size = sizeof(*cpu) + nr_tokens * sizeof(struct opal_call_stat);
+	cpus = malloc(nr_cpus * cpu_size);
+	total = calloc(nr_tokens, sizeof(*total));
+	if (!cpus || !total)
+		err(1, "Allocating %zu bytes", nr_cpus * cpu_size);
+	read_at(fd, cpus, nr_cpus * cpu_size, off + sizeof(hdr));
+	close(fd);
+
+	printf("%u CPUs, timebase %" PRIu64 " Hz\n\n", nr_cpus, tb_hz);
+
+	for (i = 0; i < nr_cpus; i++) {
+		cpu = (void *)cpus + i * cpu_size;
+		if (pir != -1 && be32_to_cpu(cpu->pir) != pir)
+			continue;
+		if (per_cpu) {
+			snprintf(title, sizeof(title), "CPU 0x%04x",
+				 be32_to_cpu(cpu->pir));
+			print_stats(title, cpu->tokens);
+		} else {
+			add_stats(total, cpu->tokens);
+		}
+	}
+
+	if (!per_cpu)
+		print_stats(pir == -1 ? "All CPUs" : "Selected CPU", total);
+
+	free(total);
+	free(cpus);
+	return 0;
+}
@@ -40,6 +40,7 @@ extern void add_core_attr(struct dt_node *cpu, uint32_t attr);
 extern uint32_t add_core_cache_info(struct dt_node *cpus,
 				    const struct sppcia_cpu_cache *cache,
 				    uint32_t int_server, int okay);
+extern int slca_get_count(void);
 extern const struct slca_entry *slca_get_entry(uint16_t slca_index);
 extern const char *slca_get_vpd_name(uint16_t slca_index);
 extern const char *slca_get_loc_code_index(uint16_t slca_index);
@@ -22,10 +22,19 @@
 #include "spira.h"
 #include "hdata.h"
 
-const struct slca_entry *slca_get_entry(uint16_t slca_index)
+/*
+ * The SLCA table is looked up for every VPD node we create, so find its
+ * header and size once rather than re-validating the HDIF each time.
+ */
+static const struct HDIF_common_hdr *slca_hdr;
+static int slca_count = -1;
+
+static const struct HDIF_common_hdr *slca_get_hdr(int *count)
 {
-	struct HDIF_common_hdr *slca_hdr;
-	int count;
+	if (slca_count >= 0) {
+		*count = slca_count;
+		return slca_hdr;
+	}
 
 	slca_hdr = get_hdif(&spira.ntuples.slca, SLCA_HDIF_SIG);
 	if (!slca_hdr) {
@@ -33,16 +42,39 @@ const struct slca_entry *slca_get_entry(uint16_t slca_index)
 		return NULL;
 	}
 
-	count = HDIF_get_iarray_size(slca_hdr, SLCA_IDATA_ARRAY);
-	if (count < 0) {
+	*count = HDIF_get_iarray_size(slca_hdr, SLCA_IDATA_ARRAY);
+	if (*count < 0) {
 		prerror("SLCA: Can't find SLCA array size!\n");
 		return NULL;
 	}
 
+	slca_count = *count;
+	return slca_hdr;
+}
+
+int slca_get_count(void)
+{
+	int count;
+
+	if (!slca_get_hdr(&count))
+		return -1;
+
+	return count;
+}
+
+const struct slca_entry *slca_get_entry(uint16_t slca_index)
+{
+	const struct HDIF_common_hdr *hdr;
+	int count;
+
+	hdr = slca_get_hdr(&count);
+	if (!hdr)
+		return NULL;
+
 	if (slca_index < count) {
 		const struct slca_entry *s_entry;
 		unsigned int entry_sz;
-		s_entry = HDIF_get_iarray_item(slca_hdr, SLCA_IDATA_ARRAY,
+		s_entry = HDIF_get_iarray_item(hdr, SLCA_IDATA_ARRAY,
 					slca_index, &entry_sz);
 
 		if (s_entry && entry_sz >= sizeof(*s_entry))
@@ -100,25 +132,17 @@ static const struct slca_entry *slca_get_sai_entry(void)
 {
 	int count;
 	unsigned int i;
-	struct HDIF_common_hdr *slca_hdr;
-
-	slca_hdr = get_hdif(&spira.ntuples.slca, SLCA_HDIF_SIG);
-	if (!slca_hdr) {
-		prerror("SLCA Invalid\n");
-		return NULL;
-	}
+	const struct HDIF_common_hdr *hdr;
 
-	count = HDIF_get_iarray_size(slca_hdr, SLCA_IDATA_ARRAY);
-	if (count < 0) {
-		prerror("SLCA: Can't find SLCA array size!\n");
+	hdr = slca_get_hdr(&count);
+	if (!hdr)
 		return NULL;
-	}
 
 	for (i = 0; i < count; i++) {
 		const struct slca_entry *s_entry;
 		unsigned int entry_sz;
 
-		s_entry = HDIF_get_iarray_item(slca_hdr, SLCA_IDATA_ARRAY,
+		s_entry = HDIF_get_iarray_item(hdr, SLCA_IDATA_ARRAY,
 					       i, &entry_sz);
 		if (s_entry &&
 		    VPD_ID(s_entry->fru_id[0],
@@ -1252,13 +1252,13 @@ int parse_hdat(bool is_opal)
 	dt_add_property_string(dt_root, "lid-type", is_opal ? "opal" : "phyp");
 
 	/* Add any BMCs and enable the LPC UART */
-	bmc_parse();
+	hdat_stage(bmc_parse);
 
 	/* Create /vpd node */
-	dt_init_vpd_node();
+	hdat_stage(dt_init_vpd_node);
 
 	/* Create /ibm,opal/led node */
-	dt_init_led_node();
+	hdat_stage(dt_init_led_node);
 
 	/* Parse SPPACA and/or PCIA */
 	if (!pcia_parse())
@@ -1266,40 +1266,40 @@ int parse_hdat(bool is_opal)
 			return -1;
 
 	/* IPL params */
-	add_iplparams();
+	hdat_stage(add_iplparams);
 
 	/* Parse MS VPD */
-	memory_parse();
+	hdat_stage(memory_parse);
 
 	/* Add XSCOM node (must be before chiptod, IO and FSP) */
-	add_xscom();
+	hdat_stage(add_xscom);
 
 	/* Add any FSPs */
-	fsp_parse();
+	hdat_stage(fsp_parse);
 
 	/* Add ChipTOD's */
 	if (!add_chiptod_old() && !add_chiptod_new())
 		prerror("CHIPTOD: No ChipTOD found !\n");
 
 	/* Add NX */
-	add_nx();
+	hdat_stage(add_nx);
 
 	/* Add nest mmu */
-	add_nmmu();
+	hdat_stage(add_nmmu);
 
 	/* Add IO HUBs and/or PHBs */
-	io_parse();
+	hdat_stage(io_parse);
 
 	/* Parse VPD */
-	vpd_parse();
+	hdat_stage(vpd_parse);
 
 	/* Host services information. */
- 	hostservices_parse();
+	hdat_stage(hostservices_parse);
 
 	/* Parse System Attention Indicator inforamtion */
-	slca_dt_add_sai_node();
+	hdat_stage(slca_dt_add_sai_node);
 
-	add_stop_levels();
+	hdat_stage(add_stop_levels);
 
 	prlog(PR_INFO, "Parsing HDAT...done\n");
 
@@ -199,6 +199,11 @@ extern bool spira_check_ptr(const void *ptr, const char *file,
 			    unsigned int line);
 #endif
 
+/* The test harness times each stage of parse_hdat() */
+#ifndef hdat_stage
+#define hdat_stage(_fn)	_fn()
+#endif
+
 struct proc_init_data {
 	struct HDIF_common_hdr	hdr;
 	struct HDIF_idata_ptr	regs_ptr;
@@ -45,6 +45,17 @@ static uint64_t base_addr;
 struct spira_ntuple;
 static void *ntuple_addr(const struct spira_ntuple *n);
 
+/* Time each stage of parse_hdat(), and count what it allocates */
+static void stage_start(void);
+static void stage_end(const char *name);
+
+#define hdat_stage(_fn)		\
+	do {			\
+		stage_start();	\
+		_fn();		\
+		stage_end(#_fn);	\
+	} while (0)
+
 /* Stuff which core expects. */
 #define __this_cpu ((struct cpu_thread *)NULL)
 
@@ -117,6 +128,7 @@ static bool spira_check_ptr(const void *ptr, const char *file, unsigned int line
 #include "../../core/device.c"
 #include "../../core/chip.c"
 #include "../../test/dt_common.c"
+#include "../../test/bench.h"
 #include "../../core/fdt.c"
 #include "../../hw/phys-map.c"
 #include "../../core/mem_region.c"
@@ -222,10 +234,619 @@ static void dump_hdata_fdt(struct dt_node *root)
 	free(fdt_blob);
 }
 
+#define BENCH_LOOPS	100
+
+/*
+ * Flatten the whole tree with a cold and a warm size cache, then fetch
+ * every subtree the way the OS does on hotplug (size query followed by
+ * the copy) and check it matches a fresh flatten. With SKIBOOT_BENCH
+ * set the flattens are repeated and timed.
+ */
+static void check_flatten(struct dt_node *root)
+{
+	struct dt_property *prop;
+	struct dt_node *n;
+	uint64_t start, cold = 0, warm = 0, fetch = 0;
+	unsigned int i, loops, total = 0, nodes = 0;
+	int64_t size;
+	void *fdt, *ref;
+
+	/* Host heap pointers are way above our fake RAM */
+	top_of_ram = -1ul >> 4;
+
+	loops = bench_enabled() ? BENCH_LOOPS : 1;
+	for (i = 0; i < loops; i++) {
+		dt_flat_flush();
+		start = bench_now_ns();
+		fdt = create_dtb(root, false);
+		cold += bench_now_ns() - start;
+		assert(fdt);
+		free(fdt);
+
+		start = bench_now_ns();
+		fdt = create_dtb(root, false);
+		warm += bench_now_ns() - start;
+		assert(fdt);
+		total = fdt_totalsize(fdt);
+		free(fdt);
+	}
+
+	/*
+	 * The size query flattens a subtree and the fill after it is
+	 * served from that, even with no full flatten before, and a
+	 * change under the subtree takes a single new flatten.
+	 */
+	n = list_top(&root->children, struct dt_node, list);
+	assert(n);
+	dt_flat_flush();
+	size = opal_get_device_tree(n->phandle, 0, 0);
+	assert(size > 0 && fdt_cache.root == n);
+	ref = fdt_cache.fdt;
+	fdt = malloc(size + 64);
+	assert(opal_get_device_tree(n->phandle, (uint64_t)fdt,
+				    size) == OPAL_SUCCESS);
+	assert(fdt_cache.fdt == ref);
+	prop = dt_add_property_cells(n, "hotplug-test", 1);
+	size = opal_get_device_tree(n->phandle, 0, 0);
+	assert(size > 0 && fdt_cache.fdt != ref);
+	ref = fdt_cache.fdt;
+	assert(opal_get_device_tree(n->phandle, (uint64_t)fdt,
+				    size) == OPAL_SUCCESS);
+	assert(fdt_cache.fdt == ref);
+	dt_del_property(n, prop);
+	free(fdt);
+
+	dt_for_each_node(root, n) {
+		start = bench_now_ns();
+		size = opal_get_device_tree(n->phandle, 0, 0);
+		assert(size > 0);
+		fdt = malloc(size);
+		assert(opal_get_device_tree(n->phandle, (uint64_t)fdt,
+					    size) == OPAL_SUCCESS);
+		fetch += bench_now_ns() - start;
+
+		ref = create_dtb(n, true);
+		assert(ref && fdt_totalsize(ref) == size);
+		assert(memcmp(ref, fdt, size) == 0);
+		free(ref);
+		free(fdt);
+		nodes++;
+	}
+
+	if (!bench_enabled())
+		return;
+
+	fprintf(stderr, "flatten: %u bytes, cold %llu ns, warm %llu ns\n",
+		total,
+		(unsigned long long)cold / loops,
+		(unsigned long long)warm / loops);
+	fprintf(stderr, "flatten: %u subtree fetches, %llu ns each\n",
+		nodes, (unsigned long long)fetch / (nodes ? nodes : 1));
+}
+
+/*
+ * Check every property is found by its name. With SKIBOOT_BENCH set,
+ * time the lookups and report what interning property names saves over
+ * a copy per property.
+ */
+static void check_names(struct dt_node *root)
+{
+	struct dt_node *n;
+	struct dt_property *p;
+	struct dt_name *name;
+	unsigned int i, loops, props = 0, names = 0;
+	size_t copied = 0, interned = 0;
+	uint64_t start, lookup;
+
+	loops = bench_enabled() ? BENCH_LOOPS : 1;
+	start = bench_now_ns();
+	for (i = 0; i < loops; i++)
+		dt_for_each_node(root, n)
+			list_for_each(&n->properties, p, list)
+				assert(dt_find_property(n, p->name) == p);
+	lookup = bench_now_ns() - start;
+
+	if (!bench_enabled())
+		return;
+
+	dt_for_each_node(root, n) {
+		list_for_each(&n->properties, p, list) {
+			copied += strlen(p->name) + 1;
+			props++;
+		}
+	}
+
+	for (i = 0; i < DT_NAME_HASH_SIZE; i++) {
+		for (name = dt_names[i]; name; name = name->next) {
+			interned += sizeof(*name) + name->len + 1;
+			names++;
+		}
+	}
+
+	fprintf(stderr, "names: %u properties, %u distinct names\n",
+		props, names);
+	fprintf(stderr, "names: %zu bytes as copies, %zu bytes interned\n",
+		copied, interned);
+	fprintf(stderr, "names: %llu ns per lookup\n",
+		(unsigned long long)lookup / (loops * (props ? props : 1)));
+}
+
+/*
+ * Profile of the parse: time and allocations for each stage of
+ * parse_hdat(). The allocation counts come from our malloc stubs.
+ */
+extern unsigned long stub_nr_allocs, stub_alloc_bytes;
+
+#define MAX_STAGES	32
+
+static struct stage {
+	const char *name;
+	uint64_t ns;
+	unsigned long nr_allocs, alloc_bytes;
+} stages[MAX_STAGES];
+static unsigned int nr_stages;
+
+static uint64_t stage_start_ns;
+static unsigned long stage_start_allocs, stage_start_bytes;
+
+static void stage_start(void)
+{
+	stage_start_allocs = stub_nr_allocs;
+	stage_start_bytes = stub_alloc_bytes;
+	stage_start_ns = bench_now_ns();
+}
+
+static void stage_end(const char *name)
+{
+	struct stage *s;
+
+	assert(nr_stages < MAX_STAGES);
+	s = &stages[nr_stages++];
+	s->ns = bench_now_ns() - stage_start_ns;
+	s->name = name;
+	s->nr_allocs = stub_nr_allocs - stage_start_allocs;
+	s->alloc_bytes = stub_alloc_bytes - stage_start_bytes;
+}
+
+/*
+ * Report the profile. What depends only on the input and the code
+ * (allocations, the size of the tree) goes to stdout, where it can be
+ * compared against a baseline. Times go to stderr, and only with
+ * SKIBOOT_BENCH set.
+ */
+static void report_profile(struct dt_node *root, uint64_t total_ns,
+			   unsigned long nr_allocs, unsigned long alloc_bytes)
+{
+	unsigned int i, nodes = 0, props = 0;
+	struct dt_property *p;
+	struct dt_node *n;
+	void *fdt;
+
+	dt_for_each_node(root, n) {
+		list_for_each(&n->properties, p, list)
+			props++;
+		nodes++;
+	}
+
+	fdt = create_dtb(root, false);
+	assert(fdt);
+
+	for (i = 0; i < nr_stages; i++) {
+		printf("stage %s: %lu allocations, %lu bytes\n",
+		       stages[i].name, stages[i].nr_allocs,
+		       stages[i].alloc_bytes);
+		if (bench_enabled())
+			fprintf(stderr, "stage %s: %llu ns\n", stages[i].name,
+				(unsigned long long)stages[i].ns);
+	}
+	printf("parse: %lu allocations, %lu bytes\n", nr_allocs, alloc_bytes);
+	printf("dt: %u nodes, %u properties, %u bytes flattened\n",
+	       nodes, props, fdt_totalsize(fdt));
+	if (bench_enabled())
+		fprintf(stderr, "parse: %llu ns\n",
+			(unsigned long long)total_ns);
+
+	free(fdt);
+}
+
+/*
+ * Synthesize a larger machine out of the dump, by adding more nodes
+ * like the one it describes. Each extra node gets a copy of the
+ * installed chips, of the memory areas and of the enclosure's SLCA
+ * subtree, with its own chip IDs, memory addresses and SLCA indices.
+ * The copies go in room we leave after the dump's own heap.
+ */
+#define SYNTH_MAX_NODES		8
+#define SYNTH_NODE_SHIFT	3
+#define SYNTH_MEM_STRIDE	(1ull << 40)
+
+static unsigned int synth_nodes = 1;
+static size_t synth_used;
+static unsigned int synth_nr_chips, synth_nr_msareas, synth_nr_slca;
+
+/* The enclosure's descendants are [lo, hi], copy k starts at base */
+static unsigned int slca_lo, slca_hi, slca_base;
+
+static void *synth_alloc(size_t size)
+{
+	void *p;
+
+	synth_used = ALIGN_UP(synth_used, 0x10);
+	if (synth_used + size > spira_heap_size)
+		errx(1, "synthesized HDAT doesn't fit");
+	p = spira_heap + synth_used;
+	synth_used += size;
+
+	return p;
+}
+
+static void synth_set_ntuple(struct spira_ntuple *n, void *p, size_t size)
+{
+	n->addr = cpu_to_be64(base_addr + (p - spira_heap));
+	n->alloc_len = n->act_len = cpu_to_be32(size);
+}
+
+static void *synth_idata(void *hdif, unsigned int di)
+{
+	return (void *)HDIF_get_idata(hdif, di, NULL);
+}
+
+static uint16_t synth_slca_index(uint16_t index, unsigned int k)
+{
+	if (!k || index < slca_lo || index > slca_hi)
+		return index;
+
+	return slca_base + (k - 1) * (slca_hi - slca_lo + 1) + index - slca_lo;
+}
+
+static void synth_fru_id(void *hdif, unsigned int di, unsigned int k)
+{
+	struct spira_fru_id *fru_id = synth_idata(hdif, di);
+
+	if (fru_id)
+		fru_id->slca_index = cpu_to_be16(synth_slca_index(
+			be16_to_cpu(fru_id->slca_index), k));
+}
+
+static void *slca_entry(void *arr, unsigned int i)
+{
+	const struct HDIF_array_hdr *ahdr = arr;
+
+	return arr + be32_to_cpu(ahdr->offset) + i * be32_to_cpu(ahdr->esize);
+}
+
+/* Range of the descendants of an entry, if they are contiguous */
+static bool slca_subtree(void *arr, unsigned int index, unsigned int *lo,
+			 unsigned int *hi, unsigned int *count)
+{
+	struct slca_entry *e = slca_entry(arr, index);
+	unsigned int i, first, nr;
+
+	first = be16_to_cpu(e->child_index);
+	nr = be16_to_cpu(e->nr_child);
+	for (i = first; nr && i < first + nr; i++) {
+		if (i >= be32_to_cpu(((struct HDIF_array_hdr *)arr)->ecnt))
+			return false;
+		*lo = MIN(*lo, i);
+		*hi = MAX(*hi, i);
+		(*count)++;
+		if (!slca_subtree(arr, i, lo, hi, count))
+			return false;
+	}
+	return true;
+}
+
+static void synth_slca(struct spira_ntuple *nt)
+{
+	struct HDIF_common_hdr *slca, *new;
+	struct HDIF_array_hdr *ahdr, *nahdr;
+	struct HDIF_idata_ptr *iptr;
+	struct slca_entry *root, *e, *enc = NULL;
+	unsigned int i, k, ecnt, esize, first, nr_root, nr, lo, hi, count;
+	unsigned int block, size, enc_index = 0;
+	void *arr, *narr;
+	uint16_t v;
+
+	slca = ntuple_addr(nt);
+	arr = synth_idata(slca, SLCA_IDATA_ARRAY);
+	ahdr = arr;
+	ecnt = be32_to_cpu(ahdr->ecnt);
+	esize = be32_to_cpu(ahdr->esize);
+	root = slca_entry(arr, SLCA_ROOT_INDEX);
+	first = be16_to_cpu(root->child_index);
+	nr_root = be16_to_cpu(root->nr_child);
+
+	/* The enclosure is the root's child with the biggest subtree */
+	for (i = first, nr = 0; i < first + nr_root; i++) {
+		lo = ecnt;
+		hi = count = 0;
+		if (!slca_subtree(arr, i, &lo, &hi, &count) ||
+		    count <= nr || count != hi - lo + 1)
+			continue;
+		enc_index = i;
+		nr = count;
+		slca_lo = lo;
+		slca_hi = hi;
+	}
+	if (!nr)
+		errx(1, "no SLCA enclosure to copy");
+	enc = slca_entry(arr, enc_index);
+
+	/*
+	 * The copies go after the original entries, and then a new set
+	 * of root children: the old ones plus a copy of the enclosure
+	 * for each extra node.
+	 */
+	slca_base = ecnt;
+	block = ecnt + (synth_nodes - 1) * nr;
+	synth_nr_slca = block + nr_root + synth_nodes - 1;
+	size = 0x30 + sizeof(*nahdr) + synth_nr_slca * esize;
+
+	new = synth_alloc(size);
+	memcpy(new, slca, sizeof(*new));
+	new->total_len = cpu_to_be32(size);
+	new->idptr_off = cpu_to_be32(sizeof(*new));
+	new->idptr_count = cpu_to_be16(1);
+	iptr = (void *)new + sizeof(*new);
+	iptr->offset = cpu_to_be32(0x30);
+	iptr->size = cpu_to_be32(size - 0x30);
+	narr = (void *)new + 0x30;
+	nahdr = narr;
+	*nahdr = *ahdr;
+	nahdr->offset = cpu_to_be32(sizeof(*nahdr));
+	nahdr->ecnt = cpu_to_be32(synth_nr_slca);
+
+	for (i = 0; i < ecnt; i++)
+		memcpy(slca_entry(narr, i), slca_entry(arr, i), esize);
+
+	for (k = 1; k < synth_nodes; k++) {
+		for (i = slca_lo; i <= slca_hi; i++) {
+			v = synth_slca_index(i, k);
+			e = slca_entry(narr, v);
+			memcpy(e, slca_entry(arr, i), esize);
+			e->my_index = cpu_to_be16(v);
+			if (be16_to_cpu(e->parent_index) == enc_index)
+				e->parent_index = cpu_to_be16(block + nr_root +
+							      k - 1);
+			else
+				e->parent_index = cpu_to_be16(synth_slca_index(
+					be16_to_cpu(e->parent_index), k));
+			if (e->nr_child)
+				e->child_index = cpu_to_be16(synth_slca_index(
+					be16_to_cpu(e->child_index), k));
+		}
+	}
+
+	for (i = 0; i < nr_root; i++) {
+		e = slca_entry(narr, block + i);
+		memcpy(e, slca_entry(arr, first + i), esize);
+		e->my_index = cpu_to_be16(block + i);
+	}
+
+	for (k = 1; k < synth_nodes; k++) {
+		v = block + nr_root + k - 1;
+		e = slca_entry(narr, v);
+		memcpy(e, enc, esize);
+		e->my_index = cpu_to_be16(v);
+		e->rsrc_id = cpu_to_be16(be16_to_cpu(enc->rsrc_id) + k);
+		e->child_index = cpu_to_be16(synth_slca_index(
+			be16_to_cpu(enc->child_index), k));
+		e->nr_dups = 0;
+	}
+
+	root = slca_entry(narr, SLCA_ROOT_INDEX);
+	root->child_index = cpu_to_be16(block);
+	root->nr_child = cpu_to_be16(nr_root + synth_nodes - 1);
+
+	synth_set_ntuple(nt, new, size);
+	nt->alloc_cnt = nt->act_cnt = cpu_to_be16(1);
+}
+
+static uint32_t synth_chip_id(uint32_t id, unsigned int k)
+{
+	return id | (k << SYNTH_NODE_SHIFT);
+}
+
+static bool synth_chip_installed(void *chip)
+{
+	struct sppcrd_chip_info *cinfo;
+	u32 ve;
+
+	cinfo = synth_idata(chip, SPPCRD_IDATA_CHIP_INFO);
+	ve = be32_to_cpu(cinfo->verif_exist_flags) & CHIP_VERIFY_MASK;
+	ve >>= CHIP_VERIFY_SHIFT;
+
+	return ve != CHIP_VERIFY_NOT_INSTALLED && ve != CHIP_VERIFY_UNUSABLE;
+}
+
+static void synth_chips(struct spira_ntuple *nt)
+{
+	unsigned int i, k, cnt, len, installed = 0, total;
+	struct sppcrd_chip_info *cinfo;
+	void *chips, *new, *p;
+
+	chips = ntuple_addr(nt);
+	cnt = be16_to_cpu(nt->act_cnt);
+	len = be32_to_cpu(nt->alloc_len);
+
+	for (i = 0; i < cnt; i++) {
+		if (!synth_chip_installed(chips + i * len))
+			continue;
+		cinfo = synth_idata(chips + i * len, SPPCRD_IDATA_CHIP_INFO);
+		if (be32_to_cpu(cinfo->xscom_id) >> SYNTH_NODE_SHIFT)
+			errx(1, "chip 0x%x is already on another node",
+			     be32_to_cpu(cinfo->xscom_id));
+		installed++;
+	}
+
+	total = cnt + installed * (synth_nodes - 1);
+	new = synth_alloc(total * len);
+	memcpy(new, chips, cnt * len);
+	p = new + cnt * len;
+
+	for (k = 1; k < synth_nodes; k++) {
+		for (i = 0; i < cnt; i++) {
+			if (!synth_chip_installed(chips + i * len))
+				continue;
+
+			memcpy(p, chips + i * len, len);
+			cinfo = synth_idata(p, SPPCRD_IDATA_CHIP_INFO);
+			cinfo->xscom_id = cpu_to_be32(synth_chip_id(
+				be32_to_cpu(cinfo->xscom_id), k));
+			cinfo->proc_chip_id = cpu_to_be32(synth_chip_id(
+				be32_to_cpu(cinfo->proc_chip_id), k));
+			synth_fru_id(p, SPPCRD_IDATA_FRU_ID, k);
+			p += len;
+		}
+	}
+
+	synth_set_ntuple(nt, new, total * len);
+	nt->alloc_len = cpu_to_be32(len);
+	nt->alloc_cnt = nt->act_cnt = cpu_to_be16(total);
+	synth_nr_chips = installed * synth_nodes;
+}
+
+static void synth_msarea(void *msarea, unsigned int k)
+{
+	struct HDIF_ms_area_address_range *arange;
+	struct HDIF_child_ptr *ptr;
+	struct HDIF_array_hdr *arr;
+	unsigned int i, j;
+
+	synth_fru_id(msarea, 0, k);
+
+	arr = synth_idata(msarea, 4);
+	arange = (void *)arr + be32_to_cpu(arr->offset);
+	for (i = 0; i < be32_to_cpu(arr->ecnt); i++) {
+		arange->start = cpu_to_be64(be64_to_cpu(arange->start) +
+					    k * SYNTH_MEM_STRIDE);
+		arange->end = cpu_to_be64(be64_to_cpu(arange->end) +
+					  k * SYNTH_MEM_STRIDE);
+		arange->chip = cpu_to_be32(synth_chip_id(
+			be32_to_cpu(arange->chip), k));
+		arange = (void *)arange + be32_to_cpu(arr->esize);
+	}
+
+	/* The RAM areas */
+	for (i = 0; i < be16_to_cpu(((struct HDIF_common_hdr *)msarea)->child_count); i++) {
+		ptr = HDIF_child_arr(msarea, i);
+		for (j = 0; j < be32_to_cpu(ptr->count); j++)
+			synth_fru_id(msarea + be32_to_cpu(ptr->offset) +
+				     j * be32_to_cpu(ptr->size), 0, k);
+	}
+}
+
+static void synth_memory(struct spira_ntuple *nt)
+{
+	struct HDIF_common_hdr *ms_vpd, *new, *msarea;
+	struct HDIF_child_ptr *msptr, *ptr;
+	unsigned int i, j, k, cnt, stride, hdr_len, nr_msareas;
+	size_t tail = 0, size;
+	void *dst, *children;
+
+	ms_vpd = ntuple_addr(nt);
+	msptr = HDIF_child_arr(ms_vpd, MSVPD_CHILD_MS_AREAS);
+	cnt = be32_to_cpu(msptr->count);
+	stride = be32_to_cpu(msptr->size);
+	hdr_len = ALIGN_UP(be32_to_cpu(ms_vpd->total_len), 0x10);
+	nr_msareas = cnt * synth_nodes;
+
+	/* Each area keeps its children, which go after all the areas */
+	for (j = 0; j < cnt; j++) {
+		msarea = (void *)ms_vpd + be32_to_cpu(msptr->offset) +
+			j * stride;
+		for (i = 0; i < be16_to_cpu(msarea->child_count); i++) {
+			ptr = HDIF_child_arr(msarea, i);
+			tail += ALIGN_UP(be32_to_cpu(ptr->size) *
+					 be32_to_cpu(ptr->count), 0x10);
+		}
+	}
+	size = hdr_len + nr_msareas * stride + tail * synth_nodes;
+
+	new = synth_alloc(size);
+	memcpy(new, ms_vpd, be32_to_cpu(ms_vpd->total_len));
+	children = (void *)new + hdr_len + nr_msareas * stride;
+
+	for (k = 0; k < synth_nodes; k++) {
+		for (j = 0; j < cnt; j++) {
+			msarea = (void *)ms_vpd + be32_to_cpu(msptr->offset) +
+				j * stride;
+			dst = (void *)new + hdr_len + (k * cnt + j) * stride;
+			memcpy(dst, msarea, stride);
+
+			for (i = 0; i < be16_to_cpu(msarea->child_count); i++) {
+				ptr = HDIF_child_arr(dst, i);
+				size = be32_to_cpu(ptr->size) *
+					be32_to_cpu(ptr->count);
+				memcpy(children, (void *)msarea +
+				       be32_to_cpu(ptr->offset), size);
+				ptr->offset = cpu_to_be32(children - dst);
+				children += ALIGN_UP(size, 0x10);
+			}
+
+			if (k)
+				synth_msarea(dst, k);
+		}
+	}
+
+	ptr = HDIF_child_arr(new, MSVPD_CHILD_MS_AREAS);
+	ptr->offset = cpu_to_be32(hdr_len);
+	ptr->count = cpu_to_be32(nr_msareas);
+
+	synth_set_ntuple(nt, new, children - (void *)new);
+	synth_nr_msareas = nr_msareas;
+}
+
+/*
+ * Copy the dump into a heap with room for the synthesized nodes, and
+ * point the ntuples at the copies.
+ */
+static void synth_hdat(bool new_spira, int fd)
+{
+	struct spira_ntuple *slca, *chips, *ms_vpd;
+	size_t size = spira_heap_size;
+
+	if (new_spira) {
+		slca = &spiras->ntuples.slca;
+		chips = &spiras->ntuples.proc_chip;
+		ms_vpd = &spiras->ntuples.ms_vpd;
+	} else {
+		slca = &spira.ntuples.slca;
+		chips = &spira.ntuples.proc_chip;
+		ms_vpd = &spira.ntuples.ms_vpd;
+	}
+
+	size += (synth_nodes + 1) * (be32_to_cpu(slca->alloc_len) +
+		be16_to_cpu(chips->act_cnt) * be32_to_cpu(chips->alloc_len) +
+		be32_to_cpu(ms_vpd->alloc_len)) + 0x1000;
+
+	munmap(spira_heap, spira_heap_size);
+	synth_used = spira_heap_size;
+	spira_heap = malloc(size);
+	if (!spira_heap)
+		err(1, "allocating synthesized HDAT");
+	if (pread(fd, spira_heap, synth_used, 0) != synth_used)
+		err(1, "reading HDAT heap");
+	spira_heap_size = size;
+	if (new_spira) {
+		spiras = (struct spiras *)spira_heap;
+		slca = &spiras->ntuples.slca;
+		chips = &spiras->ntuples.proc_chip;
+		ms_vpd = &spiras->ntuples.ms_vpd;
+	}
+
+	synth_slca(slca);
+	synth_chips(chips);
+	synth_memory(ms_vpd);
+}
+
 int main(int argc, char *argv[])
 {
 	int fd, r, i = 0, opt_count = 0;
 	bool verbose = false, quiet = false, new_spira = false, blobs = false;
+	bool flatten = false, profile = false;
+	unsigned long nr_allocs, alloc_bytes;
+	uint64_t start;
 
 	while (argv[++i]) {
 		if (strcmp(argv[i], "-v") == 0) {
@@ -240,6 +861,18 @@ int main(int argc, char *argv[])
 		} else if (strcmp(argv[i], "-b") == 0) {
 			blobs = true;
 			opt_count++;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			flatten = true;
+			opt_count++;
+		} else if (strcmp(argv[i], "-p") == 0) {
+			profile = true;
+			opt_count++;
+		} else if (strcmp(argv[i], "-n") == 0 && argv[i + 1]) {
+			synth_nodes = atoi(argv[++i]);
+			if (synth_nodes < 1 || synth_nodes > SYNTH_MAX_NODES)
+				errx(1, "-n takes 1 to %d nodes",
+				     SYNTH_MAX_NODES);
+			opt_count += 2;
 		} else if (strcmp(argv[i], "-7") == 0) {
 			fake_pvr_type = PVR_TYPE_P7;
 			proc_gen = proc_gen_p7;
@@ -271,6 +904,9 @@ int main(int argc, char *argv[])
 		     "	-v Verbose\n"
 		     "	-q Quiet mode\n"
 		     "	-b Keep blobs in the output\n"
+		     "	-t Check device tree flattening, timed with SKIBOOT_BENCH set\n"
+		     "	-p Profile the parse instead of writing the DTB\n"
+		     "	-n <nodes> Grow the dump to this many nodes\n"
 		     "\n"
 		     "  -7 Force PVR to POWER7\n"
 		     "  -8 Force PVR to POWER8\n"
@@ -332,11 +968,14 @@ int main(int argc, char *argv[])
 	if (verbose)
 		printf("verbose: mapped %zu at %p\n",
 		       spira_heap_size, spira_heap);
-	close(fd);
 
 	if (new_spira)
 		spiras = (struct spiras *)spira_heap;
 
+	if (synth_nodes > 1)
+		synth_hdat(new_spira, fd);
+	close(fd);
+
 	if (quiet) {
 		fclose(stdout);
 		fclose(stderr);
@@ -344,17 +983,37 @@ int main(int argc, char *argv[])
 
 	dt_root = dt_new_root("");
 
+	nr_allocs = stub_nr_allocs;
+	alloc_bytes = stub_alloc_bytes;
+	start = bench_now_ns();
 	if(parse_hdat(false) < 0) {
 		fprintf(stderr, "FATAL ERROR parsing HDAT\n");
 		exit(EXIT_FAILURE);
 	}
 
+	if (profile) {
+		if (synth_nodes > 1)
+			printf("hdat: %u nodes, %u chips, %u memory areas, "
+			       "%u SLCA entries\n", synth_nodes,
+			       synth_nr_chips, synth_nr_msareas,
+			       synth_nr_slca);
+		report_profile(dt_root, bench_now_ns() - start,
+			       stub_nr_allocs - nr_allocs,
+			       stub_alloc_bytes - alloc_bytes);
+		quiet = true;
+	}
+
 	mem_region_init();
 	mem_region_release_unused();
 
 	if (!blobs)
 		squash_blobs(dt_root);
 
+	if (flatten) {
+		check_flatten(dt_root);
+		check_names(dt_root);
+	}
+
 	if (!quiet)
 		dump_hdata_fdt(dt_root);
 
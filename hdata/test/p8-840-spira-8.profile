@@ -0,0 +1,17 @@
+hdat: 8 nodes, 16 chips, 16 memory areas, 540 SLCA entries
+stage bmc_parse: 0 allocations, 0 bytes
+stage dt_init_vpd_node: 3 allocations, 171 bytes
+stage dt_init_led_node: 2 allocations, 160 bytes
+stage add_iplparams: 38 allocations, 1787 bytes
+stage memory_parse: 1287 allocations, 63211 bytes
+stage add_xscom: 610 allocations, 1071452 bytes
+stage fsp_parse: 20 allocations, 809 bytes
+stage add_nx: 64 allocations, 3344 bytes
+stage add_nmmu: 0 allocations, 0 bytes
+stage io_parse: 44 allocations, 2145 bytes
+stage vpd_parse: 123 allocations, 4523 bytes
+stage hostservices_parse: 42 allocations, 6408 bytes
+stage slca_dt_add_sai_node: 3 allocations, 164 bytes
+stage add_stop_levels: 0 allocations, 0 bytes
+parse: 2794 allocations, 1179851 bytes
+dt: 332 nodes, 1630 properties, 1111213 bytes flattened
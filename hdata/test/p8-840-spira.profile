@@ -0,0 +1,16 @@
+stage bmc_parse: 0 allocations, 0 bytes
+stage dt_init_vpd_node: 3 allocations, 171 bytes
+stage dt_init_led_node: 2 allocations, 160 bytes
+stage add_iplparams: 38 allocations, 1787 bytes
+stage memory_parse: 188 allocations, 9252 bytes
+stage add_xscom: 92 allocations, 134614 bytes
+stage fsp_parse: 20 allocations, 809 bytes
+stage add_nx: 8 allocations, 418 bytes
+stage add_nmmu: 0 allocations, 0 bytes
+stage io_parse: 44 allocations, 2145 bytes
+stage vpd_parse: 122 allocations, 4486 bytes
+stage hostservices_parse: 42 allocations, 6408 bytes
+stage slca_dt_add_sai_node: 3 allocations, 164 bytes
+stage add_stop_levels: 0 allocations, 0 bytes
+parse: 1050 allocations, 182507 bytes
+dt: 80 nodes, 650 properties, 156917 bytes flattened
@@ -50,9 +50,14 @@ void _prlog(int log_level __attribute__((unused)), const char* fmt, ...)
 
 #define DEFAULT_ALIGN __alignof__(long)
 
+/* Counted for hdata_to_dt's profile of the parse */
+unsigned long stub_nr_allocs, stub_alloc_bytes;
+
 void *__memalign(size_t blocksize, size_t bytes, const char *location __unused);
 void *__memalign(size_t blocksize, size_t bytes, const char *location __unused)
 {
+	stub_nr_allocs++;
+	stub_alloc_bytes += bytes;
 	return memalign(blocksize, bytes);
 }
 
@@ -71,6 +76,8 @@ void __free(void *p, const char *location __unused)
 void *__realloc(void *ptr, size_t size, const char *location __unused);
 void *__realloc(void *ptr, size_t size, const char *location __unused)
 {
+	stub_nr_allocs++;
+	stub_alloc_bytes += size;
 	return realloc(ptr, size);
 }
 
@@ -216,6 +216,14 @@ static const char *vpd_map_name(const char *vpd_name)
 static struct dt_node *dt_create_vpd_node(struct dt_node *parent,
 					  const struct slca_entry *entry);
 
+/*
+ * The node created for each SLCA entry, indexed by SLCA index, so that
+ * dt_add_vpd_node() doesn't have to search the whole /vpd tree by name
+ * for every FRU.
+ */
+static struct dt_node **vpd_slca_nodes;
+static int vpd_slca_nr;
+
 static const struct card_info *card_info_lookup(char *ccin)
 {
 	int i;
@@ -234,31 +242,37 @@ static const struct card_info *card_info_lookup(char *ccin)
 static void vpd_opfr_parse(struct dt_node *node,
 		const void *fruvpd, unsigned int fruvpd_sz)
 {
-	const void *kw;
+	const void *kw, *opfr;
+	size_t opfr_sz;
 	uint8_t sz;
 
+	/* Look the record up once, rather than for every keyword */
+	opfr = vpd_find_record(fruvpd, fruvpd_sz, "OPFR", &opfr_sz);
+	if (!opfr)
+		return;
+
 	/* Vendor Name */
-	kw = vpd_find(fruvpd, fruvpd_sz, "OPFR", "VN", &sz);
+	kw = vpd_find_keyword(opfr, opfr_sz, "VN", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "vendor", kw, sz);
 
 	/* FRU Description */
-	kw = vpd_find(fruvpd, fruvpd_sz, "OPFR", "DR", &sz);
+	kw = vpd_find_keyword(opfr, opfr_sz, "DR", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "description", kw, sz);
 
 	/* Part number */
-	kw = vpd_find(fruvpd, fruvpd_sz, "OPFR", "VP", &sz);
+	kw = vpd_find_keyword(opfr, opfr_sz, "VP", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "part-number", kw, sz);
 
 	/* Serial number */
-	kw = vpd_find(fruvpd, fruvpd_sz, "OPFR", "VS", &sz);
+	kw = vpd_find_keyword(opfr, opfr_sz, "VS", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "serial-number", kw, sz);
 
 	/* Build date in BCD */
-	kw = vpd_find(fruvpd, fruvpd_sz, "OPFR", "MB", &sz);
+	kw = vpd_find_keyword(opfr, opfr_sz, "MB", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "build-date", kw, sz);
 
@@ -268,47 +282,52 @@ static void vpd_opfr_parse(struct dt_node *node,
 static void vpd_vini_parse(struct dt_node *node,
 			   const void *fruvpd, unsigned int fruvpd_sz)
 {
-	const void *kw;
+	const void *kw, *vini;
+	size_t vini_sz;
 	uint8_t sz;
 	const struct card_info *cinfo;
 
+	vini = vpd_find_record(fruvpd, fruvpd_sz, "VINI", &vini_sz);
+	if (!vini)
+		return;
+
 	/* FRU Stocking Part Number */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "FN", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "FN", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "fru-number", kw, sz);
 
 	/* Serial Number */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "SN", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "SN", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "serial-number", kw, sz);
 
 	/* Part Number */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "PN", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "PN", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "part-number", kw, sz);
 
 	/* CCIN Extension */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "CE", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "CE", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "ccin-extension", kw, sz);
 
 	/* HW Version info */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "HW", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "HW", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "hw-version", kw, sz);
 
 	/* Card type info */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "CT", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "CT", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "card-type", kw, sz);
 
 	/* HW characteristics info */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "B3", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "B3", &sz);
 	if (kw)
 		dt_add_property_nstr(node, "hw-characteristics", kw, sz);
 
 	/* Customer Card Identification Number (CCIN) */
-	kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "CC", &sz);
+	kw = vpd_find_keyword(vini, vini_sz, "CC", &sz);
 	if (kw) {
 		dt_add_property_nstr(node, "ccin", kw, sz);
 
@@ -317,7 +336,7 @@ static void vpd_vini_parse(struct dt_node *node,
 			dt_add_property_string(node,
 				       "description", cinfo->description);
 		} else {
-			kw = vpd_find(fruvpd, fruvpd_sz, "VINI", "DR", &sz);
+			kw = vpd_find_keyword(vini, vini_sz, "DR", &sz);
 			if (kw) {
 				dt_add_property_nstr(node,
 						     "description", kw, sz);
@@ -405,6 +424,10 @@ static struct dt_node *dt_create_vpd_node(struct dt_node *parent,
 		return NULL;
 	}
 
+	if (be16_to_cpu(entry->my_index) < vpd_slca_nr &&
+	    !vpd_slca_nodes[be16_to_cpu(entry->my_index)])
+		vpd_slca_nodes[be16_to_cpu(entry->my_index)] = node;
+
 	/* Add location code */
 	slca_vpd_add_loc_code(node, be16_to_cpu(entry->my_index));
 	/* Add FRU label */
@@ -415,19 +438,42 @@ static struct dt_node *dt_create_vpd_node(struct dt_node *parent,
 	return node;
 }
 
+/* Look a FRU up by name, for entries we didn't create a node for */
+static struct dt_node *dt_find_vpd_node(struct dt_node *dt_vpd,
+					const struct slca_entry *entry)
+{
+	struct dt_node *node;
+	const char *name;
+	uint64_t addr;
+	char *lname;
+	int len;
+
+	name = vpd_map_name(entry->fru_id);
+	addr = (uint64_t)be16_to_cpu(entry->rsrc_id);
+	len = strlen(name) + STR_MAX_CHARS(addr) + 2;
+	lname = zalloc(len);
+	if (!lname) {
+		prerror("VPD: Failed to allocate memory\n");
+		return NULL;
+	}
+
+	snprintf(lname, len, "%s@%llx", name, (long long)addr);
+	node = dt_find_by_name(dt_vpd, lname);
+	free(lname);
+
+	return node;
+}
+
 struct dt_node *dt_add_vpd_node(const struct HDIF_common_hdr *hdr,
 				int indx_fru, int indx_vpd)
 {
 	const struct spira_fru_id *fru_id;
 	unsigned int fruvpd_sz, fru_id_sz;
 	const struct slca_entry *entry;
-	struct dt_node *dt_vpd, *node;
+	struct dt_node *dt_vpd, *node = NULL;
 	static bool first = true;
 	const void *fruvpd;
-	const char *name;
-	uint64_t addr;
-	char *lname;
-	int len;
+	uint16_t slca_index;
 
 	fru_id = HDIF_get_idata(hdr, indx_fru, &fru_id_sz);
 	if (!fru_id)
@@ -448,6 +494,11 @@ struct dt_node *dt_add_vpd_node(const struct HDIF_common_hdr *hdr,
 			return NULL;
 		}
 
+		vpd_slca_nr = slca_get_count();
+		vpd_slca_nodes = zalloc(vpd_slca_nr * sizeof(*vpd_slca_nodes));
+		if (!vpd_slca_nodes)
+			vpd_slca_nr = 0;
+
 		node = dt_create_vpd_node(dt_vpd, entry);
 		if (!node)
 			return NULL;
@@ -455,24 +506,17 @@ struct dt_node *dt_add_vpd_node(const struct HDIF_common_hdr *hdr,
 		first = false;
 	}
 
-	entry = slca_get_entry(be16_to_cpu(fru_id->slca_index));
+	slca_index = be16_to_cpu(fru_id->slca_index);
+	entry = slca_get_entry(slca_index);
 	if (!entry)
 		return NULL;
 
-	name = vpd_map_name(entry->fru_id);
-	addr = (uint64_t)be16_to_cpu(entry->rsrc_id);
-	len = strlen(name) + STR_MAX_CHARS(addr) + 2;
-	lname = zalloc(len);
-	if (!lname) {
-		prerror("VPD: Failed to allocate memory\n");
-		return NULL;
-	}
-
-	snprintf(lname, len, "%s@%llx", name, (long long)addr);
-
-	/* Get the node already created */
-	node = dt_find_by_name(dt_vpd, lname);
-	free(lname);
+	/* Get the node already created, the table may not exist */
+	node = NULL;
+	if (slca_index < vpd_slca_nr)
+		node = vpd_slca_nodes[slca_index];
+	if (!node)
+		node = dt_find_vpd_node(dt_vpd, entry);
 	/*
 	 * It is unlikely that node not found because vpd nodes have the
 	 * corresponding slca entry which we would have used to populate the vpd
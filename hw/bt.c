@@ -64,12 +64,31 @@
 /* Maximum number of outstanding messages to allow in the queue. */
 #define BT_MAX_QUEUE_LEN	10
 
+/*
+ * Maximum number of messages of each class waiting to be sent, and how
+ * many of each class to send in a round when they all have some.
+ */
+static const int bt_class_quota[IPMI_NR_PRIOS] = {
+	[IPMI_PRIO_CRITICAL]	= BT_MAX_QUEUE_LEN,
+	[IPMI_PRIO_NORMAL]	= 8,
+	[IPMI_PRIO_BULK]	= 4,
+};
+
+static const int bt_class_weight[IPMI_NR_PRIOS] = {
+	[IPMI_PRIO_CRITICAL]	= 8,
+	[IPMI_PRIO_NORMAL]	= 4,
+	[IPMI_PRIO_BULK]	= 1,
+};
+
 /* How long (in seconds) before a message is timed out. */
 #define BT_MSG_TIMEOUT		3
 
 /* Maximum number of times to attempt sending a message before giving up. */
 #define BT_MAX_RETRIES		1
 
+/* Maximum number of responses to pick up in one poll */
+#define BT_MAX_RESP_PER_POLL	BT_MAX_QUEUE_LEN
+
 /* Macro to enable printing BT message queue for debug */
 #define BT_QUEUE_DEBUG		0
 
@@ -93,9 +112,11 @@
 
 struct bt_msg {
 	struct list_node link;
-	unsigned long tb;
+	unsigned long queued_tb;
+	unsigned long tb;	/* timeout start, 0 until it can be sent */
 	uint8_t seq;
-	uint8_t send_count;
+	uint8_t send_count;	/* non zero once in flight */
+	bool inflight;		/* on bt.inflight rather than a class queue */
 	struct ipmi_msg ipmi_msg;
 };
 
@@ -107,14 +128,27 @@ struct bt_caps {
 	uint8_t max_retries;
 };
 
+struct bt_class_stats {
+	uint64_t queued;
+	uint64_t done;
+	uint64_t dropped;
+	uint64_t timeouts;
+	uint64_t latency_tb;	/* from queued to done, in total */
+	uint64_t max_latency_tb;
+};
+
 struct bt {
 	uint32_t base_addr;
 	struct lock lock;
-	struct list_head msgq;
+	struct list_head msgq[IPMI_NR_PRIOS];	/* waiting, per class */
+	int class_len[IPMI_NR_PRIOS];
+	int credits[IPMI_NR_PRIOS];
+	struct list_head inflight;	/* sent, or next to send */
 	struct timer poller;
 	bool irq_ok;
 	int queue_len;
 	struct bt_caps caps;
+	struct bt_class_stats stats[IPMI_NR_PRIOS];
 };
 
 static struct bt bt;
@@ -169,6 +203,10 @@ static void get_bt_caps_complete(struct ipmi_msg *msg)
 	 * IPMI Spec says that the value for buffer sizes are:
 	 * "the largest value allowed in first byte"
 	 * Therefore we want to add one to what we get
+	 *
+	 * The number of requests is how many the BMC accepts before
+	 * it has responded to the first one. We keep that many in
+	 * flight, matching responses by sequence number.
 	 */
 	bt.caps.num_requests = msg->data[0];
 	bt.caps.input_buf_len = msg->data[1] + 1;
@@ -212,11 +250,24 @@ static inline bool bt_idle(void)
 	return !(bt_ctrl & BT_CTRL_B_BUSY) && !(bt_ctrl & BT_CTRL_H2B_ATN);
 }
 
-/* Must be called with bt.lock held */
-static void bt_msg_del(struct bt_msg *bt_msg)
+static inline int bt_msg_prio(struct bt_msg *bt_msg)
+{
+	return bt_msg->ipmi_msg.prio;
+}
+
+/* Take a message off the queue it is on */
+static void bt_msg_unlink(struct bt_msg *bt_msg)
 {
 	list_del(&bt_msg->link);
+	if (!bt_msg->inflight)
+		bt.class_len[bt_msg_prio(bt_msg)]--;
 	bt.queue_len--;
+}
+
+/* Must be called with bt.lock held */
+static void bt_msg_del(struct bt_msg *bt_msg)
+{
+	bt_msg_unlink(bt_msg);
 	unlock(&bt.lock);
 	ipmi_cmd_done(bt_msg->ipmi_msg.cmd,
 		      IPMI_NETFN_RETURN_CODE(bt_msg->ipmi_msg.netfn),
@@ -300,7 +351,9 @@ static void bt_get_resp(void)
 {
 	int i;
 	struct bt_msg *tmp_bt_msg, *bt_msg = NULL;
+	struct bt_class_stats *stats;
 	struct ipmi_msg *ipmi_msg;
+	uint64_t latency;
 	uint8_t resp_len, netfn, seq, cmd;
 	uint8_t cc = IPMI_CC_NO_ERROR;
 
@@ -328,8 +381,8 @@ static void bt_get_resp(void)
 	cc = bt_inb(BT_HOST2BMC);
 
 	/* Find the corresponding message */
-	list_for_each(&bt.msgq, tmp_bt_msg, link) {
-		if (tmp_bt_msg->seq == seq) {
+	list_for_each(&bt.inflight, tmp_bt_msg, link) {
+		if (tmp_bt_msg->seq == seq && tmp_bt_msg->send_count) {
 			bt_msg = tmp_bt_msg;
 			break;
 		}
@@ -364,8 +417,13 @@ static void bt_get_resp(void)
 
 	BT_Q_DBG(bt_msg, "IPMI MSG done");
 
-	list_del(&bt_msg->link);
-	bt.queue_len--;
+	bt_msg_unlink(bt_msg);
+	stats = &bt.stats[bt_msg_prio(bt_msg)];
+	latency = mftb() - bt_msg->queued_tb;
+	stats->done++;
+	stats->latency_tb += latency;
+	if (latency > stats->max_latency_tb)
+		stats->max_latency_tb = latency;
 	unlock(&bt.lock);
 
 	/* Call IPMI layer to finish processing the message. */
@@ -375,37 +433,72 @@ static void bt_get_resp(void)
 	return;
 }
 
+static unsigned int bt_inflight(void)
+{
+	struct bt_msg *bt_msg;
+	unsigned int count = 0;
+
+	list_for_each(&bt.inflight, bt_msg, link)
+		count++;
+
+	return count;
+}
+
+/*
+ * Retry or time out the messages that haven't got a response in time.
+ * Each message in flight has its own timeout, as does the next one to
+ * send, so that we also give up on messages when the BMC doesn't take
+ * requests at all.
+ */
 static void bt_expire_old_msg(uint64_t tb)
 {
 	struct bt_msg *bt_msg;
 
-	bt_msg = list_top(&bt.msgq, struct bt_msg, link);
+	if (chip_quirk(QUIRK_SIMICS))
+		return;
+
+	list_for_each(&bt.inflight, bt_msg, link) {
+		if (tb_compare(tb, bt_msg->tb +
+			       secs_to_tb(bt.caps.msg_timeout)) != TB_AAFTERB)
+			continue;
 
-	if (bt_msg && bt_msg->tb > 0 && !chip_quirk(QUIRK_SIMICS) &&
-	    (tb_compare(tb, bt_msg->tb +
-			secs_to_tb(bt.caps.msg_timeout)) == TB_AAFTERB)) {
 		if (bt_msg->send_count <= bt.caps.max_retries) {
-			/* A message timeout is usually due to the BMC
+			/*
+			 * A message timeout is usually due to the BMC
 			 * clearing the H2B_ATN flag without actually
-			 * doing anything. The data will still be in the
-			 * FIFO so just reset the flag.*/
+			 * doing anything. Other requests may have gone
+			 * through the FIFO since, so send the whole
+			 * message again. If the interface is still busy,
+			 * that attempt is lost, which bounds how long we
+			 * wait for a wedged BMC.
+			 */
 			BT_Q_ERR(bt_msg, "Retry sending message");
-			bt_msg->send_count++;
-
+			if (bt_idle()) {
+				bt_send_msg(bt_msg);
+			} else {
+				bt_msg->send_count++;
+			}
 			bt_msg->tb = tb;
-			bt_outb(BT_CTRL_H2B_ATN, BT_CTRL);
-		} else {
-			BT_Q_ERR(bt_msg, "Timeout sending message");
-			bt_msg_del(bt_msg);
-
-			/*
-			 * Timing out a message is inherently racy as the BMC
-			 * may start writing just as we decide to kill the
-			 * message. Hopefully resetting the interface is
-			 * sufficient to guard against such things.
-			 */
-			bt_reset_interface();
+			continue;
 		}
+
+		BT_Q_ERR(bt_msg, "Timeout sending message");
+		bt.stats[bt_msg_prio(bt_msg)].timeouts++;
+
+		/*
+		 * bt_msg_del() drops the lock, the queue may change
+		 * under us so leave the other messages to the next poll.
+		 */
+		bt_msg_del(bt_msg);
+
+		/*
+		 * Timing out a message is inherently racy as the BMC
+		 * may start writing just as we decide to kill the
+		 * message. Hopefully resetting the interface is
+		 * sufficient to guard against such things.
+		 */
+		bt_reset_interface();
+		break;
 	}
 }
 
@@ -414,13 +507,19 @@ static void print_debug_queue_info(void)
 #if BT_QUEUE_DEBUG
 	struct bt_msg *msg;
 	static bool printed = false;
+	int prio;
 
-	if (!list_empty(&bt.msgq)) {
+	if (bt.queue_len) {
 		printed = false;
 		prlog(PR_DEBUG, "-------- BT Msg Queue --------\n");
-		list_for_each(&bt.msgq, msg, link) {
+		list_for_each(&bt.inflight, msg, link) {
 			BT_Q_DBG(msg, "[ sent %d ]", msg->send_count);
 		}
+		for (prio = 0; prio < IPMI_NR_PRIOS; prio++) {
+			list_for_each(&bt.msgq[prio], msg, link) {
+				BT_Q_DBG(msg, "[ class %d ]", prio);
+			}
+		}
 		prlog(PR_DEBUG, "-----------------------------\n");
 	} else if (!printed) {
 		printed = true;
@@ -429,32 +528,75 @@ static void print_debug_queue_info(void)
 #endif
 }
 
+/*
+ * Pick the next message to send. Each class gets to send up to its
+ * weight in messages in a round, higher priority classes first, so that
+ * bulk traffic still trickles through under a steady stream of other
+ * messages.
+ */
+static struct bt_msg *bt_dispatch(void)
+{
+	struct bt_msg *bt_msg;
+	int prio, round;
+
+	for (round = 0; round < 2; round++) {
+		for (prio = 0; prio < IPMI_NR_PRIOS; prio++) {
+			if (!bt.credits[prio] || list_empty(&bt.msgq[prio]))
+				continue;
+
+			bt.credits[prio]--;
+			bt_msg = list_pop(&bt.msgq[prio], struct bt_msg, link);
+			bt.class_len[prio]--;
+			bt_msg->inflight = true;
+			list_add_tail(&bt.inflight, &bt_msg->link);
+			return bt_msg;
+		}
+
+		/* The classes with messages are out of credits */
+		for (prio = 0; prio < IPMI_NR_PRIOS; prio++)
+			bt.credits[prio] = bt_class_weight[prio];
+	}
+
+	return NULL;
+}
+
 static void bt_send_and_unlock(void)
 {
-	if (lpc_ok() && !list_empty(&bt.msgq)) {
-		struct bt_msg *bt_msg;
+	struct bt_msg *bt_msg, *next = NULL;
 
-		bt_msg = list_top(&bt.msgq, struct bt_msg, link);
-		assert(bt_msg);
+	if (!lpc_ok())
+		goto out;
 
-		/*
-		 * Start the message timeout once it gets to the top
-		 * of the queue. This will ensure we timeout messages
-		 * in the case of a broken bt interface as occurs when
-		 * the BMC is not responding to any IPMI messages.
-		 */
-		if (bt_msg->tb == 0)
-			bt_msg->tb = mftb();
+	/* The oldest message in flight not sent yet */
+	list_for_each(&bt.inflight, bt_msg, link) {
+		if (!bt_msg->send_count) {
+			next = bt_msg;
+			break;
+		}
+	}
+
+	if (!next && bt_inflight() < bt.caps.num_requests) {
+		next = bt_dispatch();
 
 		/*
-		 * Only send it if we haven't already.
-		 * Timeouts and retries happen in bt_expire_old_msg()
-		 * called from bt_poll()
+		 * Start the message timeout once it can be sent.
+		 * This will ensure we timeout messages in the case of
+		 * a broken bt interface as occurs when the BMC is not
+		 * responding to any IPMI messages.
 		 */
-		if (bt_idle() && bt_msg->send_count == 0)
-			bt_send_msg(bt_msg);
+		if (next)
+			next->tb = mftb();
 	}
 
+	/*
+	 * The FIFO holds one request at a time, the next one goes once
+	 * the BMC has taken this one. Timeouts and retries happen in
+	 * bt_expire_old_msg() called from bt_poll()
+	 */
+	if (next && bt_idle())
+		bt_send_msg(next);
+
+out:
 	unlock(&bt.lock);
 }
 
@@ -462,6 +604,7 @@ static void bt_poll(struct timer *t __unused, void *data __unused,
 		    uint64_t now)
 {
 	uint8_t bt_ctrl;
+	int i;
 
 	/* Don't do anything if the LPC bus is offline */
 	if (!lpc_ok())
@@ -475,11 +618,13 @@ static void bt_poll(struct timer *t __unused, void *data __unused,
 
 	print_debug_queue_info();
 
-	bt_ctrl = bt_inb(BT_CTRL);
-
-	/* Is there a response waiting for us? */
-	if (bt_ctrl & BT_CTRL_B2H_ATN)
+	/* Pick up the responses waiting for us */
+	for (i = 0; i < BT_MAX_RESP_PER_POLL; i++) {
+		bt_ctrl = bt_inb(BT_CTRL);
+		if (!(bt_ctrl & BT_CTRL_B2H_ATN))
+			break;
 		bt_get_resp();
+	}
 
 	bt_expire_old_msg(now);
 
@@ -503,20 +648,62 @@ static void bt_poll(struct timer *t __unused, void *data __unused,
 		       bt.irq_ok ? TIMER_POLL : msecs_to_tb(BT_DEFAULT_POLL_MS));
 }
 
-static void bt_add_msg(struct bt_msg *bt_msg)
+/*
+ * Make room for a new message of the given class, when the queue is over
+ * its length or the class over its quota. The victim is the message at
+ * the head of the class over quota or, for the queue length, of the
+ * lowest priority class with messages waiting, which may be the new
+ * message itself.
+ */
+static void bt_make_room(int prio)
+{
+	struct bt_msg *bt_msg = NULL;
+	struct bt_class_stats *stats;
+	int victim;
+
+	if (bt.class_len[prio] > bt_class_quota[prio]) {
+		victim = prio;
+	} else if (bt.queue_len > BT_MAX_QUEUE_LEN) {
+		for (victim = IPMI_NR_PRIOS - 1; victim >= 0; victim--)
+			if (!list_empty(&bt.msgq[victim]))
+				break;
+	} else {
+		return;
+	}
+
+	if (victim >= 0)
+		bt_msg = list_top(&bt.msgq[victim], struct bt_msg, link);
+	if (!bt_msg)
+		return;
+
+	stats = &bt.stats[victim];
+	stats->dropped++;
+	BT_Q_ERR(bt_msg, "Queue full, dropped (class %d, %llu dropped)",
+		 victim, (unsigned long long)stats->dropped);
+	bt_msg_del(bt_msg);
+}
+
+static void bt_add_msg(struct bt_msg *bt_msg, bool head)
 {
+	int prio = bt_msg_prio(bt_msg);
+
+	if (prio >= IPMI_NR_PRIOS)
+		prio = bt_msg->ipmi_msg.prio = IPMI_PRIO_NORMAL;
+
+	bt_msg->queued_tb = mftb();
 	bt_msg->tb = 0;
 	bt_msg->seq = ipmi_seq++;
 	bt_msg->send_count = 0;
+	bt_msg->inflight = false;
+	if (head)
+		list_add(&bt.msgq[prio], &bt_msg->link);
+	else
+		list_add_tail(&bt.msgq[prio], &bt_msg->link);
+	bt.class_len[prio]++;
 	bt.queue_len++;
-	if (bt.queue_len > BT_MAX_QUEUE_LEN) {
-		/* Maximum queue length exceeded, remove oldest messages. */
-		BT_Q_ERR(bt_msg, "Maximum queue length exceeded");
-		bt_msg = list_tail(&bt.msgq, struct bt_msg, link);
-		assert(bt_msg);
-		BT_Q_ERR(bt_msg, "Removed from queue");
-		bt_msg_del(bt_msg);
-	}
+	bt.stats[prio].queued++;
+
+	bt_make_room(prio);
 }
 
 static int bt_add_ipmi_msg_head(struct ipmi_msg *ipmi_msg)
@@ -524,8 +711,7 @@ static int bt_add_ipmi_msg_head(struct ipmi_msg *ipmi_msg)
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
 	lock(&bt.lock);
-	bt_add_msg(bt_msg);
-	list_add(&bt.msgq, &bt_msg->link);
+	bt_add_msg(bt_msg, true);
 	bt_send_and_unlock();
 
 	return 0;
@@ -536,8 +722,7 @@ static int bt_add_ipmi_msg(struct ipmi_msg *ipmi_msg)
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
 	lock(&bt.lock);
-	bt_add_msg(bt_msg);
-	list_add_tail(&bt.msgq, &bt_msg->link);
+	bt_add_msg(bt_msg, false);
 	bt_send_and_unlock();
 
 	return 0;
@@ -596,8 +781,7 @@ static int bt_del_ipmi_msg(struct ipmi_msg *ipmi_msg)
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
 	lock(&bt.lock);
-	list_del_from(&bt.msgq, &bt_msg->link);
-	bt.queue_len--;
+	bt_msg_unlink(bt_msg);
 	bt_send_and_unlock();
 	return 0;
 }
@@ -619,6 +803,7 @@ void bt_init(void)
 	struct dt_node *n;
 	const struct dt_property *prop;
 	uint32_t irq;
+	int i;
 
 	/* Set sane capability defaults */
 	bt.caps.num_requests = 1;
@@ -654,7 +839,12 @@ void bt_init(void)
 	 * The iBT interface comes up in the busy state until the daemon has
 	 * initialised it.
 	 */
-	list_head_init(&bt.msgq);
+	for (i = 0; i < IPMI_NR_PRIOS; i++) {
+		list_head_init(&bt.msgq[i]);
+		bt.class_len[i] = 0;
+		bt.credits[i] = bt_class_weight[i];
+	}
+	list_head_init(&bt.inflight);
 	bt.queue_len = 0;
 
 	prlog(PR_NOTICE, "Interface initialized, IO 0x%04x\n", bt.base_addr);
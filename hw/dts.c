@@ -19,7 +19,11 @@
 #include <sensor.h>
 #include <dts.h>
 #include <skiboot.h>
-#include <opal-api.h>
+#include <opal.h>
+#include <lock.h>
+#include <timer.h>
+#include <timebase.h>
+#include <device.h>
 
 struct dts {
 	uint8_t		valid;
@@ -27,6 +31,9 @@ struct dts {
 	int16_t		temp;
 };
 
+/* How old a snapshot may get before a read refreshes it, 0 disables it */
+unsigned long dts_refresh_ms = DTS_REFRESH_MS;
+
 /* Different sensor locations */
 #define P7_CT_ZONE_LSU	0
 #define P7_CT_ZONE_ISU	1
@@ -54,20 +61,14 @@ struct dts {
  * 60		reserved1
  * 61..63	ID of worst case DTS2 (Only valid in EX core chiplets)
  */
-static int dts_read_core_temp_p7(uint32_t pir, struct dts *dts)
+static void dts_decode_core_temp_p7(uint32_t pir, const uint64_t *regs,
+				    struct dts *dts)
 {
 	int32_t chip_id = pir_to_chip_id(pir);
 	int32_t core = pir_to_core_id(pir);
-	uint64_t dts0;
+	uint64_t dts0 = regs[0];
 	struct dts temps[P7_CT_ZONES];
 	int i;
-	int rc;
-
-	rc = xscom_read(chip_id,
-			XSCOM_ADDR_P8_EX(core, EX_THERM_P7_DTS_RESULT0),
-			&dts0);
-	if (rc)
-		return rc;
 
 	temps[P7_CT_ZONE_LSU].temp = (dts0 >> 56) & 0xff;
 	temps[P7_CT_ZONE_ISU].temp = (dts0 >> 48) & 0xff;
@@ -85,8 +86,6 @@ static int dts_read_core_temp_p7(uint32_t pir, struct dts *dts)
 
 	prlog(PR_TRACE, "DTS: Chip %x Core %x temp:%dC trip:%x\n",
 	      chip_id, core, dts->temp, dts->trip);
-
-	return 0;
 }
 
 /* Therm mac result masking for DTS (result(0:15)
@@ -148,23 +147,13 @@ static void dts_keep_max(struct dts *temps, int n, struct dts *dts)
  * Returns the temperature as the max of all 4 zones and a global trip
  * attribute.
  */
-static int dts_read_core_temp_p8(uint32_t pir, struct dts *dts)
+static void dts_decode_core_temp_p8(uint32_t pir, const uint64_t *regs,
+				    struct dts *dts)
 {
 	int32_t chip_id = pir_to_chip_id(pir);
 	int32_t core = pir_to_core_id(pir);
-	uint64_t dts0, dts1;
+	uint64_t dts0 = regs[0], dts1 = regs[1];
 	struct dts temps[P8_CT_ZONES];
-	int rc;
-
-	rc = xscom_read(chip_id, XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT0),
-			&dts0);
-	if (rc)
-		return rc;
-
-	rc = xscom_read(chip_id, XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT1),
-			&dts1);
-	if (rc)
-		return rc;
 
 	dts_decode_one_dts(dts0 >> 48, &temps[P8_CT_ZONE_LSU]);
 	dts_decode_one_dts(dts0 >> 32, &temps[P8_CT_ZONE_ISU]);
@@ -181,7 +170,6 @@ static int dts_read_core_temp_p8(uint32_t pir, struct dts *dts)
 	 * them for the moment until we understand why.
 	 */
 	dts->trip = 0;
-	return 0;
 }
 
 /* Per core Digital Thermal Sensors */
@@ -196,18 +184,13 @@ static int dts_read_core_temp_p8(uint32_t pir, struct dts *dts)
  * Returns the temperature as the max of all zones and a global trip
  * attribute.
  */
-static int dts_read_core_temp_p9(uint32_t pir, struct dts *dts)
+static void dts_decode_core_temp_p9(uint32_t pir, const uint64_t *regs,
+				    struct dts *dts)
 {
 	int32_t chip_id = pir_to_chip_id(pir);
 	int32_t core = pir_to_core_id(pir);
-	uint64_t dts0;
+	uint64_t dts0 = regs[0];
 	struct dts temps[P9_CORE_ZONES];
-	int rc;
-
-	rc = xscom_read(chip_id, XSCOM_ADDR_P9_EC(core, EC_THERM_P9_DTS_RESULT0),
-			&dts0);
-	if (rc)
-		return rc;
 
 	dts_decode_one_dts(dts0 >> 48, &temps[P9_CORE_DTS0]);
 	dts_decode_one_dts(dts0 >> 32, &temps[P9_CORE_DTS1]);
@@ -222,27 +205,68 @@ static int dts_read_core_temp_p9(uint32_t pir, struct dts *dts)
 	 * them for the moment until we understand why.
 	 */
 	dts->trip = 0;
-	return 0;
 }
 
-static int dts_read_core_temp(uint32_t pir, struct dts *dts)
+#define DTS_CORE_MAX_REGS	2
+
+/*
+ * Fill in the addresses of the DTS result registers of a core and
+ * return how many there are, 0 if we don't know this processor.
+ */
+static unsigned int dts_core_regs(uint32_t pir, uint64_t *addrs)
 {
-	int rc;
+	int32_t core = pir_to_core_id(pir);
+
+	switch (proc_gen) {
+	case proc_gen_p7:
+		addrs[0] = XSCOM_ADDR_P8_EX(core, EX_THERM_P7_DTS_RESULT0);
+		return 1;
+	case proc_gen_p8:
+		addrs[0] = XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT0);
+		addrs[1] = XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT1);
+		return 2;
+	case proc_gen_p9:
+		addrs[0] = XSCOM_ADDR_P9_EC(core, EC_THERM_P9_DTS_RESULT0);
+		return 1;
+	default:
+		return 0;
+	}
+}
 
+static void dts_decode_core_temp(uint32_t pir, const uint64_t *regs,
+				 struct dts *dts)
+{
 	switch (proc_gen) {
 	case proc_gen_p7:
-		rc = dts_read_core_temp_p7(pir, dts);
+		dts_decode_core_temp_p7(pir, regs, dts);
 		break;
 	case proc_gen_p8:
-		rc = dts_read_core_temp_p8(pir, dts);
+		dts_decode_core_temp_p8(pir, regs, dts);
 		break;
 	case proc_gen_p9:
-		rc = dts_read_core_temp_p9(pir, dts);
+		dts_decode_core_temp_p9(pir, regs, dts);
 		break;
 	default:
-		rc = OPAL_UNSUPPORTED;
+		break;
 	}
-	return rc;
+}
+
+static int dts_read_core_temp(uint32_t pir, struct dts *dts)
+{
+	uint64_t addrs[DTS_CORE_MAX_REGS], regs[DTS_CORE_MAX_REGS];
+	unsigned int n;
+	int rc;
+
+	n = dts_core_regs(pir, addrs);
+	if (!n)
+		return OPAL_UNSUPPORTED;
+
+	rc = xscom_read_multi(pir_to_chip_id(pir), addrs, regs, n);
+	if (rc)
+		return rc;
+
+	dts_decode_core_temp(pir, regs, dts);
+	return 0;
 }
 
 /* Per memory controller Digital Thermal Sensors */
@@ -316,6 +340,241 @@ enum {
  */
 #define centaur_get_id(rid) (0x80000000 | ((rid) & 0x3ff))
 
+/* The processor chip a Centaur hangs off, see centaur_make_id() */
+#define centaur_get_chip(cen_id) (((cen_id) & 0x0fffffff) >> 4)
+
+static int64_t dts_read_live(uint8_t class, uint32_t rid, struct dts *dts)
+{
+	switch (class) {
+	case SENSOR_DTS_CORE_TEMP:
+		return dts_read_core_temp(rid, dts);
+	case SENSOR_DTS_MEM_TEMP:
+		return dts_read_mem_temp(centaur_get_id(rid), dts);
+	default:
+		return OPAL_PARAMETER;
+	}
+}
+
+/*
+ * Monitoring tools poll every sensor every few seconds, which used to
+ * be one or two XSCOMs per core and Centaur per read. Instead, each
+ * chip keeps a snapshot of its sensors, cores first then Centaurs,
+ * read in one go and served to OPAL_SENSOR_READ as long as it is not
+ * older than dts_refresh_ms.
+ *
+ * The first read arms a per chip timer which keeps refreshing the
+ * snapshot in the background, so that reads rarely wait for XSCOMs.
+ * The timer stops when a whole period went by without a read.
+ */
+struct dts_sensor {
+	uint32_t	id;		/* PIR or Centaur chip ID */
+	uint32_t	handle;		/* SENSOR_DTS_ATTR_TEMP_MAX handler */
+	uint8_t		class;
+	int64_t		rc;
+	struct dts	dts;
+};
+
+struct dts_chip {
+	struct lock	lock;
+	struct timer	timer;
+	uint32_t	chip_id;
+	unsigned long	stamp;		/* timebase of the last refresh */
+	bool		valid;
+	bool		armed;
+	bool		used;
+	unsigned int	nr_regs;
+	uint64_t	*addrs;		/* DTS registers of all the cores */
+	uint64_t	*vals;
+	unsigned int	nr_sensors;
+	unsigned int	max_sensors;
+	struct dts_sensor sensors[];
+};
+
+static struct dts_chip *dts_chips[MAX_CHIPS];
+
+/* Called with the chip's snapshot lock held */
+static void dts_chip_refresh(struct dts_chip *dc)
+{
+	unsigned int i, r = 0;
+	int rc;
+
+	/* All the cores of the chip with a single hold of its XSCOM lock */
+	rc = 0;
+	if (dc->nr_regs)
+		rc = xscom_read_multi(dc->chip_id, dc->addrs, dc->vals,
+				      dc->nr_regs);
+
+	for (i = 0; i < dc->nr_sensors; i++) {
+		struct dts_sensor *s = &dc->sensors[i];
+		uint64_t addrs[DTS_CORE_MAX_REGS];
+		unsigned int n;
+
+		memset(&s->dts, 0, sizeof(s->dts));
+
+		if (s->class == SENSOR_DTS_MEM_TEMP) {
+			s->rc = dts_read_mem_temp(s->id, &s->dts);
+			continue;
+		}
+
+		n = dts_core_regs(s->id, addrs);
+		if (rc) {
+			/* Don't fail every core because of one */
+			s->rc = dts_read_core_temp(s->id, &s->dts);
+		} else {
+			dts_decode_core_temp(s->id, &dc->vals[r], &s->dts);
+			s->rc = OPAL_SUCCESS;
+		}
+		r += n;
+	}
+
+	dc->stamp = mftb();
+	dc->valid = true;
+}
+
+static void dts_chip_timer(struct timer *t __unused, void *data,
+			   uint64_t now __unused)
+{
+	struct dts_chip *dc = data;
+
+	lock(&dc->lock);
+	if (dc->used && dts_refresh_ms) {
+		dc->used = false;
+		dts_chip_refresh(dc);
+		schedule_timer(&dc->timer, msecs_to_tb(dts_refresh_ms));
+	} else {
+		dc->armed = false;
+	}
+	unlock(&dc->lock);
+}
+
+/* Called with the chip's snapshot lock held */
+static void dts_chip_update(struct dts_chip *dc)
+{
+	unsigned long now = mftb();
+
+	dc->used = true;
+
+	if (!dts_refresh_ms || !dc->valid ||
+	    tb_compare(now, dc->stamp + msecs_to_tb(dts_refresh_ms)) !=
+	    TB_ABEFOREB)
+		dts_chip_refresh(dc);
+
+	if (dts_refresh_ms && !dc->armed) {
+		dc->armed = true;
+		schedule_timer(&dc->timer, msecs_to_tb(dts_refresh_ms));
+	}
+}
+
+static struct dts_chip *dts_chip_alloc(uint32_t chip_id,
+				       unsigned int nr_cores,
+				       unsigned int nr_cens)
+{
+	unsigned int max_sensors = nr_cores + nr_cens;
+	struct dts_chip *dc;
+
+	dc = zalloc(sizeof(*dc) + max_sensors * sizeof(struct dts_sensor));
+	if (!dc)
+		return NULL;
+
+	if (nr_cores) {
+		dc->addrs = zalloc(nr_cores * DTS_CORE_MAX_REGS *
+				   sizeof(uint64_t));
+		dc->vals = zalloc(nr_cores * DTS_CORE_MAX_REGS *
+				  sizeof(uint64_t));
+		if (!dc->addrs || !dc->vals) {
+			free(dc->addrs);
+			free(dc->vals);
+			free(dc);
+			return NULL;
+		}
+	}
+
+	init_lock(&dc->lock);
+	init_timer(&dc->timer, dts_chip_timer, dc);
+	dc->chip_id = chip_id;
+	dc->max_sensors = max_sensors;
+
+	return dc;
+}
+
+static void dts_chip_add(struct dts_chip *dc, uint8_t class, uint32_t id,
+			 uint32_t handle)
+{
+	struct dts_sensor *s;
+	unsigned int n = 0;
+
+	if (!dc || dc->nr_sensors == dc->max_sensors)
+		return;
+
+	if (class == SENSOR_DTS_CORE_TEMP) {
+		n = dts_core_regs(id, &dc->addrs[dc->nr_regs]);
+
+		/* Unknown processor, leave it to dts_read_live() */
+		if (!n)
+			return;
+	}
+
+	s = &dc->sensors[dc->nr_sensors++];
+	s->id = id;
+	s->handle = handle;
+	s->class = class;
+	dc->nr_regs += n;
+}
+
+static struct dts_chip *dts_chip_of(uint8_t class, uint32_t rid)
+{
+	uint32_t chip_id;
+
+	switch (class) {
+	case SENSOR_DTS_CORE_TEMP:
+		chip_id = pir_to_chip_id(rid);
+		break;
+	case SENSOR_DTS_MEM_TEMP:
+		chip_id = centaur_get_chip(centaur_get_id(rid));
+		break;
+	default:
+		return NULL;
+	}
+
+	return chip_id < MAX_CHIPS ? dts_chips[chip_id] : NULL;
+}
+
+static struct dts_sensor *dts_chip_find(struct dts_chip *dc, uint8_t class,
+					uint32_t rid)
+{
+	unsigned int i;
+
+	for (i = 0; i < dc->nr_sensors; i++) {
+		struct dts_sensor *s = &dc->sensors[i];
+
+		if (s->class == class && sensor_get_rid(s->handle) == rid)
+			return s;
+	}
+
+	return NULL;
+}
+
+static int64_t dts_read(uint8_t class, uint32_t rid, struct dts *dts)
+{
+	struct dts_sensor *s = NULL;
+	struct dts_chip *dc;
+	int64_t rc;
+
+	dc = dts_refresh_ms ? dts_chip_of(class, rid) : NULL;
+	if (dc)
+		s = dts_chip_find(dc, class, rid);
+	if (!s)
+		return dts_read_live(class, rid, dts);
+
+	lock(&dc->lock);
+	dts_chip_update(dc);
+	*dts = s->dts;
+	rc = s->rc;
+	unlock(&dc->lock);
+
+	return rc;
+}
+
 int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data)
 {
 	uint8_t	attr = sensor_get_attr(sensor_hndl);
@@ -328,17 +587,7 @@ int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data)
 
 	memset(&dts, 0, sizeof(struct dts));
 
-	switch (sensor_get_frc(sensor_hndl)) {
-	case SENSOR_DTS_CORE_TEMP:
-		rc = dts_read_core_temp(rid, &dts);
-		break;
-	case SENSOR_DTS_MEM_TEMP:
-		rc = dts_read_mem_temp(centaur_get_id(rid), &dts);
-		break;
-	default:
-		rc = OPAL_PARAMETER;
-		break;
-	}
+	rc = dts_read(sensor_get_frc(sensor_hndl), rid, &dts);
 	if (rc)
 		return rc;
 
@@ -350,6 +599,46 @@ int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data)
 	return 0;
 }
 
+static int64_t opal_sensor_dts_read_chip(uint32_t chip_id,
+					 struct opal_dts_sensor *buf,
+					 __be32 *nr)
+{
+	struct dts_chip *dc;
+	unsigned int i;
+
+	if (chip_id >= MAX_CHIPS || !opal_addr_valid(nr))
+		return OPAL_PARAMETER;
+
+	dc = dts_chips[chip_id];
+	if (!dc)
+		return OPAL_PARAMETER;
+
+	if (be32_to_cpu(*nr) < dc->nr_sensors) {
+		*nr = cpu_to_be32(dc->nr_sensors);
+		return OPAL_PARTIAL;
+	}
+
+	if (dc->nr_sensors && !opal_addr_valid(buf))
+		return OPAL_PARAMETER;
+
+	lock(&dc->lock);
+	dts_chip_update(dc);
+	for (i = 0; i < dc->nr_sensors; i++) {
+		struct dts_sensor *s = &dc->sensors[i];
+
+		buf[i].handle = cpu_to_be32(s->handle);
+		buf[i].temp = cpu_to_be32(s->dts.temp);
+		buf[i].trip = cpu_to_be32(s->dts.trip);
+		buf[i].rc = cpu_to_be32(s->rc);
+	}
+	unlock(&dc->lock);
+
+	*nr = cpu_to_be32(dc->nr_sensors);
+
+	return OPAL_SUCCESS;
+}
+opal_call(OPAL_SENSOR_DTS_READ_CHIP, opal_sensor_dts_read_chip, 3);
+
 /*
  * We only have two bytes for the resource identifier in the sensor
  * handler. Let's trunctate the centaur chip id to squeeze it in.
@@ -371,12 +660,47 @@ int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data)
 	sensor_make_handler(SENSOR_DTS, SENSOR_DTS_MEM_TEMP,		\
 			    centaur_make_id(chip_id, 0), attr_id)
 
+/* The temperature and trip handles of all the sensors of a chip */
+static void dts_add_sensor_group(struct dts_chip *dc)
+{
+	uint32_t *handles;
+	unsigned int i;
+
+	if (!dc || !dc->nr_sensors)
+		return;
+
+	handles = malloc(2 * dc->nr_sensors * sizeof(uint32_t));
+	if (!handles)
+		return;
+
+	for (i = 0; i < dc->nr_sensors; i++) {
+		struct dts_sensor *s = &dc->sensors[i];
+
+		handles[2 * i] = s->handle;
+		handles[2 * i + 1] = sensor_make_handler(SENSOR_DTS, s->class,
+						sensor_get_rid(s->handle),
+						SENSOR_DTS_ATTR_TEMP_TRIP);
+	}
+
+	sensor_group_add("dts", dc->chip_id, handles, 2 * dc->nr_sensors);
+	free(handles);
+}
+
 bool dts_sensor_create_nodes(struct dt_node *sensors)
 {
+	unsigned int nr_cens[MAX_CHIPS] = { 0 };
 	struct proc_chip *chip;
 	struct dt_node *cn;
 	char name[64];
 
+	dt_for_each_compatible(dt_root, cn, "ibm,centaur") {
+		uint32_t gcid;
+
+		gcid = centaur_get_chip(dt_prop_get_u32(cn, "ibm,chip-id"));
+		if (gcid < MAX_CHIPS)
+			nr_cens[gcid]++;
+	}
+
 	/* build the device tree nodes :
 	 *
 	 *     sensors/core-temp@pir
@@ -386,6 +710,17 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 	 */
 	for_each_chip(chip) {
 		struct cpu_thread *c;
+		unsigned int nr_cores = 0;
+		struct dts_chip *dc;
+
+		for_each_available_core_in_chip(c, chip->id)
+			nr_cores++;
+
+		dc = dts_chip_alloc(chip->id, nr_cores, nr_cens[chip->id]);
+		if (!dc)
+			prerror("DTS: Chip %x sensors won't be cached\n",
+				chip->id);
+		dts_chips[chip->id] = dc;
 
 		for_each_available_core_in_chip(c, chip->id) {
 			struct dt_node *node;
@@ -394,6 +729,7 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 			snprintf(name, sizeof(name), "core-temp@%x", c->pir);
 
 			handler = core_handler(c->pir, SENSOR_DTS_ATTR_TEMP_MAX);
+			dts_chip_add(dc, SENSOR_DTS_CORE_TEMP, c->pir, handler);
 			node = dt_new(sensors, name);
 			dt_add_property_string(node, "compatible",
 					       "ibm,opal-sensor");
@@ -410,7 +746,7 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 	 * sensors/mem-temp@chip for Centaurs
 	 */
 	dt_for_each_compatible(dt_root, cn, "ibm,centaur") {
-		uint32_t chip_id;
+		uint32_t chip_id, gcid;
 		struct dt_node *node;
 		uint32_t handler;
 
@@ -419,6 +755,10 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 		snprintf(name, sizeof(name), "mem-temp@%x", chip_id);
 
 		handler = cen_handler(chip_id, SENSOR_DTS_ATTR_TEMP_MAX);
+		gcid = centaur_get_chip(chip_id);
+		if (gcid < MAX_CHIPS)
+			dts_chip_add(dts_chips[gcid], SENSOR_DTS_MEM_TEMP,
+				     chip_id, handler);
 		node = dt_new(sensors, name);
 		dt_add_property_string(node, "compatible",
 				       "ibm,opal-sensor");
@@ -431,5 +771,8 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 		dt_add_property_string(node, "label", "Centaur");
 	}
 
+	for_each_chip(chip)
+		dts_add_sensor_group(dts_chips[chip->id]);
+
 	return true;
 }
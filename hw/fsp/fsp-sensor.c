@@ -86,13 +86,31 @@ enum spcn_attr {
 
 /* Parsed sensor attributes, passed through OPAL */
 struct opal_sensor_data {
-	uint64_t	async_token;	/* Asynchronous token */
 	uint32_t	*sensor_data;	/* Kernel pointer to copy data */
+	__be32		*group_rc;	/* Kernel pointer to the rc of a
+					 * group entry, NULL otherwise */
 	enum spcn_attr	spcn_attr;	/* Modifier attribute */
 	uint16_t	rid;		/* Sensor RID */
 	uint8_t		frc;		/* Sensor resource class */
 	uint32_t	mod_index;	/* Modifier index*/
+	bool		done;
+	int64_t		rc;
+};
+
+/*
+ * A read in flight: one sensor for OPAL_SENSOR_READ, or all the FSP
+ * sensors of a group for OPAL_SENSOR_GROUP_READ. The response to a
+ * PRS command modifier covers every sensor it reports on, so the
+ * sensors of a group that use the same modifier share its requests.
+ */
+struct opal_sensor_req {
+	uint64_t	async_token;	/* Asynchronous token */
+	uint32_t	mod_index;	/* Modifier index being fetched */
+	uint32_t	first_index;	/* Modifier index it started from */
 	uint32_t	offset;		/* Offset in sensor buffer */
+	bool		group;
+	unsigned int	nr;
+	struct opal_sensor_data attrs[];
 };
 
 struct spcn_mod {
@@ -140,8 +158,8 @@ static bool prev_msg_consumed = true;
 static struct lock sensor_lock;
 
 /* Function prototypes */
-static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr);
-static void queue_msg_for_delivery(int rc, struct opal_sensor_data *attr);
+static int64_t fsp_sensor_send_read_request(struct opal_sensor_req *req);
+static void queue_msg_for_delivery(int rc, struct opal_sensor_req *req);
 
 
 /*
@@ -219,21 +237,31 @@ static inline uint16_t convert_status_to_fault(uint16_t status)
 	return status & 0x06;
 }
 
-static void fsp_sensor_process_data(struct opal_sensor_data *attr)
+static void fsp_sensor_set_data(struct opal_sensor_data *attr,
+				uint32_t sensor_data, int64_t rc)
+{
+	*(attr->sensor_data) = sensor_data;
+	if (attr->group_rc)
+		*(attr->group_rc) = cpu_to_be32(rc);
+	attr->rc = rc;
+	attr->done = true;
+}
+
+static void fsp_sensor_process_one(struct spcn_mod *smod,
+				   struct opal_sensor_data *attr)
 {
 	uint8_t *sensor_buf_ptr = (uint8_t *)sensor_buffer;
 	uint32_t sensor_data = INVALID_DATA;
 	uint16_t sensor_mod_data[8];
 	int count;
 
-	for (count = 0; count < spcn_mod_data[attr->mod_index].entry_count;
-			count++) {
+	for (count = 0; count < smod->entry_count; count++) {
 		memcpy((void *)sensor_mod_data, sensor_buf_ptr,
-				spcn_mod_data[attr->mod_index].entry_size);
-		if (spcn_mod_data[attr->mod_index].mod == SPCN_MOD_PROC_JUNC_TEMP) {
+				smod->entry_size);
+		if (smod->mod == SPCN_MOD_PROC_JUNC_TEMP) {
 			/* TODO Support this modifier '0x14', if required */
 
-		} else if (spcn_mod_data[attr->mod_index].mod == SPCN_MOD_SENSOR_POWER) {
+		} else if (smod->mod == SPCN_MOD_SENSOR_POWER) {
 			sensor_data = sensor_power_process_data(attr->rid,
 					(struct sensor_power *) sensor_buf_ptr);
 			break;
@@ -257,14 +285,59 @@ static void fsp_sensor_process_data(struct opal_sensor_data *attr)
 			break;
 		}
 
-		sensor_buf_ptr += spcn_mod_data[attr->mod_index].entry_size;
+		sensor_buf_ptr += smod->entry_size;
 	}
 
-	*(attr->sensor_data) = sensor_data;
-	if (sensor_data == INVALID_DATA)
-		queue_msg_for_delivery(OPAL_PARTIAL, attr);
-	else
-		queue_msg_for_delivery(OPAL_SUCCESS, attr);
+	fsp_sensor_set_data(attr, sensor_data, sensor_data == INVALID_DATA ?
+			    OPAL_PARTIAL : OPAL_SUCCESS);
+}
+
+/* Pick the data of all the sensors using the modifier just fetched */
+static void fsp_sensor_process_data(struct opal_sensor_req *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nr; i++) {
+		struct opal_sensor_data *attr = &req->attrs[i];
+
+		if (!attr->done && attr->mod_index == req->first_index)
+			fsp_sensor_process_one(&spcn_mod_data[req->mod_index],
+					       attr);
+	}
+	spcn_mod_data[req->mod_index].entry_count = 0;
+}
+
+/*
+ * Send the request for the next modifier the sensors of req need.
+ * Returns OPAL_SUCCESS if there is none left.
+ */
+static int64_t fsp_sensor_next_mod(struct opal_sensor_req *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nr; i++) {
+		struct opal_sensor_data *attr = &req->attrs[i];
+
+		if (attr->done)
+			continue;
+
+		req->mod_index = attr->mod_index;
+		req->first_index = attr->mod_index;
+		req->offset = 0;
+		return fsp_sensor_send_read_request(req);
+	}
+
+	return OPAL_SUCCESS;
+}
+
+static void fsp_sensor_fail(struct opal_sensor_req *req, int64_t rc)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nr; i++) {
+		if (!req->attrs[i].done)
+			fsp_sensor_set_data(&req->attrs[i], INVALID_DATA, rc);
+	}
 }
 
 static int fsp_sensor_process_read(struct fsp_msg *resp_msg)
@@ -304,20 +377,20 @@ static int fsp_sensor_process_read(struct fsp_msg *resp_msg)
 	return size;
 }
 
-static void queue_msg_for_delivery(int rc, struct opal_sensor_data *attr)
+static void queue_msg_for_delivery(int rc, struct opal_sensor_req *req)
 {
-	prlog(PR_INSANE, "%s: rc:%d, data:%d\n",
-	      __func__, rc, *(attr->sensor_data));
+	prlog(PR_INSANE, "%s: rc:%d, data:%d, sensors:%d\n",
+	      __func__, rc, *(req->attrs[0].sensor_data), req->nr);
 	opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL,
-			attr->async_token, rc);
-	spcn_mod_data[attr->mod_index].entry_count = 0;
-	free(attr);
+			req->async_token, rc);
+	spcn_mod_data[req->mod_index].entry_count = 0;
+	free(req);
 	prev_msg_consumed = true;
 }
 
 static void fsp_sensor_read_complete(struct fsp_msg *msg)
 {
-	struct opal_sensor_data *attr = msg->user_data;
+	struct opal_sensor_req *req = msg->user_data;
 	enum spcn_rsp_status status;
 	int rc, size;
 
@@ -329,30 +402,39 @@ static void fsp_sensor_read_complete(struct fsp_msg *msg)
 
 	lock(&sensor_lock);
 	if (sensor_state == SENSOR_VALID_DATA) {
-		spcn_mod_data[attr->mod_index].entry_count += (size /
-				spcn_mod_data[attr->mod_index].entry_size);
-		attr->offset += size;
+		spcn_mod_data[req->mod_index].entry_count += (size /
+				spcn_mod_data[req->mod_index].entry_size);
+		req->offset += size;
 		/* Fetch the subsequent entries of the same modifier type */
 		if (status == SPCN_RSP_STATUS_COND_SUCCESS) {
-			switch (spcn_mod_data[attr->mod_index].mod) {
+			switch (spcn_mod_data[req->mod_index].mod) {
 			case SPCN_MOD_PRS_STATUS_FIRST:
 			case SPCN_MOD_SENSOR_PARAM_FIRST:
 			case SPCN_MOD_SENSOR_DATA_FIRST:
-				attr->mod_index++;
-				spcn_mod_data[attr->mod_index].entry_count =
-						spcn_mod_data[attr->mod_index - 1].
+				req->mod_index++;
+				spcn_mod_data[req->mod_index].entry_count =
+						spcn_mod_data[req->mod_index - 1].
 						entry_count;
-				spcn_mod_data[attr->mod_index - 1].entry_count = 0;
+				spcn_mod_data[req->mod_index - 1].entry_count = 0;
 				break;
 			default:
 				break;
 			}
 
-			rc = fsp_sensor_send_read_request(attr);
+			rc = fsp_sensor_send_read_request(req);
 			if (rc != OPAL_ASYNC_COMPLETION)
 				goto err;
-		} else { /* Notify 'powernv' of read completion */
-			fsp_sensor_process_data(attr);
+		} else {
+			fsp_sensor_process_data(req);
+
+			/* Notify 'powernv' of read completion */
+			rc = fsp_sensor_next_mod(req);
+			if (rc == OPAL_SUCCESS)
+				queue_msg_for_delivery(req->group ?
+						       OPAL_SUCCESS :
+						       req->attrs[0].rc, req);
+			else if (rc != OPAL_ASYNC_COMPLETION)
+				goto err;
 		}
 	} else {
 		rc = OPAL_INTERNAL_ERROR;
@@ -361,15 +443,15 @@ static void fsp_sensor_read_complete(struct fsp_msg *msg)
 	unlock(&sensor_lock);
 	return;
 err:
-	*(attr->sensor_data) = INVALID_DATA;
-	queue_msg_for_delivery(rc, attr);
+	fsp_sensor_fail(req, rc);
+	queue_msg_for_delivery(rc, req);
 	unlock(&sensor_lock);
 	log_simple_error(&e_info(OPAL_RC_SENSOR_ASYNC_COMPLETE),
 		"SENSOR: %s: Failed to queue the "
 		"read request to fsp\n", __func__);
 }
 
-static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
+static int64_t fsp_sensor_send_read_request(struct opal_sensor_req *req)
 {
 	int rc;
 	struct fsp_msg *msg;
@@ -380,28 +462,28 @@ static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
 		return OPAL_BUSY;
 
 	prlog(PR_INSANE, "Get the data for modifier [%x]\n",
-	      spcn_mod_data[attr->mod_index].mod);
+	      spcn_mod_data[req->mod_index].mod);
 
-	if (spcn_mod_data[attr->mod_index].mod == SPCN_MOD_PROC_JUNC_TEMP) {
+	if (spcn_mod_data[req->mod_index].mod == SPCN_MOD_PROC_JUNC_TEMP) {
 		/* TODO Support this modifier '0x14', if required */
-		align = attr->offset % sizeof(uint32_t);
+		align = req->offset % sizeof(uint32_t);
 		if (align)
-			attr->offset += (sizeof(uint32_t) - align);
+			req->offset += (sizeof(uint32_t) - align);
 
 		/* TODO Add 8 byte command data required for mod 0x14 */
 
-		attr->offset += 8;
+		req->offset += 8;
 
-		cmd_header = spcn_mod_data[attr->mod_index].mod << 24 |
+		cmd_header = spcn_mod_data[req->mod_index].mod << 24 |
 				SPCN_CMD_PRS << 16 | 0x0008;
 	} else {
-		cmd_header = spcn_mod_data[attr->mod_index].mod << 24 |
+		cmd_header = spcn_mod_data[req->mod_index].mod << 24 |
 				SPCN_CMD_PRS << 16;
 	}
 
 	msg = fsp_mkmsg(FSP_CMD_SPCN_PASSTHRU, 4,
 			SPCN_ADDR_MODE_CEC_NODE, cmd_header, 0,
-			PSI_DMA_SENSOR_BUF + attr->offset);
+			PSI_DMA_SENSOR_BUF + req->offset);
 
 	if (!msg) {
 		log_simple_error(&e_info(OPAL_RC_SENSOR_READ), "SENSOR: Failed "
@@ -409,7 +491,7 @@ static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
 		return OPAL_INTERNAL_ERROR;
 	}
 
-	msg->user_data = attr;
+	msg->user_data = req;
 	rc = fsp_queue_msg(msg, fsp_sensor_read_complete);
 	if (rc) {
 		fsp_freemsg(msg);
@@ -515,6 +597,7 @@ int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 		uint32_t *sensor_data)
 {
 	struct opal_sensor_data *attr;
+	struct opal_sensor_req *req;
 	int64_t rc;
 
 	prlog(PR_INSANE, "fsp_opal_read_sensor [%08x]\n", sensor_hndl);
@@ -534,8 +617,8 @@ int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 
 	lock(&sensor_lock);
 	if (prev_msg_consumed) {
-		attr = zalloc(sizeof(*attr));
-		if (!attr) {
+		req = zalloc(sizeof(*req) + sizeof(*attr));
+		if (!req) {
 			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 				"SENSOR: Failed to allocate memory\n");
 			rc = OPAL_NO_MEM;
@@ -543,6 +626,8 @@ int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 		}
 
 		/* Parse the sensor id and store them to the local structure */
+		req->nr = 1;
+		attr = &req->attrs[0];
 		rc = parse_sensor_id(sensor_hndl, attr);
 		if (rc) {
 			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
@@ -552,9 +637,9 @@ int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 		}
 		/* Kernel buffer pointer to copy the data later when ready */
 		attr->sensor_data = sensor_data;
-		attr->async_token = token;
+		req->async_token = token;
 
-		rc = fsp_sensor_send_read_request(attr);
+		rc = fsp_sensor_next_mod(req);
 		if (rc != OPAL_ASYNC_COMPLETION) {
 			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 				"SENSOR: %s: Failed to queue the read "
@@ -571,13 +656,84 @@ int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 	return rc;
 
 out_free:
-	free(attr);
+	free(req);
 out_lock:
 	unlock(&sensor_lock);
 out:
 	return rc;
 }
 
+int64_t fsp_opal_read_sensor_group(struct opal_sensor_group_entry *entries,
+				   unsigned int nr, int token)
+{
+	struct opal_sensor_req *req;
+	unsigned int i, count = 0;
+	int64_t rc;
+
+	for (i = 0; i < nr; i++) {
+		if (sensor_get_family(be32_to_cpu(entries[i].handle)) ==
+		    SENSOR_FSP)
+			count++;
+	}
+	if (!count)
+		return OPAL_SUCCESS;
+
+	prlog(PR_INSANE, "fsp_opal_read_sensor_group [%d sensors]\n", count);
+
+	if (fsp_in_rr())
+		return OPAL_BUSY;
+
+	if (sensor_state == SENSOR_PERMANENT_ERROR)
+		return OPAL_HARDWARE;
+
+	lock(&sensor_lock);
+	if (!prev_msg_consumed) {
+		rc = OPAL_BUSY_EVENT;
+		goto out_lock;
+	}
+
+	req = zalloc(sizeof(*req) + count * sizeof(struct opal_sensor_data));
+	if (!req) {
+		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
+			"SENSOR: Failed to allocate memory\n");
+		rc = OPAL_NO_MEM;
+		goto out_lock;
+	}
+	req->group = true;
+	req->async_token = token;
+
+	for (i = 0; i < nr; i++) {
+		uint32_t hndl = be32_to_cpu(entries[i].handle);
+		struct opal_sensor_data *attr;
+
+		if (sensor_get_family(hndl) != SENSOR_FSP)
+			continue;
+
+		attr = &req->attrs[req->nr++];
+		attr->sensor_data = (uint32_t *)&entries[i].value;
+		attr->group_rc = &entries[i].rc;
+		if (!hndl || parse_sensor_id(hndl, attr))
+			fsp_sensor_set_data(attr, INVALID_DATA,
+					    OPAL_PARAMETER);
+	}
+
+	/* A single request per modifier, whatever the number of sensors */
+	rc = fsp_sensor_next_mod(req);
+	if (rc == OPAL_ASYNC_COMPLETION) {
+		prev_msg_consumed = false;
+	} else {
+		if (rc != OPAL_SUCCESS)
+			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
+				"SENSOR: %s: Failed to queue the read "
+					"request to fsp\n", __func__);
+		free(req);
+	}
+
+out_lock:
+	unlock(&sensor_lock);
+	return rc;
+}
+
 
 #define MAX_NAME	64
 
@@ -769,6 +925,42 @@ out_sensor:
 	}
 }
 
+/* A sensor group for each resource class, with all its attributes */
+static void add_sensor_groups(struct dt_node *sensors)
+{
+	char compat[MAX_NAME];
+	struct dt_node *node;
+	unsigned int frc, n, max = 0;
+	uint32_t *handles;
+
+	dt_for_each_child(sensors, node)
+		max++;
+
+	handles = malloc(max * sizeof(uint32_t));
+	if (!handles)
+		return;
+
+	for (frc = 0; frc < ARRAY_SIZE(frc_names); frc++) {
+		if (!sensor_frc_is_valid(frc))
+			continue;
+
+		snprintf(compat, sizeof(compat), "ibm,opal-sensor-%s",
+			 frc_names[frc]);
+		n = 0;
+		dt_for_each_child(sensors, node) {
+			if (dt_node_is_compatible(node, compat) &&
+			    dt_find_property(node, "sensor-id"))
+				handles[n++] = dt_prop_get_u32(node,
+							       "sensor-id");
+		}
+
+		if (n)
+			sensor_group_add(frc_names[frc], -1, handles, n);
+	}
+
+	free(handles);
+}
+
 static void add_opal_sensor_node(void)
 {
 	int index;
@@ -777,6 +969,7 @@ static void add_opal_sensor_node(void)
 		return;
 
 	add_sensor_ids(sensor_node);
+	add_sensor_groups(sensor_node);
 
 	/* Reset the entry count of each modifier */
 	for (index = 0; spcn_mod_data[index].mod != SPCN_MOD_LAST;
@@ -33,6 +33,7 @@ int ipmi_chassis_control(uint8_t request)
 				sizeof(request));
 	if (!msg)
 		return OPAL_HARDWARE;
+	msg->prio = IPMI_PRIO_CRITICAL;
 
 	prlog(PR_INFO, "IPMI: sending chassis control request 0x%02x\n",
 			request);
@@ -64,6 +65,7 @@ int ipmi_set_power_state(uint8_t system, uint8_t device)
 
 	if (!msg)
 		return OPAL_HARDWARE;
+	msg->prio = IPMI_PRIO_CRITICAL;
 
 	prlog(PR_INFO, "IPMI: setting power state: sys %02x, dev %02x\n",
 			power_state.system, power_state.device);
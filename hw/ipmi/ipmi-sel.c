@@ -135,6 +135,31 @@ struct ipmi_sel_panic_msg {
 };
 static struct ipmi_sel_panic_msg ipmi_sel_panic_msg;
 
+/* Times we start an eSEL over after losing the SEL reservation */
+#define ESEL_MAX_RESTARTS	3
+
+/* An eSEL on its way to the BMC */
+struct esel_xfer {
+	struct pel_stream pel;
+	size_t		index;		/* of the next byte to send */
+	size_t		size;
+	uint16_t	reservation_id;
+	uint16_t	record_id;
+	int		restarts;
+};
+
+/* One for a panic, which may cut in on any other */
+static struct esel_xfer esel_xfer, esel_panic_xfer;
+
+/*
+ * Other eSELs are sent one at a time, each chunk going behind the IPMI
+ * messages already queued, so that a burst of errors doesn't hold up
+ * the watchdog or power control. The others wait here.
+ */
+static LIST_HEAD(esel_pending);
+static struct lock esel_lock = LOCK_UNLOCKED;
+static bool esel_busy;
+
 /* Forward declaration */
 static void ipmi_elog_poll(struct ipmi_msg *msg);
 
@@ -256,14 +281,67 @@ static void ipmi_update_sel_record(uint8_t event_severity, uint16_t esel_record_
 	}
 }
 
-static void ipmi_elog_error(struct ipmi_msg *msg)
+static struct esel_xfer *ipmi_esel_xfer(struct ipmi_msg *msg)
+{
+	return msg == ipmi_sel_panic_msg.msg ? &esel_panic_xfer : &esel_xfer;
+}
+
+/* eSELs are bulk traffic, unless we are going down */
+static void ipmi_esel_set_prio(struct ipmi_msg *msg)
+{
+	if (msg == ipmi_sel_panic_msg.msg)
+		msg->prio = IPMI_PRIO_CRITICAL;
+	else
+		msg->prio = IPMI_PRIO_BULK;
+}
+
+/* Queue the next message of an eSEL */
+static void ipmi_esel_queue(struct ipmi_msg *msg)
 {
-	if (msg->cc == IPMI_LOST_ARBITRATION_ERR)
-		/* Retry due to SEL erase */
+	ipmi_esel_set_prio(msg);
+	if (msg == ipmi_sel_panic_msg.msg)
+		ipmi_queue_msg_head(msg);
+	else
 		ipmi_queue_msg(msg);
-	else {
-		opal_elog_complete(msg->user_data, false);
-		ipmi_sel_free_msg(msg);
+}
+
+static void ipmi_esel_start_next(void);
+
+/* Done with an eSEL, successfully or not */
+static void ipmi_esel_done(struct errorlog *elog_buf, bool panic,
+			   bool success)
+{
+	opal_elog_complete(elog_buf, success);
+	if (!panic)
+		ipmi_esel_start_next();
+}
+
+/* Give up on an eSEL, and free its message */
+static void ipmi_esel_fail(struct ipmi_msg *msg)
+{
+	struct errorlog *elog_buf = msg->user_data;
+	bool panic = msg == ipmi_sel_panic_msg.msg;
+
+	ipmi_sel_free_msg(msg);
+	ipmi_esel_done(elog_buf, panic, false);
+}
+
+static void ipmi_elog_error(struct ipmi_msg *msg)
+{
+	struct esel_xfer *xfer = ipmi_esel_xfer(msg);
+
+	if (msg->cc == IPMI_LOST_ARBITRATION_ERR &&
+	    xfer->restarts++ < ESEL_MAX_RESTARTS) {
+		/*
+		 * The reservation was cancelled, by a SEL erase or a
+		 * panic eSEL cutting in. Start over with a new one.
+		 */
+		ipmi_init_msg(msg, IPMI_DEFAULT_INTERFACE, IPMI_RESERVE_SEL,
+			      ipmi_elog_poll, msg->user_data, 0, 2);
+		msg->error = ipmi_elog_error;
+		ipmi_esel_queue(msg);
+	} else {
+		ipmi_esel_fail(msg);
 	}
 }
 
@@ -299,6 +377,7 @@ static void ipmi_log_sel_event(struct ipmi_msg *msg, uint8_t event_severity,
 	memcpy(msg->data, &sel_record, sizeof(struct sel_record));
 
 	msg->error = ipmi_log_sel_event_error;
+	ipmi_esel_set_prio(msg);
 	ipmi_queue_msg_head(msg);
 }
 
@@ -310,82 +389,74 @@ static void ipmi_log_sel_event(struct ipmi_msg *msg, uint8_t event_severity,
  *
  * Because a reservation is needed we need to ensure eSEL's are added
  * as a single transaction as concurrent/interleaved adds would cancel
- * the reservation. We guarantee this by always adding our messages to
- * the head of the transmission queue, blocking any other messages
- * being sent until we have completed sending this message.
+ * the reservation. We guarantee this by only sending one eSEL at a
+ * time, other than a panic one. Other IPMI messages may go in between
+ * the partial adds as they don't touch the SEL.
  *
- * There is still a very small chance that we will accidentally
- * interleave a message if there is another one waiting at the head of
- * the ipmi queue and another cpu calls the ipmi poller before we
- * complete. However this should just cause a resevation cancelled
- * error which we have to deal with anyway (eg. because there may be a
- * SEL erase in progress) so it shouldn't cause any problems.
+ * A panic eSEL goes at the head of the transmission queue, cutting in
+ * on any other eSEL, which then loses its reservation and starts over.
+ *
+ * The PEL is rendered straight into each partial add message as it is
+ * sent.
  */
 static void ipmi_elog_poll(struct ipmi_msg *msg)
 {
-	static bool first = false;
-	static char pel_buf[IPMI_MAX_PEL_SIZE];
-	static size_t pel_size;
-	static size_t esel_size;
-	static int esel_index = 0;
-	int pel_index;
-	static unsigned int reservation_id = 0;
-	static unsigned int record_id = 0;
+	struct esel_xfer *xfer = ipmi_esel_xfer(msg);
 	struct errorlog *elog_buf = (struct errorlog *) msg->user_data;
-	size_t req_size;
+	size_t req_size, len;
 
 	if (bmc_platform->ipmi_oem_partial_add_esel == 0) {
 		prlog(PR_WARNING, "Dropped eSEL: BMC code is buggy/missing\n");
+		ipmi_esel_fail(msg);
 		return;
 	}
 
 	ipmi_init_esel_record();
 	if (msg->cmd == IPMI_CMD(IPMI_RESERVE_SEL)) {
-		first = true;
-		reservation_id = msg->data[0];
-		reservation_id |= msg->data[1] << 8;
-		if (!reservation_id) {
+		xfer->reservation_id = msg->data[0];
+		xfer->reservation_id |= msg->data[1] << 8;
+		if (!xfer->reservation_id) {
 			/*
 			 * According to specification we should never
 			 * get here, but just in case we do we cancel
 			 * sending the message.
 			 */
 			prerror("Invalid reservation id");
-			opal_elog_complete(elog_buf, false);
-			ipmi_sel_free_msg(msg);
+			ipmi_esel_fail(msg);
 			return;
 		}
 
-		pel_size = create_pel_log(elog_buf, pel_buf, IPMI_MAX_PEL_SIZE);
-		esel_size = pel_size + sizeof(struct sel_record);
-		esel_index = 0;
-		record_id = 0;
+		pel_stream_init(&xfer->pel, elog_buf);
+		xfer->size = xfer->pel.size + sizeof(struct sel_record);
+		xfer->index = 0;
+		xfer->record_id = 0;
 	} else {
-		record_id = msg->data[0];
-		record_id |= msg->data[1] << 8;
+		xfer->record_id = msg->data[0];
+		xfer->record_id |= msg->data[1] << 8;
 	}
 
 	/* Start or continue the IPMI_PARTIAL_ADD_SEL */
-	if (esel_index >= esel_size) {
+	if (xfer->index >= xfer->size) {
 		/*
 		 * We're all done. Invalidate the resevation id to
 		 * ensure we get an error if we cut in on another eSEL
 		 * message.
 		 */
-		reservation_id = 0;
-		esel_index = 0;
+		xfer->reservation_id = 0;
+		xfer->index = 0;
 
 		/* Log SEL event and free ipmi message */
-		ipmi_log_sel_event(msg, elog_buf->event_severity, record_id);
+		ipmi_log_sel_event(msg, elog_buf->event_severity,
+				   xfer->record_id);
 
-		opal_elog_complete(elog_buf, true);
+		ipmi_esel_done(elog_buf, xfer == &esel_panic_xfer, true);
 		return;
 	}
 
-	if ((esel_size - esel_index) <= (IPMI_MAX_REQ_SIZE - ESEL_HDR_SIZE)) {
+	if ((xfer->size - xfer->index) <= (IPMI_MAX_REQ_SIZE - ESEL_HDR_SIZE)) {
 		/* Last data to send */
 		msg->data[6] = 1;
-		req_size = esel_size - esel_index + ESEL_HDR_SIZE;
+		req_size = xfer->size - xfer->index + ESEL_HDR_SIZE;
 	} else {
 		msg->data[6] = 0;
 		req_size = IPMI_MAX_REQ_SIZE;
@@ -395,28 +466,52 @@ static void ipmi_elog_poll(struct ipmi_msg *msg)
 		      bmc_platform->ipmi_oem_partial_add_esel,
 		      ipmi_elog_poll, elog_buf, req_size, 2);
 
-	msg->data[0] = reservation_id & 0xff;
-	msg->data[1] = (reservation_id >> 8) & 0xff;
-	msg->data[2] = record_id & 0xff;
-	msg->data[3] = (record_id >> 8) & 0xff;
-	msg->data[4] = esel_index & 0xff;
-	msg->data[5] = (esel_index >> 8) & 0xff;
+	msg->data[0] = xfer->reservation_id & 0xff;
+	msg->data[1] = (xfer->reservation_id >> 8) & 0xff;
+	msg->data[2] = xfer->record_id & 0xff;
+	msg->data[3] = (xfer->record_id >> 8) & 0xff;
+	msg->data[4] = xfer->index & 0xff;
+	msg->data[5] = (xfer->index >> 8) & 0xff;
 
-	if (first) {
-		first = false;
+	if (xfer->index == 0) {
 		memcpy(&msg->data[ESEL_HDR_SIZE], &sel_record,
 			sizeof(struct sel_record));
-		esel_index = sizeof(struct sel_record);
-		msg->req_size = esel_index + ESEL_HDR_SIZE;
+		xfer->index = sizeof(struct sel_record);
+		msg->req_size = xfer->index + ESEL_HDR_SIZE;
 	} else {
-		pel_index = esel_index - sizeof(struct sel_record);
-		memcpy(&msg->data[ESEL_HDR_SIZE], &pel_buf[pel_index],
-			msg->req_size - ESEL_HDR_SIZE);
-		esel_index += msg->req_size - ESEL_HDR_SIZE;
+		len = pel_stream_read(&xfer->pel, &msg->data[ESEL_HDR_SIZE],
+				      msg->req_size - ESEL_HDR_SIZE);
+		assert(len == msg->req_size - ESEL_HDR_SIZE);
+		xfer->index += len;
 	}
 
-	ipmi_queue_msg_head(msg);
-	return;
+	ipmi_esel_queue(msg);
+}
+
+/* Start sending an eSEL, with a reservation request */
+static void ipmi_esel_send(struct ipmi_msg *msg)
+{
+	ipmi_esel_xfer(msg)->restarts = 0;
+	ipmi_esel_set_prio(msg);
+	if (msg == ipmi_sel_panic_msg.msg)
+		ipmi_queue_msg_sync(msg);
+	else
+		ipmi_queue_msg(msg);
+}
+
+/* Start sending the next pending eSEL if any */
+static void ipmi_esel_start_next(void)
+{
+	struct ipmi_msg *msg;
+
+	lock(&esel_lock);
+	msg = list_pop(&esel_pending, struct ipmi_msg, link);
+	if (!msg)
+		esel_busy = false;
+	unlock(&esel_lock);
+
+	if (msg)
+		ipmi_esel_send(msg);
 }
 
 int ipmi_elog_commit(struct errorlog *elog_buf)
@@ -432,6 +527,12 @@ int ipmi_elog_commit(struct errorlog *elog_buf)
 		return 0;
 	}
 
+	if (pel_size(elog_buf) > IPMI_MAX_PEL_SIZE) {
+		prerror("PEL too large to send to the BMC\n");
+		opal_elog_complete(elog_buf, false);
+		return OPAL_PARAMETER;
+	}
+
 	/*
 	 * We pass a large request size in to mkmsg so that we have a
 	 * large enough allocation to reuse the message to pass the
@@ -445,10 +546,22 @@ int ipmi_elog_commit(struct errorlog *elog_buf)
 
 	msg->error = ipmi_elog_error;
 	msg->req_size = 0;
-	if (elog_buf->event_severity == OPAL_ERROR_PANIC)
-		ipmi_queue_msg_sync(msg);
-	else
-		ipmi_queue_msg(msg);
+	if (msg == ipmi_sel_panic_msg.msg) {
+		ipmi_esel_send(msg);
+		return 0;
+	}
+
+	/* Wait for the eSEL being sent if any */
+	lock(&esel_lock);
+	if (esel_busy) {
+		list_add_tail(&esel_pending, &msg->link);
+		unlock(&esel_lock);
+		return 0;
+	}
+	esel_busy = true;
+	unlock(&esel_lock);
+
+	ipmi_esel_send(msg);
 
 	return 0;
 }
@@ -480,6 +593,8 @@ static void sel_pnor(uint8_t access)
 			occ_pnor_set_owner(PNOR_OWNER_EXTERNAL);
 		/* Ack the request */
 		msg = ipmi_mkmsg_simple(bmc_platform->ipmi_oem_pnor_access_status, &granted, 1);
+		if (msg)
+			msg->prio = IPMI_PRIO_BULK;
 		ipmi_queue_msg(msg);
 		break;
 	case RELEASE_PNOR:
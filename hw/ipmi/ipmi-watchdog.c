@@ -68,6 +68,7 @@ static void set_wdt(uint8_t action, uint16_t count, uint8_t pretimeout)
 		return;
 	}
 	ipmi_msg->error = ipmi_wdt_complete;
+	ipmi_msg->prio = IPMI_PRIO_CRITICAL;
 	ipmi_msg->data[0] = TIMER_USE_POST |
 		TIMER_USE_DONT_LOG; 			/* Timer Use */
 	ipmi_msg->data[1] = action;			/* Timer Actions */
@@ -88,6 +89,7 @@ static struct ipmi_msg *wdt_reset_mkmsg(void)
 		prerror("Unable to allocate reset wdt message\n");
 		return NULL;
 	}
+	ipmi_msg->prio = IPMI_PRIO_CRITICAL;
 
 	return ipmi_msg;
 }
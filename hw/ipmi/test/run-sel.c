@@ -0,0 +1,366 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "../../../ccan/list/list.c"
+#include "../../../core/pel.c"
+
+/* ipmi-sel.c has its own */
+#undef pr_fmt
+#include "../ipmi-sel.c"
+
+#define IPMI_PARTIAL_ADD_ESEL	IPMI_CODE(SEL_NETFN_IBM, 0xf0)
+#define IPMI_WDT_TEST		IPMI_RESET_WDT
+
+struct dt_node *dt_root;
+struct platform platform;
+struct debug_descriptor debug_descriptor;
+
+static const struct bmc_platform test_bmc = {
+	.name = "test",
+	.ipmi_oem_partial_add_esel = IPMI_PARTIAL_ADD_ESEL,
+};
+const struct bmc_platform *bmc_platform = &test_bmc;
+
+void _prlog(int __unused log_level, const __unused char* fmt, ...)
+{
+}
+
+const void *dt_prop_get(const struct dt_node *node __unused,
+			const char *prop __unused)
+{
+	return "run-sel-unittest";
+}
+
+const struct dt_property *dt_find_property(const struct dt_node *node __unused,
+					   const char *name __unused)
+{
+	return NULL;
+}
+
+int rtc_cache_get_datetime(uint32_t *year_month_day,
+			   uint64_t *hour_minute_second_millisecond)
+{
+	*year_month_day = 0;
+	*hour_minute_second_millisecond = 0;
+
+	return 0;
+}
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+uint8_t ipmi_get_sensor_number(uint8_t sensor_type __unused)
+{
+	return 0x42;
+}
+
+bool flash_reserve(void)
+{
+	return true;
+}
+
+void flash_release(void)
+{
+}
+
+void occ_pnor_set_owner(enum pnor_owner owner __unused)
+{
+}
+
+void prd_occ_reset(uint32_t proc __unused)
+{
+}
+
+int _opal_queue_msg(enum opal_msg_type msg_type __unused, void *data __unused,
+		    void (*consumed)(void *data) __unused, size_t num_params __unused,
+		    const u64 *params __unused)
+{
+	return 0;
+}
+
+/*
+ * The IPMI queue, served by the BMC below one message at a time from
+ * its head.
+ */
+static LIST_HEAD(msgq);
+
+void ipmi_init_msg(struct ipmi_msg *msg, int interface __unused,
+		   uint32_t code, void (*complete)(struct ipmi_msg *),
+		   void *user_data, size_t req_size, size_t resp_size)
+{
+	msg->cmd = IPMI_CMD(code);
+	msg->netfn = IPMI_NETFN(code) << 2;
+	msg->req_size = req_size;
+	msg->resp_size = resp_size;
+	msg->complete = complete;
+	msg->user_data = user_data;
+	msg->prio = IPMI_PRIO_NORMAL;
+}
+
+struct ipmi_msg *ipmi_mkmsg(int interface, uint32_t code,
+			    void (*complete)(struct ipmi_msg *),
+			    void *user_data, void *req_data, size_t req_size,
+			    size_t resp_size)
+{
+	struct ipmi_msg *msg;
+
+	msg = calloc(1, sizeof(*msg) + MAX(req_size, resp_size));
+	assert(msg);
+	msg->data = (uint8_t *)(msg + 1);
+	ipmi_init_msg(msg, interface, code, complete, user_data, req_size,
+		      resp_size);
+	msg->error = ipmi_free_msg;
+	if (req_data)
+		memcpy(msg->data, req_data, req_size);
+
+	return msg;
+}
+
+struct ipmi_msg *ipmi_mkmsg_simple(uint32_t code, void *req_data,
+				   size_t req_size)
+{
+	return ipmi_mkmsg(IPMI_DEFAULT_INTERFACE, code, ipmi_free_msg, NULL,
+			  req_data, req_size, 0);
+}
+
+void ipmi_free_msg(struct ipmi_msg *msg)
+{
+	free(msg);
+}
+
+int ipmi_queue_msg(struct ipmi_msg *msg)
+{
+	list_add_tail(&msgq, &msg->link);
+	return 0;
+}
+
+int ipmi_queue_msg_head(struct ipmi_msg *msg)
+{
+	list_add(&msgq, &msg->link);
+	return 0;
+}
+
+void ipmi_queue_msg_sync(struct ipmi_msg *msg)
+{
+	ipmi_queue_msg_head(msg);
+}
+
+/*
+ * The BMC keeps the last eSEL it got. It can be made to cancel the
+ * reservation on the next partial add.
+ */
+#define RESERVATION_ID	0x1234
+#define RECORD_ID	0x0102
+
+static struct {
+	uint8_t esel[IPMI_MAX_PEL_SIZE + sizeof(struct sel_record)];
+	size_t esel_size;
+	unsigned int nr_reserves, nr_adds, nr_events;
+	bool lose_next;
+} bmc;
+
+/* Completions, and the order the messages were served in */
+static unsigned int nr_ok, nr_failed;
+static uint8_t served[256];
+static unsigned int nr_served;
+
+void opal_elog_complete(struct errorlog *elog_buf __unused, bool success)
+{
+	if (success)
+		nr_ok++;
+	else
+		nr_failed++;
+}
+
+static void bmc_partial_add(struct ipmi_msg *msg)
+{
+	size_t offset = msg->data[4] | msg->data[5] << 8;
+	size_t len = msg->req_size - ESEL_HDR_SIZE;
+
+	assert((msg->data[0] | msg->data[1] << 8) == RESERVATION_ID);
+	assert(offset == bmc.esel_size);
+	assert(offset + len <= sizeof(bmc.esel));
+	if (offset)
+		assert((msg->data[2] | msg->data[3] << 8) == RECORD_ID);
+
+	memcpy(bmc.esel + offset, &msg->data[ESEL_HDR_SIZE], len);
+	bmc.esel_size += len;
+	bmc.nr_adds++;
+}
+
+static bool bmc_serve(void)
+{
+	struct ipmi_msg *msg = list_pop(&msgq, struct ipmi_msg, link);
+	uint32_t code;
+
+	if (!msg)
+		return false;
+
+	code = IPMI_CODE(msg->netfn >> 2, msg->cmd);
+	served[nr_served++] = msg->cmd;
+	if (code != IPMI_WDT_TEST)
+		assert(msg->prio == IPMI_PRIO_BULK);
+	msg->cc = IPMI_CC_NO_ERROR;
+
+	switch (code) {
+	case IPMI_RESERVE_SEL:
+		bmc.nr_reserves++;
+		bmc.esel_size = 0;
+		msg->data[0] = RESERVATION_ID & 0xff;
+		msg->data[1] = RESERVATION_ID >> 8;
+		break;
+	case IPMI_PARTIAL_ADD_ESEL:
+		if (bmc.lose_next) {
+			bmc.lose_next = false;
+			msg->cc = IPMI_LOST_ARBITRATION_ERR;
+			break;
+		}
+		bmc_partial_add(msg);
+		msg->data[0] = RECORD_ID & 0xff;
+		msg->data[1] = RECORD_ID >> 8;
+		break;
+	case IPMI_ADD_SEL_EVENT:
+		bmc.nr_events++;
+		break;
+	}
+
+	if (msg->cc == IPMI_CC_NO_ERROR)
+		msg->complete(msg);
+	else
+		msg->error(msg);
+
+	return true;
+}
+
+static void bmc_run(void)
+{
+	while (bmc_serve())
+		;
+}
+
+static struct errorlog *new_elog(unsigned int data_size)
+{
+	struct errorlog *elog = calloc(1, sizeof(*elog));
+	struct elog_user_data_section *usr;
+	unsigned int i;
+
+	assert(elog);
+	elog->event_severity = OPAL_UNRECOVERABLE_ERR_GENERAL;
+	elog->elog_origin = ORG_SAPPHIRE;
+	elog->reason_code = 0xbeef;
+
+	usr = (struct elog_user_data_section *)elog->user_data_dump;
+	usr->tag = 0x44415441;
+	usr->size = sizeof(*usr) + data_size;
+	for (i = 0; i < data_size; i++)
+		usr->data_dump[i] = i;
+	elog->user_section_size = usr->size;
+	elog->user_section_count = 1;
+
+	return elog;
+}
+
+/* What the BMC should have got for this errorlog */
+static void check_esel(struct errorlog *elog)
+{
+	static char pel[IPMI_MAX_PEL_SIZE];
+	size_t size = pel_size(elog);
+
+	assert(create_pel_log(elog, pel, sizeof(pel)) == size);
+	assert(bmc.esel_size == sizeof(struct sel_record) + size);
+	assert(bmc.esel[2] == SEL_REC_TYPE_AMI_ESEL);
+	assert(!memcmp(bmc.esel + sizeof(struct sel_record), pel, size));
+}
+
+static void reset(void)
+{
+	memset(&bmc, 0, sizeof(bmc));
+	nr_ok = nr_failed = nr_served = 0;
+}
+
+int main(void)
+{
+	struct errorlog *elog1, *elog2, *big;
+	struct ipmi_msg *wdt;
+	unsigned int i;
+
+	/* An eSEL goes through in one piece, with its SEL event */
+	elog1 = new_elog(1000);
+	assert(!ipmi_elog_commit(elog1));
+	bmc_run();
+	assert(nr_ok == 1 && !nr_failed);
+	assert(bmc.nr_reserves == 1 && bmc.nr_events == 1);
+	check_esel(elog1);
+
+	/* A second one waits for the first, then goes through */
+	reset();
+	elog2 = new_elog(300);
+	assert(!ipmi_elog_commit(elog1));
+	assert(!ipmi_elog_commit(elog2));
+	assert(bmc_serve() && bmc_serve());
+	assert(bmc.nr_reserves == 1 && !list_empty(&msgq));
+	bmc_run();
+	assert(nr_ok == 2 && bmc.nr_reserves == 2 && bmc.nr_events == 2);
+	check_esel(elog2);
+
+	/* Other messages don't wait for the eSEL to be done */
+	reset();
+	assert(!ipmi_elog_commit(elog1));
+	assert(bmc_serve() && bmc_serve());
+	wdt = ipmi_mkmsg_simple(IPMI_WDT_TEST, NULL, 0);
+	ipmi_queue_msg(wdt);
+	bmc_run();
+	assert(nr_ok == 1);
+	for (i = 0; i < nr_served; i++)
+		if (served[i] == IPMI_CMD(IPMI_WDT_TEST))
+			break;
+	assert(i == 3);
+	check_esel(elog1);
+
+	/* Losing the reservation starts the eSEL over */
+	reset();
+	assert(!ipmi_elog_commit(elog1));
+	assert(bmc_serve() && bmc_serve());
+	bmc.lose_next = true;
+	bmc_run();
+	assert(nr_ok == 1 && !nr_failed);
+	assert(bmc.nr_reserves == 2);
+	check_esel(elog1);
+
+	/* A PEL the BMC can't take is refused up front */
+	reset();
+	big = new_elog(IPMI_MAX_PEL_SIZE);
+	assert(ipmi_elog_commit(big) == OPAL_PARAMETER);
+	assert(nr_failed == 1 && list_empty(&msgq));
+
+	free(big);
+	free(elog2);
+	free(elog1);
+
+	return 0;
+}
@@ -340,6 +340,107 @@ PHB3_PCI_CFG_WRITE(8, u8)
 PHB3_PCI_CFG_WRITE(16, u16)
 PHB3_PCI_CFG_WRITE(32, u32)
 
+/*
+ * Block accesses check the PHB once and then issue the config cycles
+ * back to back. A fenced PHB goes through ASB a word at a time.
+ */
+static int64_t phb3_pcicfg_block_check(struct phb3 *p, uint32_t bdfn,
+				       uint32_t offset, uint8_t *pe)
+{
+	int64_t rc;
+
+	rc = phb3_pcicfg_check(p, bdfn, offset, 4, pe);
+	if (rc)
+		return rc;
+	if (p->flags & PHB3_AIB_FENCED)
+		return (p->flags & PHB3_CFG_USE_ASB) ? OPAL_PARTIAL :
+			OPAL_HARDWARE;
+	if ((p->flags & PHB3_CFG_BLOCKED) && bdfn != 0)
+		return OPAL_HARDWARE;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb3_pcicfg_read_block(struct phb *phb, uint32_t bdfn,
+				      uint32_t offset, uint32_t *data,
+				      uint32_t count)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	uint64_t addr;
+	uint32_t i;
+	int64_t rc;
+	uint8_t pe;
+
+	rc = phb3_pcicfg_block_check(p, bdfn, offset, &pe);
+	if (rc == OPAL_PARTIAL) {
+		for (i = 0, rc = 0; i < count && !rc; i++)
+			rc = phb3_pcicfg_read32(phb, bdfn, offset + i * 4,
+						&data[i]);
+		return rc;
+	}
+	if (rc)
+		return rc;
+
+	addr = PHB_CA_ENABLE;
+	addr = SETFIELD(PHB_CA_BDFN, addr, bdfn);
+	addr = SETFIELD(PHB_CA_PE, addr, pe);
+	for (i = 0; i < count; i++, offset += 4) {
+		rc = pci_handle_cfg_filters(phb, bdfn, offset, 4, &data[i],
+					    false);
+		if (rc != OPAL_PARTIAL) {
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		out_be64(p->regs + PHB_CONFIG_ADDRESS,
+			 SETFIELD(PHB_CA_REG, addr, offset));
+		data[i] = in_le32(p->regs + PHB_CONFIG_DATA);
+	}
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb3_pcicfg_write_block(struct phb *phb, uint32_t bdfn,
+				       uint32_t offset, const uint32_t *data,
+				       uint32_t count)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	uint64_t addr;
+	uint32_t i, val;
+	int64_t rc;
+	uint8_t pe;
+
+	rc = phb3_pcicfg_block_check(p, bdfn, offset, &pe);
+	if (rc == OPAL_PARTIAL) {
+		for (i = 0, rc = 0; i < count && !rc; i++)
+			rc = phb3_pcicfg_write32(phb, bdfn, offset + i * 4,
+						 data[i]);
+		return rc;
+	}
+	if (rc)
+		return rc;
+
+	addr = PHB_CA_ENABLE;
+	addr = SETFIELD(PHB_CA_BDFN, addr, bdfn);
+	addr = SETFIELD(PHB_CA_PE, addr, pe);
+	for (i = 0; i < count; i++, offset += 4) {
+		val = data[i];
+		rc = pci_handle_cfg_filters(phb, bdfn, offset, 4, &val, true);
+		if (rc != OPAL_PARTIAL) {
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		out_be64(p->regs + PHB_CONFIG_ADDRESS,
+			 SETFIELD(PHB_CA_REG, addr, offset));
+		out_le32(p->regs + PHB_CONFIG_DATA, val);
+	}
+
+	return OPAL_SUCCESS;
+}
+
 static uint8_t phb3_choose_bus(struct phb *phb __unused,
 			       struct pci_device *bridge __unused,
 			       uint8_t candidate, uint8_t *max_bus __unused,
@@ -867,6 +968,7 @@ static int64_t phb3_ioda_reset(struct phb *phb, bool purge)
 	phb3_ioda_sel(p, IODA2_TBL_PEEV, 0, true);
 	for (i = 0; i < 4; i++)
 		out_be64(p->regs + PHB_IODA_DATA0, 0);
+	pci_frozen_pes_clear(&p->phb);
 
 	return OPAL_SUCCESS;
 }
@@ -1217,6 +1319,46 @@ static int64_t phb3_map_pe_dma_window_real(struct phb *phb,
 	return OPAL_SUCCESS;
 }
 
+/*
+ * PHB3 kills one TCE per write, selected by its DMA address, and
+ * doesn't need to wait for the kill queue like PHB4 does.
+ */
+static int64_t phb3_tce_kill(struct phb *phb, uint32_t kill_type,
+			     uint64_t pe_number, uint32_t tce_size,
+			     uint64_t dma_addr, uint32_t npages)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	uint64_t val;
+
+	if (pe_number >= PHB3_MAX_PE_NUM)
+		return OPAL_PARAMETER;
+
+	sync();
+	switch(kill_type) {
+	case OPAL_PCI_TCE_KILL_PAGES:
+		if (tce_size < 0x1000 || (tce_size & (tce_size - 1)) ||
+		    (dma_addr & (tce_size - 1)))
+			return OPAL_PARAMETER;
+		while (npages--) {
+			val = SETFIELD(PHB_TCE_KILL_PENUM, dma_addr, pe_number);
+			out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_ONE | val);
+			dma_addr += tce_size;
+		}
+		break;
+	case OPAL_PCI_TCE_KILL_PE:
+		out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_PE |
+			 SETFIELD(PHB_TCE_KILL_PENUM, 0ull, pe_number));
+		break;
+	case OPAL_PCI_TCE_KILL_ALL:
+		out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_ALL);
+		break;
+	default:
+		return OPAL_UNSUPPORTED;
+	}
+
+	return OPAL_SUCCESS;
+}
+
 static bool phb3_pci_msi_check_q(struct phb3 *p, uint32_t ive_num)
 {
 	uint64_t ive, ivc, ffi, state;
@@ -1942,6 +2084,25 @@ static int64_t phb3_lsi_set_xive(struct irq_source *is, uint32_t isn,
 	return OPAL_SUCCESS;
 }
 
+/*
+ * Refresh the frozen PE bitmap from the PEEV. Returns true if any PE
+ * is frozen.
+ */
+static bool phb3_read_frozen_pes(struct phb3 *p)
+{
+	uint64_t peev, frozen = 0;
+	int32_t i;
+
+	phb3_ioda_sel(p, IODA2_TBL_PEEV, 0, true);
+	for (i = 0; i < PHB3_MAX_PE_NUM / 64; i++) {
+		peev = in_be64(p->regs + PHB_IODA_DATA0);
+		pci_frozen_pes_update(&p->phb, i, peev);
+		frozen |= peev;
+	}
+
+	return frozen != 0;
+}
+
 static void phb3_err_interrupt(struct irq_source *is, uint32_t isn)
 {
 	struct phb3 *p = is->data;
@@ -1998,9 +2159,8 @@ static int64_t phb3_set_pe(struct phb *phb,
 			   uint8_t action)
 {
 	struct phb3 *p = phb_to_phb3(phb);
-	uint64_t mask, val, tmp, idx;
-	int32_t all = 0;
-	uint16_t *rte;
+	struct pci_rid_set rids;
+	uint32_t i, rid;
 
 	/* Sanity check */
 	if (!p->tbl_rtt)
@@ -2013,56 +2173,20 @@ static int64_t phb3_set_pe(struct phb *phb,
 	    fcompare > OPAL_COMPARE_RID_FUNCTION_NUMBER)
 		return OPAL_PARAMETER;
 
-	/* Figure out the RID range */
-	if (bcompare == OpalPciBusAny) {
-		mask = 0x0;
-		val  = 0x0;
-		all  = 0x1;
-	} else {
-		tmp  = ((0x1 << (bcompare + 1)) - 1) << (15 - bcompare);
-		mask = tmp;
-		val  = bdfn & tmp;
-	}
-
-	if (dcompare == OPAL_IGNORE_RID_DEVICE_NUMBER)
-		all = (all << 1) | 0x1;
-	else {
-		mask |= 0xf8;
-		val  |= (bdfn & 0xf8);
-	}
-
-	if (fcompare == OPAL_IGNORE_RID_FUNCTION_NUMBER)
-		all = (all << 1) | 0x1;
-	else {
-		mask |= 0x7;
-		val  |= (bdfn & 0x7);
-	}
-
-	/* Map or unmap the RTT range */
-	if (all == 0x7) {
-		if (action == OPAL_MAP_PE) {
-			for (idx = 0; idx < RTT_TABLE_ENTRIES; idx++)
-				p->rte_cache[idx] = pe_number;
-		} else {
-			for ( idx = 0; idx < ARRAY_SIZE(p->rte_cache); idx++)
-				p->rte_cache[idx] = PHB3_RESERVED_PE_NUM;
-		}
-		memcpy((void *)p->tbl_rtt, p->rte_cache, RTT_TABLE_SIZE);
-	} else {
-		rte = (uint16_t *)p->tbl_rtt;
-		for (idx = 0; idx < RTT_TABLE_ENTRIES; idx++, rte++) {
-			if ((idx & mask) != val)
-				continue;
-			if (action == OPAL_MAP_PE)
-				p->rte_cache[idx] = pe_number;
-			else
-				p->rte_cache[idx] = PHB3_RESERVED_PE_NUM;
-			*rte = p->rte_cache[idx];
-		}
+	/* Map or unmap the RTT entries of the RID range */
+	if (action == OPAL_UNMAP_PE)
+		pe_number = PHB3_RESERVED_PE_NUM;
+	pci_rid_set_init(&rids, bdfn, bcompare, dcompare, fcompare);
+	if (pci_rtt_update(p->rte_cache, (uint16_t *)p->tbl_rtt, &rids,
+			   pe_number) > PCI_RTC_INVALIDATE_RIDS_MAX) {
+		out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
+		return OPAL_SUCCESS;
 	}
 
-	/* Invalidate the entire RTC */
-	out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
+	/* Only invalidate the RTC entries we changed */
+	for_each_rid_in_set(&rids, i, rid)
+		out_be64(p->regs + PHB_RTC_INVALIDATE,
+			 SETFIELD(PHB_RTC_INVALIDATE_RID, 0ul, rid));
 
 	return OPAL_SUCCESS;
 }
@@ -2749,11 +2873,14 @@ static int64_t phb3_eeh_freeze_status(struct phb *phb, uint64_t pe_number,
 		goto bail;
 	}
 
-	/* Check the PEEV */
-	phb3_ioda_sel(p, IODA2_TBL_PEEV, pe_number / 64, false);
-	peev = in_be64(p->regs + PHB_IODA_DATA0);
-	if (!(peev & peev_bit))
-		return OPAL_SUCCESS;
+	/* Check the PEEV, unless we already know the PE is frozen */
+	if (!pci_pe_frozen(phb, pe_number)) {
+		phb3_ioda_sel(p, IODA2_TBL_PEEV, pe_number / 64, false);
+		peev = in_be64(p->regs + PHB_IODA_DATA0);
+		if (!(peev & peev_bit))
+			return OPAL_SUCCESS;
+		pci_frozen_pes_update(phb, pe_number / 64, peev);
+	}
 
 	/* Indicate that we have an ER pending */
 	phb3_set_err_pending(p, true);
@@ -2784,9 +2911,7 @@ static int64_t phb3_eeh_freeze_clear(struct phb *phb, uint64_t pe_number,
 				     uint64_t eeh_action_token)
 {
 	struct phb3 *p = phb_to_phb3(phb);
-	uint64_t err, peev[4];
-	int32_t i;
-	bool frozen_pe = false;
+	uint64_t err;
 
 	if (p->state == PHB3_STATE_BROKEN)
 		return OPAL_HARDWARE;
@@ -2820,15 +2945,7 @@ static int64_t phb3_eeh_freeze_clear(struct phb *phb, uint64_t pe_number,
 
 
 	/* Update ER pending indication */
-	phb3_ioda_sel(p, IODA2_TBL_PEEV, 0, true);
-	for (i = 0; i < ARRAY_SIZE(peev); i++) {
-		peev[i] = in_be64(p->regs + PHB_IODA_DATA0);
-		if (peev[i]) {
-			frozen_pe = true;
-			break;
-		}
-	}
-	if (frozen_pe) {
+	if (phb3_read_frozen_pes(p)) {
 		p->err.err_src	 = PHB3_ERR_SRC_PHB;
 		p->err.err_class = PHB3_ERR_CLASS_ER;
 		p->err.err_bit   = -1;
@@ -2879,9 +2996,10 @@ static int64_t phb3_eeh_next_error(struct phb *phb,
 				   uint16_t *severity)
 {
 	struct phb3 *p = phb_to_phb3(phb);
-	uint64_t fir, peev[4];
+	bool peev_read = false;
+	uint64_t fir;
 	uint32_t cfg32;
-	int32_t i, j;
+	int pe;
 
 	/* If the PHB is broken, we needn't go forward */
 	if (p->state == PHB3_STATE_BROKEN) {
@@ -2913,16 +3031,12 @@ static int64_t phb3_eeh_next_error(struct phb *phb,
 
 	/* Check frozen PEs */
 	if (!phb3_err_pending(p)) {
-		phb3_ioda_sel(p, IODA2_TBL_PEEV, 0, true);
-		for (i = 0; i < ARRAY_SIZE(peev); i++) {
-			peev[i] = in_be64(p->regs + PHB_IODA_DATA0);
-			if (peev[i]) {
-				p->err.err_src	 = PHB3_ERR_SRC_PHB;
-				p->err.err_class = PHB3_ERR_CLASS_ER;
-				p->err.err_bit	 = -1;
-				phb3_set_err_pending(p, true);
-				break;
-			}
+		peev_read = true;
+		if (phb3_read_frozen_pes(p)) {
+			p->err.err_src	 = PHB3_ERR_SRC_PHB;
+			p->err.err_class = PHB3_ERR_CLASS_ER;
+			p->err.err_bit	 = -1;
+			phb3_set_err_pending(p, true);
 		}
         }
 
@@ -2956,20 +3070,11 @@ static int64_t phb3_eeh_next_error(struct phb *phb,
 			*pci_error_type = OPAL_EEH_PE_ERROR;
 			*severity = OPAL_EEH_SEV_PE_ER;
 
-			phb3_ioda_sel(p, IODA2_TBL_PEEV, 0, true);
-			for (i = 0; i < ARRAY_SIZE(peev); i++)
-				peev[i] = in_be64(p->regs + PHB_IODA_DATA0);
-			for (i = ARRAY_SIZE(peev) - 1; i >= 0; i--) {
-				for (j = 0; j < 64; j++) {
-					if (peev[i] & PPC_BIT(j)) {
-						*first_frozen_pe = i * 64 + j;
-						break;
-					}
-				}
-
-				if (*first_frozen_pe != (uint64_t)(-1))
-					break;
-			}
+			if (!peev_read)
+				phb3_read_frozen_pes(p);
+			pe = pci_first_frozen_pe(phb);
+			if (pe >= 0)
+				*first_frozen_pe = pe;
 
 			/* No frozen PE ? */
 			if (*first_frozen_pe == (uint64_t)-1) {
@@ -2993,6 +3098,21 @@ static int64_t phb3_eeh_next_error(struct phb *phb,
 	return OPAL_SUCCESS;
 }
 
+static int64_t phb3_eeh_frozen_pes(struct phb *phb, uint32_t *num_pes)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+
+	if (p->state == PHB3_STATE_BROKEN)
+		return OPAL_HARDWARE;
+	if (phb3_fenced(p) || (p->flags & PHB3_CAPP_RECOVERY))
+		return OPAL_HARDWARE;
+
+	phb3_read_frozen_pes(p);
+	*num_pes = PHB3_MAX_PE_NUM;
+
+	return OPAL_SUCCESS;
+}
+
 static int64_t phb3_err_inject_finalize(struct phb3 *p, uint64_t addr,
 					uint64_t mask, uint64_t ctrl,
 					bool is_write)
@@ -3749,6 +3869,8 @@ static const struct phb_ops phb3_ops = {
 	.cfg_write8		= phb3_pcicfg_write8,
 	.cfg_write16		= phb3_pcicfg_write16,
 	.cfg_write32		= phb3_pcicfg_write32,
+	.cfg_read_block		= phb3_pcicfg_read_block,
+	.cfg_write_block	= phb3_pcicfg_write_block,
 	.choose_bus		= phb3_choose_bus,
 	.get_reserved_pe_number	= phb3_get_reserved_pe_number,
 	.device_init		= phb3_device_init,
@@ -3762,6 +3884,7 @@ static const struct phb_ops phb3_ops = {
 	.map_pe_dma_window	= phb3_map_pe_dma_window,
 	.map_pe_dma_window_real = phb3_map_pe_dma_window_real,
 	.pci_msi_eoi		= phb3_pci_msi_eoi,
+	.tce_kill		= phb3_tce_kill,
 	.set_xive_pe		= phb3_set_ive_pe,
 	.get_msi_32		= phb3_get_msi_32,
 	.get_msi_64		= phb3_get_msi_64,
@@ -3771,6 +3894,7 @@ static const struct phb_ops phb3_ops = {
 	.eeh_freeze_clear	= phb3_eeh_freeze_clear,
 	.eeh_freeze_set		= phb3_eeh_freeze_set,
 	.next_error		= phb3_eeh_next_error,
+	.eeh_frozen_pes		= phb3_eeh_frozen_pes,
 	.err_inject		= phb3_err_inject,
 	.get_diag_data		= NULL,
 	.get_diag_data2		= phb3_get_diag_data,
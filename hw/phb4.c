@@ -475,6 +475,111 @@ PHB4_PCI_CFG_WRITE(8, u8)
 PHB4_PCI_CFG_WRITE(16, u16)
 PHB4_PCI_CFG_WRITE(32, u32)
 
+/*
+ * Block accesses check the PHB once and then issue the config cycles
+ * back to back. The root complex, which is emulated in part, and a
+ * fenced PHB go a word at a time.
+ */
+static int64_t phb4_pcicfg_block_check(struct phb4 *p, uint32_t bdfn,
+				       uint32_t offset, uint8_t *pe)
+{
+	int64_t rc;
+
+	rc = phb4_pcicfg_check(p, bdfn, offset, 4, pe);
+	if (rc)
+		return rc;
+	if (bdfn == 0 || (p->flags & PHB4_AIB_FENCED))
+		return OPAL_PARTIAL;
+	if (p->flags & PHB4_CFG_BLOCKED)
+		return OPAL_HARDWARE;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb4_pcicfg_read_block(struct phb *phb, uint32_t bdfn,
+				      uint32_t offset, uint32_t *data,
+				      uint32_t count)
+{
+	struct phb4 *p = phb_to_phb4(phb);
+	uint64_t addr;
+	uint32_t i;
+	int64_t rc;
+	uint8_t pe;
+
+	rc = phb4_pcicfg_block_check(p, bdfn, offset, &pe);
+	if (rc == OPAL_PARTIAL) {
+		for (i = 0, rc = 0; i < count && !rc; i++)
+			rc = phb4_pcicfg_read(p, bdfn, offset + i * 4, 4,
+					      &data[i]);
+		return rc;
+	}
+	if (rc)
+		return rc;
+
+	addr = PHB_CA_ENABLE;
+	addr = SETFIELD(PHB_CA_BDFN, addr, bdfn);
+	addr = SETFIELD(PHB_CA_PE, addr, pe);
+	for (i = 0; i < count; i++, offset += 4) {
+		rc = pci_handle_cfg_filters(phb, bdfn, offset, 4, &data[i],
+					    false);
+		if (rc != OPAL_PARTIAL) {
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		out_be64(p->regs + PHB_CONFIG_ADDRESS,
+			 SETFIELD(PHB_CA_REG, addr, offset));
+		data[i] = in_le32(p->regs + PHB_CONFIG_DATA);
+	}
+	PHBLOGCFG(p, "CFG block Rd %02x, %d words\n", offset - count * 4,
+		  count);
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb4_pcicfg_write_block(struct phb *phb, uint32_t bdfn,
+				       uint32_t offset, const uint32_t *data,
+				       uint32_t count)
+{
+	struct phb4 *p = phb_to_phb4(phb);
+	uint64_t addr;
+	uint32_t i, val;
+	int64_t rc;
+	uint8_t pe;
+
+	rc = phb4_pcicfg_block_check(p, bdfn, offset, &pe);
+	if (rc == OPAL_PARTIAL) {
+		for (i = 0, rc = 0; i < count && !rc; i++)
+			rc = phb4_pcicfg_write(p, bdfn, offset + i * 4, 4,
+					       data[i]);
+		return rc;
+	}
+	if (rc)
+		return rc;
+
+	addr = PHB_CA_ENABLE;
+	addr = SETFIELD(PHB_CA_BDFN, addr, bdfn);
+	addr = SETFIELD(PHB_CA_PE, addr, pe);
+	for (i = 0; i < count; i++, offset += 4) {
+		val = data[i];
+		rc = pci_handle_cfg_filters(phb, bdfn, offset, 4, &val, true);
+		if (rc != OPAL_PARTIAL) {
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		out_be64(p->regs + PHB_CONFIG_ADDRESS,
+			 SETFIELD(PHB_CA_REG, addr, offset));
+		out_le32(p->regs + PHB_CONFIG_DATA, val);
+	}
+	PHBLOGCFG(p, "CFG block Wr %02x, %d words\n", offset - count * 4,
+		  count);
+
+	return OPAL_SUCCESS;
+}
+
 static uint8_t phb4_choose_bus(struct phb *phb __unused,
 			       struct pci_device *bridge __unused,
 			       uint8_t candidate, uint8_t *max_bus __unused,
@@ -986,6 +1091,7 @@ static int64_t phb4_ioda_reset(struct phb *phb, bool purge)
 	phb4_ioda_sel(p, IODA3_TBL_PEEV, 0, true);
 	for (i = 0; i < p->max_num_pes/64; i++)
 		out_be64(p->regs + PHB_IODA_DATA0, 0);
+	pci_frozen_pes_clear(&p->phb);
 
 	/* Invalidate RTE, TCE cache */
 	out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
@@ -1686,9 +1792,8 @@ static int64_t phb4_set_pe(struct phb *phb,
 			   uint8_t action)
 {
 	struct phb4 *p = phb_to_phb4(phb);
-	uint64_t mask, val, tmp, idx;
-	int32_t all = 0;
-	uint16_t *rte;
+	struct pci_rid_set rids;
+	uint32_t i, rid;
 
 	/* Sanity check */
 	if (!p->tbl_rtt)
@@ -1701,56 +1806,20 @@ static int64_t phb4_set_pe(struct phb *phb,
 	    fcompare > OPAL_COMPARE_RID_FUNCTION_NUMBER)
 		return OPAL_PARAMETER;
 
-	/* Figure out the RID range */
-	if (bcompare == OpalPciBusAny) {
-		mask = 0x0;
-		val  = 0x0;
-		all  = 0x1;
-	} else {
-		tmp  = ((0x1 << (bcompare + 1)) - 1) << (15 - bcompare);
-		mask = tmp;
-		val  = bdfn & tmp;
-	}
-
-	if (dcompare == OPAL_IGNORE_RID_DEVICE_NUMBER)
-		all = (all << 1) | 0x1;
-	else {
-		mask |= 0xf8;
-		val  |= (bdfn & 0xf8);
-	}
-
-	if (fcompare == OPAL_IGNORE_RID_FUNCTION_NUMBER)
-		all = (all << 1) | 0x1;
-	else {
-		mask |= 0x7;
-		val  |= (bdfn & 0x7);
-	}
-
-	/* Map or unmap the RTT range */
-	if (all == 0x7) {
-		if (action == OPAL_MAP_PE) {
-			for (idx = 0; idx < RTT_TABLE_ENTRIES; idx++)
-				p->rte_cache[idx] = pe_number;
-		} else {
-			for ( idx = 0; idx < ARRAY_SIZE(p->rte_cache); idx++)
-				p->rte_cache[idx] = PHB4_RESERVED_PE_NUM(p);
-		}
-		memcpy((void *)p->tbl_rtt, p->rte_cache, RTT_TABLE_SIZE);
-	} else {
-		rte = (uint16_t *)p->tbl_rtt;
-		for (idx = 0; idx < RTT_TABLE_ENTRIES; idx++, rte++) {
-			if ((idx & mask) != val)
-				continue;
-			if (action == OPAL_MAP_PE)
-				p->rte_cache[idx] = pe_number;
-			else
-				p->rte_cache[idx] = PHB4_RESERVED_PE_NUM(p);
-			*rte = p->rte_cache[idx];
-		}
+	/* Map or unmap the RTT entries of the RID range */
+	if (action == OPAL_UNMAP_PE)
+		pe_number = PHB4_RESERVED_PE_NUM(p);
+	pci_rid_set_init(&rids, bdfn, bcompare, dcompare, fcompare);
+	if (pci_rtt_update(p->rte_cache, (uint16_t *)p->tbl_rtt, &rids,
+			   pe_number) > PCI_RTC_INVALIDATE_RIDS_MAX) {
+		out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
+		return OPAL_SUCCESS;
 	}
 
-	/* Invalidate the entire RTC */
-	out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
+	/* Only invalidate the RTC entries we changed */
+	for_each_rid_in_set(&rids, i, rid)
+		out_be64(p->regs + PHB_RTC_INVALIDATE,
+			 SETFIELD(PHB_RTC_INVALIDATE_RID, 0ul, rid));
 
 	return OPAL_SUCCESS;
 }
@@ -2247,6 +2316,25 @@ static struct pci_slot *phb4_slot_create(struct phb *phb)
 	return slot;
 }
 
+/*
+ * Refresh the frozen PE bitmap from the PEEV. Returns true if any PE
+ * is frozen.
+ */
+static bool phb4_read_frozen_pes(struct phb4 *p)
+{
+	uint64_t peev, frozen = 0;
+	int32_t i;
+
+	phb4_ioda_sel(p, IODA3_TBL_PEEV, 0, true);
+	for (i = 0; i < p->num_pes/64; i++) {
+		peev = in_be64(p->regs + PHB_IODA_DATA0);
+		pci_frozen_pes_update(&p->phb, i, peev);
+		frozen |= peev;
+	}
+
+	return frozen != 0;
+}
+
 static int64_t phb4_eeh_freeze_status(struct phb *phb, uint64_t pe_number,
 				      uint8_t *freeze_state,
 				      uint16_t *pci_error_type,
@@ -2279,11 +2367,14 @@ static int64_t phb4_eeh_freeze_status(struct phb *phb, uint64_t pe_number,
 		goto bail;
 	}
 
-	/* Check the PEEV */
-	phb4_ioda_sel(p, IODA3_TBL_PEEV, pe_number / 64, false);
-	peev = in_be64(p->regs + PHB_IODA_DATA0);
-	if (!(peev & peev_bit))
-		return OPAL_SUCCESS;
+	/* Check the PEEV, unless we already know the PE is frozen */
+	if (!pci_pe_frozen(phb, pe_number)) {
+		phb4_ioda_sel(p, IODA3_TBL_PEEV, pe_number / 64, false);
+		peev = in_be64(p->regs + PHB_IODA_DATA0);
+		if (!(peev & peev_bit))
+			return OPAL_SUCCESS;
+		pci_frozen_pes_update(phb, pe_number / 64, peev);
+	}
 
 	/* Indicate that we have an ER pending */
 	phb4_set_err_pending(p, true);
@@ -2313,9 +2404,7 @@ static int64_t phb4_eeh_freeze_clear(struct phb *phb, uint64_t pe_number,
 				     uint64_t eeh_action_token)
 {
 	struct phb4 *p = phb_to_phb4(phb);
-	uint64_t err, peev;
-	int32_t i;
-	bool frozen_pe = false;
+	uint64_t err;
 
 	if (p->state == PHB4_STATE_BROKEN)
 		return OPAL_HARDWARE;
@@ -2349,15 +2438,7 @@ static int64_t phb4_eeh_freeze_clear(struct phb *phb, uint64_t pe_number,
 
 
 	/* Update ER pending indication */
-	phb4_ioda_sel(p, IODA3_TBL_PEEV, 0, true);
-	for (i = 0; i < p->num_pes/64; i++) {
-		peev = in_be64(p->regs + PHB_IODA_DATA0);
-		if (peev) {
-			frozen_pe = true;
-			break;
-		}
-	}
-	if (frozen_pe) {
+	if (phb4_read_frozen_pes(p)) {
 		p->err.err_src	 = PHB4_ERR_SRC_PHB;
 		p->err.err_class = PHB4_ERR_CLASS_ER;
 		p->err.err_bit   = -1;
@@ -2408,9 +2489,8 @@ static int64_t phb4_eeh_next_error(struct phb *phb,
 				   uint16_t *severity)
 {
 	struct phb4 *p = phb_to_phb4(phb);
-	uint64_t peev;
-	uint32_t peev_size = p->num_pes/64;
-	int32_t i, j;
+	bool peev_read = false;
+	int pe;
 
 	/* If the PHB is broken, we needn't go forward */
 	if (p->state == PHB4_STATE_BROKEN) {
@@ -2442,16 +2522,12 @@ static int64_t phb4_eeh_next_error(struct phb *phb,
 
 	/* Check frozen PEs */
 	if (!phb4_err_pending(p)) {
-		phb4_ioda_sel(p, IODA3_TBL_PEEV, 0, true);
-		for (i = 0; i < peev_size; i++) {
-			peev = in_be64(p->regs + PHB_IODA_DATA0);
-			if (peev) {
-				p->err.err_src	 = PHB4_ERR_SRC_PHB;
-				p->err.err_class = PHB4_ERR_CLASS_ER;
-				p->err.err_bit	 = -1;
-				phb4_set_err_pending(p, true);
-				break;
-			}
+		peev_read = true;
+		if (phb4_read_frozen_pes(p)) {
+			p->err.err_src	 = PHB4_ERR_SRC_PHB;
+			p->err.err_class = PHB4_ERR_CLASS_ER;
+			p->err.err_bit	 = -1;
+			phb4_set_err_pending(p, true);
 		}
 	}
 
@@ -2488,19 +2564,11 @@ static int64_t phb4_eeh_next_error(struct phb *phb,
 			*pci_error_type = OPAL_EEH_PE_ERROR;
 			*severity = OPAL_EEH_SEV_PE_ER;
 
-			for (i = peev_size - 1; i >= 0; i--) {
-				phb4_ioda_sel(p, IODA3_TBL_PEEV, i, false);
-				peev = in_be64(p->regs + PHB_IODA_DATA0);
-				for (j = 0; j < 64; j++) {
-					if (peev & PPC_BIT(j)) {
-						*first_frozen_pe = i * 64 + j;
-						break;
-					}
-				}
-
-				if (*first_frozen_pe != (uint64_t)(-1))
-					break;
-			}
+			if (!peev_read)
+				phb4_read_frozen_pes(p);
+			pe = pci_first_frozen_pe(phb);
+			if (pe >= 0)
+				*first_frozen_pe = pe;
 
 			/* No frozen PE ? */
 			if (*first_frozen_pe == (uint64_t)-1) {
@@ -2524,6 +2592,21 @@ static int64_t phb4_eeh_next_error(struct phb *phb,
 	return OPAL_SUCCESS;
 }
 
+static int64_t phb4_eeh_frozen_pes(struct phb *phb, uint32_t *num_pes)
+{
+	struct phb4 *p = phb_to_phb4(phb);
+
+	if (p->state == PHB4_STATE_BROKEN)
+		return OPAL_HARDWARE;
+	if (phb4_fenced(p) || (p->flags & PHB4_CAPP_RECOVERY))
+		return OPAL_HARDWARE;
+
+	phb4_read_frozen_pes(p);
+	*num_pes = MIN(p->num_pes, PCI_MAX_PES);
+
+	return OPAL_SUCCESS;
+}
+
 static int64_t phb4_err_inject_finalize(struct phb4 *phb, uint64_t addr,
 					uint64_t mask, uint64_t ctrl,
 					bool is_write)
@@ -3128,6 +3211,8 @@ static const struct phb_ops phb4_ops = {
 	.cfg_write8		= phb4_pcicfg_write8,
 	.cfg_write16		= phb4_pcicfg_write16,
 	.cfg_write32		= phb4_pcicfg_write32,
+	.cfg_read_block		= phb4_pcicfg_read_block,
+	.cfg_write_block	= phb4_pcicfg_write_block,
 	.choose_bus		= phb4_choose_bus,
 	.get_reserved_pe_number	= phb4_get_reserved_pe_number,
 	.device_init		= phb4_device_init,
@@ -3149,6 +3234,7 @@ static const struct phb_ops phb4_ops = {
 	.eeh_freeze_clear	= phb4_eeh_freeze_clear,
 	.eeh_freeze_set		= phb4_eeh_freeze_set,
 	.next_error		= phb4_eeh_next_error,
+	.eeh_frozen_pes		= phb4_eeh_frozen_pes,
 	.err_inject		= phb4_err_inject,
 	.get_diag_data		= NULL,
 	.get_diag_data2		= phb4_get_diag_data,
@@ -0,0 +1,601 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+static unsigned long sim_tb = 1;
+
+static inline unsigned long mftb(void)
+{
+	return sim_tb;
+}
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* Override this for device.c */
+#define is_rodata(p) false
+
+#include "../../core/device.c"
+
+/* bt.c has its own */
+#undef pr_fmt
+#include "../bt.c"
+
+unsigned long tb_hz = 512000000;
+unsigned long top_of_ram = ~0ul;
+enum proc_chip_quirks proc_chip_quirks;
+
+#define BT_IO_BASE	0xe4
+#define TEST_NETFN	0x30
+#define TEST_CMD	0x42
+
+/*
+ * The BMC side of the interface. It takes a request out of the FIFO
+ * whenever H2B_ATN is set and it has room for it, and answers each one
+ * "latency" after it took it, in order or, if "reverse" is set, newest
+ * first. Requests whose first data byte matches "drop" are taken but
+ * never answered, as are all of them if "deaf" is set.
+ */
+struct bmc_req {
+	uint8_t netfn, seq, cmd;
+	uint8_t data[BT_FIFO_LEN];
+	unsigned int len;
+	unsigned long ready;
+};
+
+static struct {
+	/* Interface registers */
+	bool h2b_atn, b2h_atn, sms_atn, h_busy;
+	uint8_t req_fifo[BT_FIFO_LEN];
+	uint8_t resp_fifo[BT_FIFO_LEN];
+	unsigned int wr_ptr, rd_ptr;
+
+	/* BMC behaviour */
+	unsigned int num_requests;
+	unsigned long latency;
+	bool reverse;
+	bool deaf;
+	int drop;
+
+	/* Requests being worked on */
+	struct bmc_req reqs[16];
+	unsigned int nr_reqs;
+
+	unsigned int nr_taken, nr_resets;
+} bmc;
+
+static void bmc_reset(void)
+{
+	bmc.h2b_atn = bmc.b2h_atn = bmc.sms_atn = bmc.h_busy = false;
+	bmc.wr_ptr = bmc.rd_ptr = 0;
+	bmc.nr_reqs = 0;
+	bmc.nr_resets++;
+}
+
+static void bmc_take_req(void)
+{
+	struct bmc_req *req = &bmc.reqs[bmc.nr_reqs];
+	uint8_t *f = bmc.req_fifo;
+
+	bmc.h2b_atn = false;
+	bmc.nr_taken++;
+	if (bmc.deaf || (f[0] > 3 && f[4] == bmc.drop))
+		return;
+
+	req->netfn = f[1];
+	req->seq = f[2];
+	req->cmd = f[3];
+	req->len = f[0] - 3;
+	memcpy(req->data, &f[4], req->len);
+	req->ready = sim_tb + bmc.latency;
+	bmc.nr_reqs++;
+}
+
+static void bmc_respond(unsigned int i)
+{
+	struct bmc_req *req = &bmc.reqs[i];
+	uint8_t *f = bmc.resp_fifo;
+	unsigned int len = 0;
+
+	f[1] = req->netfn | 4;
+	f[2] = req->seq;
+	f[3] = req->cmd;
+	f[4] = IPMI_CC_NO_ERROR;
+	if (req->cmd == IPMI_CMD(IPMI_GET_BT_CAPS)) {
+		f[5] = bmc.num_requests;
+		f[6] = BT_FIFO_LEN - 1;
+		f[7] = BT_FIFO_LEN - 1;
+		f[8] = BT_MSG_TIMEOUT;
+		f[9] = BT_MAX_RETRIES;
+		len = 5;
+	} else {
+		/* Echo the request */
+		memcpy(&f[5], req->data, req->len);
+		len = req->len;
+	}
+	f[0] = len + BT_MIN_RESP_LEN;
+
+	bmc.nr_reqs--;
+	memmove(req, req + 1, (bmc.nr_reqs - i) * sizeof(*req));
+	bmc.b2h_atn = true;
+}
+
+static void bmc_step(void)
+{
+	unsigned int i;
+
+	if (bmc.h2b_atn && bmc.nr_reqs < bmc.num_requests)
+		bmc_take_req();
+
+	if (bmc.b2h_atn || bmc.h_busy || !bmc.nr_reqs)
+		return;
+
+	i = bmc.reverse ? bmc.nr_reqs - 1 : 0;
+	if (bmc.reqs[i].ready <= sim_tb)
+		bmc_respond(i);
+}
+
+int64_t lpc_write(enum OpalLPCAddressType addr_type, uint32_t addr,
+		  uint32_t data, uint32_t sz)
+{
+	assert(addr_type == OPAL_LPC_IO && sz == 1);
+
+	switch (addr - BT_IO_BASE) {
+	case BT_CTRL:
+		if (data & BT_CTRL_CLR_WR_PTR)
+			bmc.wr_ptr = 0;
+		if (data & BT_CTRL_CLR_RD_PTR)
+			bmc.rd_ptr = 0;
+		if (data & BT_CTRL_H2B_ATN)
+			bmc.h2b_atn = true;
+		if (data & BT_CTRL_B2H_ATN)
+			bmc.b2h_atn = false;
+		if (data & BT_CTRL_SMS_ATN)
+			bmc.sms_atn = false;
+		if (data & BT_CTRL_H_BUSY)
+			bmc.h_busy = !bmc.h_busy;
+		break;
+	case BT_HOST2BMC:
+		/* The host must not write while the BMC reads */
+		assert(!bmc.h2b_atn);
+		if (bmc.wr_ptr < BT_FIFO_LEN)
+			bmc.req_fifo[bmc.wr_ptr++] = data;
+		break;
+	case BT_INTMASK:
+		if (data & BT_INTMASK_BMC_HWRST)
+			bmc_reset();
+		break;
+	default:
+		assert(0);
+	}
+
+	return OPAL_SUCCESS;
+}
+
+int64_t lpc_read(enum OpalLPCAddressType addr_type, uint32_t addr,
+		 uint32_t *data, uint32_t sz)
+{
+	assert(addr_type == OPAL_LPC_IO && sz == 1);
+
+	switch (addr - BT_IO_BASE) {
+	case BT_CTRL:
+		*data = (bmc.h2b_atn ? BT_CTRL_H2B_ATN : 0) |
+			(bmc.b2h_atn ? BT_CTRL_B2H_ATN : 0) |
+			(bmc.sms_atn ? BT_CTRL_SMS_ATN : 0) |
+			(bmc.h_busy ? BT_CTRL_H_BUSY : 0);
+		break;
+	case BT_HOST2BMC:
+		assert(bmc.rd_ptr < BT_FIFO_LEN);
+		*data = bmc.resp_fifo[bmc.rd_ptr++];
+		break;
+	case BT_INTMASK:
+		*data = bmc.b2h_atn ? BT_INTMASK_B2H_IRQ : 0;
+		break;
+	default:
+		assert(0);
+	}
+
+	return OPAL_SUCCESS;
+}
+
+bool lpc_ok(void)
+{
+	return true;
+}
+
+void lpc_register_client(uint32_t chip_id __unused,
+			 const struct lpc_client *clt __unused,
+			 uint32_t policy __unused)
+{
+}
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+void init_timer(struct timer *t, timer_func_t expiry, void *data)
+{
+	t->expiry = expiry;
+	t->user_data = data;
+	t->target = 0;
+}
+
+uint64_t schedule_timer(struct timer *t, uint64_t how_long)
+{
+	t->target = how_long == TIMER_POLL ? 0 : mftb() + how_long;
+
+	return mftb();
+}
+
+/* A minimal IPMI core on top of the BT backend */
+struct ipmi_backend *ipmi_backend;
+
+void ipmi_register_backend(struct ipmi_backend *backend)
+{
+	ipmi_backend = backend;
+}
+
+struct ipmi_msg *ipmi_mkmsg(int interface __unused, uint32_t code,
+			    void (*complete)(struct ipmi_msg *),
+			    void *user_data, void *req_data, size_t req_size,
+			    size_t resp_size)
+{
+	struct ipmi_msg *msg;
+
+	msg = ipmi_backend->alloc_msg(req_size, resp_size);
+	assert(msg);
+	msg->backend = ipmi_backend;
+	msg->cmd = IPMI_CMD(code);
+	msg->netfn = IPMI_NETFN(code) << 2;
+	msg->complete = complete;
+	msg->error = complete;
+	msg->user_data = user_data;
+	msg->prio = IPMI_PRIO_NORMAL;
+	if (req_data)
+		memcpy(msg->data, req_data, req_size);
+
+	return msg;
+}
+
+int ipmi_queue_msg(struct ipmi_msg *msg)
+{
+	return msg->backend->queue_msg(msg);
+}
+
+void ipmi_free_msg(struct ipmi_msg *msg)
+{
+	msg->backend->free_msg(msg);
+}
+
+void ipmi_cmd_done(uint8_t cmd, uint8_t netfn, uint8_t cc,
+		   struct ipmi_msg *msg)
+{
+	assert(cmd == msg->cmd);
+	assert(netfn == IPMI_NETFN_RETURN_CODE(msg->netfn));
+	msg->cc = cc;
+	if (cc == IPMI_CC_NO_ERROR)
+		msg->complete(msg);
+	else
+		msg->error(msg);
+}
+
+void ipmi_sms_attention(void)
+{
+}
+
+/*
+ * Test messages carry a tag, which the BMC echoes back. Completing one
+ * queues another one until "to_send" have been sent.
+ */
+static unsigned int to_send, nr_sent, nr_done, nr_errors;
+static unsigned int nr_prio_done[IPMI_NR_PRIOS];
+static unsigned int nr_prio_errors[IPMI_NR_PRIOS];
+static uint8_t last_tag;
+static enum ipmi_prio resend_prio = IPMI_PRIO_NORMAL;
+static unsigned int bulk_done_at;
+
+static void send_prio(enum ipmi_prio prio);
+
+static void test_complete(struct ipmi_msg *msg)
+{
+	uint8_t tag = (uintptr_t)msg->user_data;
+
+	if (msg->cc == IPMI_CC_NO_ERROR) {
+		assert(msg->resp_size == 1 && msg->data[0] == tag);
+		nr_done++;
+		nr_prio_done[msg->prio]++;
+		if (msg->prio == IPMI_PRIO_BULK)
+			bulk_done_at = nr_done;
+	} else {
+		assert(msg->cc == IPMI_TIMEOUT_ERR);
+		nr_errors++;
+		nr_prio_errors[msg->prio]++;
+	}
+	last_tag = tag;
+	ipmi_free_msg(msg);
+
+	if (nr_sent < to_send)
+		send_prio(resend_prio);
+}
+
+static void send_prio(enum ipmi_prio prio)
+{
+	struct ipmi_msg *msg;
+	uint8_t tag = nr_sent++;
+
+	msg = ipmi_mkmsg(IPMI_DEFAULT_INTERFACE,
+			 IPMI_CODE(TEST_NETFN >> 2, TEST_CMD), test_complete,
+			 (void *)(uintptr_t)tag, &tag, 1, 1);
+	msg->prio = prio;
+	assert(!ipmi_queue_msg(msg));
+}
+
+static void send_one(void)
+{
+	send_prio(IPMI_PRIO_NORMAL);
+}
+
+/*
+ * Run the BMC and the host for a while. The host polls on every tick,
+ * as it would with the interrupt working.
+ */
+#define TICK	usecs_to_tb(10)
+
+static void run_until(bool (*done)(void), unsigned long max_tb)
+{
+	unsigned long end = sim_tb + max_tb;
+
+	while (!done() && tb_compare(sim_tb, end) == TB_ABEFOREB) {
+		sim_tb += TICK;
+		bmc_step();
+		bt_poll(NULL, NULL, mftb());
+	}
+}
+
+static bool all_done(void)
+{
+	return nr_done + nr_errors == to_send;
+}
+
+static bool caps_done(void)
+{
+	return !bt.queue_len;
+}
+
+static void setup(unsigned int num_requests)
+{
+	struct dt_node *n;
+
+	memset(&bmc, 0, sizeof(bmc));
+	memset(&bt, 0, sizeof(bt));
+	bmc.num_requests = num_requests;
+	bmc.latency = msecs_to_tb(1);
+	bmc.drop = -1;
+	to_send = nr_sent = nr_done = nr_errors = 0;
+	memset(nr_prio_done, 0, sizeof(nr_prio_done));
+	memset(nr_prio_errors, 0, sizeof(nr_prio_errors));
+
+	dt_root = dt_new_root("");
+	n = dt_new_addr(dt_root, "bt", BT_IO_BASE);
+	dt_add_property_string(n, "compatible", "ipmi-bt");
+	dt_add_property_cells(n, "reg", OPAL_LPC_IO, BT_IO_BASE, 3);
+	dt_add_property_cells(n, "interrupts", 10);
+	dt_add_property_cells(n, "ibm,chip-id", 0);
+
+	bt_init();
+	run_until(caps_done, secs_to_tb(1));
+	assert(bt.caps.num_requests == num_requests);
+}
+
+static void teardown(void)
+{
+	assert(list_empty(&bt.inflight) && !bt.queue_len);
+	dt_free(dt_root);
+}
+
+/* Returns the number of messages per second for a full queue */
+static unsigned long measure(unsigned int num_requests, unsigned int count)
+{
+	unsigned long start, elapsed;
+	unsigned int i;
+
+	setup(num_requests);
+	to_send = count;
+	start = sim_tb;
+	for (i = 0; i < BT_MAX_QUEUE_LEN - 2; i++)
+		send_one();
+	run_until(all_done, secs_to_tb(60));
+	assert(nr_done == count && !nr_errors);
+	elapsed = sim_tb - start;
+	teardown();
+
+	return count * tb_hz / elapsed;
+}
+
+static void check_throughput(void)
+{
+	unsigned long serial, piped;
+
+	serial = measure(1, 1000);
+	piped = measure(4, 1000);
+	printf("BT: %lu msgs/s with 1 request, %lu with 4 in flight\n",
+	       serial, piped);
+
+	/* The BMC answers in 1ms whatever the number in flight */
+	assert(serial > 800 && serial <= 1000);
+	assert(piped > 3 * serial);
+}
+
+/* Responses out of order still complete the right messages */
+static void check_out_of_order(void)
+{
+	unsigned int i;
+
+	setup(4);
+	bmc.reverse = true;
+	to_send = 4;
+	for (i = 0; i < 4; i++)
+		send_one();
+
+	/* Let the BMC take all of them before it answers any */
+	run_until(all_done, secs_to_tb(1));
+	assert(nr_done == 4 && last_tag == 0);
+	teardown();
+}
+
+/* A request the BMC loses is sent again, all of it */
+static void check_retry(void)
+{
+	unsigned int taken;
+
+	setup(2);
+	bmc.drop = 0;
+	to_send = 2;
+	send_one();
+	send_one();
+
+	/* The other message is not held up by the lost one */
+	run_until(all_done, msecs_to_tb(100));
+	assert(nr_done == 1 && last_tag == 1);
+
+	/* The retry goes through once the BMC behaves */
+	taken = bmc.nr_taken;
+	bmc.drop = -1;
+	run_until(all_done, secs_to_tb(BT_MSG_TIMEOUT + 1));
+	assert(nr_done == 2 && !nr_errors && last_tag == 0);
+	assert(bmc.nr_taken == taken + 1);
+	teardown();
+}
+
+/* A BMC that never answers has the messages time out, one by one */
+static void check_timeout(void)
+{
+	unsigned int resets;
+
+	setup(2);
+	bmc.deaf = true;
+	to_send = 3;
+	send_one();
+	send_one();
+	send_one();
+
+	resets = bmc.nr_resets;
+	run_until(all_done, secs_to_tb(4 * (BT_MSG_TIMEOUT + 1) *
+				       (BT_MAX_RETRIES + 1)));
+	assert(nr_errors == 3 && !nr_done);
+	assert(bmc.nr_resets > resets);
+	teardown();
+}
+
+/* Critical messages overtake the others, and bulk ones go first */
+static void check_priorities(void)
+{
+	struct bt_class_stats *st = bt.stats;
+	unsigned int i;
+
+	/* Dropping messages doesn't queue others behind them */
+	setup(1);
+
+	/* A backlog of bulk and normal messages, one bulk one in flight */
+	for (i = 0; i < 6; i++)
+		send_prio(IPMI_PRIO_BULK);
+	assert(st[IPMI_PRIO_BULK].dropped == 1);
+	for (i = 0; i < 6; i++)
+		send_prio(IPMI_PRIO_NORMAL);
+	assert(bt.queue_len == BT_MAX_QUEUE_LEN);
+	assert(st[IPMI_PRIO_BULK].dropped == 2);
+
+	/* Critical ones push bulk ones out, never the other way */
+	for (i = 0; i < 3; i++)
+		send_prio(IPMI_PRIO_CRITICAL);
+	assert(st[IPMI_PRIO_BULK].dropped == 5);
+	for (i = 0; i < 4; i++)
+		send_prio(IPMI_PRIO_BULK);
+	assert(st[IPMI_PRIO_BULK].dropped == 9);
+	assert(!st[IPMI_PRIO_CRITICAL].dropped);
+	assert(!st[IPMI_PRIO_NORMAL].dropped);
+	assert(nr_prio_errors[IPMI_PRIO_BULK] == 9);
+
+	/* The critical ones are sent right after the one in flight */
+	to_send = nr_sent;
+	while (!nr_prio_done[IPMI_PRIO_CRITICAL]) {
+		sim_tb += TICK;
+		bmc_step();
+		bt_poll(NULL, NULL, mftb());
+	}
+	assert(nr_done == 2 && nr_prio_done[IPMI_PRIO_BULK] == 1);
+	run_until(all_done, secs_to_tb(1));
+	assert(nr_prio_done[IPMI_PRIO_CRITICAL] == 3);
+	assert(nr_prio_done[IPMI_PRIO_NORMAL] == 6);
+	assert(nr_prio_done[IPMI_PRIO_BULK] == 1);
+
+	printf("BT: latency critical %lluus normal %lluus\n",
+	       (unsigned long long)tb_to_usecs(st[IPMI_PRIO_CRITICAL].latency_tb /
+				 st[IPMI_PRIO_CRITICAL].done),
+	       (unsigned long long)tb_to_usecs(st[IPMI_PRIO_NORMAL].latency_tb /
+				 st[IPMI_PRIO_NORMAL].done));
+	assert(st[IPMI_PRIO_CRITICAL].max_latency_tb <
+	       st[IPMI_PRIO_NORMAL].max_latency_tb);
+	teardown();
+}
+
+/* Bulk messages still get through behind a stream of others */
+static void check_fairness(void)
+{
+	unsigned int i;
+
+	setup(1);
+	to_send = 200;
+	resend_prio = IPMI_PRIO_CRITICAL;
+	send_prio(IPMI_PRIO_CRITICAL);
+	send_prio(IPMI_PRIO_BULK);
+	for (i = 0; i < 6; i++)
+		send_prio(IPMI_PRIO_CRITICAL);
+
+	/* Completions keep the queue full of critical messages */
+	run_until(all_done, secs_to_tb(1));
+	assert(nr_done == to_send && !nr_errors);
+	assert(nr_prio_done[IPMI_PRIO_BULK] == 1);
+	assert(bulk_done_at <= bt_class_weight[IPMI_PRIO_CRITICAL] + 2);
+	resend_prio = IPMI_PRIO_NORMAL;
+	teardown();
+}
+
+int main(void)
+{
+	check_throughput();
+	check_out_of_order();
+	check_retry();
+	check_timeout();
+	check_priorities();
+	check_fairness();
+
+	return 0;
+}
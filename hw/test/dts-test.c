@@ -0,0 +1,450 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+static unsigned long sim_tb = 1;
+
+static inline unsigned long mftb(void)
+{
+	return sim_tb;
+}
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* Override this for device.c */
+#define is_rodata(p) false
+
+#include "../../core/device.c"
+#include "../dts.c"
+
+/*
+ * Two P9 chips of four cores, the first one with two Centaurs and the
+ * second one with one.
+ */
+#define NR_CHIPS	2
+#define NR_CORES	4
+
+static struct proc_chip chips[NR_CHIPS];
+static struct cpu_thread cores[NR_CHIPS][NR_CORES];
+static const uint32_t centaurs[] = { 0x80000000, 0x80000001, 0x80000010 };
+
+enum proc_gen proc_gen = proc_gen_p9;
+unsigned long tb_hz = 512000000;
+unsigned long top_of_ram = ~0ul;
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+uint32_t pir_to_chip_id(uint32_t pir)
+{
+	return pir >> 8;
+}
+
+uint32_t pir_to_core_id(uint32_t pir)
+{
+	return (pir >> 2) & 0x1f;
+}
+
+struct proc_chip *next_chip(struct proc_chip *chip)
+{
+	unsigned int i = chip ? chip - chips + 1 : 0;
+
+	return i < NR_CHIPS ? &chips[i] : NULL;
+}
+
+struct cpu_thread *first_available_core_in_chip(u32 chip_id)
+{
+	return &cores[chip_id][0];
+}
+
+struct cpu_thread *next_available_core_in_chip(struct cpu_thread *core,
+					       u32 chip_id)
+{
+	unsigned int i = core - cores[chip_id] + 1;
+
+	return i < NR_CORES ? &cores[chip_id][i] : NULL;
+}
+
+static unsigned int nr_groups;
+
+int sensor_group_add(const char *name, int chip_id, const uint32_t *handles,
+		     unsigned int nr)
+{
+	struct dts_chip *dc = dts_chips[chip_id];
+	unsigned int i;
+
+	assert(!strcmp(name, "dts"));
+	assert(nr == 2 * dc->nr_sensors);
+	for (i = 0; i < dc->nr_sensors; i++) {
+		assert(handles[2 * i] == dc->sensors[i].handle);
+		assert(sensor_get_attr(handles[2 * i + 1]) ==
+		       SENSOR_DTS_ATTR_TEMP_TRIP);
+	}
+
+	return nr_groups++;
+}
+
+/* One timer per chip at most */
+static struct timer *timers[NR_CHIPS];
+
+void init_timer(struct timer *t, timer_func_t expiry, void *data)
+{
+	t->expiry = expiry;
+	t->user_data = data;
+	t->target = 0;
+}
+
+uint64_t schedule_timer(struct timer *t, uint64_t how_long)
+{
+	struct dts_chip *dc = t->user_data;
+
+	t->target = mftb() + how_long;
+	timers[dc->chip_id] = t;
+
+	return mftb();
+}
+
+/* Move time forward, running the timers that expire on the way */
+static void advance_ms(unsigned long ms)
+{
+	unsigned long end = sim_tb + msecs_to_tb(ms);
+	unsigned int i;
+	bool ran;
+
+	do {
+		ran = false;
+		for (i = 0; i < NR_CHIPS; i++) {
+			struct timer *t = timers[i];
+
+			if (!t || tb_compare(t->target, end) == TB_AAFTERB)
+				continue;
+			timers[i] = NULL;
+			if (tb_compare(sim_tb, t->target) == TB_ABEFOREB)
+				sim_tb = t->target;
+			t->expiry(t, t->user_data, sim_tb);
+			ran = true;
+		}
+	} while (ran);
+	sim_tb = end;
+}
+
+/*
+ * The SCOM backend: each sensor reads as a temperature derived from its
+ * address and from "gen", which the test bumps to change them all.
+ */
+static unsigned int gen;
+static unsigned int nr_multi, nr_single, nr_regs_read;
+static uint32_t fail_partid;
+static uint64_t fail_addr;
+
+static int16_t fake_temp(uint32_t partid, uint64_t addr)
+{
+	return 30 + (partid + (addr >> 24) + gen) % 50;
+}
+
+static uint64_t fake_reg(uint32_t partid, uint64_t addr)
+{
+	uint16_t t = fake_temp(partid, addr);
+	uint64_t dts0 = (t << 4) | 1;
+	uint64_t dts1 = ((t - 1) << 4) | 1;
+
+	return dts0 << 48 | dts1 << 32;
+}
+
+int _xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val,
+		bool take_lock __unused)
+{
+	nr_single++;
+	nr_regs_read++;
+	if (partid == fail_partid && pcb_addr == fail_addr)
+		return OPAL_XSCOM_BUSY;
+	*val = fake_reg(partid, pcb_addr);
+	return 0;
+}
+
+int xscom_read_multi(uint32_t partid, const uint64_t *addrs, uint64_t *vals,
+		     unsigned int count)
+{
+	unsigned int i;
+
+	nr_multi++;
+	for (i = 0; i < count; i++) {
+		nr_regs_read++;
+		if (partid == fail_partid && addrs[i] == fail_addr)
+			return OPAL_XSCOM_BUSY;
+		vals[i] = fake_reg(partid, addrs[i]);
+	}
+	return 0;
+}
+
+static void reset_counts(void)
+{
+	nr_multi = nr_single = nr_regs_read = 0;
+}
+
+static uint32_t core_pir(unsigned int chip, unsigned int core)
+{
+	return chip << 8 | core << 2;
+}
+
+static int16_t core_temp(uint32_t pir)
+{
+	return fake_temp(pir_to_chip_id(pir),
+			 XSCOM_ADDR_P9_EC(pir_to_core_id(pir),
+					  EC_THERM_P9_DTS_RESULT0));
+}
+
+static int16_t cen_temp(uint32_t cen_id)
+{
+	return fake_temp(cen_id, THERM_MEM_DTS_RESULT0);
+}
+
+static uint32_t read_core(uint32_t pir, int64_t *rc)
+{
+	uint32_t val = ~0u;
+
+	*rc = dts_sensor_read(core_handler(pir, SENSOR_DTS_ATTR_TEMP_MAX),
+			      &val);
+	return val;
+}
+
+static uint32_t read_cen(uint32_t chip_id, int64_t *rc)
+{
+	uint32_t val = ~0u;
+
+	*rc = dts_sensor_read(cen_handler(chip_id, SENSOR_DTS_ATTR_TEMP_MAX),
+			      &val);
+	return val;
+}
+
+/* Read every sensor and check it against the backend */
+static void read_all(void)
+{
+	unsigned int i, j;
+	int64_t rc;
+
+	for (i = 0; i < NR_CHIPS; i++) {
+		for (j = 0; j < NR_CORES; j++) {
+			uint32_t pir = core_pir(i, j);
+
+			assert(read_core(pir, &rc) == core_temp(pir));
+			assert(rc == OPAL_SUCCESS);
+		}
+	}
+	for (i = 0; i < ARRAY_SIZE(centaurs); i++) {
+		assert(read_cen(centaurs[i], &rc) == cen_temp(centaurs[i]));
+		assert(rc == OPAL_SUCCESS);
+	}
+}
+
+static void setup(void)
+{
+	struct dt_node *sensors, *cn;
+	unsigned int i, j;
+	char name[32];
+
+	dt_root = dt_new_root("");
+	sensors = dt_new(dt_root, "sensors");
+
+	for (i = 0; i < NR_CHIPS; i++) {
+		chips[i].id = i;
+		for (j = 0; j < NR_CORES; j++)
+			cores[i][j].pir = core_pir(i, j);
+	}
+	for (i = 0; i < ARRAY_SIZE(centaurs); i++) {
+		snprintf(name, sizeof(name), "memory-buffer@%x", centaurs[i]);
+		cn = dt_new(dt_root, name);
+		dt_add_property_string(cn, "compatible", "ibm,centaur");
+		dt_add_property_cells(cn, "ibm,chip-id", centaurs[i]);
+	}
+
+	assert(dts_sensor_create_nodes(sensors));
+	assert(nr_groups == NR_CHIPS);
+
+	assert(dts_chips[0]->nr_sensors == NR_CORES + 2);
+	assert(dts_chips[0]->nr_regs == NR_CORES);
+	assert(dts_chips[1]->nr_sensors == NR_CORES + 1);
+	assert(dts_chips[1]->nr_regs == NR_CORES);
+	assert(dt_find_by_path(dt_root, "/sensors/core-temp@104"));
+	assert(dt_find_by_path(dt_root, "/sensors/mem-temp@80000010"));
+}
+
+/* A whole round of reads costs one batch of SCOMs per chip */
+static void check_snapshot(void)
+{
+	reset_counts();
+	read_all();
+	assert(nr_multi == NR_CHIPS);
+	assert(nr_single == ARRAY_SIZE(centaurs));
+	assert(nr_regs_read == NR_CHIPS * NR_CORES + ARRAY_SIZE(centaurs));
+
+	/* Nothing more while the snapshot is fresh */
+	reset_counts();
+	advance_ms(dts_refresh_ms / 2);
+	read_all();
+	read_all();
+	assert(nr_regs_read == 0);
+}
+
+/*
+ * Reads keep the timer going, which refreshes the snapshot in the
+ * background. Without reads it stops after one more refresh.
+ */
+static void check_timer(void)
+{
+	unsigned int i;
+
+	reset_counts();
+	gen++;
+	advance_ms(dts_refresh_ms);
+	assert(nr_multi == NR_CHIPS);
+	read_all();
+	assert(nr_multi == NR_CHIPS);
+
+	reset_counts();
+	for (i = 0; i < 10; i++)
+		advance_ms(dts_refresh_ms);
+	assert(nr_multi == NR_CHIPS);
+	assert(!dts_chips[0]->armed && !dts_chips[1]->armed);
+
+	/* A stale snapshot is refreshed by the read itself */
+	reset_counts();
+	gen++;
+	read_all();
+	assert(nr_multi == NR_CHIPS);
+	assert(dts_chips[0]->armed && dts_chips[1]->armed);
+}
+
+/* A failing core doesn't take the others down with it */
+static void check_errors(void)
+{
+	uint32_t bad = core_pir(1, 2);
+	unsigned int j;
+	int64_t rc;
+
+	fail_partid = 1;
+	fail_addr = XSCOM_ADDR_P9_EC(2, EC_THERM_P9_DTS_RESULT0);
+	advance_ms(dts_refresh_ms * 2);
+
+	for (j = 0; j < NR_CORES; j++) {
+		uint32_t pir = core_pir(1, j);
+		uint32_t val = read_core(pir, &rc);
+
+		if (pir == bad) {
+			assert(rc == OPAL_XSCOM_BUSY);
+		} else {
+			assert(rc == OPAL_SUCCESS);
+			assert(val == core_temp(pir));
+		}
+	}
+
+	fail_partid = 0xffffffff;
+	advance_ms(dts_refresh_ms * 2);
+	read_all();
+}
+
+static void check_read_chip(void)
+{
+	struct opal_dts_sensor buf[NR_CORES + 2];
+	unsigned int i;
+	int64_t rc;
+	__be32 nr;
+
+	nr = cpu_to_be32(1);
+	assert(opal_sensor_dts_read_chip(0, buf, &nr) == OPAL_PARTIAL);
+	assert(be32_to_cpu(nr) == NR_CORES + 2);
+	assert(opal_sensor_dts_read_chip(NR_CHIPS, buf, &nr) ==
+	       OPAL_PARAMETER);
+
+	gen++;
+	advance_ms(dts_refresh_ms * 2);
+	reset_counts();
+	nr = cpu_to_be32(ARRAY_SIZE(buf));
+	assert(opal_sensor_dts_read_chip(0, buf, &nr) == OPAL_SUCCESS);
+	assert(be32_to_cpu(nr) == NR_CORES + 2);
+	assert(nr_multi == 1 && nr_single == 2);
+
+	for (i = 0; i < NR_CORES; i++) {
+		uint32_t pir = core_pir(0, i);
+
+		assert(be32_to_cpu(buf[i].handle) ==
+		       core_handler(pir, SENSOR_DTS_ATTR_TEMP_MAX));
+		assert(be32_to_cpu(buf[i].temp) == core_temp(pir));
+		assert(buf[i].rc == 0);
+	}
+	for (i = 0; i < 2; i++) {
+		uint32_t chip_id = centaurs[i];
+
+		assert(be32_to_cpu(buf[NR_CORES + i].handle) ==
+		       cen_handler(chip_id, SENSOR_DTS_ATTR_TEMP_MAX));
+		assert(be32_to_cpu(buf[NR_CORES + i].temp) == cen_temp(chip_id));
+	}
+
+	/* The sensors read individually come from the same snapshot */
+	reset_counts();
+	assert(read_core(core_pir(0, 1), &rc) == core_temp(core_pir(0, 1)));
+	assert(read_cen(centaurs[1], &rc) == cen_temp(centaurs[1]));
+	assert(nr_regs_read == 0);
+}
+
+/* With the cache disabled, each read goes to the hardware */
+static void check_disabled(void)
+{
+	int64_t rc;
+
+	dts_refresh_ms = 0;
+	reset_counts();
+	read_all();
+	assert(nr_multi == NR_CHIPS * NR_CORES);
+	assert(nr_single == ARRAY_SIZE(centaurs));
+	dts_refresh_ms = DTS_REFRESH_MS;
+
+	/* So do unknown sensors */
+	reset_counts();
+	assert(read_core(core_pir(0, NR_CORES), &rc) ==
+	       core_temp(core_pir(0, NR_CORES)));
+	assert(rc == OPAL_SUCCESS && nr_multi == 1);
+}
+
+int main(void)
+{
+	fail_partid = 0xffffffff;
+
+	setup();
+	check_snapshot();
+	check_timer();
+	check_errors();
+	check_read_chip();
+	check_disabled();
+
+	return 0;
+}
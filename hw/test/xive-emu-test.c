@@ -0,0 +1,191 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+#include <xive.h>
+
+#include "../../test/bench.h"
+
+/* Same size as the queue set up for XICS emulation: one 64K page */
+#define EQ_ENTRIES	(0x10000 / 4)
+
+static uint32_t eq_page[EQ_ENTRIES];
+
+/*
+ * Software model of the XIVE side of the queue: it starts writing
+ * generation 1 into a cleared page and flips generation on each wrap.
+ */
+static struct {
+	uint32_t	ptr;
+	uint32_t	gen;
+} hw;
+
+static void eq_reset(struct xive_emu_eq *eq)
+{
+	memset(eq_page, 0, sizeof(eq_page));
+	eq->buf = eq_page;
+	eq->ptr = 0;
+	eq->msk = EQ_ENTRIES - 1;
+	eq->gen = 0;
+	hw.ptr = 0;
+	hw.gen = 1;
+}
+
+static void hw_push(uint32_t isn)
+{
+	eq_page[hw.ptr] = (hw.gen << 31) | isn;
+	hw.ptr = (hw.ptr + 1) & (EQ_ENTRIES - 1);
+	if (hw.ptr == 0)
+		hw.gen ^= 1;
+}
+
+static uint32_t eq_pop(struct xive_emu_eq *eq)
+{
+	uint32_t isn = xive_emu_eq_peek(eq);
+
+	if (isn)
+		xive_emu_eq_advance(eq);
+	return isn;
+}
+
+static void check_empty(void)
+{
+	struct xive_emu_eq eq;
+
+	eq_reset(&eq);
+	assert(xive_emu_eq_peek(&eq) == 0);
+	assert(eq_pop(&eq) == 0);
+	assert(eq.ptr == 0 && eq.gen == 0);
+}
+
+/* Fill and drain in bursts of every size, over several wraps */
+static void check_wraps(void)
+{
+	struct xive_emu_eq eq;
+	uint32_t burst, i, next_in = 0x10, next_out = 0x10;
+	uint32_t wraps = 0;
+	uint8_t gen;
+
+	eq_reset(&eq);
+	gen = eq.gen;
+	for (burst = 1; wraps < 4; burst = burst * 3 % 1021 + 1) {
+		for (i = 0; i < burst; i++)
+			hw_push(next_in++ & 0x00ffffff);
+		for (i = 0; i < burst; i++) {
+			assert(xive_emu_eq_peek(&eq) == (next_out & 0x00ffffff));
+			assert(eq_pop(&eq) == (next_out++ & 0x00ffffff));
+			if (eq.gen != gen) {
+				assert(eq.ptr == 0);
+				gen = eq.gen;
+				wraps++;
+			}
+		}
+		assert(xive_emu_eq_peek(&eq) == 0);
+	}
+}
+
+/* A full queue must not look empty, nor a drained one full */
+static void check_full(void)
+{
+	struct xive_emu_eq eq;
+	uint32_t i;
+
+	eq_reset(&eq);
+	for (i = 0; i < EQ_ENTRIES; i++)
+		hw_push(0x100 + i);
+	assert(eq.ptr == hw.ptr);
+	for (i = 0; i < EQ_ENTRIES; i++)
+		assert(eq_pop(&eq) == 0x100 + i);
+	assert(eq.ptr == 0 && eq.gen == 1);
+	assert(xive_emu_eq_peek(&eq) == 0);
+}
+
+/*
+ * What the emulation used to pay per interrupt on top of the queue
+ * accesses: the per CPU lock taken by get_xirr and again by eoi.
+ */
+static int model_lock;
+
+static inline void model_lock_take(void)
+{
+	while (__atomic_exchange_n(&model_lock, 1, __ATOMIC_ACQUIRE))
+		;
+}
+
+static inline void model_lock_drop(void)
+{
+	__atomic_store_n(&model_lock, 0, __ATOMIC_RELEASE);
+}
+
+#define BENCH_IRQS	(10 * 1000 * 1000)
+
+/*
+ * The common case: one interrupt pending, get_xirr pops it, eoi finds
+ * the queue empty.
+ */
+static uint64_t bench_one(bool locked)
+{
+	struct xive_emu_eq eq;
+	uint64_t start, sum = 0;
+	uint32_t i;
+
+	eq_reset(&eq);
+	start = bench_now_ns();
+	for (i = 0; i < BENCH_IRQS; i++) {
+		hw_push(0x10 + (i & 0xff));
+
+		/* get_xirr */
+		if (locked)
+			model_lock_take();
+		sum += eq_pop(&eq);
+		if (locked)
+			model_lock_drop();
+
+		/* eoi */
+		if (locked)
+			model_lock_take();
+		sum += xive_emu_eq_peek(&eq);
+		if (locked)
+			model_lock_drop();
+	}
+	assert(sum);
+	return bench_now_ns() - start;
+}
+
+int main(void)
+{
+	uint64_t old, new;
+
+	check_empty();
+	check_wraps();
+	check_full();
+
+	if (!bench_enabled())
+		return 0;
+
+	old = bench_one(true);
+	new = bench_one(false);
+	printf("%d interrupts: locked %.1f ns, lockless %.1f ns per irq\n",
+	       BENCH_IRQS, (double)old / BENCH_IRQS, (double)new / BENCH_IRQS);
+
+	return 0;
+}
@@ -278,18 +278,20 @@ struct xive_cpu_state {
 	/* Pre-allocated IPI */
 	uint32_t	ipi_irq;
 
-	/* Use for XICS emulation */
-	struct lock	lock;
-	uint8_t		cppr;
-	uint8_t		mfrr;
+	/* Use for XICS emulation. Only the CPU owning the state uses
+	 * these, from get_xirr, eoi and set_cppr, so they need no lock.
+	 * They get a cache line of their own, away from the MFRR.
+	 */
+	uint8_t		cppr __align(0x80);
 	uint8_t		pending;
 	uint8_t		prev_cppr;
-	uint32_t	*eqbuf;
-	uint32_t	eqptr;
-	uint32_t	eqmsk;
-	uint8_t		eqgen;
+	struct xive_emu_eq emu_eq;
 	void		*eqmmio;
 	uint64_t	total_irqs;
+
+	/* Set by any CPU with set_mfrr, under the lock */
+	struct lock	lock __align(0x80);
+	uint8_t		mfrr;
 };
 
 #ifdef XIVE_PERCPU_LOG
@@ -698,6 +700,7 @@ static uint32_t xive_encode_vp(uint32_t blk, uint32_t idx, uint32_t order)
 
 #define xive_dbg(__x,__fmt,...)		prlog(PR_DEBUG,"XIVE[ IC %02x  ] " __fmt, (__x)->chip_id, ##__VA_ARGS__)
 #define xive_cpu_dbg(__c,__fmt,...)	prlog(PR_DEBUG,"XIVE[CPU %04x] " __fmt, (__c)->pir, ##__VA_ARGS__)
+#define xive_info(__x,__fmt,...)	prlog(PR_INFO,"XIVE[ IC %02x  ] " __fmt, (__x)->chip_id, ##__VA_ARGS__)
 #define xive_warn(__x,__fmt,...)	prlog(PR_WARNING,"XIVE[ IC %02x  ] " __fmt, (__x)->chip_id, ##__VA_ARGS__)
 #define xive_cpu_warn(__c,__fmt,...)	prlog(PR_WARNING,"XIVE[CPU %04x] " __fmt, (__c)->pir, ##__VA_ARGS__)
 #define xive_err(__x,__fmt,...)		prlog(PR_ERR,"XIVE[ IC %02x  ] " __fmt, (__x)->chip_id, ##__VA_ARGS__)
@@ -999,13 +1002,39 @@ static void xive_free_eq_set(struct xive *x, uint32_t eqs)
 }
 
 #ifdef USE_INDIRECT
+/*
+ * Indirect VP pages are never taken back once installed (a reset
+ * leaves them in place), so this can be checked without the lock.
+ * xive_provision_vp_ind() publishes a page with a single store of
+ * the complete VSD after clearing the page, which the lwsync here
+ * pairs with.
+ */
+static bool xive_vp_ind_provisioned(struct xive *x, uint32_t pbase,
+				    uint32_t pend)
+{
+	uint32_t i;
+
+	for (i = pbase; i <= pend; i++)
+		if (!x->vp_ind_base[i])
+			return false;
+	lwsync();
+	return true;
+}
+
 static bool xive_provision_vp_ind(struct xive *x, uint32_t vp_idx, uint32_t order)
 {
 	uint32_t pbase, pend, i;
+	uint64_t vsd;
+	bool rc = true;
 
 	pbase = vp_idx / VP_PER_PAGE;
 	pend  = (vp_idx + (1 << order)) / VP_PER_PAGE;
 
+	/* Most of the time there's nothing to do, don't bother the lock */
+	if (xive_vp_ind_provisioned(x, pbase, pend))
+		return true;
+
+	lock(&x->lock);
 	for (i = pbase; i <= pend; i++) {
 		void *page;
 
@@ -1015,16 +1044,22 @@ static bool xive_provision_vp_ind(struct xive *x, uint32_t vp_idx, uint32_t orde
 
 		/* Try to grab a donated page */
 		page = xive_get_donated_page(x);
-		if (!page)
-			return false;
+		if (!page) {
+			rc = false;
+			break;
+		}
 
-		/* Install the page */
+		/* Install the page, cleared before anyone can see it */
 		memset(page, 0, 0x10000);
-		x->vp_ind_base[i] = ((uint64_t)page) & VSD_ADDRESS_MASK;
-		x->vp_ind_base[i] |= SETFIELD(VSD_TSIZE, 0ull, 4);
-		x->vp_ind_base[i] |= SETFIELD(VSD_MODE, 0ull, VSD_MODE_EXCLUSIVE);
+		vsd = ((uint64_t)page) & VSD_ADDRESS_MASK;
+		vsd |= SETFIELD(VSD_TSIZE, 0ull, 4);
+		vsd |= SETFIELD(VSD_MODE, 0ull, VSD_MODE_EXCLUSIVE);
+		lwsync();
+		x->vp_ind_base[i] = vsd;
 	}
-	return true;
+	unlock(&x->lock);
+
+	return rc;
 }
 #else
 static inline bool xive_provision_vp_ind(struct xive *x __unused,
@@ -1083,17 +1118,16 @@ static uint32_t xive_alloc_vps(uint32_t order)
 	if (vp < 0)
 		return XIVE_ALLOC_NO_SPACE;
 
-	/* Provision on every chip considered for allocation */
+	/* Provision on every chip considered for allocation. Each chip
+	 * is locked on its own and only if it is missing pages, so
+	 * concurrent allocations don't queue up on every chip in turn.
+	 */
 	for (i = 0; i < (1 << xive_chips_alloc_bits); i++) {
 		struct xive *x = xive_from_pc_blk(i);
-		bool success;
 
 		/* Return internal error & log rather than assert ? */
 		assert(x);
-		lock(&x->lock);
-		success = xive_provision_vp_ind(x, vp, local_order);
-		unlock(&x->lock);
-		if (!success) {
+		if (!xive_provision_vp_ind(x, vp, local_order)) {
 			lock(&xive_buddy_lock);
 			buddy_free(xive_vp_buddy, vp, local_order);
 			unlock(&xive_buddy_lock);
@@ -2702,6 +2736,7 @@ static struct xive *init_one_xive(struct dt_node *np)
 {
 	struct xive *x;
 	struct proc_chip *chip;
+	unsigned long start = mftb();
 
 	x = zalloc(sizeof(struct xive));
 	assert(x);
@@ -2770,7 +2805,10 @@ static struct xive *init_one_xive(struct dt_node *np)
 	/* Dump some MMIO registers for diagnostics */
 	xive_dump_mmio(x);
 
-	/* Pre-allocate a number of tables */
+	/* Pre-allocate a number of tables. They come from memory local
+	 * to the chip, and clearing them is most of the time spent here
+	 * (memset() zeroes whole cache lines with dcbz)
+	 */
 	if (!xive_prealloc_tables(x))
 		goto fail;
 
@@ -2794,6 +2832,7 @@ static struct xive *init_one_xive(struct dt_node *np)
 			       x->eq_mmio, XIVE_SRC_EOI_PAGE1,
 			       false, NULL, NULL);
 
+	xive_info(x, "Initialized in %lu us\n", tb_to_usecs(mftb() - start));
 
 	return x;
  fail:
@@ -2939,14 +2978,14 @@ static void xive_init_cpu_emulation(struct xive_cpu_state *xs,
 	/* Initialize remaining state */
 	xs->cppr = 0;
 	xs->mfrr = 0xff;
-	xs->eqbuf = xive_get_eq_buf(xs->vp_blk,
+	xs->emu_eq.buf = xive_get_eq_buf(xs->vp_blk,
 				    xs->eq_idx + XIVE_EMULATION_PRIO);
-	assert(xs->eqbuf);
-	memset(xs->eqbuf, 0, 0x10000);
+	assert(xs->emu_eq.buf);
+	memset(xs->emu_eq.buf, 0, 0x10000);
 
-	xs->eqptr = 0;
-	xs->eqmsk = (0x10000/4) - 1;
-	xs->eqgen = 0;
+	xs->emu_eq.ptr = 0;
+	xs->emu_eq.msk = (0x10000/4) - 1;
+	xs->emu_eq.gen = 0;
 	x = xive_from_vc_blk(xs->eq_blk);
 	assert(x);
 	xs->eqmmio = x->eq_mmio + (xs->eq_idx + XIVE_EMULATION_PRIO) * 0x20000;
@@ -2973,10 +3012,10 @@ static void xive_init_cpu_exploitation(struct xive_cpu_state *xs)
 	/* Clenaup remaining state */
 	xs->cppr = 0;
 	xs->mfrr = 0xff;
-	xs->eqbuf = NULL;
-	xs->eqptr = 0;
-	xs->eqmsk = 0;
-	xs->eqgen = 0;
+	xs->emu_eq.buf = NULL;
+	xs->emu_eq.ptr = 0;
+	xs->emu_eq.msk = 0;
+	xs->emu_eq.gen = 0;
 	xs->eqmmio = NULL;
 }
 
@@ -3055,8 +3094,10 @@ static void xive_init_cpu(struct cpu_thread *c)
 		xive_configure_ex_special_bar(x, c);
 
 	/* Initialize the state structure */
-	c->xstate = xs = local_alloc(c->chip_id, sizeof(struct xive_cpu_state), 1);
+	c->xstate = xs = local_alloc(c->chip_id, sizeof(struct xive_cpu_state),
+				     0x80);
 	assert(xs);
+	memset(xs, 0, sizeof(struct xive_cpu_state));
 	xs->xive = x;
 
 	init_lock(&xs->lock);
@@ -3102,16 +3143,16 @@ static uint32_t xive_count_irq_copies(struct xive_cpu_state *xs, uint32_t ref)
 {
 	uint32_t i, irq;
 	uint32_t cnt = 0;
-	uint32_t pos = xs->eqptr;
-	uint32_t gen = xs->eqgen;
+	uint32_t pos = xs->emu_eq.ptr;
+	uint32_t gen = xs->emu_eq.gen;
 
 	for (i = 0; i < 0x3fff; i++) {
-		irq = xs->eqbuf[pos];
+		irq = xs->emu_eq.buf[pos];
 		if ((irq >> 31) == gen)
 			break;
 		if (irq == ref)
 			cnt++;
-		pos = (pos + 1) & xs->eqmsk;
+		pos = (pos + 1) & xs->emu_eq.msk;
 		if (!pos)
 			gen ^= 1;
 	}
@@ -3127,17 +3168,18 @@ static inline uint32_t xive_count_irq_copies(struct xive_cpu_state *xs __unused,
 
 static uint32_t xive_read_eq(struct xive_cpu_state *xs, bool just_peek)
 {
-	uint32_t cur, copies;
+	uint32_t cur, isn, copies;
 
 	xive_cpu_vdbg(this_cpu(), "  EQ %s... IDX=%x MSK=%x G=%d\n",
 		      just_peek ? "peek" : "read",
-		      xs->eqptr, xs->eqmsk, xs->eqgen);
-	cur = xs->eqbuf[xs->eqptr];
+		      xs->emu_eq.ptr, xs->emu_eq.msk, xs->emu_eq.gen);
+	isn = xive_emu_eq_peek(&xs->emu_eq);
+	cur = xs->emu_eq.buf[xs->emu_eq.ptr];
 	xive_cpu_vdbg(this_cpu(), "    cur: %08x [%08x %08x %08x ...]\n", cur,
-		      xs->eqbuf[(xs->eqptr + 1) & xs->eqmsk],
-		      xs->eqbuf[(xs->eqptr + 2) & xs->eqmsk],
-		      xs->eqbuf[(xs->eqptr + 3) & xs->eqmsk]);
-	if ((cur >> 31) == xs->eqgen)
+		      xs->emu_eq.buf[(xs->emu_eq.ptr + 1) & xs->emu_eq.msk],
+		      xs->emu_eq.buf[(xs->emu_eq.ptr + 2) & xs->emu_eq.msk],
+		      xs->emu_eq.buf[(xs->emu_eq.ptr + 3) & xs->emu_eq.msk]);
+	if (!isn)
 		return 0;
 
 	/* Debug: check for duplicate interrupts in the queue */
@@ -3148,31 +3190,29 @@ static uint32_t xive_read_eq(struct xive_cpu_state *xs, bool just_peek)
 		prerror("Wow ! Dups of irq %x, found %d copies !\n",
 			cur & 0x7fffffff, copies);
 		prerror("[%08x > %08x %08x %08x %08x ...] eqgen=%x eqptr=%x jp=%d\n",
-			xs->eqbuf[(xs->eqptr - 1) & xs->eqmsk],
-			xs->eqbuf[(xs->eqptr + 0) & xs->eqmsk],
-			xs->eqbuf[(xs->eqptr + 1) & xs->eqmsk],
-			xs->eqbuf[(xs->eqptr + 2) & xs->eqmsk],
-			xs->eqbuf[(xs->eqptr + 3) & xs->eqmsk],
-			xs->eqgen, xs->eqptr, just_peek);
+			xs->emu_eq.buf[(xs->emu_eq.ptr - 1) & xs->emu_eq.msk],
+			xs->emu_eq.buf[(xs->emu_eq.ptr + 0) & xs->emu_eq.msk],
+			xs->emu_eq.buf[(xs->emu_eq.ptr + 1) & xs->emu_eq.msk],
+			xs->emu_eq.buf[(xs->emu_eq.ptr + 2) & xs->emu_eq.msk],
+			xs->emu_eq.buf[(xs->emu_eq.ptr + 3) & xs->emu_eq.msk],
+			xs->emu_eq.gen, xs->emu_eq.ptr, just_peek);
 		__xive_cache_scrub(xs->xive, xive_cache_eqc, xs->eq_blk,
 				   xs->eq_idx + XIVE_EMULATION_PRIO,
 				   false, false);
 		eq = xive_get_eq(xs->xive, xs->eq_idx + XIVE_EMULATION_PRIO);
 		prerror("EQ @%p W0=%08x W1=%08x qbuf @%p\n",
-			eq, eq->w0, eq->w1, xs->eqbuf);
+			eq, eq->w0, eq->w1, xs->emu_eq.buf);
 	}
 	log_add(xs, LOG_TYPE_POPQ, 7, cur,
-		xs->eqbuf[(xs->eqptr + 1) & xs->eqmsk],
-		xs->eqbuf[(xs->eqptr + 2) & xs->eqmsk],
+		xs->emu_eq.buf[(xs->emu_eq.ptr + 1) & xs->emu_eq.msk],
+		xs->emu_eq.buf[(xs->emu_eq.ptr + 2) & xs->emu_eq.msk],
 		copies,
-		xs->eqptr, xs->eqgen, just_peek);
+		xs->emu_eq.ptr, xs->emu_eq.gen, just_peek);
 	if (!just_peek) {
-		xs->eqptr = (xs->eqptr + 1) & xs->eqmsk;
-		if (xs->eqptr == 0)
-			xs->eqgen ^= 1;
+		xive_emu_eq_advance(&xs->emu_eq);
 		xs->total_irqs++;
 	}
-	return cur & 0x00ffffff;
+	return isn;
 }
 
 static uint8_t xive_sanitize_cppr(uint8_t cppr)
@@ -3193,7 +3233,11 @@ static inline uint8_t opal_xive_check_pending(struct xive_cpu_state *xs,
 
 static void opal_xive_update_cppr(struct xive_cpu_state *xs, u8 cppr)
 {
-	/* Peform the update */
+	/* Peform the update. The sync in out_8() orders the CPPR store
+	 * before the MFRR load below, which pairs with the one in
+	 * opal_xive_set_mfrr(): at least one of us sees the other's
+	 * update and triggers the IPI.
+	 */
 	xs->cppr = cppr;
 	out_8(xs->tm_ring1 + TM_QW3_HV_PHYS + TM_CPPR, cppr);
 
@@ -3238,9 +3282,7 @@ static int64_t opal_xive_eoi(uint32_t xirr)
 	/* Limit supported CPPR values from OS */
 	cppr = xive_sanitize_cppr(xirr >> 24);
 
-	lock(&xs->lock);
-
-	log_add(xs, LOG_TYPE_EOI, 3, isn, xs->eqptr, xs->eqgen);
+	log_add(xs, LOG_TYPE_EOI, 3, isn, xs->emu_eq.ptr, xs->emu_eq.gen);
 
 	/* If this was our magic IPI, convert to IRQ number */
 	if (isn == 2) {
@@ -3307,11 +3349,8 @@ static int64_t opal_xive_eoi(uint32_t xirr)
 
 	xive_cpu_vdbg(c, "  pending=0x%x cppr=%d\n", xs->pending, cppr);
 
-	unlock(&xs->lock);
-
 	/* Return whether something is pending that is suitable for
-	 * delivery considering the new CPPR value. This can be done
-	 * without lock as these fields are per-cpu.
+	 * delivery considering the new CPPR value.
 	 */
 	return opal_xive_check_pending(xs, cppr) ? 1 : 0;
 }
@@ -3332,8 +3371,6 @@ static int64_t opal_xive_get_xirr(uint32_t *out_xirr, bool just_poll)
 
 	*out_xirr = 0;
 
-	lock(&xs->lock);
-
 	/*
 	 * Due to the need to fetch multiple interrupts from the EQ, we
 	 * need to play some tricks.
@@ -3389,7 +3426,7 @@ static int64_t opal_xive_get_xirr(uint32_t *out_xirr, bool just_poll)
 	active = opal_xive_check_pending(xs, old_cppr);
 
 	log_add(xs, LOG_TYPE_XIRR, 6, old_cppr, xs->cppr, xs->pending, active,
-		xs->eqptr, xs->eqgen);
+		xs->emu_eq.ptr, xs->emu_eq.gen);
 
 #ifdef XIVE_PERCPU_LOG
 	{
@@ -3453,12 +3490,10 @@ static int64_t opal_xive_get_xirr(uint32_t *out_xirr, bool just_poll)
  skip:
 
 	log_add(xs, LOG_TYPE_XIRR2, 5, xs->cppr, xs->pending,
-		*out_xirr, xs->eqptr, xs->eqgen);
+		*out_xirr, xs->emu_eq.ptr, xs->emu_eq.gen);
 	xive_cpu_vdbg(c, "  returning XIRR=%08x, pending=0x%x\n",
 		      *out_xirr, xs->pending);
 
-	unlock(&xs->lock);
-
 	return OPAL_SUCCESS;
 }
 
@@ -3477,9 +3512,7 @@ static int64_t opal_xive_set_cppr(uint8_t cppr)
 		return OPAL_INTERNAL_ERROR;
 	xive_cpu_vdbg(c, "CPPR setting to %d\n", cppr);
 
-	lock(&xs->lock);
 	opal_xive_update_cppr(xs, cppr);
-	unlock(&xs->lock);
 
 	return OPAL_SUCCESS;
 }
@@ -3502,6 +3535,11 @@ static int64_t opal_xive_set_mfrr(uint32_t cpu, uint8_t mfrr)
 	old_mfrr = xs->mfrr;
 	xive_cpu_vdbg(c, "  Setting MFRR to %x, old is %x\n", mfrr, old_mfrr);
 	xs->mfrr = mfrr;
+
+	/* Order against the owner's CPPR updates, see
+	 * opal_xive_update_cppr()
+	 */
+	sync();
 	if (old_mfrr > mfrr && mfrr < xs->cppr)
 		xive_ipi_trigger(xs->xive, GIRQ_TO_IDX(xs->ipi_irq));
 	unlock(&xs->lock);
@@ -4464,14 +4502,14 @@ static int64_t opal_xive_dump_emu(uint32_t pir)
 	      xs->cppr, xs->mfrr, xs->pending, xs->prev_cppr, xs->total_irqs);
 
 	prlog(PR_INFO, "CPU[%04x]: EQ IDX=%x MSK=%x G=%d [%08x %08x %08x > %08x %08x %08x %08x ...]\n",
-	      pir,  xs->eqptr, xs->eqmsk, xs->eqgen,
-	      xs->eqbuf[(xs->eqptr - 3) & xs->eqmsk],
-	      xs->eqbuf[(xs->eqptr - 2) & xs->eqmsk],
-	      xs->eqbuf[(xs->eqptr - 1) & xs->eqmsk],
-	      xs->eqbuf[(xs->eqptr + 0) & xs->eqmsk],
-	      xs->eqbuf[(xs->eqptr + 1) & xs->eqmsk],
-	      xs->eqbuf[(xs->eqptr + 2) & xs->eqmsk],
-	      xs->eqbuf[(xs->eqptr + 3) & xs->eqmsk]);
+	      pir,  xs->emu_eq.ptr, xs->emu_eq.msk, xs->emu_eq.gen,
+	      xs->emu_eq.buf[(xs->emu_eq.ptr - 3) & xs->emu_eq.msk],
+	      xs->emu_eq.buf[(xs->emu_eq.ptr - 2) & xs->emu_eq.msk],
+	      xs->emu_eq.buf[(xs->emu_eq.ptr - 1) & xs->emu_eq.msk],
+	      xs->emu_eq.buf[(xs->emu_eq.ptr + 0) & xs->emu_eq.msk],
+	      xs->emu_eq.buf[(xs->emu_eq.ptr + 1) & xs->emu_eq.msk],
+	      xs->emu_eq.buf[(xs->emu_eq.ptr + 2) & xs->emu_eq.msk],
+	      xs->emu_eq.buf[(xs->emu_eq.ptr + 3) & xs->emu_eq.msk]);
 
 	mm = xs->xive->esb_mmio + GIRQ_TO_IDX(xs->ipi_irq) * 0x20000;
 	pq = in_8(mm + 0x10800);
@@ -4484,7 +4522,7 @@ static int64_t opal_xive_dump_emu(uint32_t pir)
 			   false, false);
 	eq = xive_get_eq(xs->xive, xs->eq_idx + XIVE_EMULATION_PRIO);
 	prlog(PR_INFO, "CPU[%04x]: EQ @%p W0=%08x W1=%08x qbuf @%p\n",
-	      pir, eq, eq->w0, eq->w1, xs->eqbuf);
+	      pir, eq, eq->w0, eq->w1, xs->emu_eq.buf);
 
 	log_print(xs);
 
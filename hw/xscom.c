@@ -60,7 +60,48 @@ static struct {
  * send XSCOMs simultaneously (HMER responses get mixed up), so just
  * use a global lock instead
  */
-static struct lock xscom_lock = LOCK_UNLOCKED;
+static struct lock xscom_lock = LOCK_UNLOCKED_NAMED("xscom_lock");
+
+/*
+ * Accesses to each processor chip, counted under xscom_lock. Those made
+ * by a caller that holds it already through _xscom_lock() aren't.
+ *
+ * With a single lock, the time waiting for it is what tells whether
+ * the users of XSCOM (DTS, HMI, OCC, PRD...) get serialised behind one
+ * another. @wait is in timebase ticks from before lock() to once it's
+ * held, @access from then to the end of the access.
+ */
+static struct xscom_stats {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t errors;
+	uint64_t wait_tb;
+	uint64_t max_wait_tb;
+	uint64_t total_tb;
+	uint64_t max_tb;
+} xscom_stats[MAX_CHIPS];
+
+static void xscom_account(uint32_t gcid, bool write, int rc,
+			  uint64_t wait, uint64_t access)
+{
+	struct xscom_stats *s;
+
+	if (gcid >= MAX_CHIPS)
+		return;
+	s = &xscom_stats[gcid];
+	if (write)
+		s->writes++;
+	else
+		s->reads++;
+	if (rc)
+		s->errors++;
+	s->wait_tb += wait;
+	if (wait > s->max_wait_tb)
+		s->max_wait_tb = wait;
+	s->total_tb += access;
+	if (access > s->max_tb)
+		s->max_tb = access;
+}
 
 static inline void *xscom_addr(uint32_t gcid, uint32_t pcb_addr)
 {
@@ -473,11 +514,21 @@ void _xscom_unlock(void)
 	unlock(&xscom_lock);
 }
 
+static int xscom_locked_read(uint32_t gcid, uint64_t pcb_addr, uint64_t *val)
+{
+	/* Direct vs indirect access */
+	if (pcb_addr & XSCOM_ADDR_IND_FLAG)
+		return xscom_indirect_read(gcid, pcb_addr, val);
+	else
+		return __xscom_read(gcid, pcb_addr & 0x7fffffff, val);
+}
+
 /*
  * External API
  */
 int _xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val, bool take_lock)
 {
+	uint64_t start = 0, locked = 0;
 	uint32_t gcid;
 	int rc;
 
@@ -516,18 +567,20 @@ int _xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val, bool take_loc
 	}
 
 	/* HW822317 requires us to do global locking */
-	if (take_lock)
+	if (take_lock) {
+		start = mftb();
 		lock(&xscom_lock);
+		locked = mftb();
+	}
 
-	/* Direct vs indirect access */
-	if (pcb_addr & XSCOM_ADDR_IND_FLAG)
-		rc = xscom_indirect_read(gcid, pcb_addr, val);
-	else
-		rc = __xscom_read(gcid, pcb_addr & 0x7fffffff, val);
+	rc = xscom_locked_read(gcid, pcb_addr, val);
 
 	/* Unlock it */
-	if (take_lock)
+	if (take_lock) {
+		xscom_account(gcid, false, rc, locked - start,
+			      mftb() - locked);
 		unlock(&xscom_lock);
+	}
 	return rc;
 }
 
@@ -535,6 +588,7 @@ opal_call(OPAL_XSCOM_READ, xscom_read, 3);
 
 int _xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val, bool take_lock)
 {
+	uint64_t start = 0, locked = 0;
 	uint32_t gcid;
 	int rc;
 
@@ -561,8 +615,11 @@ int _xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val, bool take_loc
 	}
 
 	/* HW822317 requires us to do global locking */
-	if (take_lock)
+	if (take_lock) {
+		start = mftb();
 		lock(&xscom_lock);
+		locked = mftb();
+	}
 
 	/* Direct vs indirect access */
 	if (pcb_addr & XSCOM_ADDR_IND_FLAG)
@@ -571,12 +628,123 @@ int _xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val, bool take_loc
 		rc = __xscom_write(gcid, pcb_addr & 0x7fffffff, val);
 
 	/* Unlock it */
-	if (take_lock)
+	if (take_lock) {
+		xscom_account(gcid, true, rc, locked - start,
+			      mftb() - locked);
 		unlock(&xscom_lock);
+	}
 	return rc;
 }
 opal_call(OPAL_XSCOM_WRITE, xscom_write, 3);
 
+/*
+ * Read @count registers of the same target in one go. Processor chip
+ * accesses are done under a single hold of the lock. We stop at the
+ * first error, and the entries from there on read 0xdeadbeefdeadbeef.
+ */
+int xscom_read_multi(uint32_t partid, const uint64_t *addrs, uint64_t *vals,
+		     unsigned int count)
+{
+	uint64_t start, now, wait;
+	unsigned int i;
+	int rc = OPAL_SUCCESS;
+
+	for (i = 0; i < count; i++)
+		vals[i] = 0xdeadbeefdeadbeefull;
+
+	/* Centaurs and chiplets go one by one */
+	if (partid >> 28) {
+		for (i = 0; i < count && rc == OPAL_SUCCESS; i++)
+			rc = xscom_read(partid, addrs[i], &vals[i]);
+		return rc;
+	}
+
+	if (!xscom_gcid_ok(partid)) {
+		prerror("%s: invalid XSCOM gcid 0x%x\n", __func__, partid);
+		return OPAL_PARAMETER;
+	}
+
+	/* The wait for the lock goes on the first register */
+	start = mftb();
+	lock(&xscom_lock);
+	now = mftb();
+	wait = now - start;
+	for (i = 0; i < count && rc == OPAL_SUCCESS; i++) {
+		start = now;
+		rc = xscom_locked_read(partid, addrs[i], &vals[i]);
+		now = mftb();
+		xscom_account(partid, false, rc, wait, now - start);
+		wait = 0;
+	}
+	unlock(&xscom_lock);
+
+	/* Don't hand out whatever a failed access left behind */
+	if (rc)
+		vals[i - 1] = 0xdeadbeefdeadbeefull;
+
+	return rc;
+}
+
+/* Bounds how long the OS can keep the XSCOM lock */
+#define XSCOM_READ_MULTI_CHUNK	32
+
+static int64_t opal_xscom_read_multi(uint32_t partid, __be64 *addrs,
+				     __be64 *vals, uint64_t count)
+{
+	uint64_t a[XSCOM_READ_MULTI_CHUNK], v[XSCOM_READ_MULTI_CHUNK];
+	uint64_t done, n, i;
+	int64_t rc = OPAL_SUCCESS;
+
+	if (!count || !opal_addr_valid(addrs) || !opal_addr_valid(vals))
+		return OPAL_PARAMETER;
+
+	for (done = 0; done < count; done += n) {
+		n = MIN(count - done, XSCOM_READ_MULTI_CHUNK);
+		if (rc == OPAL_SUCCESS) {
+			for (i = 0; i < n; i++)
+				a[i] = be64_to_cpu(addrs[done + i]);
+			rc = xscom_read_multi(partid, a, v, n);
+		} else {
+			for (i = 0; i < n; i++)
+				v[i] = 0xdeadbeefdeadbeefull;
+		}
+		for (i = 0; i < n; i++)
+			vals[done + i] = cpu_to_be64(v[i]);
+	}
+
+	return rc;
+}
+opal_call(OPAL_XSCOM_READ_MULTI, opal_xscom_read_multi, 4);
+
+static int64_t opal_xscom_stats(uint32_t partid, struct opal_xscom_stats *stats,
+				uint64_t flags)
+{
+	struct xscom_stats *s;
+
+	if (!xscom_gcid_ok(partid) || (flags & ~OPAL_XSCOM_STATS_RESET))
+		return OPAL_PARAMETER;
+	if (stats && !opal_addr_valid(stats))
+		return OPAL_PARAMETER;
+
+	lock(&xscom_lock);
+	s = &xscom_stats[partid];
+	if (stats) {
+		stats->reads = cpu_to_be64(s->reads);
+		stats->writes = cpu_to_be64(s->writes);
+		stats->errors = cpu_to_be64(s->errors);
+		stats->wait_tb = cpu_to_be64(s->wait_tb);
+		stats->max_wait_tb = cpu_to_be64(s->max_wait_tb);
+		stats->total_tb = cpu_to_be64(s->total_tb);
+		stats->max_tb = cpu_to_be64(s->max_tb);
+	}
+	if (flags & OPAL_XSCOM_STATS_RESET)
+		memset(s, 0, sizeof(*s));
+	unlock(&xscom_lock);
+
+	return OPAL_SUCCESS;
+}
+opal_call(OPAL_XSCOM_STATS, opal_xscom_stats, 3);
+
 int xscom_readme(uint64_t pcb_addr, uint64_t *val)
 {
 	return xscom_read(this_cpu()->chip_id, pcb_addr, val);
@@ -23,6 +23,9 @@
 
 #define BUDDY_MAX_ORDER	30
 
+/* Levels of free index needed to cover the map at BUDDY_MAX_ORDER */
+#define BUDDY_INDEX_LEVELS	5
+
 struct buddy {
 	/* max_order is both the height of the tree - 1 and the ^2 of the
 	 * size of the lowest level.
@@ -40,6 +43,16 @@ struct buddy {
 	 * have there to speed up searches.
 	 */
 	unsigned int freecounts[BUDDY_MAX_ORDER + 1];
+
+	/* Free index. Level 0 has a bit for each element of the map
+	 * that has a free node in it, and each level above has a bit
+	 * for each element of the one below that has a bit set, up to
+	 * a level that fits in a single element. Finding a free node of
+	 * a given order is then a lookup per level rather than a scan
+	 * of the whole order.
+	 */
+	unsigned int	index_levels;
+	bitmap_elem_t	*index[BUDDY_INDEX_LEVELS];
 	bitmap_elem_t     map[];
 };
 
@@ -42,6 +42,7 @@ enum cpu_thread_state {
 
 struct cpu_job;
 struct xive_cpu_state;
+struct opal_call_stat;
 
 struct cpu_thread {
 	uint32_t			pir;
@@ -67,6 +68,9 @@ struct cpu_thread {
 	uint32_t			hbrt_spec_wakeup; /* primary only */
 	uint64_t			save_l2_fir_action1;
 	uint64_t			current_token;
+	/* OPAL call latency statistics, NULL unless enabled */
+	struct opal_call_stat		*opal_call_stats;
+	uint64_t			opal_call_entry_tb;
 #ifdef STACK_CHECK_ENABLED
 	int64_t				stack_bot_mark;
 	uint64_t			stack_bot_pc;
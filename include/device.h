@@ -23,13 +23,41 @@
 /* Any property or node with this prefix will not be passed to the kernel. */
 #define DT_PRIVATE	"skiboot,"
 
+/*
+ * Property names are interned: there is a single copy of each distinct
+ * name and every dt_property points into it, so two properties have the
+ * same name iff their name pointers are equal.
+ */
+struct dt_name {
+	struct dt_name *next;
+	u32 hash;
+	u32 len;
+	bool private;
+	/* Strings block bookkeeping for core/fdt.c */
+	u32 flat_gen;
+	int flat_off;
+	char name[];
+};
+
+static inline struct dt_name *dt_name_of(const char *name)
+{
+	return (struct dt_name *)(name - offsetof(struct dt_name, name));
+}
+
+/* Return the interned copy of a name, adding it if needed */
+const char *dt_intern_name(const char *name);
+
+/* Return the interned copy of a name, or NULL if no property has it */
+const char *dt_lookup_name(const char *name);
+
 /*
  * An in-memory representation of a node in the device tree.
  *
  * This is trivially flattened into an fdt.
  *
- * Note that the add_* routines will make a copy of the name if it's not
- * a read-only string (ie. usually a string literal).
+ * Note that the add_* routines will make a copy of the node name if it's
+ * not a read-only string (ie. usually a string literal). Property names
+ * are always interned, see struct dt_name.
  */
 struct dt_property {
 	struct list_node list;
@@ -45,6 +73,15 @@ struct dt_node {
 	struct list_head children;
 	struct dt_node *parent;
 	u32 phandle;
+
+	/*
+	 * Cached size of this subtree once flattened (struct block and
+	 * an upper bound on its strings), valid while dt_flat_valid().
+	 * Maintained by core/fdt.c, invalidated by the add/del routines.
+	 */
+	u32 flat_seq;
+	u32 flat_size;
+	u32 flat_strings;
 };
 
 /* This is shared with device_tree.c .. make it static when
@@ -55,6 +92,21 @@ extern u32 last_phandle;
 extern struct dt_node *dt_root;
 extern struct dt_node *dt_chosen;
 
+/* Flattened size cache generation counters, see struct dt_node */
+extern u32 dt_flat_seq;
+extern u32 dt_flat_flush_seq;
+
+static inline bool dt_flat_valid(const struct dt_node *node)
+{
+	return node->flat_seq > dt_flat_flush_seq;
+}
+
+/* Drop the cached flattened size of a node and all its parents */
+void dt_flat_invalidate(struct dt_node *node);
+
+/* Drop every cached flattened size, for changes we can't attribute */
+void dt_flat_flush(void);
+
 /* Create a root node: ie. a parentless one. */
 struct dt_node *dt_new_root(const char *name);
 
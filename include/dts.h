@@ -19,6 +19,11 @@
 
 #include <stdint.h>
 
+/* Default age limit of the DTS snapshots, "dts-refresh-ms" in NVRAM */
+#define DTS_REFRESH_MS	1000
+
+extern unsigned long dts_refresh_ms;
+
 extern int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data);
 extern bool dts_sensor_create_nodes(struct dt_node *sensors);
 
@@ -824,6 +824,8 @@ extern void fsp_memory_err_init(void);
 extern void fsp_init_sensor(void);
 extern int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 			uint32_t *sensor_data);
+extern int64_t fsp_opal_read_sensor_group(struct opal_sensor_group_entry *entries,
+			unsigned int nr, int token);
 
 /* Diagnostic */
 extern void fsp_init_diag(void);
@@ -149,6 +149,17 @@
  */
 #define IPMI_MAX_PEL_SIZE		0x800
 
+/*
+ * Message classes, highest priority first. A backend may use them to
+ * order messages and to pick which ones to drop when it is overloaded.
+ */
+enum ipmi_prio {
+	IPMI_PRIO_CRITICAL,	/* watchdog, power control */
+	IPMI_PRIO_NORMAL,	/* sensors, FRU, everything else */
+	IPMI_PRIO_BULK,		/* eSEL, PNOR access */
+};
+#define IPMI_NR_PRIOS			3
+
 struct ipmi_backend;
 struct ipmi_msg {
 	/* Can be used by command implementations to track requests */
@@ -158,6 +169,7 @@ struct ipmi_msg {
 	uint8_t netfn;
 	uint8_t cmd;
 	uint8_t cc;
+	uint8_t prio;		/* enum ipmi_prio, normal by default */
 
 	/* Called when a response is received to the ipmi message */
 	void (*complete)(struct ipmi_msg *);
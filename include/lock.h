@@ -30,10 +30,20 @@ struct lock {
 	 * in which case taking it will suspend console flushing
 	 */
 	bool in_con_path;
+
+#ifdef LOCK_STATS
+	/* Name reported by the lock statistics, may be NULL */
+	const char *name;
+#endif
 };
 
 /* Initializer */
 #define LOCK_UNLOCKED	{ .lock_val = 0, .in_con_path = 0 }
+#ifdef LOCK_STATS
+#define LOCK_UNLOCKED_NAMED(n)	{ .lock_val = 0, .in_con_path = 0, .name = (n) }
+#else
+#define LOCK_UNLOCKED_NAMED(n)	LOCK_UNLOCKED
+#endif
 
 /* Note vs. libc and locking:
  *
@@ -63,6 +73,16 @@ static inline void init_lock(struct lock *l)
 	*l = (struct lock)LOCK_UNLOCKED;
 }
 
+static inline void init_lock_named(struct lock *l, const char *name)
+{
+	init_lock(l);
+#ifdef LOCK_STATS
+	l->name = name;
+#else
+	(void)name;
+#endif
+}
+
 extern bool __try_lock(struct lock *l);
 extern bool try_lock(struct lock *l);
 extern void lock(struct lock *l);
@@ -81,4 +101,12 @@ extern bool lock_recursive(struct lock *l);
 /* Called after per-cpu data structures are available */
 extern void init_locks(void);
 
+/*
+ * Lock statistics (LOCK_STATS builds only). lock_stats_init() exports
+ * the statistics blob in the device-tree, lock_stats_dump() refreshes
+ * it and prints the statistics to the console.
+ */
+extern void lock_stats_init(void);
+extern bool lock_stats_dump(void);
+
 #endif /* __LOCK_H */
@@ -24,5 +24,17 @@ bool nvram_validate(void);
 
 const char *nvram_query(const char *name);
 bool nvram_query_eq(const char *key, const char *value);
+bool nvram_query_bool(const char *key, bool def);
+long nvram_query_int(const char *key, long def);
+
+struct nvram_update {
+	const char	*key;
+	const char	*value;		/* NULL to remove the key */
+};
+
+int nvram_update(const struct nvram_update *updates, unsigned int count);
+
+/* Write part of the NVRAM image back to the platform */
+int nvram_write_back(const void *start, uint32_t len);
 
 #endif /* __NVRAM_H */
@@ -204,7 +204,17 @@
 #define OPAL_NPU_INIT_CONTEXT			146
 #define OPAL_NPU_DESTROY_CONTEXT		147
 #define OPAL_NPU_MAP_LPAR			148
-#define OPAL_LAST				148
+#define OPAL_CALL_STATS				149
+#define OPAL_PCI_TCE_KILL_RANGES		150
+#define OPAL_PCI_TCE_KILL_STATS			151
+#define OPAL_PCI_GET_FROZEN_PES			152
+#define OPAL_PCI_CONFIG_READ_BLOCK		153
+#define OPAL_PCI_CONFIG_WRITE_BLOCK		154
+#define OPAL_XSCOM_READ_MULTI			155
+#define OPAL_XSCOM_STATS			156
+#define OPAL_SENSOR_DTS_READ_CHIP		157
+#define OPAL_SENSOR_GROUP_READ			158
+#define OPAL_LAST				158
 
 /* Device tree flags */
 
@@ -1183,6 +1193,24 @@ enum {
 	OPAL_PCI_TCE_KILL_ALL,
 };
 
+/* Argument to OPAL_PCI_TCE_KILL_RANGES, an array of these */
+struct opal_tce_kill_range {
+	__be64 dma_addr;
+	__be64 npages;
+};
+
+/* Returned by OPAL_PCI_TCE_KILL_STATS */
+struct opal_tce_kill_stats {
+	__be64 kills;		/* Kills issued to the PHB, of any type */
+	__be64 pe_kills;	/* ... of which PE wide */
+	__be64 all_kills;	/* ... of which PHB wide */
+	__be64 pages;		/* TCEs the OS asked to invalidate */
+	__be64 requests;	/* OPAL calls */
+};
+
+/* Flags for OPAL_PCI_TCE_KILL_STATS */
+#define OPAL_PCI_TCE_KILL_STATS_RESET	0x1
+
 /* The xive operation mode indicates the active "API" and
  * corresponds to the "mode" parameter of the opal_xive_reset()
  * call
@@ -1236,6 +1264,83 @@ enum {
 	XIVE_DUMP_EMU_STATE	= 5,
 };
 
+/* OPAL_CALL_STATS operations */
+enum {
+	OPAL_CALL_STATS_DISABLE	= 0,
+	OPAL_CALL_STATS_ENABLE	= 1,
+	OPAL_CALL_STATS_RESET	= 2,
+	OPAL_CALL_STATS_READ	= 3,
+	OPAL_CALL_STATS_DUMP_LOCKS = 4,
+};
+
+/*
+ * OPAL call latency statistics, as returned by OPAL_CALL_STATS and
+ * exported in /ibm,opal/firmware/exports/opal_call_stats. All fields
+ * are big endian and times are in timebase ticks.
+ *
+ * Bucket 0 counts calls shorter than (1 << bucket_shift) ticks, bucket
+ * n counts calls in [1 << (bucket_shift + n - 1), 1 << (bucket_shift + n))
+ * and the last bucket is open ended.
+ */
+#define OPAL_CALL_STATS_MAGIC	0x4f435354	/* "OCST" */
+#define OPAL_CALL_STATS_VERSION	1
+#define OPAL_CALL_STATS_BUCKETS	16
+#define OPAL_CALL_STATS_SHIFT	8
+
+struct opal_call_stat {
+	__be64 count;
+	__be64 total_tb;
+	__be64 max_tb;
+	__be32 buckets[OPAL_CALL_STATS_BUCKETS];
+};
+
+/* One per CPU, with nr_tokens entries indexed by token */
+struct opal_call_stats_cpu {
+	__be32 pir;
+	__be32 reserved;
+	struct opal_call_stat tokens[];
+};
+
+/* Header, followed by nr_cpus struct opal_call_stats_cpu */
+struct opal_call_stats {
+	__be32 magic;
+	__be32 version;
+	__be32 nr_cpus;
+	__be32 nr_tokens;
+	__be32 nr_buckets;
+	__be32 bucket_shift;
+	__be64 tb_hz;
+};
+
+/* Returned by OPAL_XSCOM_STATS */
+struct opal_xscom_stats {
+	__be64 reads;
+	__be64 writes;
+	__be64 errors;		/* Accesses that failed */
+	__be64 wait_tb;		/* Waiting for the XSCOM lock */
+	__be64 max_wait_tb;
+	__be64 total_tb;	/* Doing the accesses, lock held */
+	__be64 max_tb;
+};
+
+/* Flags for OPAL_XSCOM_STATS */
+#define OPAL_XSCOM_STATS_RESET	0x1
+
+/* One sensor returned by OPAL_SENSOR_DTS_READ_CHIP */
+struct opal_dts_sensor {
+	__be32 handle;		/* "sensor-data" of the sensor node */
+	__be32 temp;		/* Degrees C */
+	__be32 trip;
+	__be32 rc;		/* What OPAL_SENSOR_READ would return */
+};
+
+/* One sensor returned by OPAL_SENSOR_GROUP_READ */
+struct opal_sensor_group_entry {
+	__be32 handle;
+	__be32 value;
+	__be32 rc;		/* What OPAL_SENSOR_READ would return */
+};
+
 #endif /* __ASSEMBLY__ */
 
 #endif /* __OPAL_API_H */
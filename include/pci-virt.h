@@ -31,6 +31,7 @@ struct pci_virt_device {
 	uint32_t		cfg_size;
 	uint8_t			*config[PCI_VIRT_CFG_MAX];
 	struct list_head	pcrf;
+	struct pci_cfg_filter_map pcrf_map;
 	struct list_node	node;
 	void			*data;
 };
@@ -42,6 +42,21 @@ struct pci_cfg_reg_filter {
 	struct list_node	link;
 };
 
+/*
+ * Config filter lookup table, see core/pci-cfg-filter.c. There is an
+ * entry per 32-bit word of config space: 0 if no filter overlaps the
+ * word, n if filters[n - 1] is the only one that does and
+ * PCI_CFG_FILTER_SEVERAL if there are more.
+ */
+#define PCI_CFG_FILTER_WORDS	(0x1000 / 4)
+#define PCI_CFG_FILTER_SEVERAL	0xff
+
+struct pci_cfg_filter_map {
+	uint8_t				*words;
+	struct pci_cfg_reg_filter	**filters;
+	uint32_t			nr;
+};
+
 /*
  * While this might not be necessary in the long run, the existing
  * Linux kernels expect us to provide a device-tree that contains
@@ -70,6 +85,7 @@ struct pci_device {
 	uint8_t			secondary_bus;
 	uint8_t			subordinate_bus;
 	uint32_t		scan_map;
+	bool			crs_visible;	/* Config reads may return CRS */
 
 	uint32_t		vdid;
 	uint32_t		sub_vdid;
@@ -83,9 +99,8 @@ struct pci_device {
 	} cap[64];
 	uint32_t		mps;		/* Max payload size capability */
 
-	uint32_t		pcrf_start;
-	uint32_t		pcrf_end;
 	struct list_head	pcrf;
+	struct pci_cfg_filter_map pcrf_map;
 
 	struct dt_node		*dn;
 	struct pci_slot		*slot;
@@ -196,6 +211,19 @@ struct phb_ops {
 	int64_t (*cfg_write32)(struct phb *phb, uint32_t bdfn,
 			       uint32_t offset, uint32_t data);
 
+	/*
+	 * Optional block accesses of @count words from @offset, which
+	 * pci_cfg_read_block() and pci_cfg_write_block() have checked.
+	 * Each word must behave like a 32-bit access to it would,
+	 * config filters included.
+	 */
+	int64_t (*cfg_read_block)(struct phb *phb, uint32_t bdfn,
+				  uint32_t offset, uint32_t *data,
+				  uint32_t count);
+	int64_t (*cfg_write_block)(struct phb *phb, uint32_t bdfn,
+				   uint32_t offset, const uint32_t *data,
+				   uint32_t count);
+
 	/*
 	 * Bus number selection. See pci_scan() for a description
 	 */
@@ -241,6 +269,12 @@ struct phb_ops {
 	int64_t (*next_error)(struct phb *phb, uint64_t *first_frozen_pe,
 			      uint16_t *pci_error_type, uint16_t *severity);
 
+	/*
+	 * Refresh phb->frozen_pes from the hardware and return the
+	 * number of PEs of the PHB in *num_pes
+	 */
+	int64_t (*eeh_frozen_pes)(struct phb *phb, uint32_t *num_pes);
+
 	/*
 	 * Other IODA methods
 	 *
@@ -336,6 +370,17 @@ enum phb_type {
 	phb_type_npu_v2,
 };
 
+/* Most PEs a PHB can have, PHB4 has up to 512 */
+#define PCI_MAX_PES		512
+
+struct pci_tce_kill_stats {
+	uint64_t		kills;
+	uint64_t		pe_kills;
+	uint64_t		all_kills;
+	uint64_t		pages;
+	uint64_t		requests;
+};
+
 struct phb {
 	struct dt_node		*dt_node;
 	int			opal_id;
@@ -349,9 +394,23 @@ struct phb {
 	uint32_t		mps;
 	bitmap_t		*filter_map;
 
+	/*
+	 * bdfn -> pci_device lookup used by pci_find_dev(), indexed by bus
+	 * then devfn. The per bus tables are allocated on first use.
+	 */
+	struct pci_device	**dev_map[256];
+
 	/* PCI-X only slot info, for PCI-E this is in the RC bridge */
 	struct pci_slot		*slot;
 
+	struct pci_tce_kill_stats tce_kill_stats;
+
+	/*
+	 * PEs the hardware is known to have frozen, see
+	 * pci_frozen_pes_update()
+	 */
+	bitmap_elem_t		frozen_pes[BITMAP_ELEMS(PCI_MAX_PES)];
+
 	/* Base location code used to generate the children one */
 	const char		*base_loc_code;
 
@@ -406,6 +465,13 @@ static inline int64_t pci_cfg_write32(struct phb *phb, uint32_t bdfn,
 	return phb->ops->cfg_write32(phb, bdfn, offset, data);
 }
 
+extern int64_t pci_cfg_read_block(struct phb *phb, uint32_t bdfn,
+				  uint32_t offset, uint32_t *data,
+				  uint32_t count);
+extern int64_t pci_cfg_write_block(struct phb *phb, uint32_t bdfn,
+				   uint32_t offset, const uint32_t *data,
+				   uint32_t count);
+
 /* Utilities */
 extern void pci_remove_bus(struct phb *phb, struct list_head *list);
 extern uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
@@ -427,7 +493,15 @@ extern struct pci_device *pci_walk_dev(struct phb *phb,
 						 struct pci_device *,
 						 void *),
 				       void *userdata);
-extern struct pci_device *pci_find_dev(struct phb *phb, uint16_t bdfn);
+extern void pci_dev_map_add(struct phb *phb, struct pci_device *pd);
+extern void pci_dev_map_del(struct phb *phb, struct pci_device *pd);
+
+static inline struct pci_device *pci_find_dev(struct phb *phb, uint16_t bdfn)
+{
+	struct pci_device **bus = phb->dev_map[bdfn >> 8];
+
+	return bus ? bus[bdfn & 0xff] : NULL;
+}
 extern void pci_restore_bridge_buses(struct phb *phb, struct pci_device *pd);
 extern struct pci_cfg_reg_filter *pci_find_cfg_reg_filter(struct pci_device *pd,
 					uint32_t start, uint32_t len);
@@ -456,6 +530,58 @@ static inline struct phb *__pci_next_phb_idx(uint64_t *phb_id) {
 	for (uint64_t __phb_idx = 0;				\
 	     (phb = __pci_next_phb_idx(&__phb_idx)) ; )
 
+/* RIDs selected by an OPAL_PCI_SET_PE request, see core/pci-rtt.c */
+struct pci_rid_set {
+	uint32_t	first;		/* First RID */
+	uint32_t	run;		/* Consecutive RIDs per run */
+	uint32_t	stride;		/* Distance between two runs */
+	uint32_t	count;		/* Number of runs */
+};
+
+#define for_each_rid_in_set(rs, i, rid)					\
+	for (i = 0; i < (rs)->count; i++)				\
+		for (rid = (rs)->first + i * (rs)->stride;		\
+		     rid < (rs)->first + i * (rs)->stride + (rs)->run;	\
+		     rid++)
+
+/* Past that many RIDs, invalidate the whole RTC rather than RID by RID */
+#define PCI_RTC_INVALIDATE_RIDS_MAX	16
+
+extern void pci_rid_set_init(struct pci_rid_set *rs, uint16_t bdfn,
+			     uint8_t bcompare, uint8_t dcompare,
+			     uint8_t fcompare);
+extern uint32_t pci_rtt_update(uint16_t *cache, uint16_t *rtt,
+			       const struct pci_rid_set *rs, uint16_t pe);
+
+/* Config filter lookup */
+extern bool pci_cfg_filter_map_add(struct pci_cfg_filter_map *map,
+				   struct pci_cfg_reg_filter *pcrf);
+extern void pci_cfg_filter_map_free(struct pci_cfg_filter_map *map);
+extern struct pci_cfg_reg_filter *pci_cfg_filter_find(
+					struct pci_cfg_filter_map *map,
+					struct list_head *filters,
+					uint32_t start, uint32_t len,
+					bool contain);
+
+/* TCE invalidation */
+#define PCI_TCE_KILL_PE_THRESHOLD	64
+#define PCI_TCE_KILL_MAX_RANGES		4096
+extern unsigned int pci_tce_kill_threshold;
+extern int64_t pci_tce_kill(struct phb *phb, uint32_t kill_type,
+			    uint64_t pe_number, uint32_t tce_size,
+			    uint64_t dma_addr, uint32_t npages);
+extern int64_t pci_tce_kill_ranges(struct phb *phb, uint64_t pe_number,
+				   uint32_t tce_size,
+				   const struct opal_tce_kill_range *ranges,
+				   uint32_t nr_ranges);
+
+/* Frozen PE tracking */
+extern void pci_frozen_pes_update(struct phb *phb, uint32_t word,
+				  uint64_t peev);
+extern void pci_frozen_pes_clear(struct phb *phb);
+extern bool pci_pe_frozen(struct phb *phb, uint64_t pe_number);
+extern int pci_first_frozen_pe(struct phb *phb);
+
 /* Device tree */
 extern void pci_std_swizzle_irq_map(struct dt_node *dt_node,
 				    struct pci_device *pd,
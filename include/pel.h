@@ -173,8 +173,27 @@ struct opal_user_section {
 		      + SRC_SECTION_SIZE + EXTENDED_HEADER_SECTION_SIZE \
 		      + MTMS_SECTION_SIZE)
 
+/*
+ * A PEL produced a chunk at a time. The fixed sections are rendered
+ * when the stream is set up, the user data sections are copied straight
+ * out of the errorlog as they are read.
+ */
+struct pel_stream {
+	struct errorlog *elog_data;
+	size_t size;			/* of the whole PEL */
+	size_t offset;			/* of the next byte to read */
+
+	/* User data section being read */
+	size_t usr_offset;		/* where it starts in the PEL */
+	const char *usr_data;		/* and in the errorlog */
+
+	char hdr[PEL_MIN_SIZE];		/* the fixed sections */
+};
+
 size_t pel_size(struct errorlog *elog_data);
 int create_pel_log(struct errorlog *elog_data, char *pel_buffer,
 		   size_t pel_buffer_size) __warn_unused_result;
+void pel_stream_init(struct pel_stream *s, struct errorlog *elog_data);
+size_t pel_stream_read(struct pel_stream *s, void *buf, size_t len);
 
 #endif
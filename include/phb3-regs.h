@@ -79,6 +79,9 @@
 #define   PHB_RTC_INVALIDATE_RID	PPC_BITMASK(16,31)
 #define PHB_TCE_KILL			0x210
 #define   PHB_TCE_KILL_ALL		PPC_BIT(0)
+#define   PHB_TCE_KILL_PE		PPC_BIT(1)
+#define   PHB_TCE_KILL_ONE		PPC_BIT(2)
+#define   PHB_TCE_KILL_PENUM		PPC_BITMASK(56,63)
 #define PHB_TCE_SPEC_CTL		0x218
 #define PHB_IODA_ADDR			0x220
 #define   PHB_IODA_AD_AUTOINC		PPC_BIT(0)
@@ -22,6 +22,7 @@ struct phb;
 struct pci_device;
 struct pci_slot;
 struct errorlog;
+struct opal_sensor_group_entry;
 
 enum resource_id {
 	RESOURCE_ID_KERNEL,
@@ -182,6 +183,14 @@ struct platform {
 	 */
 	int64_t		(*sensor_read)(uint32_t sensor_hndl, int token,
 				       uint32_t *sensor_data);
+
+	/*
+	 * Read the platform's sensors of a group, filling in their
+	 * entries in the OS buffer and leaving the others alone. Can
+	 * complete asynchronously like sensor_read.
+	 */
+	int64_t		(*sensor_read_group)(struct opal_sensor_group_entry *entries,
+					     unsigned int nr, int token);
 	/*
 	 * Return the heartbeat time
 	 */
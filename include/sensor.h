@@ -17,6 +17,8 @@
 #ifndef __SENSOR_H
 #define __SENSOR_H
 
+#include <stdint.h>
+
 /*
  * A sensor handler is a four bytes value which identifies a sensor by
  * its resource class (temperature, fans ...), a resource identifier
@@ -63,4 +65,12 @@ extern struct dt_node *sensor_node;
 
 extern void sensor_init(void);
 
+/*
+ * Sensor groups: sets of handles the OS can read in one go with
+ * OPAL_SENSOR_GROUP_READ. They appear as /ibm,opal/sensor-groups/
+ * <name>@<group id>. chip_id is -1 when the group isn't chip specific.
+ */
+extern int sensor_group_add(const char *name, int chip_id,
+			    const uint32_t *handles, unsigned int nr);
+
 #endif /* __SENSOR_H */
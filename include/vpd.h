@@ -36,6 +36,41 @@ const void *vpd_find(const void *vpd, size_t vpd_size,
 
 bool vpd_valid(const void *vvpd, size_t vpd_size);
 
+/* A record and the range of its keywords in vpd_index.kws */
+struct vpd_index_rec {
+	const char *name;
+	uint8_t namesz;
+	uint32_t offset;
+	uint32_t size;
+	unsigned int first_kw;
+	unsigned int nr_kws;
+};
+
+/* A keyword, with the offset of its data in the blob */
+struct vpd_index_kw {
+	char kw[2];
+	uint8_t size;
+	uint32_t offset;
+};
+
+struct vpd_index {
+	const void *vpd;
+	size_t vpd_size;
+	unsigned int nr_recs;
+	unsigned int nr_kws;
+	struct vpd_index_rec *recs;
+	struct vpd_index_kw *kws;
+};
+
+struct vpd_index *vpd_index_build(const void *vpd, size_t vpd_size);
+void vpd_index_free(struct vpd_index *idx);
+
+const void *vpd_index_find_record(const struct vpd_index *idx,
+				  const char *record, size_t *sz);
+
+const void *vpd_index_find(const struct vpd_index *idx, const char *record,
+			   const char *keyword, uint8_t *sz);
+
 /* Add model property to dt_root */
 void add_dtb_model(void);
 
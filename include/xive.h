@@ -427,6 +427,36 @@ struct xive_vp {
 	uint32_t	wf;
 };
 
+/*
+ * Event queue as read by the XICS emulation. The XIVE writes each
+ * entry with the top bit set to the inverse of the generation it is
+ * filling, so an entry whose top bit still equals @gen hasn't been
+ * written yet. @gen flips every time the pointer wraps.
+ */
+struct xive_emu_eq {
+	uint32_t	*buf;
+	uint32_t	ptr;
+	uint32_t	msk;
+	uint8_t		gen;
+};
+
+/* Interrupt number at the head of the queue, 0 if it's empty */
+static inline uint32_t xive_emu_eq_peek(const struct xive_emu_eq *eq)
+{
+	uint32_t cur = eq->buf[eq->ptr];
+
+	if ((cur >> 31) == eq->gen)
+		return 0;
+	return cur & 0x00ffffff;
+}
+
+static inline void xive_emu_eq_advance(struct xive_emu_eq *eq)
+{
+	eq->ptr = (eq->ptr + 1) & eq->msk;
+	if (eq->ptr == 0)
+		eq->gen ^= 1;
+}
+
 /* Internal APIs to other modules */
 
 /* IRQ allocators return this on failure */
@@ -464,6 +494,7 @@ void xive_register_hw_source(uint32_t base, uint32_t count, uint32_t shift,
 void xive_register_ipi_source(uint32_t base, uint32_t count, void *data,
 			      const struct irq_source_ops *ops);
 
+struct cpu_thread;
 void xive_cpu_callin(struct cpu_thread *cpu);
 
 /* Get the trigger page address for an interrupt allocated with
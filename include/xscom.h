@@ -231,6 +231,9 @@ static inline int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val)
 	return _xscom_write(partid, pcb_addr, val, true);
 }
 
+/* Read several registers of the same target under one lock hold */
+extern int xscom_read_multi(uint32_t partid, const uint64_t *addrs,
+			    uint64_t *vals, unsigned int count);
 
 /* This chip SCOM access */
 extern int xscom_readme(uint64_t pcb_addr, uint64_t *val);
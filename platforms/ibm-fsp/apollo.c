@@ -46,5 +46,6 @@ DECLARE_PLATFORM(apollo) = {
 	.start_preload_resource	= fsp_start_preload_resource,
 	.resource_loaded	= fsp_resource_loaded,
 	.sensor_read		= ibm_fsp_sensor_read,
+	.sensor_read_group	= ibm_fsp_sensor_read_group,
 	.terminate		= ibm_fsp_terminate,
 };
@@ -234,3 +234,9 @@ int64_t ibm_fsp_sensor_read(uint32_t sensor_hndl, int token,
 {
 	return fsp_opal_read_sensor(sensor_hndl, token, sensor_data);
 }
+
+int64_t ibm_fsp_sensor_read_group(struct opal_sensor_group_entry *entries,
+				  unsigned int nr, int token)
+{
+	return fsp_opal_read_sensor_group(entries, nr, token);
+}
@@ -29,6 +29,8 @@ extern int elog_fsp_commit(struct errorlog *buf);
 
 extern int64_t ibm_fsp_sensor_read(uint32_t sensor_hndl, int token,
 				uint32_t *sensor_data);
+extern int64_t ibm_fsp_sensor_read_group(struct opal_sensor_group_entry *entries,
+					 unsigned int nr, int token);
 
 /* Apollo PCI support */
 extern void apollo_pci_setup_phb(struct phb *phb,
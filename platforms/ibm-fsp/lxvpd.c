@@ -21,6 +21,7 @@
 #include <pci.h>
 #include <pci-cfg.h>
 #include <pci-slot.h>
+#include <lock.h>
 
 #include "lxvpd.h"
 
@@ -275,6 +276,34 @@ static void lxvpd_parse_1005_map(struct phb *phb,
 	}
 }
 
+/*
+ * Every PHB looks its PRxy record up in the same LX VPD, so index it
+ * once rather than rescanning it from the start for each of them.
+ */
+static struct vpd_index *lxvpd_index;
+static struct lock lxvpd_index_lock = LOCK_UNLOCKED;
+
+static const void *lxvpd_find_record(const void *lxvpd, size_t lxvpd_size,
+				     const char *record, size_t *sz)
+{
+	const void *rec;
+
+	lock(&lxvpd_index_lock);
+	if (!lxvpd_index || lxvpd_index->vpd != lxvpd ||
+	    lxvpd_index->vpd_size != lxvpd_size) {
+		vpd_index_free(lxvpd_index);
+		lxvpd_index = vpd_index_build(lxvpd, lxvpd_size);
+	}
+
+	if (lxvpd_index)
+		rec = vpd_index_find_record(lxvpd_index, record, sz);
+	else
+		rec = vpd_find_record(lxvpd, lxvpd_size, record, sz);
+	unlock(&lxvpd_index_lock);
+
+	return rec;
+}
+
 void lxvpd_process_slot_entries(struct phb *phb,
 				struct dt_node *node,
 				uint8_t chip_id,
@@ -301,7 +330,7 @@ void lxvpd_process_slot_entries(struct phb *phb,
 		return;
 	}
 
-	pr_rec = vpd_find_record(lxvpd, lxvpd_size, record, &pr_size);
+	pr_rec = lxvpd_find_record(lxvpd, lxvpd_size, record, &pr_size);
 	if (!pr_rec) {
 		prlog(PR_WARNING, "Record %s not found on PHB%04x\n",
 			   record, phb->opal_id);
@@ -0,0 +1,45 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TEST_BENCH_H
+#define __TEST_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Timing loops for the host unit tests. They are skipped unless
+ * SKIBOOT_BENCH is set in the environment, so a plain "make check"
+ * stays quiet and its output doesn't depend on the machine:
+ *
+ *	SKIBOOT_BENCH=1 make core/test/run-vpd-check
+ */
+static inline bool bench_enabled(void)
+{
+	return getenv("SKIBOOT_BENCH") != NULL;
+}
+
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif /* __TEST_BENCH_H */